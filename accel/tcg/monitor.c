@@ -12,13 +12,17 @@
 #include "qapi/error.h"
 #include "qapi/type-helpers.h"
 #include "qapi/qapi-commands-machine.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/util.h"
 #include "monitor/monitor.h"
+#include "monitor/hmp.h"
 #include "sysemu/cpus.h"
 #include "sysemu/cpu-timers.h"
 #include "sysemu/tcg.h"
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-stats.h"
 
 
 static void dump_drift_info(GString *buf)
@@ -235,10 +239,159 @@ HumanReadableText *qmp_x_query_opcount(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+void qmp_x_tb_stats(TBStatsAction action, Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_setg(errp, "TB statistics are only available with accel=tcg");
+        return;
+    }
+
+    switch (action) {
+    case TB_STATS_ACTION_START:
+        tb_stats_enable(true);
+        break;
+    case TB_STATS_ACTION_STOP:
+        tb_stats_enable(false);
+        break;
+    case TB_STATS_ACTION_RESET:
+        tb_stats_reset();
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static double tb_stats_expansion(const TBStatistics *s)
+{
+    uint32_t guest_size = qatomic_read(&s->guest_size);
+
+    return guest_size ? (double)qatomic_read(&s->host_size) / guest_size : 0;
+}
+
+/* Sort in descending order, for use with g_ptr_array_sort() */
+#define TB_STATS_CMP(name, key)                                         \
+static gint tb_stats_cmp_##name(gconstpointer ap, gconstpointer bp)     \
+{                                                                       \
+    const TBStatistics *a = *(TBStatistics * const *)ap;                \
+    const TBStatistics *b = *(TBStatistics * const *)bp;                \
+    return key(a) < key(b) ? 1 : key(a) > key(b) ? -1 : 0;              \
+}
+
+#define TB_STATS_EXECUTIONS(s)      ((s)->executions)
+#define TB_STATS_TRANSLATIONS(s)    qatomic_read(&(s)->translations)
+#define TB_STATS_INVALIDATIONS(s)   qatomic_read(&(s)->invalidations)
+
+TB_STATS_CMP(executions, TB_STATS_EXECUTIONS)
+TB_STATS_CMP(translations, TB_STATS_TRANSLATIONS)
+TB_STATS_CMP(invalidations, TB_STATS_INVALIDATIONS)
+TB_STATS_CMP(expansion, tb_stats_expansion)
+
+TBStatsInfoList *qmp_x_query_tb_stats(bool has_top, uint32_t top,
+                                      bool has_sort_by, TBStatsSortBy sort_by,
+                                      Error **errp)
+{
+    static const GCompareFunc cmp[TB_STATS_SORT_BY__MAX] = {
+        [TB_STATS_SORT_BY_EXECUTIONS] = tb_stats_cmp_executions,
+        [TB_STATS_SORT_BY_TRANSLATIONS] = tb_stats_cmp_translations,
+        [TB_STATS_SORT_BY_INVALIDATIONS] = tb_stats_cmp_invalidations,
+        [TB_STATS_SORT_BY_EXPANSION] = tb_stats_cmp_expansion,
+    };
+    g_autoptr(GPtrArray) arr = NULL;
+    TBStatsInfoList *head = NULL, **tail = &head;
+    guint i;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TB statistics are only available with accel=tcg");
+        return NULL;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    arr = tb_stats_collect(cmp[has_sort_by ? sort_by
+                                           : TB_STATS_SORT_BY_EXECUTIONS],
+                           has_top ? top : 10);
+    for (i = 0; i < arr->len; i++) {
+        const TBStatistics *s = g_ptr_array_index(arr, i);
+        TBStatsInfo *info = g_new0(TBStatsInfo, 1);
+
+        info->pc = s->pc;
+        info->phys_pc = s->phys_pc;
+        info->flags = s->flags;
+        info->executions = s->executions;
+        info->translations = qatomic_read(&s->translations);
+        info->invalidations = qatomic_read(&s->invalidations);
+        info->guest_size = qatomic_read(&s->guest_size);
+        info->host_size = qatomic_read(&s->host_size);
+        info->instructions = qatomic_read(&s->insns);
+        info->expansion = tb_stats_expansion(s);
+        QAPI_LIST_APPEND(tail, info);
+    }
+
+    return head;
+}
+
+static void hmp_tb_stats(Monitor *mon, const QDict *qdict)
+{
+    const char *action_str = qdict_get_str(qdict, "action");
+    Error *err = NULL;
+    int action;
+
+    action = qapi_enum_parse(&TBStatsAction_lookup, action_str, -1, &err);
+    if (action >= 0) {
+        qmp_x_tb_stats(action, &err);
+    }
+    hmp_handle_error(mon, err);
+}
+
+static void hmp_info_tb_stats(Monitor *mon, const QDict *qdict)
+{
+    int64_t top = qdict_get_try_int(qdict, "top", 10);
+    const char *sort_str = qdict_get_try_str(qdict, "sort");
+    TBStatsInfoList *list, *e;
+    Error *err = NULL;
+    int sort_by;
+
+    if (top < 0 || top > UINT32_MAX) {
+        monitor_printf(mon, "Invalid number of blocks: %" PRId64 "\n", top);
+        return;
+    }
+    sort_by = qapi_enum_parse(&TBStatsSortBy_lookup, sort_str,
+                              TB_STATS_SORT_BY_EXECUTIONS, &err);
+    if (err) {
+        hmp_handle_error(mon, err);
+        return;
+    }
+
+    list = qmp_x_query_tb_stats(true, top, true, sort_by, &err);
+    if (hmp_handle_error(mon, err)) {
+        return;
+    }
+    if (!qatomic_read(&tb_stats_enabled)) {
+        monitor_printf(mon, "TB statistics are not being collected, "
+                       "use \"tb-stats start\"\n");
+    }
+
+    monitor_printf(mon, "%-18s %-18s %12s %6s %6s %5s %6s %6s %6s\n",
+                   "pc", "phys_pc", "executions", "trans", "inval",
+                   "insns", "guest", "host", "ratio");
+    for (e = list; e; e = e->next) {
+        TBStatsInfo *s = e->value;
+
+        monitor_printf(mon, "0x%016" PRIx64 " 0x%016" PRIx64 " %12" PRIu64
+                       " %6" PRIu32 " %6" PRIu32 " %5" PRIu32 " %6" PRIu32
+                       " %6" PRIu32 " %6.1f\n",
+                       s->pc, s->phys_pc, s->executions, s->translations,
+                       s->invalidations, s->instructions, s->guest_size,
+                       s->host_size, s->expansion);
+    }
+    qapi_free_TBStatsInfoList(list);
+}
+
 static void hmp_tcg_register(void)
 {
     monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
     monitor_register_hmp_info_hrt("opcount", qmp_x_query_opcount);
+    monitor_register_hmp("tb-stats", true, hmp_info_tb_stats);
+    monitor_register_hmp("tb-stats", false, hmp_tb_stats);
 }
 
 type_init(hmp_tcg_register);
@@ -79,6 +79,7 @@ enum plugin_gen_from {
 
 enum plugin_gen_cb {
     PLUGIN_GEN_CB_UDATA,
+    PLUGIN_GEN_CB_COND_UDATA,
     PLUGIN_GEN_CB_INLINE,
     PLUGIN_GEN_CB_MEM,
     PLUGIN_GEN_ENABLE_MEM_HELPER,
@@ -113,21 +114,71 @@ static void gen_empty_udata_cb(void)
 }
 
 /*
- * For now we only support addi_i64.
- * When we support more ops, we can generate one empty inline cb for each.
+ * Compute the address of the executing vCPU's entry: ptr + cpu_index * stride.
+ * Both the base pointer and the stride are filled in when copying; global
+ * counters use a stride of 0, which the optimizer folds away.
  */
-static void gen_empty_inline_cb(void)
+static TCGv_ptr gen_plugin_u64_ptr(TCGv_i32 cpu_index)
 {
-    TCGv_i64 val = tcg_temp_ebb_new_i64();
+    TCGv_i32 cpu_offset = tcg_temp_ebb_new_i32();
+    TCGv_ptr cpu_offset_ptr = tcg_temp_ebb_new_ptr();
     TCGv_ptr ptr = tcg_temp_ebb_new_ptr();
 
+    tcg_gen_ld_i32(cpu_index, tcg_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    /* the second operand is replaced by the stride */
+    tcg_gen_mul_i32(cpu_offset, cpu_index, cpu_index);
+    tcg_gen_ext_i32_ptr(cpu_offset_ptr, cpu_offset);
     tcg_gen_movi_ptr(ptr, 0);
+    tcg_gen_add_ptr(ptr, ptr, cpu_offset_ptr);
+
+    tcg_temp_free_ptr(cpu_offset_ptr);
+    tcg_temp_free_i32(cpu_offset);
+    return ptr;
+}
+
+/*
+ * The template is for addi_i64; QEMU_PLUGIN_INLINE_STORE_U64 reuses it by
+ * skipping the load and add, and storing the immediate instead.
+ */
+static void gen_empty_inline_cb(void)
+{
+    TCGv_i32 cpu_index = tcg_temp_ebb_new_i32();
+    TCGv_i64 val = tcg_temp_ebb_new_i64();
+    TCGv_ptr ptr = gen_plugin_u64_ptr(cpu_index);
+
     tcg_gen_ld_i64(val, ptr, 0);
     /* pass an immediate != 0 so that it doesn't get optimized away */
     tcg_gen_addi_i64(val, val, 0xdeadface);
     tcg_gen_st_i64(val, ptr, 0);
     tcg_temp_free_ptr(ptr);
     tcg_temp_free_i64(val);
+    tcg_temp_free_i32(cpu_index);
+}
+
+/*
+ * Conditional callback: skip the call unless the executing vCPU's entry
+ * satisfies the condition. The branch condition, immediate and label are
+ * all replaced when copying.
+ */
+static void gen_empty_cond_udata_cb(void)
+{
+    TCGv_i32 cpu_index = tcg_temp_ebb_new_i32();
+    TCGv_i64 val = tcg_temp_ebb_new_i64();
+    TCGv_ptr udata = tcg_temp_ebb_new_ptr();
+    TCGLabel *after_cb = gen_new_label();
+    TCGv_ptr ptr = gen_plugin_u64_ptr(cpu_index);
+
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_gen_brcondi_i64(TCG_COND_EQ, val, 0xdeadface, after_cb);
+    tcg_gen_movi_ptr(udata, 0);
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, udata);
+    gen_set_label(after_cb);
+
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_i64(val);
+    tcg_temp_free_i32(cpu_index);
 }
 
 static void gen_empty_mem_cb(TCGv_i64 addr, uint32_t info)
@@ -194,6 +245,8 @@ static void plugin_gen_empty_callback(enum plugin_gen_from from)
     case PLUGIN_GEN_FROM_TB:
         gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
         gen_wrapped(from, PLUGIN_GEN_CB_INLINE, gen_empty_inline_cb);
+        /* after the inline ops, so that conditions see their updates */
+        gen_wrapped(from, PLUGIN_GEN_CB_COND_UDATA, gen_empty_cond_udata_cb);
         break;
     default:
         g_assert_not_reached();
@@ -274,6 +327,52 @@ static TCGOp *copy_const_ptr(TCGOp **begin_op, TCGOp *op, void *ptr)
     return op;
 }
 
+/* step over a template op without copying it */
+static void skip_op(TCGOp **begin_op, TCGOpcode opc)
+{
+    *begin_op = QTAILQ_NEXT(*begin_op, link);
+    tcg_debug_assert((*begin_op)->opc == opc);
+}
+
+static TCGOp *copy_mul_i32(TCGOp **begin_op, TCGOp *op, uint32_t v)
+{
+    op = copy_op(begin_op, op, INDEX_op_mul_i32);
+    op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+    return op;
+}
+
+static TCGOp *copy_ext_i32_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        op = copy_op(begin_op, op, INDEX_op_mov_i32);
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_ext_i32_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_add_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        op = copy_op(begin_op, op, INDEX_op_add_i32);
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_add_i64);
+    }
+    return op;
+}
+
+/* ld_i32 cpu_index, then ptr = base + cpu_index * stride */
+static TCGOp *copy_plugin_u64_ptr(TCGOp **begin_op, TCGOp *op,
+                                  void *base, size_t stride)
+{
+    op = copy_op(begin_op, op, INDEX_op_ld_i32);
+    op = copy_mul_i32(begin_op, op, stride);
+    op = copy_ext_i32_ptr(begin_op, op);
+    op = copy_const_ptr(begin_op, op, base);
+    op = copy_add_ptr(begin_op, op);
+    return op;
+}
+
 static TCGOp *copy_ld_i64(TCGOp **begin_op, TCGOp *op)
 {
     if (TCG_TARGET_REG_BITS == 32) {
@@ -300,6 +399,55 @@ static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
+static TCGOp *copy_st_i64_imm(TCGOp **begin_op, TCGOp *op, uint64_t v)
+{
+    if (TCG_TARGET_REG_BITS == 32) {
+        /* 2x st_i32, in the order tcg_gen_st_i64 emitted them */
+        op = copy_op(begin_op, op, INDEX_op_st_i32);
+        op->args[0] = tcgv_i32_arg(tcg_constant_i32(HOST_BIG_ENDIAN ?
+                                                    v >> 32 : v));
+        op = copy_op(begin_op, op, INDEX_op_st_i32);
+        op->args[0] = tcgv_i32_arg(tcg_constant_i32(HOST_BIG_ENDIAN ?
+                                                    v : v >> 32));
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_st_i64);
+        op->args[0] = tcgv_i64_arg(tcg_constant_i64(v));
+    }
+    return op;
+}
+
+static TCGOp *copy_brcond_i64(TCGOp **begin_op, TCGOp *op, TCGCond cond,
+                              uint64_t v, TCGLabel *l)
+{
+    TCGLabelUse *u;
+
+    if (TCG_TARGET_REG_BITS == 32) {
+        op = copy_op(begin_op, op, INDEX_op_brcond2_i32);
+        op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+        op->args[3] = tcgv_i32_arg(tcg_constant_i32(v >> 32));
+        op->args[4] = cond;
+        op->args[5] = label_arg(l);
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_brcond_i64);
+        op->args[1] = tcgv_i64_arg(tcg_constant_i64(v));
+        op->args[2] = cond;
+        op->args[3] = label_arg(l);
+    }
+
+    u = tcg_malloc(sizeof(TCGLabelUse));
+    u->op = op;
+    QSIMPLEQ_INSERT_TAIL(&l->branches, u, next);
+    return op;
+}
+
+static TCGOp *copy_set_label(TCGOp **begin_op, TCGOp *op, TCGLabel *l)
+{
+    op = copy_op(begin_op, op, INDEX_op_set_label);
+    op->args[0] = label_arg(l);
+    l->present = 1;
+    return op;
+}
+
 static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
 {
     if (TCG_TARGET_REG_BITS == 32) {
@@ -376,21 +524,86 @@ static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+static TCGCond plugin_cond_to_tcgcond(enum qemu_plugin_cond cond)
+{
+    switch (cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        return TCG_COND_EQ;
+    case QEMU_PLUGIN_COND_NE:
+        return TCG_COND_NE;
+    case QEMU_PLUGIN_COND_LT:
+        return TCG_COND_LTU;
+    case QEMU_PLUGIN_COND_LE:
+        return TCG_COND_LEU;
+    case QEMU_PLUGIN_COND_GT:
+        return TCG_COND_GTU;
+    case QEMU_PLUGIN_COND_GE:
+        return TCG_COND_GEU;
+    default:
+        /* ALWAYS and NEVER are handled at registration */
+        g_assert_not_reached();
+    }
+}
+
+static TCGOp *append_cond_udata_cb(const struct qemu_plugin_dyn_cb *cb,
+                                   TCGOp *begin_op, TCGOp *op, int *cb_idx)
+{
+    TCGLabel *after_cb = gen_new_label();
+    TCGCond cond = tcg_invert_cond(plugin_cond_to_tcgcond(cb->cond.cond));
+
+    /* ptr = entry of the executing vCPU */
+    op = copy_plugin_u64_ptr(&begin_op, op, cb->cond.ptr, cb->cond.stride);
+
+    /* ld_i64, then branch over the call if the condition does not hold */
+    op = copy_ld_i64(&begin_op, op);
+    op = copy_brcond_i64(&begin_op, op, cond, cb->cond.imm, after_cb);
+
+    /* const_ptr */
+    op = copy_const_ptr(&begin_op, op, cb->userp);
+
+    /* call */
+    op = copy_call(&begin_op, op, cb->f.vcpu_udata, cb_idx);
+
+    /* set_label */
+    op = copy_set_label(&begin_op, op, after_cb);
+
+    return op;
+}
+
 static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
-    /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
+    /* ptr = entry of the executing vCPU */
+    op = copy_plugin_u64_ptr(&begin_op, op, cb->userp,
+                             cb->inline_insn.stride);
 
-    /* ld_i64 */
-    op = copy_ld_i64(&begin_op, op);
+    switch (cb->inline_insn.op) {
+    case QEMU_PLUGIN_INLINE_ADD_U64:
+        /* ld_i64 */
+        op = copy_ld_i64(&begin_op, op);
 
-    /* add_i64 */
-    op = copy_add_i64(&begin_op, op, cb->inline_insn.imm);
+        /* add_i64 */
+        op = copy_add_i64(&begin_op, op, cb->inline_insn.imm);
 
-    /* st_i64 */
-    op = copy_st_i64(&begin_op, op);
+        /* st_i64 */
+        op = copy_st_i64(&begin_op, op);
+        break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        /* skip ld_i64 and add_i64, store the immediate */
+        if (TCG_TARGET_REG_BITS == 32) {
+            skip_op(&begin_op, INDEX_op_ld_i32);
+            skip_op(&begin_op, INDEX_op_ld_i32);
+            skip_op(&begin_op, INDEX_op_add2_i32);
+        } else {
+            skip_op(&begin_op, INDEX_op_ld_i64);
+            skip_op(&begin_op, INDEX_op_add_i64);
+        }
+        op = copy_st_i64_imm(&begin_op, op, cb->inline_insn.imm);
+        break;
+    default:
+        g_assert_not_reached();
+    }
 
     return op;
 }
@@ -476,6 +689,12 @@ inject_udata_cb(const GArray *cbs, TCGOp *begin_op)
     inject_cb_type(cbs, begin_op, append_udata_cb, op_ok);
 }
 
+static void
+inject_cond_udata_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    inject_cb_type(cbs, begin_op, append_cond_udata_cb, op_ok);
+}
+
 static void
 inject_inline_cb(const GArray *cbs, TCGOp *begin_op, op_ok_fn ok)
 {
@@ -588,6 +807,12 @@ static void plugin_gen_tb_udata(const struct qemu_plugin_tb *ptb,
     inject_udata_cb(ptb->cbs[PLUGIN_CB_REGULAR], begin_op);
 }
 
+static void plugin_gen_tb_cond_udata(const struct qemu_plugin_tb *ptb,
+                                     TCGOp *begin_op)
+{
+    inject_cond_udata_cb(ptb->cbs[PLUGIN_CB_REGULAR_COND], begin_op);
+}
+
 static void plugin_gen_tb_inline(const struct qemu_plugin_tb *ptb,
                                  TCGOp *begin_op)
 {
@@ -602,6 +827,15 @@ static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
     inject_udata_cb(insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_REGULAR], begin_op);
 }
 
+static void plugin_gen_insn_cond_udata(const struct qemu_plugin_tb *ptb,
+                                       TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_cond_udata_cb(insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_REGULAR_COND],
+                         begin_op);
+}
+
 static void plugin_gen_insn_inline(const struct qemu_plugin_tb *ptb,
                                    TCGOp *begin_op, int insn_idx)
 {
@@ -673,6 +907,9 @@ static void pr_ops(void)
             case PLUGIN_GEN_CB_UDATA:
                 type = "udata";
                 break;
+            case PLUGIN_GEN_CB_COND_UDATA:
+                type = "cond udata";
+                break;
             case PLUGIN_GEN_CB_INLINE:
                 type = "inline";
                 break;
@@ -721,6 +958,9 @@ static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_UDATA:
                     plugin_gen_tb_udata(plugin_tb, op);
                     break;
+                case PLUGIN_GEN_CB_COND_UDATA:
+                    plugin_gen_tb_cond_udata(plugin_tb, op);
+                    break;
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_tb_inline(plugin_tb, op);
                     break;
@@ -737,6 +977,9 @@ static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_UDATA:
                     plugin_gen_insn_udata(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_COND_UDATA:
+                    plugin_gen_insn_cond_udata(plugin_tb, op, insn_idx);
+                    break;
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_insn_inline(plugin_tb, op, insn_idx);
                     break;
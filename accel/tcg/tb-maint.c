@@ -20,6 +20,7 @@
 #include "qemu/osdep.h"
 #include "qemu/interval-tree.h"
 #include "qemu/qtree.h"
+#include "qemu/rcu.h"
 #include "exec/cputlb.h"
 #include "exec/log.h"
 #include "exec/exec-all.h"
@@ -29,6 +30,7 @@
 #include "tcg/tcg.h"
 #include "tb-hash.h"
 #include "tb-context.h"
+#include "tb-stats.h"
 #include "internal-common.h"
 #include "internal-target.h"
 
@@ -55,11 +57,114 @@ static bool tb_cmp(const void *ap, const void *bp)
             tb_page_addr1(a) == tb_page_addr1(b));
 }
 
+#ifndef CONFIG_USER_ONLY
+/*
+ * Instructions doing device I/O must be the last of their TB; when one
+ * is found in the middle of a block, cpu_io_recompile() rewinds it and
+ * executes the I/O instruction on its own, every time the block runs.
+ * Remember how long such blocks may be so that their retranslation ends
+ * on the I/O instruction instead.  A hint only ever caps the length of
+ * a block, which is always safe, so it is keyed on the physical address
+ * alone and is not dropped when the code changes.  The table is emptied
+ * on tb_flush(), and stops growing when it holds TB_IO_HINTS_MAX hints.
+ */
+typedef struct TBIOHint {
+    tb_page_addr_t phys_pc;
+    int max_insns;
+} TBIOHint;
+
+#define TB_IO_HINTS_SIZE (1 << 8)
+#define TB_IO_HINTS_MAX (1 << 16)
+
+static struct qht tb_io_hints;
+static unsigned int tb_io_hints_count;
+
+static bool tb_io_hint_cmp(const void *ap, const void *bp)
+{
+    const TBIOHint *a = ap;
+    const TBIOHint *b = bp;
+
+    return a->phys_pc == b->phys_pc;
+}
+
+/* Called with rcu_read_lock held. */
+int tb_io_hint_lookup(tb_page_addr_t phys_pc)
+{
+    TBIOHint key = { .phys_pc = phys_pc };
+    TBIOHint *hint;
+
+    hint = qht_lookup(&tb_io_hints, &key, qemu_xxhash2(phys_pc));
+    return hint ? qatomic_read(&hint->max_insns) : 0;
+}
+
+/*
+ * Record that blocks starting at @phys_pc should contain at most
+ * @max_insns instructions.  Returns true if the hint got tighter.
+ */
+bool tb_io_hint_record(tb_page_addr_t phys_pc, int max_insns)
+{
+    TBIOHint key = { .phys_pc = phys_pc };
+    uint32_t hash = qemu_xxhash2(phys_pc);
+    void *existing = NULL;
+    TBIOHint *hint;
+    int old;
+
+    RCU_READ_LOCK_GUARD();
+
+    hint = qht_lookup(&tb_io_hints, &key, hash);
+    if (!hint) {
+        if (qatomic_fetch_inc(&tb_io_hints_count) >= TB_IO_HINTS_MAX) {
+            qatomic_dec(&tb_io_hints_count);
+            return false;
+        }
+
+        hint = g_new(TBIOHint, 1);
+        hint->phys_pc = phys_pc;
+        hint->max_insns = max_insns;
+        if (qht_insert(&tb_io_hints, hint, hash, &existing)) {
+            return true;
+        }
+        g_free(hint);
+        qatomic_dec(&tb_io_hints_count);
+        hint = existing;
+    }
+
+    old = qatomic_read(&hint->max_insns);
+    while (max_insns < old) {
+        int prev = qatomic_cmpxchg(&hint->max_insns, old, max_insns);
+        if (prev == old) {
+            return true;
+        }
+        old = prev;
+    }
+    return false;
+}
+
+static void tb_io_hint_free(void *p, uint32_t hash, void *userp)
+{
+    g_free(p);
+}
+
+/*
+ * Called from do_tb_flush(), in an exclusive section: the vCPUs, which
+ * are the only users of the hints, cannot be looking at them.
+ */
+static void tb_io_hints_reset(void)
+{
+    qht_iter(&tb_io_hints, tb_io_hint_free, NULL);
+    qht_reset_size(&tb_io_hints, TB_IO_HINTS_SIZE);
+    qatomic_set(&tb_io_hints_count, 0);
+}
+#endif /* !CONFIG_USER_ONLY */
+
 void tb_htable_init(void)
 {
     unsigned int mode = QHT_MODE_AUTO_RESIZE;
 
     qht_init(&tb_ctx.htable, tb_cmp, CODE_GEN_HTABLE_SIZE, mode);
+#ifndef CONFIG_USER_ONLY
+    qht_init(&tb_io_hints, tb_io_hint_cmp, TB_IO_HINTS_SIZE, mode);
+#endif
 }
 
 typedef struct PageDesc PageDesc;
@@ -772,6 +877,9 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     tb_remove_all();
+#ifndef CONFIG_USER_ONLY
+    tb_io_hints_reset();
+#endif
 
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is expensive */
@@ -939,6 +1047,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 
     qatomic_set(&tb_ctx.tb_phys_invalidate_count,
                 tb_ctx.tb_phys_invalidate_count + 1);
+    tb_stats_record_invalidation(tb);
 }
 
 static void tb_phys_invalidate__locked(TranslationBlock *tb)
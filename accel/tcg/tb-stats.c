@@ -0,0 +1,168 @@
+/*
+ * TB execution statistics
+ *
+ * Entries are kept in a QHT keyed on the guest code they describe, so that
+ * generated code and TBs can keep pointers to them across code cache
+ * flushes; "reset" clears the counters in place.  They are only freed once
+ * collection stops and the flush that goes with it has dropped every TB
+ * that pointed to them.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/qht.h"
+#include "qemu/rcu.h"
+#include "qemu/xxhash.h"
+#include "exec/exec-all.h"
+#include "exec/tb-flush.h"
+#include "hw/core/cpu.h"
+#include "tb-stats.h"
+
+#define TB_STATS_HTABLE_SIZE (1 << 12)
+
+bool tb_stats_enabled;
+
+static struct qht tb_stats_ht;
+
+static bool tb_stats_cmp(const void *ap, const void *bp)
+{
+    const TBStatistics *a = ap;
+    const TBStatistics *b = bp;
+
+    return a->phys_pc == b->phys_pc &&
+           a->pc == b->pc &&
+           a->cs_base == b->cs_base &&
+           a->flags == b->flags;
+}
+
+static uint32_t tb_stats_hash(const TBStatistics *s)
+{
+    return qemu_xxhash7(s->phys_pc, s->pc, s->cs_base, s->flags);
+}
+
+static void __attribute__((__constructor__)) tb_stats_init(void)
+{
+    qht_init(&tb_stats_ht, tb_stats_cmp, TB_STATS_HTABLE_SIZE,
+             QHT_MODE_AUTO_RESIZE);
+}
+
+static void tb_stats_free_iter(void *p, uint32_t hash, void *userp)
+{
+    TBStatistics *s = p;
+
+    /* tb_stats_collect() callers may still be looking at it */
+    g_free_rcu(s, rcu);
+}
+
+static void tb_stats_free_all(void)
+{
+    qht_iter(&tb_stats_ht, tb_stats_free_iter, NULL);
+    qht_reset(&tb_stats_ht);
+}
+
+/*
+ * Queued behind the flush, so this runs with all vCPUs stopped and no TB
+ * left that points to an entry.
+ */
+static void do_tb_stats_free(CPUState *cpu, run_on_cpu_data data)
+{
+    /*
+     * If collection was restarted in the meantime, blocks translated since
+     * may already use the entries; they are freed by the next stop.
+     */
+    if (!qatomic_read(&tb_stats_enabled)) {
+        tb_stats_free_all();
+    }
+}
+
+void tb_stats_enable(bool enable)
+{
+    if (qatomic_read(&tb_stats_enabled) == enable) {
+        return;
+    }
+    qatomic_set(&tb_stats_enabled, enable);
+
+    /* Retranslate everything so that counting starts or stops now */
+    if (first_cpu) {
+        tb_flush(first_cpu);
+        if (!enable) {
+            async_safe_run_on_cpu(first_cpu, do_tb_stats_free,
+                                  RUN_ON_CPU_NULL);
+        }
+    } else if (!enable) {
+        tb_stats_free_all();
+    }
+}
+
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, vaddr pc,
+                           uint64_t cs_base, uint32_t flags)
+{
+    TBStatistics key = {
+        .phys_pc = phys_pc,
+        .pc = pc,
+        .cs_base = cs_base,
+        .flags = flags,
+    };
+    uint32_t hash = tb_stats_hash(&key);
+    TBStatistics *s;
+    void *existing = NULL;
+
+    s = qht_lookup(&tb_stats_ht, &key, hash);
+    if (likely(s)) {
+        return s;
+    }
+
+    s = g_new0(TBStatistics, 1);
+    *s = key;
+    if (!qht_insert(&tb_stats_ht, s, hash, &existing)) {
+        /* Raced with another translation of the same code */
+        g_free(s);
+        s = existing;
+    }
+    return s;
+}
+
+void tb_stats_record_translation(const TranslationBlock *tb)
+{
+    TBStatistics *s = tb->tb_stats;
+
+    qatomic_inc(&s->translations);
+    qatomic_set(&s->guest_size, tb->size);
+    qatomic_set(&s->host_size, tb->tc.size);
+    qatomic_set(&s->insns, tb->icount);
+}
+
+static void tb_stats_reset_iter(void *p, uint32_t hash, void *userp)
+{
+    TBStatistics *s = p;
+
+    /* not atomic: racing increments from generated code may survive */
+    s->executions = 0;
+    qatomic_set(&s->translations, 0);
+    qatomic_set(&s->invalidations, 0);
+}
+
+void tb_stats_reset(void)
+{
+    qht_iter(&tb_stats_ht, tb_stats_reset_iter, NULL);
+}
+
+static void tb_stats_collect_iter(void *p, uint32_t hash, void *userp)
+{
+    GPtrArray *arr = userp;
+
+    g_ptr_array_add(arr, p);
+}
+
+GPtrArray *tb_stats_collect(GCompareFunc cmp, size_t max)
+{
+    GPtrArray *arr = g_ptr_array_new();
+
+    qht_iter(&tb_stats_ht, tb_stats_collect_iter, arr);
+    g_ptr_array_sort(arr, cmp);
+    if (arr->len > max) {
+        g_ptr_array_set_size(arr, max);
+    }
+    return arr;
+}
@@ -0,0 +1,73 @@
+/*
+ * TB execution statistics
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_STATS_H
+#define ACCEL_TCG_TB_STATS_H
+
+#include "qemu/rcu.h"
+#include "exec/translation-block.h"
+
+/*
+ * Statistics for one block of guest code, identified by its physical and
+ * virtual address and the translation flags. They outlive the TBs that
+ * point to them, so that retranslations and invalidations of the same
+ * guest code accumulate in a single entry.
+ */
+typedef struct TBStatistics {
+    tb_page_addr_t phys_pc;
+    vaddr pc;
+    uint64_t cs_base;
+    uint32_t flags;
+
+    /*
+     * Incremented by the generated code without atomics, so concurrent
+     * executions of the same block under MTTCG may lose counts.
+     */
+    uint64_t executions;
+
+    uint32_t translations;
+    uint32_t invalidations;
+
+    /* Sizes from the most recent translation */
+    uint32_t guest_size;
+    uint32_t host_size;
+    uint32_t insns;
+
+    struct rcu_head rcu;
+} TBStatistics;
+
+/*
+ * Only read when translating, so that collection costs nothing unless
+ * enabled. Changes take effect for newly translated blocks, hence
+ * tb_stats_enable() flushes the code cache.
+ */
+extern bool tb_stats_enabled;
+
+void tb_stats_enable(bool enable);
+void tb_stats_reset(void);
+
+/* Return the statistics for a block, creating them on first use. */
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, vaddr pc,
+                           uint64_t cs_base, uint32_t flags);
+
+void tb_stats_record_translation(const TranslationBlock *tb);
+
+static inline void tb_stats_record_invalidation(const TranslationBlock *tb)
+{
+    if (tb->tb_stats) {
+        qatomic_inc(&tb->tb_stats->invalidations);
+    }
+}
+
+/*
+ * Return the first @max entries after sorting them with @cmp, which is
+ * called as for g_ptr_array_sort(). The caller must hold the RCU read
+ * lock for as long as it uses the entries, which stopping collection
+ * frees; their counters keep changing while guest code runs.
+ */
+GPtrArray *tb_stats_collect(GCompareFunc cmp, size_t max);
+
+#endif /* ACCEL_TCG_TB_STATS_H */
@@ -39,6 +39,7 @@
 #include "hw/boards.h"
 #endif
 #include "internal-target.h"
+#include "tb-stats.h"
 
 struct TCGState {
     AccelState parent_obj;
@@ -207,6 +208,16 @@ static void tcg_set_one_insn_per_tb(Object *obj, bool value, Error **errp)
     qatomic_set(&one_insn_per_tb, value);
 }
 
+static bool tcg_get_tb_stats(Object *obj, Error **errp)
+{
+    return qatomic_read(&tb_stats_enabled);
+}
+
+static void tcg_set_tb_stats(Object *obj, bool value, Error **errp)
+{
+    tb_stats_enable(value);
+}
+
 static int tcg_gdbstub_supported_sstep_flags(void)
 {
     /*
@@ -252,6 +263,12 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
                                    tcg_set_one_insn_per_tb);
     object_class_property_set_description(oc, "one-insn-per-tb",
         "Only put one guest insn in each translation block");
+
+    object_class_property_add_bool(oc, "tb-stats",
+                                   tcg_get_tb_stats,
+                                   tcg_set_tb_stats);
+    object_class_property_set_description(oc, "tb-stats",
+        "Collect per translation block execution statistics");
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -64,6 +64,7 @@
 #include "internal-common.h"
 #include "internal-target.h"
 #include "perf.h"
+#include "tb-stats.h"
 #include "tcg/insn-start-words.h"
 
 TBContext tb_ctx;
@@ -197,16 +198,18 @@ static int cpu_unwind_data_from_tb(TranslationBlock *tb, uintptr_t host_pc,
 
 /*
  * The cpu state corresponding to 'host_pc' is restored in
- * preparation for exiting the TB.
+ * preparation for exiting the TB.  Returns the number of insns
+ * of the TB that were not executed, or -1 if 'host_pc' is not
+ * within the TB.
  */
-void cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
-                               uintptr_t host_pc)
+int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
+                              uintptr_t host_pc)
 {
     uint64_t data[TARGET_INSN_START_WORDS];
     int insns_left = cpu_unwind_data_from_tb(tb, host_pc, data);
 
     if (insns_left < 0) {
-        return;
+        return -1;
     }
 
     if (tb_cflags(tb) & CF_USE_ICOUNT) {
@@ -219,6 +222,7 @@ void cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
     }
 
     cpu->cc->tcg_ops->restore_state_to_opc(cpu, tb, data);
+    return insns_left;
 }
 
 bool cpu_restore_state(CPUState *cpu, uintptr_t host_pc)
@@ -294,6 +298,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb_page_addr_t phys_pc, phys_p2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
+#ifndef CONFIG_USER_ONLY
+    int io_hint;
+#endif
     int64_t ti;
     void *host_pc;
 
@@ -310,6 +317,13 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     max_insns = cflags & CF_COUNT_MASK;
     if (max_insns == 0) {
         max_insns = TCG_MAX_INSNS;
+#ifndef CONFIG_USER_ONLY
+        /* End the block on an insn previously seen doing I/O.  */
+        io_hint = tb_io_hint_lookup(phys_pc);
+        if (io_hint) {
+            max_insns = io_hint;
+        }
+#endif
     }
     QEMU_BUILD_BUG_ON(CF_COUNT_MASK + 1 != TCG_MAX_INSNS);
 
@@ -336,6 +350,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if (phys_pc != -1) {
         tb_lock_page0(phys_pc);
     }
+    tb->tb_stats = NULL;
+    if (unlikely(qatomic_read(&tb_stats_enabled)) && phys_pc != -1) {
+        tb->tb_stats = tb_stats_get(phys_pc, pc, cs_base, flags);
+    }
 
     tcg_ctx->gen_tb = tb;
     tcg_ctx->addr_type = TARGET_LONG_BITS == 32 ? TCG_TYPE_I32 : TCG_TYPE_I64;
@@ -427,6 +445,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
     tb->tc.size = gen_code_size;
 
+    if (tb->tb_stats) {
+        tb_stats_record_translation(tb);
+    }
+
     /*
      * For CF_PCREL, attribute all executions of the generated code
      * to its first mapping.
@@ -603,13 +625,14 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
     TranslationBlock *tb;
     CPUClass *cc;
     uint32_t n;
+    int insns_left;
 
     tb = tcg_tb_lookup(retaddr);
     if (!tb) {
         cpu_abort(cpu, "cpu_io_recompile: could not find TB for pc=%p",
                   (void *)retaddr);
     }
-    cpu_restore_state_from_tb(cpu, tb, retaddr);
+    insns_left = cpu_restore_state_from_tb(cpu, tb, retaddr);
 
     /*
      * Some guests must re-execute the branch when re-executing a delay
@@ -624,6 +647,17 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
         n = 2;
     }
 
+    /*
+     * Have later translations of this block end on the I/O insn, so
+     * that it is not rewound again on each execution, and drop the
+     * current translation so that the next lookup picks that up.
+     * Branch replay is left to the slow path.
+     */
+    if (n == 1 && insns_left > 0 && tb_page_addr0(tb) != -1 &&
+        tb_io_hint_record(tb_page_addr0(tb), tb->icount - insns_left + 1)) {
+        tb_phys_invalidate(tb, -1);
+    }
+
     /*
      * Exit the loop and potentially generate a new TB executing the
      * just the I/O insns. We also limit instrumentation to memory
@@ -15,6 +15,7 @@
 #include "exec/plugin-gen.h"
 #include "tcg/tcg-op-common.h"
 #include "internal-target.h"
+#include "tb-stats.h"
 
 static void set_can_do_io(DisasContextBase *db, bool val)
 {
@@ -91,6 +92,16 @@ static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
      */
     set_can_do_io(db, db->max_insns == 1);
 
+    /* Count executions that get past the exit request check */
+    if (db->tb->tb_stats) {
+        TCGv_i64 execs = tcg_temp_new_i64();
+        TCGv_ptr ptr = tcg_constant_ptr(&db->tb->tb_stats->executions);
+
+        tcg_gen_ld_i64(execs, ptr, 0);
+        tcg_gen_addi_i64(execs, execs, 1);
+        tcg_gen_st_i64(execs, ptr, 0);
+    }
+
     return icount_start_insn;
 }
 
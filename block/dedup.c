@@ -0,0 +1,1142 @@
+/*
+ * Block driver for deduplicating images
+ *
+ * A dedup image is a manifest that splits the virtual disk into chunks
+ * of a fixed size and records the SHA-256 digest of the contents of each
+ * chunk.  The contents themselves live in a chunk store, a directory that
+ * holds one file per distinct chunk, named after its digest.  Any number
+ * of images can share a store, so that for example the backups of many
+ * similar VMs only take up space for the data that differs between them.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "qapi/qobject-input-visitor.h"
+#include "qapi/qapi-visit-block-core.h"
+#include "block/block_int.h"
+#include "block/qdict.h"
+#include "block/thread-pool.h"
+#include "sysemu/block-backend.h"
+#include "crypto/hash.h"
+#include "migration/blocker.h"
+#include "qemu/bitmap.h"
+#include "qemu/bswap.h"
+#include "qemu/coroutine.h"
+#include "qemu/cutils.h"
+#include "qemu/lockable.h"
+#include "qemu/memalign.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "trace.h"
+
+#define DEDUP_MAGIC         (('Q' << 24) | ('D' << 16) | ('D' << 8) | 'P')
+#define DEDUP_VERSION       1
+
+/* The header and the store path fill the first DEDUP_HEADER_SIZE bytes */
+#define DEDUP_HEADER_SIZE   4096
+
+#define DEDUP_DIGEST_SIZE   32
+
+#define DEDUP_MIN_CHUNK_SIZE        (4 * KiB)
+#define DEDUP_MAX_CHUNK_SIZE        (2 * MiB)
+#define DEDUP_DEFAULT_CHUNK_SIZE    (64 * KiB)
+
+/* Limits the in-memory chunk table to 256 MiB */
+#define DEDUP_MAX_CHUNKS    (8 * MiB)
+
+#define DEDUP_OPT_STORE     "store"
+#define DEDUP_OPT_BASE      "base"
+
+typedef struct DedupHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    uint32_t chunk_size;
+    uint32_t store_len;     /* length of the path following the header */
+    uint64_t table_offset;  /* DEDUP_DIGEST_SIZE bytes per chunk */
+} QEMU_PACKED DedupHeader;
+
+typedef struct BDRVDedupState {
+    uint64_t size;
+    uint32_t chunk_size;
+    uint64_t nb_chunks;
+    uint64_t table_offset;
+
+    /* An all-zero digest stands for a chunk that reads as zeroes */
+    uint8_t (*table)[DEDUP_DIGEST_SIZE];
+    /* Entries of the chunk table not yet written back to the image */
+    unsigned long *dirty;
+
+    char *store;
+
+    /*
+     * Protects updates of the chunk table, @dirty and @garbage.  Held
+     * across the read-modify-write cycles of partially written chunks and
+     * across flushes, so that the table only ever reaches the image after
+     * the chunks it refers to.
+     *
+     * Reads and block status look up table entries without it: all
+     * requests run in the AioContext of the node, and neither side yields
+     * while copying a digest, so a reader sees either the old or the new
+     * entry.  Both stay readable, because chunks are never removed from
+     * the store and dedup_co_load_chunk() finds chunks that are still
+     * pending.  Waiting for the lock would instead stall reads behind the
+     * thread pool I/O of partial writes to unrelated chunks.
+     */
+    CoMutex lock;
+
+    /*
+     * Chunks stored since the last flush, mapping their path in the store
+     * to the temporary file that holds them until they are synced.  This
+     * way the store never has a torn chunk under its digest.
+     */
+    QemuMutex pending_lock;
+    GHashTable *pending;
+    /* Temporary files of chunks that turned out to be pending already */
+    GPtrArray *garbage;
+
+    Error *migration_blocker;
+} BDRVDedupState;
+
+typedef struct DedupChunkTask {
+    const char *store;
+    void *buf;
+    size_t len;
+    uint8_t digest[DEDUP_DIGEST_SIZE];
+    /* The chunk is in the store already */
+    bool exists;
+    /* Temporary file holding a new or a pending chunk */
+    char *tmp;
+} DedupChunkTask;
+
+typedef struct DedupSyncTask {
+    const char *store;
+    /* Temporary files of the pending chunks, and their paths in the store */
+    GPtrArray *tmps;
+    GPtrArray *paths;
+    GPtrArray *garbage;
+    /* False with cache=unsafe: only move the chunks into place */
+    bool sync;
+} DedupSyncTask;
+
+static QemuOptsList dedup_create_opts;
+
+static QemuOptsList dedup_runtime_opts = {
+    .name = "dedup",
+    .head = QTAILQ_HEAD_INITIALIZER(dedup_runtime_opts.head),
+    .desc = {
+        {
+            .name = DEDUP_OPT_STORE,
+            .type = QEMU_OPT_STRING,
+            .help = "Directory of the chunk store",
+        },
+        { /* end of list */ }
+    },
+};
+
+static int dedup_probe(const uint8_t *buf, int buf_size, const char *filename)
+{
+    const DedupHeader *header = (const DedupHeader *)buf;
+
+    if (buf_size >= sizeof(*header) &&
+        be32_to_cpu(header->magic) == DEDUP_MAGIC &&
+        be32_to_cpu(header->version) == DEDUP_VERSION) {
+        return 100;
+    }
+    return 0;
+}
+
+/* Convert @header to host byte order and check it */
+static int dedup_check_header(DedupHeader *header, Error **errp)
+{
+    header->magic = be32_to_cpu(header->magic);
+    header->version = be32_to_cpu(header->version);
+    header->size = be64_to_cpu(header->size);
+    header->chunk_size = be32_to_cpu(header->chunk_size);
+    header->store_len = be32_to_cpu(header->store_len);
+    header->table_offset = be64_to_cpu(header->table_offset);
+
+    if (header->magic != DEDUP_MAGIC) {
+        error_setg(errp, "Image not in dedup format");
+        return -EINVAL;
+    }
+    if (header->version != DEDUP_VERSION) {
+        error_setg(errp, "Unsupported dedup version %" PRIu32,
+                   header->version);
+        return -ENOTSUP;
+    }
+    if (header->chunk_size < DEDUP_MIN_CHUNK_SIZE ||
+        header->chunk_size > DEDUP_MAX_CHUNK_SIZE ||
+        !is_power_of_2(header->chunk_size)) {
+        error_setg(errp, "Invalid chunk size %" PRIu32, header->chunk_size);
+        return -EINVAL;
+    }
+    if (!QEMU_IS_ALIGNED(header->size, BDRV_SECTOR_SIZE) ||
+        DIV_ROUND_UP(header->size, header->chunk_size) > DEDUP_MAX_CHUNKS) {
+        error_setg(errp, "Invalid image size %" PRIu64, header->size);
+        return -EINVAL;
+    }
+    if (header->store_len > DEDUP_HEADER_SIZE - sizeof(*header) ||
+        header->table_offset < DEDUP_HEADER_SIZE ||
+        !QEMU_IS_ALIGNED(header->table_offset, BDRV_SECTOR_SIZE)) {
+        error_setg(errp, "Invalid dedup header");
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static bool dedup_digest_is_zero(const uint8_t *digest)
+{
+    return buffer_is_zero(digest, DEDUP_DIGEST_SIZE);
+}
+
+static uint64_t dedup_chunk_len(BDRVDedupState *s, uint64_t index)
+{
+    return MIN(s->chunk_size, s->size - index * s->chunk_size);
+}
+
+/* Chunks are spread over 256 subdirectories by their first digest byte */
+static char *dedup_chunk_path(const char *store, const uint8_t *digest)
+{
+    char hex[DEDUP_DIGEST_SIZE * 2 + 1];
+    int i;
+
+    for (i = 0; i < DEDUP_DIGEST_SIZE; i++) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+    return g_strdup_printf("%s/%.2s/%s", store, hex, hex);
+}
+
+/*
+ * Hash the chunk in task->buf and look it up in the store.  Runs in the
+ * thread pool.
+ */
+static int dedup_hash_chunk_func(void *opaque)
+{
+    DedupChunkTask *task = opaque;
+    g_autofree uint8_t *digest = NULL;
+    g_autofree char *path = NULL;
+    size_t digest_len;
+
+    if (qcrypto_hash_bytes(QCRYPTO_HASH_ALG_SHA256, task->buf, task->len,
+                           &digest, &digest_len, NULL) < 0) {
+        return -EIO;
+    }
+    assert(digest_len == DEDUP_DIGEST_SIZE);
+    memcpy(task->digest, digest, DEDUP_DIGEST_SIZE);
+
+    /* The all-zero digest is reserved, and not worth handling anyway */
+    if (dedup_digest_is_zero(task->digest)) {
+        return -EIO;
+    }
+
+    path = dedup_chunk_path(task->store, task->digest);
+    task->exists = g_file_test(path, G_FILE_TEST_EXISTS);
+    return 0;
+}
+
+/*
+ * Write the new chunk in task->buf to a temporary file next to its path in
+ * the store.  It is synced and moved into place on the next flush.  Runs
+ * in the thread pool.
+ */
+static int dedup_write_chunk_func(void *opaque)
+{
+    DedupChunkTask *task = opaque;
+    g_autofree char *path = dedup_chunk_path(task->store, task->digest);
+    g_autofree char *dir = g_path_get_dirname(path);
+    g_autofree char *tmp = NULL;
+    int fd, ret;
+
+    if (g_mkdir_with_parents(dir, 0755) < 0) {
+        return -errno;
+    }
+
+    tmp = g_strdup_printf("%s.XXXXXX", path);
+    fd = g_mkstemp(tmp);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (qemu_write_full(fd, task->buf, task->len) != task->len) {
+        ret = -errno;
+        close(fd);
+        unlink(tmp);
+        return ret;
+    }
+    close(fd);
+
+    task->tmp = g_steal_pointer(&tmp);
+    return 0;
+}
+
+static int dedup_fsync_dir(const char *dir)
+{
+    int fd, ret = 0;
+
+    fd = qemu_open_old(dir, O_RDONLY);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (qemu_fdatasync(fd) < 0) {
+        ret = -errno;
+    }
+    close(fd);
+    return ret;
+}
+
+/*
+ * Sync the pending chunks and move them into place, then sync the
+ * directories that now refer to them.  Runs in the thread pool.
+ */
+static int dedup_sync_chunks_func(void *opaque)
+{
+    DedupSyncTask *task = opaque;
+    g_autoptr(GHashTable) dirs = g_hash_table_new_full(g_str_hash,
+                                                       g_str_equal,
+                                                       g_free, NULL);
+    GHashTableIter iter;
+    const char *dir;
+    int fd, ret;
+    guint i;
+
+    for (i = 0; i < task->tmps->len; i++) {
+        const char *tmp = g_ptr_array_index(task->tmps, i);
+        const char *path = g_ptr_array_index(task->paths, i);
+
+        g_hash_table_add(dirs, g_path_get_dirname(path));
+
+        /* A failed flush may have moved the chunk already */
+        if (!g_file_test(tmp, G_FILE_TEST_EXISTS) &&
+            g_file_test(path, G_FILE_TEST_EXISTS)) {
+            continue;
+        }
+
+        if (task->sync) {
+            fd = qemu_open_old(tmp, O_RDONLY);
+            if (fd < 0) {
+                return -errno;
+            }
+            if (qemu_fdatasync(fd) < 0) {
+                ret = -errno;
+                close(fd);
+                return ret;
+            }
+            close(fd);
+        }
+        if (rename(tmp, path) < 0) {
+            return -errno;
+        }
+    }
+
+    if (task->sync && task->tmps->len) {
+        /* The subdirectories may be new as well */
+        g_hash_table_add(dirs, g_strdup(task->store));
+
+        g_hash_table_iter_init(&iter, dirs);
+        while (g_hash_table_iter_next(&iter, (gpointer *)&dir, NULL)) {
+            ret = dedup_fsync_dir(dir);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+
+    for (i = 0; i < task->garbage->len; i++) {
+        unlink(g_ptr_array_index(task->garbage, i));
+    }
+    return 0;
+}
+
+static int dedup_load_chunk_func(void *opaque)
+{
+    DedupChunkTask *task = opaque;
+    g_autofree char *path = dedup_chunk_path(task->store, task->digest);
+    g_autofree char *contents = NULL;
+    gsize len;
+
+    /* A pending chunk may be moved into place while we look for it */
+    if ((!task->tmp ||
+         !g_file_get_contents(task->tmp, &contents, &len, NULL)) &&
+        !g_file_get_contents(path, &contents, &len, NULL)) {
+        return -EIO;
+    }
+    if (len != task->len) {
+        return -EIO;
+    }
+    memcpy(task->buf, contents, len);
+    return 0;
+}
+
+static int coroutine_fn
+dedup_co_load_chunk(BDRVDedupState *s, const uint8_t *digest, void *buf,
+                    size_t len)
+{
+    g_autofree char *path = NULL;
+    DedupChunkTask task = {
+        .store = s->store,
+        .buf = buf,
+        .len = len,
+    };
+    int ret;
+
+    if (dedup_digest_is_zero(digest)) {
+        memset(buf, 0, len);
+        return 0;
+    }
+
+    memcpy(task.digest, digest, DEDUP_DIGEST_SIZE);
+    path = dedup_chunk_path(s->store, digest);
+    WITH_QEMU_LOCK_GUARD(&s->pending_lock) {
+        task.tmp = g_strdup(g_hash_table_lookup(s->pending, path));
+    }
+
+    ret = thread_pool_submit_co(dedup_load_chunk_func, &task);
+    g_free(task.tmp);
+    return ret;
+}
+
+/*
+ * Hash the complete contents of chunk @index in task->buf, and write it
+ * to a temporary file unless the store has it already.  The chunk table
+ * is updated separately by dedup_commit_chunk().
+ */
+static int coroutine_fn
+dedup_co_store_chunk(BlockDriverState *bs, uint64_t index,
+                     DedupChunkTask *task)
+{
+    BDRVDedupState *s = bs->opaque;
+    g_autofree char *path = NULL;
+    bool pending = false;
+    int ret;
+
+    if (buffer_is_zero(task->buf, task->len)) {
+        memset(task->digest, 0, DEDUP_DIGEST_SIZE);
+        return 0;
+    }
+
+    ret = thread_pool_submit_co(dedup_hash_chunk_func, task);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (!task->exists) {
+        path = dedup_chunk_path(s->store, task->digest);
+        WITH_QEMU_LOCK_GUARD(&s->pending_lock) {
+            pending = g_hash_table_contains(s->pending, path);
+        }
+        if (!pending) {
+            ret = thread_pool_submit_co(dedup_write_chunk_func, task);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+
+    trace_dedup_store_chunk(bs, index, task->tmp != NULL);
+    return 0;
+}
+
+/* Point chunk @index at the chunk of @task.  Called with s->lock held */
+static void dedup_commit_chunk(BDRVDedupState *s, uint64_t index,
+                               DedupChunkTask *task)
+{
+    char *path;
+
+    if (task->tmp) {
+        path = dedup_chunk_path(s->store, task->digest);
+
+        QEMU_LOCK_GUARD(&s->pending_lock);
+        if (g_hash_table_contains(s->pending, path)) {
+            /* Someone else stored the same chunk in the meantime */
+            g_ptr_array_add(s->garbage, g_steal_pointer(&task->tmp));
+            g_free(path);
+        } else {
+            g_hash_table_insert(s->pending, path,
+                                g_steal_pointer(&task->tmp));
+        }
+    }
+
+    if (memcmp(s->table[index], task->digest, DEDUP_DIGEST_SIZE)) {
+        memcpy(s->table[index], task->digest, DEDUP_DIGEST_SIZE);
+        set_bit(index, s->dirty);
+    }
+}
+
+static int dedup_open(BlockDriverState *bs, QDict *options, int flags,
+                      Error **errp)
+{
+    BDRVDedupState *s = bs->opaque;
+    QemuOpts *opts = NULL;
+    DedupHeader header;
+    g_autofree char *store = NULL;
+    size_t table_size;
+    int ret;
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    GRAPH_RDLOCK_GUARD_MAINLOOP();
+
+    opts = qemu_opts_create(&dedup_runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    ret = bdrv_pread(bs->file, 0, sizeof(header), &header, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read dedup header");
+        goto fail;
+    }
+
+    ret = dedup_check_header(&header, errp);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    s->size = header.size;
+    s->chunk_size = header.chunk_size;
+    s->nb_chunks = DIV_ROUND_UP(header.size, header.chunk_size);
+    s->table_offset = header.table_offset;
+    bs->total_sectors = header.size / BDRV_SECTOR_SIZE;
+
+    store = g_strdup(qemu_opt_get(opts, DEDUP_OPT_STORE));
+    if (!store) {
+        g_autofree char *recorded = g_malloc0(header.store_len + 1);
+
+        ret = bdrv_pread(bs->file, sizeof(header), header.store_len,
+                         recorded, 0);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read chunk store path");
+            goto fail;
+        }
+
+        /* A relative store path is relative to the image file */
+        store = path_combine(bs->file->bs->filename, recorded);
+    }
+    if (!g_file_test(store, G_FILE_TEST_IS_DIR)) {
+        error_setg(errp, "Chunk store '%s' is not a directory", store);
+        ret = -EINVAL;
+        goto fail;
+    }
+    s->store = g_steal_pointer(&store);
+
+    table_size = s->nb_chunks * DEDUP_DIGEST_SIZE;
+    s->table = qemu_try_blockalign(bs->file->bs, table_size);
+    if (!s->table) {
+        error_setg(errp, "Could not allocate chunk table");
+        ret = -ENOMEM;
+        goto fail;
+    }
+    ret = bdrv_pread(bs->file, s->table_offset, table_size, s->table, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read chunk table");
+        goto fail;
+    }
+
+    /* The chunk table is cached, so the image must not change under us */
+    error_setg(&s->migration_blocker, "The dedup format used by node '%s' "
+               "does not support live migration",
+               bdrv_get_device_or_node_name(bs));
+    ret = migrate_add_blocker_normal(&s->migration_blocker, errp);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    s->dirty = bitmap_new(s->nb_chunks);
+    qemu_co_mutex_init(&s->lock);
+    qemu_mutex_init(&s->pending_lock);
+    s->pending = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                       g_free, g_free);
+    s->garbage = g_ptr_array_new_with_free_func(g_free);
+    qemu_opts_del(opts);
+    return 0;
+
+fail:
+    qemu_vfree(s->table);
+    s->table = NULL;
+    g_free(s->store);
+    s->store = NULL;
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static void dedup_close(BlockDriverState *bs)
+{
+    BDRVDedupState *s = bs->opaque;
+
+    /* Chunks that a failed flush left behind stay in their temporary files */
+    g_hash_table_destroy(s->pending);
+    g_ptr_array_free(s->garbage, true);
+    qemu_mutex_destroy(&s->pending_lock);
+    g_free(s->dirty);
+    qemu_vfree(s->table);
+    g_free(s->store);
+    migrate_del_blocker(&s->migration_blocker);
+}
+
+static int dedup_reopen_prepare(BDRVReopenState *state,
+                                BlockReopenQueue *queue, Error **errp)
+{
+    return 0;
+}
+
+static void GRAPH_RDLOCK
+dedup_refresh_limits(BlockDriverState *bs, Error **errp)
+{
+    BDRVDedupState *s = bs->opaque;
+
+    bs->bl.pwrite_zeroes_alignment = s->chunk_size;
+    bs->bl.max_transfer = QEMU_ALIGN_DOWN(BDRV_REQUEST_MAX_BYTES,
+                                          s->chunk_size);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+dedup_co_block_status(BlockDriverState *bs, bool want_zero, int64_t offset,
+                      int64_t bytes, int64_t *pnum, int64_t *map,
+                      BlockDriverState **file)
+{
+    BDRVDedupState *s = bs->opaque;
+    uint64_t index = offset / s->chunk_size;
+    bool zero = dedup_digest_is_zero(s->table[index]);
+    int64_t end = MIN(offset + bytes, s->size);
+    int64_t next = (index + 1) * s->chunk_size;
+
+    while (next < end && dedup_digest_is_zero(s->table[++index]) == zero) {
+        next += s->chunk_size;
+    }
+    *pnum = MIN(next, end) - offset;
+
+    return zero ? BDRV_BLOCK_ZERO : BDRV_BLOCK_DATA;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+dedup_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                QEMUIOVector *qiov, BdrvRequestFlags flags)
+{
+    BDRVDedupState *s = bs->opaque;
+    uint8_t digest[DEDUP_DIGEST_SIZE];
+    uint8_t *buf = NULL;
+    uint64_t bytes_done = 0;
+    int ret = 0;
+
+    while (bytes > 0) {
+        uint64_t index = offset / s->chunk_size;
+        uint64_t offset_in_chunk = offset % s->chunk_size;
+        uint64_t len = dedup_chunk_len(s, index);
+        uint64_t n = MIN(bytes, len - offset_in_chunk);
+
+        /* A snapshot of the entry, see BDRVDedupState.lock */
+        memcpy(digest, s->table[index], DEDUP_DIGEST_SIZE);
+        if (dedup_digest_is_zero(digest)) {
+            qemu_iovec_memset(qiov, bytes_done, 0, n);
+        } else {
+            if (!buf) {
+                buf = qemu_blockalign(bs, s->chunk_size);
+            }
+            ret = dedup_co_load_chunk(s, digest, buf, len);
+            if (ret < 0) {
+                break;
+            }
+            qemu_iovec_from_buf(qiov, bytes_done, buf + offset_in_chunk, n);
+        }
+
+        bytes -= n;
+        offset += n;
+        bytes_done += n;
+    }
+
+    qemu_vfree(buf);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+dedup_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                 QEMUIOVector *qiov, BdrvRequestFlags flags)
+{
+    BDRVDedupState *s = bs->opaque;
+    uint8_t *buf = qemu_blockalign(bs, s->chunk_size);
+    uint64_t bytes_done = 0;
+    int ret = 0;
+
+    while (bytes > 0) {
+        uint64_t index = offset / s->chunk_size;
+        uint64_t offset_in_chunk = offset % s->chunk_size;
+        uint64_t len = dedup_chunk_len(s, index);
+        uint64_t n = MIN(bytes, len - offset_in_chunk);
+
+        DedupChunkTask task = {
+            .store = s->store,
+            .buf = buf,
+            .len = len,
+        };
+
+        if (n == len) {
+            qemu_iovec_to_buf(qiov, bytes_done, buf, n);
+            ret = dedup_co_store_chunk(bs, index, &task);
+            if (ret >= 0) {
+                qemu_co_mutex_lock(&s->lock);
+                dedup_commit_chunk(s, index, &task);
+                qemu_co_mutex_unlock(&s->lock);
+            }
+        } else {
+            /* Partial chunk: merge with the current contents */
+            qemu_co_mutex_lock(&s->lock);
+            ret = dedup_co_load_chunk(s, s->table[index], buf, len);
+            if (ret >= 0) {
+                qemu_iovec_to_buf(qiov, bytes_done, buf + offset_in_chunk, n);
+                ret = dedup_co_store_chunk(bs, index, &task);
+            }
+            if (ret >= 0) {
+                dedup_commit_chunk(s, index, &task);
+            }
+            qemu_co_mutex_unlock(&s->lock);
+        }
+        if (ret < 0) {
+            break;
+        }
+
+        bytes -= n;
+        offset += n;
+        bytes_done += n;
+    }
+
+    qemu_vfree(buf);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+dedup_co_pwrite_zeroes(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                       BdrvRequestFlags flags)
+{
+    BDRVDedupState *s = bs->opaque;
+    uint64_t first = offset / s->chunk_size;
+    uint64_t last = (offset + bytes - 1) / s->chunk_size;
+
+    /* Partial chunks are left to the generic fallback */
+    if (!QEMU_IS_ALIGNED(offset, s->chunk_size) ||
+        (offset + bytes != s->size &&
+         !QEMU_IS_ALIGNED(offset + bytes, s->chunk_size))) {
+        return -ENOTSUP;
+    }
+
+    QEMU_LOCK_GUARD(&s->lock);
+    memset(s->table[first], 0, (last - first + 1) * DEDUP_DIGEST_SIZE);
+    bitmap_set(s->dirty, first, last - first + 1);
+    return 0;
+}
+
+/*
+ * Move the chunks stored since the last flush into place, and only then
+ * write back the chunk table.  Unless cache=unsafe, the chunks and their
+ * directories are synced first, so that a table that made it to the disk
+ * never refers to a chunk that did not.
+ */
+static int coroutine_fn GRAPH_RDLOCK dedup_co_flush_to_os(BlockDriverState *bs)
+{
+    BDRVDedupState *s = bs->opaque;
+    g_autoptr(GPtrArray) tmps = g_ptr_array_new();
+    g_autoptr(GPtrArray) paths = g_ptr_array_new();
+    DedupSyncTask task = {
+        .store = s->store,
+        .tmps = tmps,
+        .paths = paths,
+        .garbage = s->garbage,
+        .sync = !(bs->open_flags & BDRV_O_NO_FLUSH),
+    };
+    GHashTableIter iter;
+    gpointer path, tmp;
+    uint64_t first, last;
+    int ret;
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    /* Only flushes remove entries, so they stay valid without the lock */
+    WITH_QEMU_LOCK_GUARD(&s->pending_lock) {
+        g_hash_table_iter_init(&iter, s->pending);
+        while (g_hash_table_iter_next(&iter, &path, &tmp)) {
+            g_ptr_array_add(paths, path);
+            g_ptr_array_add(tmps, tmp);
+        }
+    }
+
+    if (tmps->len || s->garbage->len) {
+        ret = thread_pool_submit_co(dedup_sync_chunks_func, &task);
+        if (ret < 0) {
+            return ret;
+        }
+        WITH_QEMU_LOCK_GUARD(&s->pending_lock) {
+            g_hash_table_remove_all(s->pending);
+        }
+        g_ptr_array_set_size(s->garbage, 0);
+    }
+
+    /* Write back runs of dirty chunk table entries */
+    first = find_first_bit(s->dirty, s->nb_chunks);
+    while (first < s->nb_chunks) {
+        last = find_next_zero_bit(s->dirty, s->nb_chunks, first);
+        ret = bdrv_co_pwrite(bs->file,
+                             s->table_offset + first * DEDUP_DIGEST_SIZE,
+                             (last - first) * DEDUP_DIGEST_SIZE,
+                             s->table[first], 0);
+        if (ret < 0) {
+            return ret;
+        }
+        bitmap_clear(s->dirty, first, last - first);
+        first = find_next_bit(s->dirty, s->nb_chunks, last);
+    }
+
+    return 0;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+dedup_co_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
+{
+    BDRVDedupState *s = bs->opaque;
+
+    bdi->cluster_size = s->chunk_size;
+    return 0;
+}
+
+static int GRAPH_RDLOCK dedup_has_zero_init(BlockDriverState *bs)
+{
+    return 1;
+}
+
+/*
+ * Copy the chunk table of the dedup image @base_name into the image being
+ * created on @blk, so that an incremental backup into the new image only
+ * has to write the chunks that changed and still leaves a complete
+ * manifest.  A relative @base_name is relative to @filename.
+ */
+static int coroutine_fn GRAPH_UNLOCKED
+dedup_co_copy_base(BlockBackend *blk, const char *filename,
+                   const char *base_name, const char *store,
+                   uint64_t size, uint64_t chunk_size, Error **errp)
+{
+    g_autofree char *base_path = path_combine(filename, base_name);
+    g_autofree char *base_store = NULL;
+    g_autofree char *recorded = NULL;
+    g_autofree uint8_t *buf = NULL;
+    BlockBackend *base;
+    DedupHeader header;
+    struct stat st_base, st_store;
+    uint64_t table_size, pos, n;
+    int ret;
+
+    base = blk_co_new_open(base_path, NULL, NULL, BDRV_O_PROTOCOL, errp);
+    if (!base) {
+        return -EIO;
+    }
+
+    ret = blk_co_pread(base, 0, sizeof(header), &header, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read dedup header of '%s'",
+                         base_path);
+        goto out;
+    }
+    ret = dedup_check_header(&header, errp);
+    if (ret < 0) {
+        goto out;
+    }
+    if (header.size != size || header.chunk_size != chunk_size) {
+        error_setg(errp, "Base image '%s' must have the same size and chunk "
+                   "size", base_path);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    /* Its chunks must be where the new image looks for them */
+    recorded = g_malloc0(header.store_len + 1);
+    ret = blk_co_pread(base, sizeof(header), header.store_len, recorded, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read chunk store path of '%s'",
+                         base_path);
+        goto out;
+    }
+    base_store = path_combine(base_path, recorded);
+    if (stat(base_store, &st_base) < 0 || stat(store, &st_store) < 0 ||
+        st_base.st_dev != st_store.st_dev ||
+        st_base.st_ino != st_store.st_ino) {
+        error_setg(errp, "Base image '%s' must use the same chunk store",
+                   base_path);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    table_size = DIV_ROUND_UP(size, chunk_size) * DEDUP_DIGEST_SIZE;
+    buf = g_malloc(MIN(table_size, 1 * MiB));
+    for (pos = 0; pos < table_size; pos += n) {
+        n = MIN(table_size - pos, 1 * MiB);
+        ret = blk_co_pread(base, header.table_offset + pos, n, buf, 0);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read chunk table of '%s'",
+                             base_path);
+            goto out;
+        }
+        ret = blk_co_pwrite(blk, DEDUP_HEADER_SIZE + pos, n, buf, 0);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not write chunk table");
+            goto out;
+        }
+    }
+
+    ret = 0;
+out:
+    blk_co_unref(base);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_UNLOCKED
+dedup_co_create(BlockdevCreateOptions *create_options, Error **errp)
+{
+    BlockdevCreateOptionsDedup *dedup_opts;
+    BlockDriverState *bs_file = NULL;
+    BlockBackend *blk = NULL;
+    g_autofree char *header_buf = NULL;
+    g_autofree char *store = NULL;
+    DedupHeader *header;
+    uint64_t chunk_size, nb_chunks;
+    size_t store_len;
+    int ret;
+
+    assert(create_options->driver == BLOCKDEV_DRIVER_DEDUP);
+    dedup_opts = &create_options->u.dedup;
+
+    chunk_size = dedup_opts->has_chunk_size ? dedup_opts->chunk_size
+                                            : DEDUP_DEFAULT_CHUNK_SIZE;
+    if (chunk_size < DEDUP_MIN_CHUNK_SIZE ||
+        chunk_size > DEDUP_MAX_CHUNK_SIZE || !is_power_of_2(chunk_size)) {
+        error_setg(errp, "Chunk size must be a power of two between %"
+                   PRId64 " and %" PRId64, DEDUP_MIN_CHUNK_SIZE,
+                   DEDUP_MAX_CHUNK_SIZE);
+        return -EINVAL;
+    }
+    if (!QEMU_IS_ALIGNED(dedup_opts->size, BDRV_SECTOR_SIZE)) {
+        error_setg(errp, "Image size must be a multiple of %u bytes",
+                   (unsigned) BDRV_SECTOR_SIZE);
+        return -EINVAL;
+    }
+    nb_chunks = DIV_ROUND_UP(dedup_opts->size, chunk_size);
+    if (nb_chunks > DEDUP_MAX_CHUNKS) {
+        error_setg(errp, "Image size is too large for chunk size %" PRIu64,
+                   chunk_size);
+        return -EINVAL;
+    }
+
+    store_len = strlen(dedup_opts->store);
+    if (store_len > DEDUP_HEADER_SIZE - sizeof(*header)) {
+        error_setg(errp, "Chunk store path is too long");
+        return -EINVAL;
+    }
+
+    bs_file = bdrv_co_open_blockdev_ref(dedup_opts->file, errp);
+    if (!bs_file) {
+        return -EIO;
+    }
+
+    /* The image records the path as given, relative to the image file */
+    store = path_combine(bs_file->filename, dedup_opts->store);
+    if (g_mkdir_with_parents(store, 0755) < 0) {
+        ret = -errno;
+        error_setg_errno(errp, -ret, "Could not create chunk store '%s'",
+                         store);
+        goto out;
+    }
+
+    blk = blk_co_new_with_bs(bs_file, BLK_PERM_WRITE | BLK_PERM_RESIZE,
+                             BLK_PERM_ALL, errp);
+    if (!blk) {
+        ret = -EPERM;
+        goto out;
+    }
+    blk_set_allow_write_beyond_eof(blk, true);
+
+    header_buf = g_malloc0(DEDUP_HEADER_SIZE);
+    header = (DedupHeader *)header_buf;
+    *header = (DedupHeader) {
+        .magic          = cpu_to_be32(DEDUP_MAGIC),
+        .version        = cpu_to_be32(DEDUP_VERSION),
+        .size           = cpu_to_be64(dedup_opts->size),
+        .chunk_size     = cpu_to_be32(chunk_size),
+        .store_len      = cpu_to_be32(store_len),
+        .table_offset   = cpu_to_be64(DEDUP_HEADER_SIZE),
+    };
+    memcpy(header_buf + sizeof(*header), dedup_opts->store, store_len);
+
+    ret = blk_co_pwrite(blk, 0, DEDUP_HEADER_SIZE, header_buf, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not write dedup header");
+        goto out;
+    }
+
+    /* An empty chunk table reads as zeroes */
+    ret = blk_co_truncate(blk, DEDUP_HEADER_SIZE +
+                          ROUND_UP(nb_chunks * DEDUP_DIGEST_SIZE,
+                                   BDRV_SECTOR_SIZE),
+                          false, PREALLOC_MODE_OFF, 0, errp);
+    if (ret < 0) {
+        goto out;
+    }
+
+    if (dedup_opts->base) {
+        ret = dedup_co_copy_base(blk, bs_file->filename, dedup_opts->base,
+                                 store, dedup_opts->size, chunk_size, errp);
+        if (ret < 0) {
+            goto out;
+        }
+    }
+
+    ret = 0;
+out:
+    blk_co_unref(blk);
+    bdrv_co_unref(bs_file);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_UNLOCKED
+dedup_co_create_opts(BlockDriver *drv, const char *filename,
+                     QemuOpts *opts, Error **errp)
+{
+    BlockdevCreateOptions *create_options = NULL;
+    BlockDriverState *bs_file = NULL;
+    QDict *qdict;
+    Visitor *v;
+    int ret;
+
+    static const QDictRenames opt_renames[] = {
+        { BLOCK_OPT_CLUSTER_SIZE,       "chunk-size" },
+        { NULL, NULL },
+    };
+
+    qdict = qemu_opts_to_qdict_filtered(opts, NULL, &dedup_create_opts, true);
+    if (!qdict_rename_keys(qdict, opt_renames, errp)) {
+        ret = -EINVAL;
+        goto done;
+    }
+
+    /* Create and open the file (protocol layer) */
+    ret = bdrv_co_create_file(filename, opts, errp);
+    if (ret < 0) {
+        goto done;
+    }
+
+    bs_file = bdrv_co_open(filename, NULL, NULL,
+                           BDRV_O_RDWR | BDRV_O_RESIZE | BDRV_O_PROTOCOL, errp);
+    if (!bs_file) {
+        ret = -EIO;
+        goto done;
+    }
+
+    qdict_put_str(qdict, "driver", "dedup");
+    qdict_put_str(qdict, "file", bs_file->node_name);
+
+    /* Get the QAPI object */
+    v = qobject_input_visitor_new_flat_confused(qdict, errp);
+    if (!v) {
+        ret = -EINVAL;
+        goto done;
+    }
+    visit_type_BlockdevCreateOptions(v, NULL, &create_options, errp);
+    visit_free(v);
+    if (!create_options) {
+        ret = -EINVAL;
+        goto done;
+    }
+
+    /* Silently round up size */
+    create_options->u.dedup.size = ROUND_UP(create_options->u.dedup.size,
+                                            BDRV_SECTOR_SIZE);
+
+    /* Create the dedup image (format layer) */
+    ret = dedup_co_create(create_options, errp);
+done:
+    qobject_unref(qdict);
+    qapi_free_BlockdevCreateOptions(create_options);
+    bdrv_co_unref(bs_file);
+    return ret;
+}
+
+static QemuOptsList dedup_create_opts = {
+    .name = "dedup-create-opts",
+    .head = QTAILQ_HEAD_INITIALIZER(dedup_create_opts.head),
+    .desc = {
+        {
+            .name = BLOCK_OPT_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Virtual disk size"
+        },
+        {
+            .name = DEDUP_OPT_STORE,
+            .type = QEMU_OPT_STRING,
+            .help = "Directory of the chunk store"
+        },
+        {
+            .name = BLOCK_OPT_CLUSTER_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Deduplication chunk size",
+            .def_value_str = stringify(DEDUP_DEFAULT_CHUNK_SIZE)
+        },
+        {
+            .name = DEDUP_OPT_BASE,
+            .type = QEMU_OPT_STRING,
+            .help = "Dedup image whose chunk table the new image starts with"
+        },
+        { /* end of list */ }
+    }
+};
+
+static const char *const dedup_strong_runtime_opts[] = {
+    DEDUP_OPT_STORE,
+
+    NULL
+};
+
+static BlockDriver bdrv_dedup = {
+    .format_name            = "dedup",
+    .instance_size          = sizeof(BDRVDedupState),
+    .bdrv_probe             = dedup_probe,
+    .bdrv_open              = dedup_open,
+    .bdrv_close             = dedup_close,
+    .bdrv_reopen_prepare    = dedup_reopen_prepare,
+    .bdrv_child_perm        = bdrv_default_perms,
+    .bdrv_co_create         = dedup_co_create,
+    .bdrv_co_create_opts    = dedup_co_create_opts,
+    .bdrv_has_zero_init     = dedup_has_zero_init,
+    .bdrv_refresh_limits    = dedup_refresh_limits,
+    .bdrv_co_block_status   = dedup_co_block_status,
+
+    .bdrv_co_preadv         = dedup_co_preadv,
+    .bdrv_co_pwritev        = dedup_co_pwritev,
+    .bdrv_co_pwrite_zeroes  = dedup_co_pwrite_zeroes,
+    .bdrv_co_flush_to_os    = dedup_co_flush_to_os,
+
+    .bdrv_co_get_info       = dedup_co_get_info,
+
+    .is_format              = true,
+    .create_opts            = &dedup_create_opts,
+    .strong_runtime_opts    = dedup_strong_runtime_opts,
+};
+
+static void bdrv_dedup_init(void)
+{
+    bdrv_register(&bdrv_dedup);
+}
+
+block_init(bdrv_dedup_init);
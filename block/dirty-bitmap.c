@@ -95,11 +95,25 @@ BdrvDirtyBitmap *bdrv_find_dirty_bitmap(BlockDriverState *bs, const char *name)
     return NULL;
 }
 
-/* Called with BQL taken.  */
-BdrvDirtyBitmap *bdrv_create_dirty_bitmap(BlockDriverState *bs,
-                                          uint32_t granularity,
-                                          const char *name,
-                                          Error **errp)
+/* Allocate an empty HBitmap of the same kind and granularity as @hb */
+static HBitmap *bdrv_dirty_bitmap_alloc_like(const HBitmap *hb, uint64_t size)
+{
+    if (hbitmap_is_compressed(hb)) {
+        return hbitmap_alloc_compressed(size, hbitmap_granularity(hb));
+    }
+    return hbitmap_alloc(size, hbitmap_granularity(hb));
+}
+
+/*
+ * Create a dirty bitmap; if @compressed is true, it is stored in compressed
+ * form from the start.
+ * Called with BQL taken.
+ */
+BdrvDirtyBitmap *bdrv_create_dirty_bitmap_full(BlockDriverState *bs,
+                                               uint32_t granularity,
+                                               const char *name,
+                                               bool compressed,
+                                               Error **errp)
 {
     int64_t bitmap_size;
     BdrvDirtyBitmap *bitmap;
@@ -124,7 +138,9 @@ BdrvDirtyBitmap *bdrv_create_dirty_bitmap(BlockDriverState *bs,
     }
     bitmap = g_new0(BdrvDirtyBitmap, 1);
     bitmap->bs = bs;
-    bitmap->bitmap = hbitmap_alloc(bitmap_size, ctz32(granularity));
+    bitmap->bitmap = compressed ?
+        hbitmap_alloc_compressed(bitmap_size, ctz32(granularity)) :
+        hbitmap_alloc(bitmap_size, ctz32(granularity));
     bitmap->size = bitmap_size;
     bitmap->name = g_strdup(name);
     bitmap->disabled = false;
@@ -134,6 +150,15 @@ BdrvDirtyBitmap *bdrv_create_dirty_bitmap(BlockDriverState *bs,
     return bitmap;
 }
 
+/* Called with BQL taken.  */
+BdrvDirtyBitmap *bdrv_create_dirty_bitmap(BlockDriverState *bs,
+                                          uint32_t granularity,
+                                          const char *name,
+                                          Error **errp)
+{
+    return bdrv_create_dirty_bitmap_full(bs, granularity, name, false, errp);
+}
+
 int64_t bdrv_dirty_bitmap_size(const BdrvDirtyBitmap *bitmap)
 {
     return bitmap->size;
@@ -224,7 +249,9 @@ int bdrv_dirty_bitmap_create_successor(BdrvDirtyBitmap *bitmap, Error **errp)
 
     /* Create an anonymous successor */
     granularity = bdrv_dirty_bitmap_granularity(bitmap);
-    child = bdrv_create_dirty_bitmap(bitmap->bs, granularity, NULL, errp);
+    child = bdrv_create_dirty_bitmap_full(bitmap->bs, granularity, NULL,
+                                          bdrv_dirty_bitmap_compressed(bitmap),
+                                          errp);
     if (!child) {
         return -1;
     }
@@ -465,6 +492,8 @@ BlockDirtyInfoList *bdrv_query_dirty_bitmaps(BlockDriverState *bs)
         info->recording = bdrv_dirty_bitmap_recording(bm);
         info->busy = bdrv_dirty_bitmap_busy(bm);
         info->persistent = bm->persistent;
+        info->has_compressed = hbitmap_is_compressed(bm->bitmap);
+        info->compressed = info->has_compressed;
         info->has_inconsistent = bm->inconsistent;
         info->inconsistent = bm->inconsistent;
         QAPI_LIST_APPEND(tail, info);
@@ -580,8 +609,7 @@ void bdrv_clear_dirty_bitmap(BdrvDirtyBitmap *bitmap, HBitmap **out)
         hbitmap_reset_all(bitmap->bitmap);
     } else {
         HBitmap *backup = bitmap->bitmap;
-        bitmap->bitmap = hbitmap_alloc(bitmap->size,
-                                       hbitmap_granularity(backup));
+        bitmap->bitmap = bdrv_dirty_bitmap_alloc_like(backup, bitmap->size);
         *out = backup;
     }
     bdrv_dirty_bitmaps_unlock(bitmap->bs);
@@ -750,6 +778,11 @@ void bdrv_dirty_bitmap_skip_store(BdrvDirtyBitmap *bitmap, bool skip)
     bdrv_dirty_bitmaps_unlock(bitmap->bs);
 }
 
+bool bdrv_dirty_bitmap_compressed(const BdrvDirtyBitmap *bitmap)
+{
+    return hbitmap_is_compressed(bitmap->bitmap);
+}
+
 bool bdrv_dirty_bitmap_get_persistence(BdrvDirtyBitmap *bitmap)
 {
     return bitmap->persistent && !bitmap->skip_store;
@@ -875,7 +908,7 @@ void bdrv_dirty_bitmap_merge_internal(BdrvDirtyBitmap *dest,
 
     if (backup) {
         *backup = dest->bitmap;
-        dest->bitmap = hbitmap_alloc(dest->size, hbitmap_granularity(*backup));
+        dest->bitmap = bdrv_dirty_bitmap_alloc_like(*backup, dest->size);
         hbitmap_merge(*backup, src->bitmap, dest->bitmap);
     } else {
         hbitmap_merge(dest->bitmap, src->bitmap, dest->bitmap);
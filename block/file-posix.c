@@ -160,6 +160,9 @@ typedef struct BDRVRawState {
     bool has_write_zeroes:1;
     bool use_linux_aio:1;
     bool use_linux_io_uring:1;
+    bool aio_register_buffers:1;
+    bool use_linux_io_uring_poll:1;
+    int luring_fixed_file; /* fixed file slot of fd in io_uring, or -1 */
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
     bool needs_alignment;
@@ -560,6 +563,18 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+        {
+            .name = "aio-poll",
+            .type = QEMU_OPT_BOOL,
+            .help = "poll the device for AIO completions "
+                    "(io_uring only, default: off)",
+        },
+        {
+            .name = "aio-register-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "register guest memory with the AIO backend "
+                    "(io_uring only, default: off)",
+        },
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -588,6 +603,23 @@ static QemuOptsList raw_runtime_opts = {
 
 static const char *const mutable_opts[] = { "x-check-cache-dropped", NULL };
 
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * Let io_uring access @fd as a fixed file, replacing the previous one.  The
+ * old fd must be unregistered before it is closed, or the rings would keep
+ * its OFD locks alive.
+ */
+static void raw_luring_set_fd(BDRVRawState *s, int fd)
+{
+    luring_unregister_fd(s->luring_fixed_file);
+    s->luring_fixed_file = -1;
+
+    if (s->use_linux_io_uring && fd >= 0) {
+        s->luring_fixed_file = luring_register_fd(fd);
+    }
+}
+#endif
+
 static int raw_open_common(BlockDriverState *bs, QDict *options,
                            int bdrv_flags, int open_flags,
                            bool device, Error **errp)
@@ -640,6 +672,19 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
 #endif
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
+    s->aio_register_buffers = qemu_opt_get_bool(opts, "aio-register-buffers",
+                                                false);
+    if (s->aio_register_buffers && !s->use_linux_io_uring) {
+        error_setg(errp, "aio-register-buffers requires aio=io_uring");
+        ret = -EINVAL;
+        goto fail;
+    }
+    s->use_linux_io_uring_poll = qemu_opt_get_bool(opts, "aio-poll", false);
+    if (s->use_linux_io_uring_poll && !s->use_linux_io_uring) {
+        error_setg(errp, "aio-poll requires aio=io_uring");
+        ret = -EINVAL;
+        goto fail;
+    }
 
     locking = qapi_enum_parse(&OnOffAuto_lookup,
                               qemu_opt_get(opts, "locking"),
@@ -687,6 +732,7 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     raw_parse_flags(bdrv_flags, &s->open_flags, false);
 
     s->fd = -1;
+    s->luring_fixed_file = -1;
     fd = qemu_open(filename, s->open_flags, errp);
     ret = fd < 0 ? -errno : 0;
 
@@ -740,6 +786,19 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
             goto fail;
         }
     }
+    if (s->use_linux_io_uring_poll) {
+        /* Polled io_uring only supports O_DIRECT reads and writes */
+        if (!(s->open_flags & O_DIRECT)) {
+            error_setg(errp, "aio-poll=on was specified, but it requires "
+                             "cache.direct=on, which was not specified.");
+            ret = -EINVAL;
+            goto fail;
+        }
+        if (!aio_setup_linux_io_uring_poll(bdrv_get_aio_context(bs), errp)) {
+            error_prepend(errp, "Unable to use polled io_uring: ");
+            goto fail;
+        }
+    }
 #else
     if (s->use_linux_io_uring) {
         error_setg(errp, "aio=io_uring was specified, but is not supported "
@@ -818,6 +877,9 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
         /* When extending regular files, we get zeros from the OS */
         bs->supported_truncate_flags = BDRV_REQ_ZERO_WRITE;
     }
+#ifdef CONFIG_LINUX_IO_URING
+    raw_luring_set_fd(s, s->fd);
+#endif
     ret = 0;
 fail:
     if (ret < 0 && s->fd != -1) {
@@ -2476,7 +2538,16 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr,
 #ifdef CONFIG_LINUX_IO_URING
     } else if (s->use_linux_io_uring) {
         assert(qiov->size == bytes);
-        ret = luring_co_submit(bs, s->fd, offset, qiov, type);
+        ret = luring_co_submit(bs, s->fd, s->luring_fixed_file, offset, qiov,
+                               type, s->use_linux_io_uring_poll);
+        if (ret == -EOPNOTSUPP && s->use_linux_io_uring_poll) {
+            /* The device has no poll queues, stop polling it */
+            warn_report("'%s' does not support polled I/O, disabling aio-poll",
+                        bs->filename);
+            s->use_linux_io_uring_poll = false;
+            ret = luring_co_submit(bs, s->fd, s->luring_fixed_file, offset,
+                                   qiov, type, false);
+        }
         goto out;
 #endif
 #ifdef CONFIG_LINUX_AIO
@@ -2568,7 +2639,8 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
 
 #ifdef CONFIG_LINUX_IO_URING
     if (s->use_linux_io_uring) {
-        return luring_co_submit(bs, s->fd, 0, NULL, QEMU_AIO_FLUSH);
+        return luring_co_submit(bs, s->fd, s->luring_fixed_file, 0, NULL,
+                                QEMU_AIO_FLUSH, false);
     }
 #endif
     return raw_thread_pool_submit(handle_aiocb_flush, &acb);
@@ -2595,6 +2667,15 @@ static void raw_aio_attach_aio_context(BlockDriverState *bs,
             error_reportf_err(local_err, "Unable to use linux io_uring, "
                                          "falling back to thread pool: ");
             s->use_linux_io_uring = false;
+            s->use_linux_io_uring_poll = false;
+        }
+    }
+    if (s->use_linux_io_uring_poll) {
+        Error *local_err = NULL;
+        if (!aio_setup_linux_io_uring_poll(new_context, &local_err)) {
+            error_reportf_err(local_err, "Unable to use polled io_uring, "
+                                         "falling back to interrupts: ");
+            s->use_linux_io_uring_poll = false;
         }
     }
 #endif
@@ -2607,12 +2688,37 @@ static void raw_close(BlockDriverState *bs)
     if (s->fd >= 0) {
 #if defined(CONFIG_BLKZONED)
         g_free(bs->wps);
+#endif
+#ifdef CONFIG_LINUX_IO_URING
+        raw_luring_set_fd(s, -1);
 #endif
         qemu_close(s->fd);
         s->fd = -1;
     }
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+static bool raw_register_buf(BlockDriverState *bs, void *host, size_t size,
+                             Error **errp)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->aio_register_buffers) {
+        luring_register_buf(host, size);
+    }
+    return true;
+}
+
+static void raw_unregister_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->aio_register_buffers) {
+        luring_unregister_buf(host, size);
+    }
+}
+#endif
+
 /**
  * Truncates the given regular file @fd to @offset and, when growing, fills the
  * new space according to @prealloc.
@@ -3799,6 +3905,9 @@ static void raw_set_perm(BlockDriverState *bs, uint64_t perm, uint64_t shared)
     /* For reopen, we have already switched to the new fd (.bdrv_set_perm is
      * called after .bdrv_reopen_commit) */
     if (s->perm_change_fd && s->fd != s->perm_change_fd) {
+#ifdef CONFIG_LINUX_IO_URING
+        raw_luring_set_fd(s, s->perm_change_fd);
+#endif
         qemu_close(s->fd);
         s->fd = s->perm_change_fd;
         s->open_flags = s->perm_change_flags;
@@ -3897,6 +4006,10 @@ BlockDriver bdrv_file = {
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -4267,6 +4380,10 @@ static BlockDriver bdrv_host_device = {
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -16,6 +16,10 @@
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
 #include "qemu/defer-call.h"
+#include "qemu/lockable.h"
+#include "qemu/rcu.h"
+#include "qemu/rcu_queue.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 #include "sysemu/block-backend.h"
 #include "trace.h"
@@ -26,6 +30,12 @@
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Number of fixed file slots in each ring */
+#define MAX_FIXED_FILES 64
+
+/* The kernel refuses to register buffers larger than 1 GiB */
+#define MAX_FIXED_BUF_SIZE (1 * GiB)
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -50,16 +60,152 @@ typedef struct LuringQueue {
 } LuringQueue;
 
 typedef struct LuringState {
+    /* Freed after a grace period, luring_unregister_fd() walks the rings */
+    struct rcu_head rcu;
+
     AioContext *aio_context;
 
     struct io_uring ring;
 
+    /*
+     * IORING_SETUP_IOPOLL rings only produce completions when polled, so
+     * the AioContext busy polls them while requests are in flight.
+     */
+    bool iopoll;
+    bool busy_poll;
+
     /* No locking required, only accessed from AioContext home thread */
     LuringQueue io_q;
 
     QEMUBH *completion_bh;
+
+    /*
+     * Fixed buffers registered with the ring, sorted by address.  They are
+     * only valid while buf_generation matches the published LuringRegs.
+     */
+    struct iovec *bufs;
+    unsigned int nr_bufs;
+    unsigned int buf_generation;
+
+    /*
+     * Scheduled when the registered regions change, so that an idle ring
+     * does not keep the memory of a removed region pinned.
+     */
+    QEMUBH *refresh_bh;
+
+    /*
+     * fd installed in each fixed file slot, or -1.  Slots are installed
+     * lazily from the home thread, luring_unregister_fd() may clear them
+     * from the main loop.
+     */
+    bool has_fixed_files;
+    int fixed_files[MAX_FIXED_FILES];
+
+    /* Updated under luring_regs.lock, read with RCU */
+    QLIST_ENTRY(LuringState) next;
 } LuringState;
 
+typedef struct LuringBufRegion {
+    void *host;
+    size_t size;
+    unsigned int refcnt;
+} LuringBufRegion;
+
+/*
+ * Buffers and files that rings may register with the kernel.  Registration
+ * requests come from the main loop, which publishes a new copy for each
+ * change.  Rings read the current copy from their own AioContext with RCU,
+ * so submissions never wait for each other or for the main loop.
+ */
+typedef struct LuringRegs {
+    struct rcu_head rcu;
+
+    /* Incremented whenever the registered regions change */
+    unsigned int buf_generation;
+
+    /* fd for each fixed file slot, or -1 if the slot is free */
+    int fixed_files[MAX_FIXED_FILES];
+
+    /* The registered regions cut into fixed buffers, sorted by address */
+    unsigned int nr_bufs;
+    struct iovec bufs[];
+} LuringRegs;
+
+static struct {
+    /* Serializes registration requests */
+    QemuMutex lock;
+
+    /* LuringBufRegion, sorted by host address */
+    GArray *bufs;
+
+    /* Read with RCU */
+    LuringRegs *current;
+    QLIST_HEAD(, LuringState) rings;
+} luring_regs;
+
+static void __attribute__((__constructor__)) luring_regs_init(void)
+{
+    qemu_mutex_init(&luring_regs.lock);
+    luring_regs.bufs = g_array_new(false, false, sizeof(LuringBufRegion));
+    luring_regs.current = g_new0(LuringRegs, 1);
+    for (int i = 0; i < MAX_FIXED_FILES; i++) {
+        luring_regs.current->fixed_files[i] = -1;
+    }
+    QLIST_INIT(&luring_regs.rings);
+}
+
+/*
+ * Returns a copy of the published registrations, with the buffers rebuilt
+ * from luring_regs.bufs, for the caller to modify and publish.
+ *
+ * Called with luring_regs.lock held.
+ */
+static LuringRegs *luring_regs_copy(void)
+{
+    g_autoptr(GArray) iovs = g_array_new(false, false, sizeof(struct iovec));
+    LuringRegs *regs;
+
+    for (guint i = 0; i < luring_regs.bufs->len; i++) {
+        LuringBufRegion *r = &g_array_index(luring_regs.bufs,
+                                            LuringBufRegion, i);
+        size_t done;
+
+        for (done = 0; done < r->size; done += MAX_FIXED_BUF_SIZE) {
+            struct iovec iov = {
+                .iov_base = r->host + done,
+                .iov_len = MIN(r->size - done, MAX_FIXED_BUF_SIZE),
+            };
+            g_array_append_val(iovs, iov);
+        }
+    }
+
+    regs = g_malloc(sizeof(*regs) + iovs->len * sizeof(struct iovec));
+    regs->buf_generation = luring_regs.current->buf_generation;
+    memcpy(regs->fixed_files, luring_regs.current->fixed_files,
+           sizeof(regs->fixed_files));
+    regs->nr_bufs = iovs->len;
+    memcpy(regs->bufs, iovs->data, iovs->len * sizeof(struct iovec));
+    return regs;
+}
+
+/* Called with luring_regs.lock held */
+static void luring_regs_publish(LuringRegs *regs)
+{
+    LuringRegs *old = luring_regs.current;
+
+    qatomic_rcu_set(&luring_regs.current, regs);
+    g_free_rcu(old, rcu);
+}
+
+/* Whether the fixed buffers of @s are missing changes to the regions */
+static bool luring_bufs_stale(LuringState *s)
+{
+    RCU_READ_LOCK_GUARD();
+
+    return s->buf_generation !=
+           qatomic_rcu_read(&luring_regs.current)->buf_generation;
+}
+
 /**
  * luring_resubmit:
  *
@@ -102,12 +248,34 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 
     /* Update sqe */
     luringcb->sqeq.off += nread;
-    luringcb->sqeq.addr = (__u64)(uintptr_t)luringcb->resubmit_qiov.iov;
-    luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        luringcb->sqeq.addr += nread;
+        luringcb->sqeq.len -= nread;
+    } else {
+        luringcb->sqeq.addr = (__u64)(uintptr_t)luringcb->resubmit_qiov.iov;
+        luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
+    }
 
     luring_resubmit(s, luringcb);
 }
 
+/**
+ * luring_update_busy_poll:
+ * @s: AIO state
+ *
+ * Lets the AioContext spin on an IOPOLL ring while it has requests in
+ * flight, and go back to blocking in the fd monitor once it is idle.
+ */
+static void luring_update_busy_poll(LuringState *s)
+{
+    bool busy = s->io_q.in_flight > 0;
+
+    if (s->iopoll && s->busy_poll != busy) {
+        s->busy_poll = busy;
+        aio_set_fd_busy_poll(s->aio_context, s->ring.ring_fd, busy);
+    }
+}
+
 /**
  * luring_process_completions:
  * @s: AIO state
@@ -222,15 +390,31 @@ end:
     }
 
     qemu_bh_cancel(s->completion_bh);
+    luring_update_busy_poll(s);
 
     defer_call_end();
 }
 
+static void luring_refresh_bufs(LuringState *s);
+
 static int ioq_submit(LuringState *s)
 {
     int ret = 0;
     LuringAIOCB *luringcb, *luringcb_next;
 
+    /*
+     * Fixed buffers can only be replaced while no request is in flight, so
+     * a busy ring holds back new requests until it has drained.  The
+     * completions submit the queue again.
+     */
+    if (luring_bufs_stale(s)) {
+        if (s->io_q.in_flight) {
+            s->io_q.blocked = (s->io_q.in_queue > 0);
+            return 0;
+        }
+        luring_refresh_bufs(s);
+    }
+
     while (s->io_q.in_queue > 0) {
         /*
          * Try to fetch sqes from the ring for requests waiting in
@@ -259,6 +443,7 @@ static int ioq_submit(LuringState *s)
         s->io_q.in_queue  -= ret;
     }
     s->io_q.blocked = (s->io_q.in_queue > 0);
+    luring_update_busy_poll(s);
 
     if (s->io_q.in_flight) {
         /*
@@ -274,7 +459,7 @@ static void luring_process_completions_and_submit(LuringState *s)
 {
     luring_process_completions(s);
 
-    if (s->io_q.in_queue > 0) {
+    if (s->io_q.in_queue > 0 || luring_bufs_stale(s)) {
         ioq_submit(s);
     }
 }
@@ -294,7 +479,12 @@ static void qemu_luring_completion_cb(void *opaque)
 static bool qemu_luring_poll_cb(void *opaque)
 {
     LuringState *s = opaque;
+    struct io_uring_cqe *cqe;
 
+    if (s->iopoll) {
+        /* Peeking enters the kernel, which polls the device for completions */
+        return s->io_q.in_flight && io_uring_peek_cqe(&s->ring, &cqe) == 0;
+    }
     return io_uring_cq_ready(&s->ring);
 }
 
@@ -324,8 +514,194 @@ static void luring_deferred_fn(void *opaque)
 }
 
 /**
- * luring_do_submit:
+ * luring_refresh_bufs:
+ * @s: AIO state
+ *
+ * Replaces the fixed buffers of the ring with the currently registered
+ * regions.  Buffer indices change, so this may only be called when no
+ * request is in flight.  Queued requests stop using fixed buffers.
+ */
+static void luring_refresh_bufs(LuringState *s)
+{
+    g_autofree struct iovec *bufs = NULL;
+    unsigned int nr_bufs;
+    LuringAIOCB *luringcb;
+    int ret;
+
+    assert(!s->io_q.in_flight);
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        LuringRegs *regs = qatomic_rcu_read(&luring_regs.current);
+
+        s->buf_generation = regs->buf_generation;
+        nr_bufs = regs->nr_bufs;
+        bufs = g_memdup2(regs->bufs, nr_bufs * sizeof(struct iovec));
+    }
+
+    QSIMPLEQ_FOREACH(luringcb, &s->io_q.submit_queue, next) {
+        struct io_uring_sqe *sqe = &luringcb->sqeq;
+        QEMUIOVector *qiov = luringcb->total_read ? &luringcb->resubmit_qiov
+                                                  : luringcb->qiov;
+
+        if (sqe->opcode == IORING_OP_READ_FIXED) {
+            sqe->opcode = IORING_OP_READV;
+        } else if (sqe->opcode == IORING_OP_WRITE_FIXED) {
+            sqe->opcode = IORING_OP_WRITEV;
+        } else {
+            continue;
+        }
+        sqe->addr = (__u64)(uintptr_t)qiov->iov;
+        sqe->len = qiov->niov;
+        sqe->buf_index = 0;
+    }
+
+    if (s->nr_bufs) {
+        io_uring_unregister_buffers(&s->ring);
+        g_free(s->bufs);
+        s->bufs = NULL;
+        s->nr_bufs = 0;
+    }
+
+    if (nr_bufs) {
+        /*
+         * Registration pins the memory and may fail because of
+         * RLIMIT_MEMLOCK.  Requests then simply keep using readv/writev.
+         */
+        ret = io_uring_register_buffers(&s->ring, bufs, nr_bufs);
+        trace_luring_register_buffers(s, nr_bufs, ret);
+        if (ret == 0) {
+            s->nr_bufs = nr_bufs;
+            s->bufs = g_steal_pointer(&bufs);
+        }
+    }
+}
+
+static void luring_refresh_bh(void *opaque)
+{
+    LuringState *s = opaque;
+
+    if (luring_bufs_stale(s)) {
+        ioq_submit(s);
+    }
+}
+
+/* Called with luring_regs.lock held */
+static void luring_regs_bufs_changed(void)
+{
+    LuringRegs *regs = luring_regs_copy();
+    LuringState *s;
+
+    regs->buf_generation++;
+    luring_regs_publish(regs);
+    QLIST_FOREACH(s, &luring_regs.rings, next) {
+        if (s->refresh_bh) {
+            qemu_bh_schedule(s->refresh_bh);
+        }
+    }
+}
+
+/**
+ * luring_find_buf:
+ * @s: AIO state
+ * @qiov: I/O vector of the request
+ *
+ * Returns the index of the fixed buffer that contains all of @qiov, or -1
+ * if there is none.  Only single-element vectors can use fixed buffers.
+ */
+static int luring_find_buf(LuringState *s, QEMUIOVector *qiov)
+{
+    uintptr_t base, end;
+    unsigned int lo = 0, hi = s->nr_bufs;
+
+    if (qiov->niov != 1 || !s->nr_bufs) {
+        return -1;
+    }
+
+    base = (uintptr_t)qiov->iov[0].iov_base;
+    end = base + qiov->iov[0].iov_len;
+
+    /* Find the last buffer that starts at or below base */
+    while (hi - lo > 1) {
+        unsigned int mid = lo + (hi - lo) / 2;
+
+        if ((uintptr_t)s->bufs[mid].iov_base <= base) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (base >= (uintptr_t)s->bufs[lo].iov_base &&
+        end <= (uintptr_t)s->bufs[lo].iov_base + s->bufs[lo].iov_len) {
+        return lo;
+    }
+    return -1;
+}
+
+static bool luring_fixed_file_registered(int index, int fd)
+{
+    RCU_READ_LOCK_GUARD();
+
+    return qatomic_rcu_read(&luring_regs.current)->fixed_files[index] == fd;
+}
+
+/* Drops the file in fixed file slot @index of the ring */
+static void luring_clear_fixed_file(LuringState *s, int index)
+{
+    int none = -1;
+
+    io_uring_register_files_update(&s->ring, index, &none, 1);
+    qatomic_set(&s->fixed_files[index], -1);
+}
+
+/**
+ * luring_get_fixed_file:
+ * @s: AIO state
+ * @index: fixed file slot returned by luring_register_fd(), or -1
  * @fd: file descriptor for I/O
+ *
+ * Returns true if @fd can be accessed through fixed file slot @index of the
+ * ring, installing it in the slot first if necessary.
+ */
+static bool luring_get_fixed_file(LuringState *s, int index, int fd)
+{
+    int ret;
+
+    if (index < 0 || !s->has_fixed_files) {
+        return false;
+    }
+    if (qatomic_read(&s->fixed_files[index]) == fd) {
+        return true;
+    }
+    if (!luring_fixed_file_registered(index, fd)) {
+        return false;
+    }
+
+    ret = io_uring_register_files_update(&s->ring, index, &fd, 1);
+    trace_luring_install_fixed_file(s, index, fd, ret);
+    if (ret != 1) {
+        s->has_fixed_files = false;
+        return false;
+    }
+    qatomic_set(&s->fixed_files[index], fd);
+
+    /*
+     * luring_unregister_fd() may have missed the slot if it ran since the
+     * check above.  Pairs with smp_mb() in luring_unregister_fd().
+     */
+    smp_mb();
+    if (!luring_fixed_file_registered(index, fd)) {
+        luring_clear_fixed_file(s, index);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * luring_do_submit:
+ * @fd: file descriptor for I/O, or fixed file slot if @fixed_file is true
+ * @fixed_file: whether @fd is a fixed file slot
+ * @buf_index: fixed buffer that contains the request's data, or -1
  * @luringcb: AIO control block
  * @s: AIO state
  * @offset: offset for request
@@ -334,14 +710,21 @@ static void luring_deferred_fn(void *opaque)
  * Fetches sqes from ring, adds to pending queue and preps them
  *
  */
-static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
+static int luring_do_submit(int fd, bool fixed_file, int buf_index,
+                            LuringAIOCB *luringcb, LuringState *s,
                             uint64_t offset, int type)
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    struct iovec *iov = luringcb->qiov ? luringcb->qiov->iov : NULL;
 
     switch (type) {
     case QEMU_AIO_WRITE:
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, iov->iov_base, iov->iov_len,
+                                      offset, buf_index);
+            break;
+        }
         io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
                              luringcb->qiov->niov, offset);
         break;
@@ -350,6 +733,11 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                              luringcb->qiov->niov, offset);
         break;
     case QEMU_AIO_READ:
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, iov->iov_base, iov->iov_len,
+                                     offset, buf_index);
+            break;
+        }
         io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
                             luringcb->qiov->niov, offset);
         break;
@@ -361,6 +749,9 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (fixed_file) {
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -379,21 +770,52 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
     return 0;
 }
 
-int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
-                                  QEMUIOVector *qiov, int type)
+int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, int fixed_fd,
+                                  uint64_t offset, QEMUIOVector *qiov, int type,
+                                  bool iopoll)
 {
     int ret;
     AioContext *ctx = qemu_get_current_aio_context();
-    LuringState *s = aio_get_linux_io_uring(ctx);
+    LuringState *s;
+    bool fixed_file;
+    int buf_index = -1;
     LuringAIOCB luringcb = {
         .co         = qemu_coroutine_self(),
         .ret        = -EINPROGRESS,
         .qiov       = qiov,
         .is_read    = (type == QEMU_AIO_READ),
     };
+
+    /*
+     * IOPOLL rings only support O_DIRECT reads and writes.  Busy polling is
+     * also pointless if the user has disabled polling for the AioContext.
+     */
+    if (iopoll && (type == QEMU_AIO_READ || type == QEMU_AIO_WRITE) &&
+        ctx->poll_max_ns) {
+        s = aio_get_linux_io_uring_poll(ctx);
+    } else {
+        s = aio_get_linux_io_uring(ctx);
+    }
+
     trace_luring_co_submit(bs, s, &luringcb, fd, offset, qiov ? qiov->size : 0,
                            type);
-    ret = luring_do_submit(fd, &luringcb, s, offset, type);
+
+    /*
+     * Stale fixed buffers must not be used because the memory behind them
+     * may have been unmapped.  An idle ring replaces them right away, a busy
+     * one once ioq_submit() has drained it.
+     */
+    if (luring_bufs_stale(s) && !s->io_q.in_flight) {
+        luring_refresh_bufs(s);
+    }
+    if ((type == QEMU_AIO_READ || type == QEMU_AIO_WRITE) &&
+        !luring_bufs_stale(s)) {
+        buf_index = luring_find_buf(s, qiov);
+    }
+
+    fixed_file = luring_get_fixed_file(s, fixed_fd, fd);
+    ret = luring_do_submit(fixed_file ? fixed_fd : fd, fixed_file, buf_index,
+                           &luringcb, s, offset, type);
 
     if (ret < 0) {
         return ret;
@@ -405,11 +827,114 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
     return luringcb.ret;
 }
 
+void luring_register_buf(void *host, size_t size)
+{
+    LuringBufRegion region = {
+        .host = host,
+        .size = size,
+        .refcnt = 1,
+    };
+    guint i;
+
+    QEMU_LOCK_GUARD(&luring_regs.lock);
+
+    for (i = 0; i < luring_regs.bufs->len; i++) {
+        LuringBufRegion *r = &g_array_index(luring_regs.bufs,
+                                            LuringBufRegion, i);
+
+        if (r->host == host && r->size == size) {
+            r->refcnt++;
+            return;
+        }
+        if ((uintptr_t)r->host > (uintptr_t)host) {
+            break;
+        }
+    }
+
+    g_array_insert_val(luring_regs.bufs, i, region);
+    luring_regs_bufs_changed();
+}
+
+void luring_unregister_buf(void *host, size_t size)
+{
+    QEMU_LOCK_GUARD(&luring_regs.lock);
+
+    for (guint i = 0; i < luring_regs.bufs->len; i++) {
+        LuringBufRegion *r = &g_array_index(luring_regs.bufs,
+                                            LuringBufRegion, i);
+
+        if (r->host == host && r->size == size) {
+            if (--r->refcnt == 0) {
+                g_array_remove_index(luring_regs.bufs, i);
+                luring_regs_bufs_changed();
+            }
+            return;
+        }
+    }
+}
+
+int luring_register_fd(int fd)
+{
+    QEMU_LOCK_GUARD(&luring_regs.lock);
+
+    for (int i = 0; i < MAX_FIXED_FILES; i++) {
+        if (luring_regs.current->fixed_files[i] == -1) {
+            LuringRegs *regs = luring_regs_copy();
+
+            regs->fixed_files[i] = fd;
+            luring_regs_publish(regs);
+            return i;
+        }
+    }
+    return -1;
+}
+
+void luring_unregister_fd(int index)
+{
+    LuringRegs *regs;
+    LuringState *s;
+    int fd;
+
+    if (index < 0) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&luring_regs.lock) {
+        regs = luring_regs_copy();
+        fd = regs->fixed_files[index];
+        regs->fixed_files[index] = -1;
+        luring_regs_publish(regs);
+    }
+
+    /* Pairs with smp_mb() in luring_get_fixed_file() */
+    smp_mb();
+
+    /*
+     * The rings hold a reference to the file, which would keep its OFD
+     * locks alive after the caller closes the fd, so drop it right away.
+     * The caller has drained the requests that use the slot.
+     */
+    RCU_READ_LOCK_GUARD();
+    QLIST_FOREACH_RCU(s, &luring_regs.rings, next) {
+        if (qatomic_read(&s->fixed_files[index]) == fd) {
+            luring_clear_fixed_file(s, index);
+        }
+    }
+}
+
 void luring_detach_aio_context(LuringState *s, AioContext *old_context)
 {
+    QEMUBH *refresh_bh;
+
     aio_set_fd_handler(old_context, s->ring.ring_fd,
                        NULL, NULL, NULL, NULL, s);
+    WITH_QEMU_LOCK_GUARD(&luring_regs.lock) {
+        refresh_bh = s->refresh_bh;
+        s->refresh_bh = NULL;
+    }
+    qemu_bh_delete(refresh_bh);
     qemu_bh_delete(s->completion_bh);
+    s->busy_poll = false;
     s->aio_context = NULL;
 }
 
@@ -417,12 +942,15 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
 {
     s->aio_context = new_context;
     s->completion_bh = aio_bh_new(new_context, qemu_luring_completion_bh, s);
+    WITH_QEMU_LOCK_GUARD(&luring_regs.lock) {
+        s->refresh_bh = aio_bh_new(new_context, luring_refresh_bh, s);
+    }
     aio_set_fd_handler(s->aio_context, s->ring.ring_fd,
                        qemu_luring_completion_cb, NULL,
                        qemu_luring_poll_cb, qemu_luring_poll_ready, s);
 }
 
-LuringState *luring_init(Error **errp)
+LuringState *luring_init(bool iopoll, Error **errp)
 {
     int rc;
     LuringState *s = g_new0(LuringState, 1);
@@ -430,21 +958,44 @@ LuringState *luring_init(Error **errp)
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    rc = io_uring_queue_init(MAX_ENTRIES, ring,
+                             iopoll ? IORING_SETUP_IOPOLL : 0);
     if (rc < 0) {
         error_setg_errno(errp, errno, "failed to init linux io_uring ring");
         g_free(s);
         return NULL;
     }
+    s->iopoll = iopoll;
 
     ioq_init(&s->io_q);
+
+    /* Start with empty slots, luring_get_fixed_file() fills them */
+    for (int i = 0; i < MAX_FIXED_FILES; i++) {
+        s->fixed_files[i] = -1;
+    }
+    rc = io_uring_register_files(ring, s->fixed_files, MAX_FIXED_FILES);
+    trace_luring_register_files(s, rc);
+    s->has_fixed_files = (rc == 0);
+
+    WITH_QEMU_LOCK_GUARD(&luring_regs.lock) {
+        QLIST_INSERT_HEAD_RCU(&luring_regs.rings, s, next);
+    }
     return s;
 
 }
 
-void luring_cleanup(LuringState *s)
+static void luring_free(LuringState *s)
 {
     io_uring_queue_exit(&s->ring);
-    trace_luring_cleanup_state(s);
+    g_free(s->bufs);
     g_free(s);
 }
+
+void luring_cleanup(LuringState *s)
+{
+    WITH_QEMU_LOCK_GUARD(&luring_regs.lock) {
+        QLIST_REMOVE_RCU(s, next);
+    }
+    trace_luring_cleanup_state(s);
+    call_rcu(s, luring_free, rcu);
+}
@@ -91,6 +91,7 @@ void qmp_block_dirty_bitmap_add(const char *node, const char *name,
                                 bool has_granularity, uint32_t granularity,
                                 bool has_persistent, bool persistent,
                                 bool has_disabled, bool disabled,
+                                bool has_compressed, bool compressed,
                                 Error **errp)
 {
     BlockDriverState *bs;
@@ -129,13 +130,18 @@ void qmp_block_dirty_bitmap_add(const char *node, const char *name,
         disabled = false;
     }
 
+    if (!has_compressed) {
+        compressed = false;
+    }
+
     if (persistent &&
         !bdrv_can_store_new_dirty_bitmap(bs, name, granularity, errp))
     {
         goto out;
     }
 
-    bitmap = bdrv_create_dirty_bitmap(bs, granularity, name, errp);
+    bitmap = bdrv_create_dirty_bitmap_full(bs, granularity, name, compressed,
+                                           errp);
     if (bitmap == NULL) {
         goto out;
     }
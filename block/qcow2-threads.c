@@ -33,6 +33,7 @@
 #include <zstd_errors.h>
 #endif
 
+#include "qapi/error.h"
 #include "qcow2.h"
 #include "block/block-io.h"
 #include "block/thread-pool.h"
@@ -61,18 +62,53 @@ qcow2_co_process(BlockDriverState *bs, ThreadPoolFunc *func, void *arg)
     return ret;
 }
 
+/*
+ * Same as qcow2_co_process(), but for (de)compression tasks, whose number
+ * is limited separately by the compression-threads option.
+ */
+static int coroutine_fn
+qcow2_co_process_compress(BlockDriverState *bs, ThreadPoolFunc *func,
+                          void *arg)
+{
+    int ret;
+    BDRVQcow2State *s = bs->opaque;
+
+    qemu_co_mutex_lock(&s->lock);
+    while (s->nb_compress_threads >= s->compression_threads) {
+        qemu_co_queue_wait(&s->compress_task_queue, &s->lock);
+    }
+    s->nb_compress_threads++;
+    qemu_co_mutex_unlock(&s->lock);
+
+    ret = thread_pool_submit_co(func, arg);
+
+    qemu_co_mutex_lock(&s->lock);
+    s->nb_compress_threads--;
+    qemu_co_queue_next(&s->compress_task_queue);
+    qemu_co_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
 
 /*
  * Compression
  */
 
+/*
+ * @level is the compression level, 0 for the default of the method.
+ * @dict is the digested dictionary for the method, or NULL.
+ */
 typedef ssize_t (*Qcow2CompressFunc)(void *dest, size_t dest_size,
-                                     const void *src, size_t src_size);
+                                     const void *src, size_t src_size,
+                                     int level, const void *dict);
 typedef struct Qcow2CompressData {
     void *dest;
     size_t dest_size;
     const void *src;
     size_t src_size;
+    int level;
+    const void *dict;
     ssize_t ret;
 
     Qcow2CompressFunc func;
@@ -85,20 +121,25 @@ typedef struct Qcow2CompressData {
  *
  * @dest - destination buffer, @dest_size bytes
  * @src - source buffer, @src_size bytes
+ * @level - compression level, 0 for the zlib default
+ * @dict - unused, zlib compression does not support dictionaries
  *
  * Returns: compressed size on success
  *          -ENOMEM destination buffer is not enough to store compressed data
  *          -EIO    on any other error
  */
 static ssize_t qcow2_zlib_compress(void *dest, size_t dest_size,
-                                   const void *src, size_t src_size)
+                                   const void *src, size_t src_size,
+                                   int level, const void *dict)
 {
     ssize_t ret;
     z_stream strm;
 
-    /* best compression, small window, no zlib header */
+    assert(!dict);
+
+    /* small window, no zlib header */
     memset(&strm, 0, sizeof(strm));
-    ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+    ret = deflateInit2(&strm, level ?: Z_DEFAULT_COMPRESSION, Z_DEFLATED,
                        -12, 9, Z_DEFAULT_STRATEGY);
     if (ret != Z_OK) {
         return -EIO;
@@ -138,7 +179,8 @@ static ssize_t qcow2_zlib_compress(void *dest, size_t dest_size,
  *          -EIO on fail
  */
 static ssize_t qcow2_zlib_decompress(void *dest, size_t dest_size,
-                                     const void *src, size_t src_size)
+                                     const void *src, size_t src_size,
+                                     int level, const void *dict)
 {
     int ret;
     z_stream strm;
@@ -180,13 +222,17 @@ static ssize_t qcow2_zlib_decompress(void *dest, size_t dest_size,
  *
  * @dest - destination buffer, @dest_size bytes
  * @src - source buffer, @src_size bytes
+ * @level - compression level, 0 for the zstd default
+ * @dict - ZSTD_CDict to compress with, or NULL.  The compression level
+ *         of the dictionary takes precedence over @level.
  *
  * Returns: compressed size on success
  *          -ENOMEM destination buffer is not enough to store compressed data
  *          -EIO    on any other error
  */
 static ssize_t qcow2_zstd_compress(void *dest, size_t dest_size,
-                                   const void *src, size_t src_size)
+                                   const void *src, size_t src_size,
+                                   int level, const void *dict)
 {
     ssize_t ret;
     size_t zstd_ret;
@@ -205,6 +251,26 @@ static ssize_t qcow2_zstd_compress(void *dest, size_t dest_size,
     if (!cctx) {
         return -EIO;
     }
+
+    if (dict) {
+        zstd_ret = ZSTD_CCtx_refCDict(cctx, dict);
+        /*
+         * If the dictionary is dropped because the image was modified by
+         * a program that does not know it, reading the cluster must fail
+         * rather than return garbage.
+         */
+        if (!ZSTD_isError(zstd_ret)) {
+            zstd_ret = ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+        }
+    } else {
+        zstd_ret = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+                                          level);
+    }
+    if (ZSTD_isError(zstd_ret)) {
+        ret = -EIO;
+        goto out;
+    }
+
     /*
      * Use the zstd streamed interface for symmetry with decompression,
      * where streaming is essential since we don't record the exact
@@ -254,7 +320,8 @@ out:
  *          -EIO on any error
  */
 static ssize_t qcow2_zstd_decompress(void *dest, size_t dest_size,
-                                     const void *src, size_t src_size)
+                                     const void *src, size_t src_size,
+                                     int level, const void *dict)
 {
     size_t zstd_ret = 0;
     ssize_t ret = 0;
@@ -274,6 +341,11 @@ static ssize_t qcow2_zstd_decompress(void *dest, size_t dest_size,
         return -EIO;
     }
 
+    if (dict && ZSTD_isError(ZSTD_DCtx_refDDict(dctx, dict))) {
+        ZSTD_freeDCtx(dctx);
+        return -EIO;
+    }
+
     /*
      * The compressed stream from the input buffer may consist of more
      * than one zstd frame. So we iterate until we get a fully
@@ -325,29 +397,137 @@ static ssize_t qcow2_zstd_decompress(void *dest, size_t dest_size,
 }
 #endif
 
+int qcow2_max_compression_level(BDRVQcow2State *s)
+{
+    switch (s->compression_type) {
+    case QCOW2_COMPRESSION_TYPE_ZLIB:
+        return Z_BEST_COMPRESSION;
+#ifdef CONFIG_ZSTD
+    case QCOW2_COMPRESSION_TYPE_ZSTD:
+        return ZSTD_maxCLevel();
+#endif
+    default:
+        abort();
+    }
+}
+
+/*
+ * qcow2_compression_dict_new_cdict()
+ *
+ * Digest the compression dictionary loaded from the image for compressing
+ * at @level (0 for the default level of the compression type).  *@cdict
+ * is set to NULL if the image has no dictionary.
+ *
+ * Returns 0 on success, -errno on failure.
+ */
+int qcow2_compression_dict_new_cdict(BDRVQcow2State *s, int level,
+                                     void **cdict, Error **errp)
+{
+    *cdict = NULL;
+    if (!s->compression_dict) {
+        return 0;
+    }
+
+    switch (s->compression_type) {
+#ifdef CONFIG_ZSTD
+    case QCOW2_COMPRESSION_TYPE_ZSTD:
+        *cdict = ZSTD_createCDict(s->compression_dict,
+                                  s->compression_dict_ext.length,
+                                  level ?: ZSTD_CLEVEL_DEFAULT);
+        if (!*cdict) {
+            error_setg(errp, "Could not load the compression dictionary");
+            return -EINVAL;
+        }
+        return 0;
+#endif
+    default:
+        error_setg(errp, "Compression dictionaries are not supported with "
+                   "compression type '%s'",
+                   Qcow2CompressionType_str(s->compression_type));
+        return -ENOTSUP;
+    }
+}
+
+void qcow2_compression_dict_free_cdict(void *cdict)
+{
+#ifdef CONFIG_ZSTD
+    ZSTD_freeCDict(cdict);
+#endif
+}
+
+/*
+ * qcow2_compression_dict_init()
+ *
+ * Digest the compression dictionary loaded from the image, if any, for
+ * use by the compression threads.
+ */
+int qcow2_compression_dict_init(BDRVQcow2State *s, Error **errp)
+{
+    void *cdict;
+    int ret;
+
+    ret = qcow2_compression_dict_new_cdict(s, s->compression_level, &cdict,
+                                           errp);
+    if (ret < 0 || !cdict) {
+        return ret;
+    }
+
+#ifdef CONFIG_ZSTD
+    if (!s->zstd_ddict) {
+        s->zstd_ddict = ZSTD_createDDict(s->compression_dict,
+                                         s->compression_dict_ext.length);
+        if (!s->zstd_ddict) {
+            qcow2_compression_dict_free_cdict(cdict);
+            error_setg(errp, "Could not load the compression dictionary");
+            return -EINVAL;
+        }
+    }
+#endif
+    qcow2_compression_dict_free_cdict(s->zstd_cdict);
+    s->zstd_cdict = cdict;
+    return 0;
+}
+
+void qcow2_compression_dict_cleanup(BDRVQcow2State *s)
+{
+#ifdef CONFIG_ZSTD
+    ZSTD_freeCDict(s->zstd_cdict);
+    ZSTD_freeDDict(s->zstd_ddict);
+#endif
+    s->zstd_cdict = NULL;
+    s->zstd_ddict = NULL;
+    g_free(s->compression_dict);
+    s->compression_dict = NULL;
+}
+
 static int qcow2_compress_pool_func(void *opaque)
 {
     Qcow2CompressData *data = opaque;
 
     data->ret = data->func(data->dest, data->dest_size,
-                           data->src, data->src_size);
+                           data->src, data->src_size,
+                           data->level, data->dict);
 
     return 0;
 }
 
 static ssize_t coroutine_fn
 qcow2_co_do_compress(BlockDriverState *bs, void *dest, size_t dest_size,
-                     const void *src, size_t src_size, Qcow2CompressFunc func)
+                     const void *src, size_t src_size, Qcow2CompressFunc func,
+                     const void *dict)
 {
+    BDRVQcow2State *s = bs->opaque;
     Qcow2CompressData arg = {
         .dest = dest,
         .dest_size = dest_size,
         .src = src,
         .src_size = src_size,
+        .level = s->compression_level,
+        .dict = dict,
         .func = func,
     };
 
-    qcow2_co_process(bs, qcow2_compress_pool_func, &arg);
+    qcow2_co_process_compress(bs, qcow2_compress_pool_func, &arg);
 
     return arg.ret;
 }
@@ -370,6 +550,7 @@ qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2CompressFunc fn;
+    const void *dict = NULL;
 
     switch (s->compression_type) {
     case QCOW2_COMPRESSION_TYPE_ZLIB:
@@ -379,13 +560,14 @@ qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
 #ifdef CONFIG_ZSTD
     case QCOW2_COMPRESSION_TYPE_ZSTD:
         fn = qcow2_zstd_compress;
+        dict = s->zstd_cdict;
         break;
 #endif
     default:
         abort();
     }
 
-    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, fn);
+    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, fn, dict);
 }
 
 /*
@@ -407,6 +589,7 @@ qcow2_co_decompress(BlockDriverState *bs, void *dest, size_t dest_size,
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2CompressFunc fn;
+    const void *dict = NULL;
 
     switch (s->compression_type) {
     case QCOW2_COMPRESSION_TYPE_ZLIB:
@@ -416,13 +599,14 @@ qcow2_co_decompress(BlockDriverState *bs, void *dest, size_t dest_size,
 #ifdef CONFIG_ZSTD
     case QCOW2_COMPRESSION_TYPE_ZSTD:
         fn = qcow2_zstd_decompress;
+        dict = s->zstd_ddict;
         break;
 #endif
     default:
         abort();
     }
 
-    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, fn);
+    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, fn, dict);
 }
 
 
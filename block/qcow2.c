@@ -73,6 +73,8 @@ typedef struct {
 #define  QCOW2_EXT_MAGIC_CRYPTO_HEADER 0x0537be77
 #define  QCOW2_EXT_MAGIC_BITMAPS 0x23852875
 #define  QCOW2_EXT_MAGIC_DATA_FILE 0x44415441
+/* Not part of the qcow2 specification, see qcow2-compression-dict.txt */
+#define  QCOW2_EXT_MAGIC_COMPRESSION_DICT 0x9c4f5e21
 
 static int coroutine_fn
 qcow2_co_preadv_compressed(BlockDriverState *bs,
@@ -327,6 +329,56 @@ qcow2_read_extensions(BlockDriverState *bs, uint64_t start_offset,
             }
         }   break;
 
+        case QCOW2_EXT_MAGIC_COMPRESSION_DICT:
+        {
+            Qcow2CompressionDictExtension *dict_ext = &s->compression_dict_ext;
+
+            if (ext.len != sizeof(*dict_ext)) {
+                error_setg(errp, "compression_dict_ext: "
+                           "Invalid extension length");
+                return -EINVAL;
+            }
+
+            ret = bdrv_co_pread(bs->file, offset, ext.len, dict_ext, 0);
+            if (ret < 0) {
+                error_setg_errno(errp, -ret, "compression_dict_ext: "
+                                 "Could not read ext header");
+                return ret;
+            }
+            dict_ext->offset = be64_to_cpu(dict_ext->offset);
+            dict_ext->length = be32_to_cpu(dict_ext->length);
+
+            if (!(s->autoclear_features & QCOW2_AUTOCLEAR_COMPRESSION_DICT)) {
+                warn_report("a program lacking compression dictionary "
+                            "support modified this file, so the dictionary "
+                            "is dropped and clusters compressed with it "
+                            "can no longer be read");
+                error_printf("Some clusters may be leaked, "
+                             "run 'qemu-img check -r' on the image "
+                             "file to fix.");
+                memset(dict_ext, 0, sizeof(*dict_ext));
+                if (need_update_header != NULL) {
+                    /* Updating is needed to drop the stale extension. */
+                    *need_update_header = true;
+                }
+                break;
+            }
+
+            if (dict_ext->length == 0 ||
+                dict_ext->length > QCOW2_MAX_COMPRESSION_DICT_SIZE) {
+                error_setg(errp, "Invalid compression dictionary size %" PRIu32,
+                           dict_ext->length);
+                return -EINVAL;
+            }
+            if (!QEMU_IS_ALIGNED(dict_ext->offset, s->cluster_size)) {
+                error_setg(errp, "Compression dictionary offset '%" PRIu64
+                           "' is not a multiple of cluster size '%u'",
+                           dict_ext->offset, s->cluster_size);
+                return -EINVAL;
+            }
+            break;
+        }
+
         case QCOW2_EXT_MAGIC_BITMAPS:
             if (ext.len != sizeof(bitmaps_ext)) {
                 error_setg_errno(errp, -ret, "bitmaps_ext: "
@@ -701,6 +753,8 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_COMPRESSION_LEVEL,
+    QCOW2_OPT_COMPRESSION_THREADS,
     NULL
 };
 
@@ -812,6 +866,18 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_SIZE,
             .help = "Maximum refcount block cache size",
         },
+        {
+            .name = QCOW2_OPT_COMPRESSION_LEVEL,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Compression level (0 for the default of the compression "
+                    "type)",
+        },
+        {
+            .name = QCOW2_OPT_COMPRESSION_THREADS,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Maximum number of clusters compressed or decompressed "
+                    "in parallel",
+        },
         {
             .name = QCOW2_OPT_CACHE_CLEAN_INTERVAL,
             .type = QEMU_OPT_NUMBER,
@@ -979,6 +1045,9 @@ typedef struct Qcow2ReopenState {
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
     uint64_t cache_clean_interval;
+    int compression_level;
+    int compression_threads;
+    void *zstd_cdict; /* Dictionary digested for the new compression level */
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -991,6 +1060,7 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
     const char *opt_overlap_check, *opt_overlap_check_template;
     int overlap_check_template = 0;
     uint64_t l2_cache_size, l2_cache_entry_size, refcount_cache_size;
+    uint64_t compression_level, compression_threads;
     int i;
     const char *encryptfmt;
     QDict *encryptopts = NULL;
@@ -1079,6 +1149,38 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    /* Compression options */
+    compression_level = qemu_opt_get_number(opts, QCOW2_OPT_COMPRESSION_LEVEL,
+                                            0);
+    if (compression_level > qcow2_max_compression_level(s)) {
+        error_setg(errp, QCOW2_OPT_COMPRESSION_LEVEL " must be between 0 and "
+                   "%d for compression type '%s'",
+                   qcow2_max_compression_level(s),
+                   Qcow2CompressionType_str(s->compression_type));
+        ret = -EINVAL;
+        goto fail;
+    }
+    r->compression_level = compression_level;
+    if (r->compression_level != s->compression_level) {
+        ret = qcow2_compression_dict_new_cdict(s, r->compression_level,
+                                               &r->zstd_cdict, errp);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    compression_threads = qemu_opt_get_number(opts,
+                                              QCOW2_OPT_COMPRESSION_THREADS,
+                                              QCOW2_MAX_THREADS);
+    if (compression_threads < 1 ||
+        compression_threads > QCOW2_MAX_COMPRESSION_THREADS) {
+        error_setg(errp, QCOW2_OPT_COMPRESSION_THREADS " must be between 1 "
+                   "and %d", QCOW2_MAX_COMPRESSION_THREADS);
+        ret = -EINVAL;
+        goto fail;
+    }
+    r->compression_threads = compression_threads;
+
     /* lazy-refcounts; flush if going from enabled to disabled */
     r->use_lazy_refcounts = qemu_opt_get_bool(opts, QCOW2_OPT_LAZY_REFCOUNTS,
         (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS));
@@ -1245,6 +1347,13 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
         cache_clean_timer_init(bs, bdrv_get_aio_context(bs));
     }
 
+    s->compression_threads = r->compression_threads;
+    s->compression_level = r->compression_level;
+    if (r->zstd_cdict) {
+        qcow2_compression_dict_free_cdict(s->zstd_cdict);
+        s->zstd_cdict = r->zstd_cdict;
+    }
+
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
     s->crypto_opts = r->crypto_opts;
 }
@@ -1258,6 +1367,7 @@ static void qcow2_update_options_abort(BlockDriverState *bs,
     if (r->refcount_block_cache) {
         qcow2_cache_destroy(r->refcount_block_cache);
     }
+    qcow2_compression_dict_free_cdict(r->zstd_cdict);
     qapi_free_QCryptoBlockOpenOptions(r->crypto_opts);
 }
 
@@ -1636,6 +1746,29 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
         goto fail;
     }
 
+    if ((s->autoclear_features & QCOW2_AUTOCLEAR_COMPRESSION_DICT) &&
+        !s->compression_dict_ext.length) {
+        error_setg(errp, "Compression dictionary feature bit is set without "
+                   "the compression dictionary header extension");
+        ret = -EINVAL;
+        goto fail;
+    }
+    if (s->compression_dict_ext.length && !(flags & BDRV_O_NO_IO)) {
+        s->compression_dict = g_malloc(s->compression_dict_ext.length);
+        ret = bdrv_co_pread(bs->file, s->compression_dict_ext.offset,
+                            s->compression_dict_ext.length,
+                            s->compression_dict, 0);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read the compression "
+                             "dictionary");
+            goto fail;
+        }
+    }
+    ret = qcow2_compression_dict_init(s, errp);
+    if (ret < 0) {
+        goto fail;
+    }
+
     if (open_data_file) {
         /* Open external data file */
         bdrv_graph_co_rdunlock();
@@ -1874,6 +2007,7 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
 #endif
 
     qemu_co_queue_init(&s->thread_task_queue);
+    qemu_co_queue_init(&s->compress_task_queue);
 
     return ret;
 
@@ -1901,6 +2035,7 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
     }
     qcrypto_block_free(s->crypto);
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
+    qcow2_compression_dict_cleanup(s);
     return ret;
 }
 
@@ -2797,6 +2932,8 @@ qcow2_do_close(BlockDriverState *bs, bool close_data_file)
     s->crypto = NULL;
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
 
+    qcow2_compression_dict_cleanup(s);
+
     g_free(s->unknown_header_fields);
     cleanup_unknown_header_ext(bs);
 
@@ -3032,11 +3169,26 @@ int qcow2_update_header(BlockDriverState *bs)
         buflen -= ret;
     }
 
+    /* Compression dictionary pointer extension */
+    if (s->compression_dict_ext.length) {
+        Qcow2CompressionDictExtension dict_ext = {
+            .offset = cpu_to_be64(s->compression_dict_ext.offset),
+            .length = cpu_to_be32(s->compression_dict_ext.length),
+        };
+        ret = header_ext_add(buf, QCOW2_EXT_MAGIC_COMPRESSION_DICT,
+                             &dict_ext, sizeof(dict_ext), buflen);
+        if (ret < 0) {
+            goto fail;
+        }
+        buf += ret;
+        buflen -= ret;
+    }
+
     /*
-     * Feature table.  A mere 8 feature names occupies 392 bytes, and
+     * Feature table.  A mere 9 feature names occupies 440 bytes, and
      * when coupled with the v3 minimum header of 104 bytes plus the
-     * 8-byte end-of-extension marker, that would leave only 8 bytes
-     * for a backing file name in an image with 512-byte clusters.
+     * 8-byte end-of-extension marker, that would not even fit in an
+     * image with 512-byte clusters.
      * Thus, we choose to omit this header for cluster sizes 4k and
      * smaller.
      */
@@ -3082,6 +3234,11 @@ int qcow2_update_header(BlockDriverState *bs)
                 .bit  = QCOW2_AUTOCLEAR_DATA_FILE_RAW_BITNR,
                 .name = "raw external data",
             },
+            {
+                .type = QCOW2_FEAT_TYPE_AUTOCLEAR,
+                .bit  = QCOW2_AUTOCLEAR_COMPRESSION_DICT_BITNR,
+                .name = "compression dictionary",
+            },
         };
 
         ret = header_ext_add(buf, QCOW2_EXT_MAGIC_FEATURE_TABLE,
@@ -3233,6 +3390,71 @@ qcow2_set_up_encryption(BlockDriverState *bs,
     return ret;
 }
 
+static int coroutine_fn GRAPH_RDLOCK
+qcow2_set_up_compression_dict(BlockDriverState *bs, const char *filename,
+                              Error **errp)
+{
+    BDRVQcow2State *s = bs->opaque;
+    g_autofree char *dict = NULL;
+    g_autoptr(GError) gerr = NULL;
+    gsize len;
+    int64_t offset;
+    int ret;
+
+    if (!g_file_get_contents(filename, &dict, &len, &gerr)) {
+        error_setg(errp, "Could not read compression dictionary: %s",
+                   gerr->message);
+        return -EIO;
+    }
+    if (len == 0 || len > QCOW2_MAX_COMPRESSION_DICT_SIZE) {
+        error_setg(errp, "Compression dictionary must be between 1 and %"
+                   PRId64 " bytes long", QCOW2_MAX_COMPRESSION_DICT_SIZE);
+        return -EINVAL;
+    }
+
+    /* Make sure that zstd accepts it before it goes into the image */
+    g_free(s->compression_dict);
+    s->compression_dict = g_steal_pointer(&dict);
+    s->compression_dict_ext.length = len;
+    ret = qcow2_compression_dict_init(s, errp);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    offset = qcow2_alloc_clusters(bs, len);
+    if (offset < 0) {
+        error_setg_errno(errp, -offset, "Could not allocate clusters for "
+                         "the compression dictionary");
+        ret = offset;
+        goto fail;
+    }
+
+    ret = bdrv_co_pwrite(bs->file, offset, len, s->compression_dict, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not write compression dictionary");
+        goto fail_free;
+    }
+
+    s->compression_dict_ext.offset = offset;
+    s->autoclear_features |= QCOW2_AUTOCLEAR_COMPRESSION_DICT;
+    ret = qcow2_update_header(bs);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not write compression dictionary "
+                         "header extension");
+        s->autoclear_features &= ~QCOW2_AUTOCLEAR_COMPRESSION_DICT;
+        goto fail_free;
+    }
+
+    return 0;
+
+fail_free:
+    qcow2_free_clusters(bs, offset, len, QCOW2_DISCARD_ALWAYS);
+fail:
+    qcow2_compression_dict_cleanup(s);
+    memset(&s->compression_dict_ext, 0, sizeof(s->compression_dict_ext));
+    return ret;
+}
+
 /**
  * Preallocates metadata structures for data clusters between @offset (in the
  * guest disk) and @new_length (which is thus generally the new guest disk
@@ -3686,6 +3908,14 @@ qcow2_co_create(BlockdevCreateOptions *create_options, Error **errp)
         compression_type = qcow2_opts->compression_type;
     }
 
+    if (qcow2_opts->compression_dict &&
+        compression_type != QCOW2_COMPRESSION_TYPE_ZSTD) {
+        error_setg(errp, "Compression dictionaries are only supported with "
+                   "compression type zstd");
+        ret = -EINVAL;
+        goto out;
+    }
+
     /* Create BlockBackend to write to the image */
     blk = blk_co_new_with_bs(bs, BLK_PERM_WRITE | BLK_PERM_RESIZE, BLK_PERM_ALL,
                              errp);
@@ -3846,6 +4076,18 @@ qcow2_co_create(BlockdevCreateOptions *create_options, Error **errp)
         }
     }
 
+    /* Want a compression dictionary? There you go. */
+    if (qcow2_opts->compression_dict) {
+        bdrv_graph_co_rdlock();
+        ret = qcow2_set_up_compression_dict(blk_bs(blk),
+                                            qcow2_opts->compression_dict, errp);
+        bdrv_graph_co_rdunlock();
+
+        if (ret < 0) {
+            goto out;
+        }
+    }
+
     blk_co_unref(blk);
     blk = NULL;
 
@@ -3930,6 +4172,7 @@ qcow2_co_create_opts(BlockDriver *drv, const char *filename, QemuOpts *opts,
         { BLOCK_OPT_COMPAT_LEVEL,       "version" },
         { BLOCK_OPT_DATA_FILE_RAW,      "data-file-raw" },
         { BLOCK_OPT_COMPRESSION_TYPE,   "compression-type" },
+        { BLOCK_OPT_COMPRESSION_DICT,   "compression-dict" },
         { NULL, NULL },
     };
 
@@ -5006,13 +5249,15 @@ static int GRAPH_RDLOCK qcow2_make_empty(BlockDriverState *bs)
     l1_clusters = DIV_ROUND_UP(s->l1_size, s->cluster_size / L1E_SIZE);
 
     if (s->qcow_version >= 3 && !s->snapshots && !s->nb_bitmaps &&
+        !s->compression_dict_ext.length &&
         3 + l1_clusters <= s->refcount_block_size &&
         s->crypt_method_header != QCOW_CRYPT_LUKS &&
         !has_data_file(bs)) {
         /* The following function only works for qcow2 v3 images (it
          * requires the dirty flag) and only as long as there are no
          * features that reserve extra clusters (such as snapshots,
-         * LUKS header, or persistent bitmaps), because it completely
+         * LUKS header, persistent bitmaps, or a compression
+         * dictionary), because it completely
          * empties the image.  Furthermore, the L1 table and three
          * additional clusters (image header, refcount table, one
          * refcount block) have to fit inside one refcount block. It
@@ -5062,6 +5307,7 @@ static BlockMeasureInfo *qcow2_measure(QemuOpts *opts, BlockDriverState *in_bs,
     uint64_t refcount_bits;
     uint64_t l2_tables;
     uint64_t luks_payload_size = 0;
+    uint64_t compression_dict_size = 0;
     size_t cluster_size;
     int version;
     char *optstr;
@@ -5127,6 +5373,20 @@ static BlockMeasureInfo *qcow2_measure(QemuOpts *opts, BlockDriverState *in_bs,
         luks_payload_size = ROUND_UP(headerlen, cluster_size);
     }
 
+    optstr = qemu_opt_get_del(opts, BLOCK_OPT_COMPRESSION_DICT);
+    if (optstr) {
+        struct stat st;
+
+        if (stat(optstr, &st) < 0) {
+            error_setg_errno(&local_err, errno, "Could not access "
+                             "compression dictionary '%s'", optstr);
+            g_free(optstr);
+            goto err;
+        }
+        compression_dict_size = ROUND_UP(st.st_size, cluster_size);
+        g_free(optstr);
+    }
+
     virtual_size = qemu_opt_get_size_del(opts, BLOCK_OPT_SIZE, 0);
     virtual_size = ROUND_UP(virtual_size, cluster_size);
 
@@ -5196,7 +5456,7 @@ static BlockMeasureInfo *qcow2_measure(QemuOpts *opts, BlockDriverState *in_bs,
     }
 
     info = g_new0(BlockMeasureInfo, 1);
-    info->fully_allocated = luks_payload_size +
+    info->fully_allocated = luks_payload_size + compression_dict_size +
         qcow2_calc_prealloc_size(virtual_size, cluster_size,
                                  ctz32(refcount_bits), extended_l2);
 
@@ -5311,6 +5571,21 @@ qcow2_get_specific_info(BlockDriverState *bs, Error **errp)
     return spec_info;
 }
 
+static BlockStatsSpecific *qcow2_get_specific_stats(BlockDriverState *bs)
+{
+    BlockStatsSpecific *stats = g_new(BlockStatsSpecific, 1);
+    BDRVQcow2State *s = bs->opaque;
+
+    stats->driver = BLOCKDEV_DRIVER_QCOW2;
+    stats->u.qcow2.l2_cache = g_new(Qcow2CacheStats, 1);
+    stats->u.qcow2.refcount_cache = g_new(Qcow2CacheStats, 1);
+    qcow2_cache_get_stats(s->l2_table_cache, stats->u.qcow2.l2_cache);
+    qcow2_cache_get_stats(s->refcount_block_cache,
+                          stats->u.qcow2.refcount_cache);
+
+    return stats;
+}
+
 static int coroutine_mixed_fn GRAPH_RDLOCK
 qcow2_has_zero_init(BlockDriverState *bs)
 {
@@ -6097,6 +6372,12 @@ static QemuOptsList qcow2_create_opts = {
             .help = "Compression method used for image cluster "        \
                     "compression",                                      \
             .def_value_str = "zlib"                                     \
+        },                                                              \
+        {                                                               \
+            .name = BLOCK_OPT_COMPRESSION_DICT,                         \
+            .type = QEMU_OPT_STRING,                                    \
+            .help = "File with a zstd dictionary to store in the image "\
+                    "(compression_type=zstd only)",                     \
         },
         QCOW_COMMON_OPTIONS,
         { /* end of list */ }
@@ -6160,6 +6441,7 @@ BlockDriver bdrv_qcow2 = {
     .bdrv_measure                       = qcow2_measure,
     .bdrv_co_get_info                   = qcow2_co_get_info,
     .bdrv_get_specific_info             = qcow2_get_specific_info,
+    .bdrv_get_specific_stats            = qcow2_get_specific_stats,
 
     .bdrv_co_save_vmstate               = qcow2_co_save_vmstate,
     .bdrv_co_load_vmstate               = qcow2_co_load_vmstate,
@@ -150,6 +150,8 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_COMPRESSION_LEVEL "compression-level"
+#define QCOW2_OPT_COMPRESSION_THREADS "compression-threads"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -236,6 +238,12 @@ typedef struct Qcow2CryptoHeaderExtension {
     uint64_t length;
 } QEMU_PACKED Qcow2CryptoHeaderExtension;
 
+typedef struct Qcow2CompressionDictExtension {
+    uint64_t offset;
+    uint32_t length;
+    uint32_t reserved;
+} QEMU_PACKED Qcow2CompressionDictExtension;
+
 typedef struct Qcow2UnknownHeaderExtension {
     uint32_t magic;
     uint32_t len;
@@ -277,15 +285,23 @@ enum {
     QCOW2_COMPAT_FEAT_MASK            = QCOW2_COMPAT_LAZY_REFCOUNTS,
 };
 
-/* Autoclear feature bits */
+/*
+ * Autoclear feature bits.  The compression dictionary is not part of the
+ * qcow2 specification, so its bit is taken from the top of the range that
+ * is used upstream.
+ */
 enum {
     QCOW2_AUTOCLEAR_BITMAPS_BITNR       = 0,
     QCOW2_AUTOCLEAR_DATA_FILE_RAW_BITNR = 1,
+    QCOW2_AUTOCLEAR_COMPRESSION_DICT_BITNR = 30,
     QCOW2_AUTOCLEAR_BITMAPS             = 1 << QCOW2_AUTOCLEAR_BITMAPS_BITNR,
     QCOW2_AUTOCLEAR_DATA_FILE_RAW       = 1 << QCOW2_AUTOCLEAR_DATA_FILE_RAW_BITNR,
+    QCOW2_AUTOCLEAR_COMPRESSION_DICT    =
+        1 << QCOW2_AUTOCLEAR_COMPRESSION_DICT_BITNR,
 
     QCOW2_AUTOCLEAR_MASK                = QCOW2_AUTOCLEAR_BITMAPS
-                                        | QCOW2_AUTOCLEAR_DATA_FILE_RAW,
+                                        | QCOW2_AUTOCLEAR_DATA_FILE_RAW
+                                        | QCOW2_AUTOCLEAR_COMPRESSION_DICT,
 };
 
 enum qcow2_discard_type {
@@ -324,6 +340,12 @@ typedef struct Qcow2BitmapHeaderExt {
 
 #define QCOW2_MAX_THREADS 4
 
+/* Maximum number of compression tasks per image that run in parallel */
+#define QCOW2_MAX_COMPRESSION_THREADS 64
+
+/* Maximum size of a compression dictionary */
+#define QCOW2_MAX_COMPRESSION_DICT_SIZE (1 * MiB)
+
 typedef struct BDRVQcow2State {
     int cluster_bits;
     int cluster_size;
@@ -411,6 +433,11 @@ typedef struct BDRVQcow2State {
     CoQueue thread_task_queue;
     int nb_threads;
 
+    CoQueue compress_task_queue;
+    int nb_compress_threads;
+    int compression_threads;
+    int compression_level; /* 0 for the default of the compression type */
+
     BdrvChild *data_file;
 
     bool metadata_preallocation_checked;
@@ -422,6 +449,16 @@ typedef struct BDRVQcow2State {
      * is to convert the image with the desired compression type set.
      */
     Qcow2CompressionType compression_type;
+
+    /*
+     * Dictionary shared by all compressed clusters, stored in the image
+     * if QCOW2_AUTOCLEAR_COMPRESSION_DICT is set. zstd_cdict and zstd_ddict
+     * are the digested forms used by the compression threads.
+     */
+    Qcow2CompressionDictExtension compression_dict_ext;
+    void *compression_dict;
+    void *zstd_cdict;
+    void *zstd_ddict;
 } BDRVQcow2State;
 
 typedef struct Qcow2COWRegion {
@@ -1021,6 +1058,7 @@ qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
+void qcow2_cache_get_stats(Qcow2Cache *c, Qcow2CacheStats *stats);
 
 /* qcow2-bitmap.c functions */
 int coroutine_fn GRAPH_RDLOCK
@@ -1064,6 +1102,13 @@ qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
 ssize_t coroutine_fn
 qcow2_co_decompress(BlockDriverState *bs, void *dest, size_t dest_size,
                     const void *src, size_t src_size);
+
+int qcow2_max_compression_level(BDRVQcow2State *s);
+int qcow2_compression_dict_init(BDRVQcow2State *s, Error **errp);
+int qcow2_compression_dict_new_cdict(BDRVQcow2State *s, int level,
+                                     void **cdict, Error **errp);
+void qcow2_compression_dict_free_cdict(void *cdict);
+void qcow2_compression_dict_cleanup(BDRVQcow2State *s);
 int coroutine_fn
 qcow2_co_encrypt(BlockDriverState *bs, uint64_t host_offset,
                  uint64_t guest_offset, void *buf, size_t len);
@@ -0,0 +1,977 @@
+/*
+ * Persistent read cache filter driver
+ *
+ * The filter keeps a copy of the data read from its file child, typically a
+ * slow network protocol, in a cache file on fast local storage.  The cache
+ * file consists of a header, an index that maps each cache slot to the block
+ * of the image it holds, and the slots themselves.  The index is kept in
+ * memory and only written back when the cache is flushed or closed; before
+ * the first slot is modified after that, the header is marked dirty, so that
+ * a cache that was not closed cleanly is dropped on the next open instead of
+ * returning stale data.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/util.h"
+#include "block/block-io.h"
+#include "block/block_int.h"
+#include "block/qdict.h"
+#include "qemu/bswap.h"
+#include "qemu/coroutine.h"
+#include "qemu/host-utils.h"
+#include "qemu/lockable.h"
+#include "qemu/memalign.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "trace.h"
+
+#define READ_CACHE_MAGIC    (('Q' << 24) | ('R' << 16) | ('C' << 8) | 'H')
+#define READ_CACHE_VERSION  1
+
+#define READ_CACHE_FLAG_DIRTY   (1 << 0)
+
+/* The index starts right after the header */
+#define READ_CACHE_HEADER_SIZE  4096
+
+#define READ_CACHE_MIN_BLOCK_SIZE       (4 * KiB)
+#define READ_CACHE_MAX_BLOCK_SIZE       (2 * MiB)
+#define READ_CACHE_DEFAULT_BLOCK_SIZE   (64 * KiB)
+#define READ_CACHE_DEFAULT_SIZE         (1 * GiB)
+
+/* Limits the in-memory slot table to about 160 MiB */
+#define READ_CACHE_MAX_SLOTS    (4 * MiB)
+
+/* Misses are not cached while this many fills are still running */
+#define READ_CACHE_MAX_FILLS    64
+
+#define READ_CACHE_OPT_CACHE_SIZE   "cache-size"
+#define READ_CACHE_OPT_BLOCK_SIZE   "block-size"
+#define READ_CACHE_OPT_EVICTION     "eviction"
+
+typedef struct ReadCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t block_size;
+    uint64_t nb_slots;
+    uint64_t source_size;
+    uint64_t index_offset;  /* per slot: cached block number + 1, or 0 */
+    uint64_t data_offset;
+} QEMU_PACKED ReadCacheHeader;
+
+typedef enum ReadCacheSlotState {
+    READ_CACHE_SLOT_EMPTY,
+    READ_CACHE_SLOT_FILLING,    /* being written, reads still miss */
+    READ_CACHE_SLOT_VALID,
+    READ_CACHE_SLOT_STALE,      /* invalidated, freed by its last user */
+} ReadCacheSlotState;
+
+typedef struct ReadCacheSlot {
+    uint64_t block;
+    ReadCacheSlotState state;
+    unsigned readers;
+    QTAILQ_ENTRY(ReadCacheSlot) next;
+} ReadCacheSlot;
+
+typedef struct BDRVReadCacheState {
+    BdrvChild *cache_file;
+
+    uint32_t block_size;
+    uint64_t nb_slots;
+    uint64_t source_size;
+    uint64_t index_offset;
+    uint64_t data_offset;
+    ReadCacheEviction eviction;
+
+    /* Protects the slots and the statistics */
+    QemuMutex lock;
+    ReadCacheSlot *slots;
+    /* Block number -> slot, for slots that are filling or valid */
+    GHashTable *blocks;
+    QTAILQ_HEAD(, ReadCacheSlot) free_slots;
+    /* Valid slots, in the order in which they are evicted */
+    QTAILQ_HEAD(, ReadCacheSlot) lru;
+    /* Incremented around every write, so that racing misses are not cached */
+    uint64_t write_gen;
+    unsigned fills_in_flight;
+    BlockStatsSpecificReadCache stats;
+
+    /*
+     * Slots and the source may only be modified while the header on disk is
+     * marked dirty.  Writers hold meta_lock shared, checkpoints exclusively.
+     */
+    CoRwlock meta_lock;
+    CoMutex dirty_lock;
+    bool dirty;
+} BDRVReadCacheState;
+
+typedef struct ReadCacheFill {
+    BlockDriverState *bs;
+    ReadCacheSlot *slot;
+    void *buf;
+    int64_t len;
+} ReadCacheFill;
+
+static QemuOptsList read_cache_runtime_opts = {
+    .name = "read-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(read_cache_runtime_opts.head),
+    .desc = {
+        {
+            .name = READ_CACHE_OPT_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Amount of data to cache, default 1G",
+        },
+        {
+            .name = READ_CACHE_OPT_BLOCK_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Caching granularity, default 64k",
+        },
+        {
+            .name = READ_CACHE_OPT_EVICTION,
+            .type = QEMU_OPT_STRING,
+            .help = "Eviction policy (lru, fifo), default lru",
+        },
+        { /* end of list */ }
+    },
+};
+
+static uint64_t read_cache_slot_offset(BDRVReadCacheState *s,
+                                       ReadCacheSlot *slot)
+{
+    return s->data_offset + (slot - s->slots) * (uint64_t)s->block_size;
+}
+
+/* Called with s->lock held */
+static void read_cache_free_slot(BDRVReadCacheState *s, ReadCacheSlot *slot)
+{
+    slot->state = READ_CACHE_SLOT_EMPTY;
+    QTAILQ_INSERT_TAIL(&s->free_slots, slot, next);
+}
+
+/*
+ * Drop a slot that is filling or valid from the cache. Slots that are still
+ * in use are freed once the last reader or the fill is done with them.
+ *
+ * Called with s->lock held.
+ */
+static void read_cache_drop_slot(BDRVReadCacheState *s, ReadCacheSlot *slot)
+{
+    g_hash_table_remove(s->blocks, &slot->block);
+
+    if (slot->state == READ_CACHE_SLOT_VALID) {
+        QTAILQ_REMOVE(&s->lru, slot, next);
+        s->stats.used_blocks--;
+        if (!slot->readers) {
+            read_cache_free_slot(s, slot);
+            return;
+        }
+    }
+    slot->state = READ_CACHE_SLOT_STALE;
+}
+
+/*
+ * Find a slot for a new block, evicting an unused valid slot if the cache
+ * is full.
+ *
+ * Called with s->lock held.
+ */
+static ReadCacheSlot *read_cache_alloc_slot(BDRVReadCacheState *s)
+{
+    ReadCacheSlot *slot = QTAILQ_FIRST(&s->free_slots);
+
+    if (slot) {
+        QTAILQ_REMOVE(&s->free_slots, slot, next);
+        return slot;
+    }
+
+    QTAILQ_FOREACH(slot, &s->lru, next) {
+        if (!slot->readers) {
+            read_cache_drop_slot(s, slot);
+            QTAILQ_REMOVE(&s->free_slots, slot, next);
+            s->stats.evictions++;
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Look up the slot caching @block. If it is valid, it is returned with a
+ * reader reference that must be dropped with read_cache_put_slot().
+ */
+static ReadCacheSlot *read_cache_get_slot(BDRVReadCacheState *s,
+                                          uint64_t block)
+{
+    ReadCacheSlot *slot;
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    slot = g_hash_table_lookup(s->blocks, &block);
+    if (!slot || slot->state != READ_CACHE_SLOT_VALID) {
+        return NULL;
+    }
+
+    slot->readers++;
+    if (s->eviction == READ_CACHE_EVICTION_LRU) {
+        QTAILQ_REMOVE(&s->lru, slot, next);
+        QTAILQ_INSERT_TAIL(&s->lru, slot, next);
+    }
+    return slot;
+}
+
+static void read_cache_put_slot(BDRVReadCacheState *s, ReadCacheSlot *slot,
+                                bool drop)
+{
+    QEMU_LOCK_GUARD(&s->lock);
+
+    slot->readers--;
+    if (drop && slot->state == READ_CACHE_SLOT_VALID) {
+        read_cache_drop_slot(s, slot);
+    } else if (!slot->readers && slot->state == READ_CACHE_SLOT_STALE) {
+        read_cache_free_slot(s, slot);
+    }
+}
+
+/* Drop all cached blocks that intersect [offset, offset + bytes) */
+static void read_cache_invalidate(BDRVReadCacheState *s, int64_t offset,
+                                  int64_t bytes)
+{
+    uint64_t first = offset / s->block_size;
+    uint64_t last = (offset + bytes - 1) / s->block_size;
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    s->write_gen++;
+
+    if (last - first >= s->nb_slots) {
+        for (uint64_t i = 0; i < s->nb_slots; i++) {
+            ReadCacheSlot *slot = &s->slots[i];
+
+            if ((slot->state == READ_CACHE_SLOT_VALID ||
+                 slot->state == READ_CACHE_SLOT_FILLING) &&
+                slot->block >= first && slot->block <= last) {
+                read_cache_drop_slot(s, slot);
+                s->stats.invalidations++;
+            }
+        }
+        return;
+    }
+
+    for (uint64_t block = first; block <= last; block++) {
+        ReadCacheSlot *slot = g_hash_table_lookup(s->blocks, &block);
+
+        if (slot) {
+            read_cache_drop_slot(s, slot);
+            s->stats.invalidations++;
+        }
+    }
+}
+
+static int coroutine_mixed_fn GRAPH_RDLOCK
+read_cache_write_header(BlockDriverState *bs, bool dirty)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    ReadCacheHeader header = {
+        .magic          = cpu_to_be32(READ_CACHE_MAGIC),
+        .version        = cpu_to_be32(READ_CACHE_VERSION),
+        .flags          = cpu_to_be32(dirty ? READ_CACHE_FLAG_DIRTY : 0),
+        .block_size     = cpu_to_be32(s->block_size),
+        .nb_slots       = cpu_to_be64(s->nb_slots),
+        .source_size    = cpu_to_be64(s->source_size),
+        .index_offset   = cpu_to_be64(s->index_offset),
+        .data_offset    = cpu_to_be64(s->data_offset),
+    };
+
+    return bdrv_pwrite(s->cache_file, 0, sizeof(header), &header, 0);
+}
+
+/*
+ * Mark the cache file dirty before the first modification of a slot or of
+ * the source after a checkpoint. Must be called with meta_lock held shared.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_mark_dirty(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret = 0;
+
+    if (s->dirty) {
+        return 0;
+    }
+
+    qemu_co_mutex_lock(&s->dirty_lock);
+    if (!s->dirty) {
+        ret = read_cache_write_header(bs, true);
+        if (ret >= 0) {
+            ret = bdrv_co_flush(s->cache_file->bs);
+        }
+        if (ret >= 0) {
+            s->dirty = true;
+        }
+    }
+    qemu_co_mutex_unlock(&s->dirty_lock);
+
+    return ret;
+}
+
+/*
+ * Write the index and mark the cache file clean. Must be called with
+ * meta_lock held exclusively, or with no requests in flight.
+ */
+static int coroutine_mixed_fn GRAPH_RDLOCK
+read_cache_checkpoint(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    g_autofree uint64_t *index = NULL;
+    int ret;
+
+    if (!s->dirty) {
+        return 0;
+    }
+
+    index = g_new0(uint64_t, s->nb_slots);
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        for (uint64_t i = 0; i < s->nb_slots; i++) {
+            if (s->slots[i].state == READ_CACHE_SLOT_VALID) {
+                index[i] = cpu_to_be64(s->slots[i].block + 1);
+            }
+        }
+    }
+
+    /* The flush also makes the data of all valid slots stable */
+    ret = bdrv_pwrite(s->cache_file, s->index_offset,
+                      s->nb_slots * sizeof(uint64_t), index, 0);
+    if (ret >= 0) {
+        ret = bdrv_flush(s->cache_file->bs);
+    }
+    if (ret >= 0) {
+        ret = read_cache_write_header(bs, false);
+    }
+    if (ret >= 0) {
+        ret = bdrv_flush(s->cache_file->bs);
+    }
+    if (ret >= 0) {
+        s->dirty = false;
+    }
+
+    trace_read_cache_checkpoint(bs, ret);
+    return ret;
+}
+
+/*
+ * Load the index of a cache file that was closed cleanly with the same
+ * geometry. Anything else leaves the cache empty.
+ */
+static int GRAPH_RDLOCK read_cache_load(BlockDriverState *bs, Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    uint64_t nb_blocks = DIV_ROUND_UP(s->source_size, s->block_size);
+    g_autofree uint64_t *index = NULL;
+    ReadCacheHeader header;
+    int64_t len;
+    int ret;
+
+    len = bdrv_getlength(s->cache_file->bs);
+    if (len < 0) {
+        error_setg_errno(errp, -len, "Could not get cache file length");
+        return len;
+    }
+    if (len < s->index_offset + s->nb_slots * sizeof(uint64_t)) {
+        trace_read_cache_discard(bs);
+        return 0;
+    }
+
+    ret = bdrv_pread(s->cache_file, 0, sizeof(header), &header, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read cache file header");
+        return ret;
+    }
+
+    if (be32_to_cpu(header.magic) != READ_CACHE_MAGIC ||
+        be32_to_cpu(header.version) != READ_CACHE_VERSION ||
+        (be32_to_cpu(header.flags) & READ_CACHE_FLAG_DIRTY) ||
+        be32_to_cpu(header.block_size) != s->block_size ||
+        be64_to_cpu(header.nb_slots) != s->nb_slots ||
+        be64_to_cpu(header.source_size) != s->source_size ||
+        be64_to_cpu(header.index_offset) != s->index_offset ||
+        be64_to_cpu(header.data_offset) != s->data_offset) {
+        trace_read_cache_discard(bs);
+        return 0;
+    }
+
+    index = g_new(uint64_t, s->nb_slots);
+    ret = bdrv_pread(s->cache_file, s->index_offset,
+                     s->nb_slots * sizeof(uint64_t), index, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read cache file index");
+        return ret;
+    }
+
+    for (uint64_t i = 0; i < s->nb_slots; i++) {
+        ReadCacheSlot *slot = &s->slots[i];
+        uint64_t entry = be64_to_cpu(index[i]);
+
+        if (!entry || entry - 1 >= nb_blocks) {
+            continue;
+        }
+        slot->block = entry - 1;
+        if (g_hash_table_contains(s->blocks, &slot->block)) {
+            continue;
+        }
+
+        QTAILQ_REMOVE(&s->free_slots, slot, next);
+        slot->state = READ_CACHE_SLOT_VALID;
+        g_hash_table_insert(s->blocks, &slot->block, slot);
+        QTAILQ_INSERT_TAIL(&s->lru, slot, next);
+        s->stats.used_blocks++;
+    }
+
+    trace_read_cache_load(bs, s->stats.used_blocks);
+    return 0;
+}
+
+static bool read_cache_absorb_opts(BDRVReadCacheState *s, QDict *options,
+                                   uint64_t *cache_size, Error **errp)
+{
+    QemuOpts *opts = qemu_opts_create(&read_cache_runtime_opts, NULL, 0,
+                                      &error_abort);
+    uint64_t block_size;
+    int eviction;
+    bool ok = false;
+
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        goto out;
+    }
+
+    *cache_size = qemu_opt_get_size(opts, READ_CACHE_OPT_CACHE_SIZE,
+                                    READ_CACHE_DEFAULT_SIZE);
+    block_size = qemu_opt_get_size(opts, READ_CACHE_OPT_BLOCK_SIZE,
+                                   READ_CACHE_DEFAULT_BLOCK_SIZE);
+    eviction = qapi_enum_parse(&ReadCacheEviction_lookup,
+                               qemu_opt_get(opts, READ_CACHE_OPT_EVICTION),
+                               READ_CACHE_EVICTION_LRU, errp);
+    if (eviction < 0) {
+        goto out;
+    }
+    s->eviction = eviction;
+
+    if (block_size < READ_CACHE_MIN_BLOCK_SIZE ||
+        block_size > READ_CACHE_MAX_BLOCK_SIZE ||
+        !is_power_of_2(block_size)) {
+        error_setg(errp, "block-size must be a power of two between %d and "
+                   "%d bytes", READ_CACHE_MIN_BLOCK_SIZE,
+                   READ_CACHE_MAX_BLOCK_SIZE);
+        goto out;
+    }
+    s->block_size = block_size;
+
+    if (*cache_size < block_size) {
+        error_setg(errp, "cache-size must be at least block-size");
+        goto out;
+    }
+
+    ok = true;
+out:
+    qemu_opts_del(opts);
+    return ok;
+}
+
+static int read_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                           Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    uint64_t cache_size;
+    int64_t len;
+    int ret;
+
+    GLOBAL_STATE_CODE();
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /*
+     * The cache is written even if the filter is read-only. A reference to an
+     * existing node cannot take additional options, it must be writable.
+     */
+    if (!qdict_get_try_str(options, "cache-file")) {
+        qdict_set_default_str(options, "cache-file." BDRV_OPT_READ_ONLY, "off");
+    }
+    s->cache_file = bdrv_open_child(NULL, options, "cache-file", bs,
+                                    &child_of_bds, BDRV_CHILD_METADATA,
+                                    false, errp);
+    if (!s->cache_file) {
+        return -EINVAL;
+    }
+
+    if (!read_cache_absorb_opts(s, options, &cache_size, errp)) {
+        return -EINVAL;
+    }
+
+    GRAPH_RDLOCK_GUARD_MAINLOOP();
+
+    len = bdrv_getlength(bs->file->bs);
+    if (len < 0) {
+        error_setg_errno(errp, -len, "Could not get source length");
+        return len;
+    }
+    s->source_size = len;
+    s->nb_slots = MIN(cache_size / s->block_size,
+                      MAX(DIV_ROUND_UP(len, s->block_size), 1));
+    if (s->nb_slots > READ_CACHE_MAX_SLOTS) {
+        error_setg(errp, "cache-size must not exceed %" PRIu64 " bytes with "
+                   "this block-size",
+                   (uint64_t)READ_CACHE_MAX_SLOTS * s->block_size);
+        return -EINVAL;
+    }
+    s->index_offset = READ_CACHE_HEADER_SIZE;
+    s->data_offset = ROUND_UP(s->index_offset +
+                              s->nb_slots * sizeof(uint64_t), s->block_size);
+
+    qemu_mutex_init(&s->lock);
+    qemu_co_rwlock_init(&s->meta_lock);
+    qemu_co_mutex_init(&s->dirty_lock);
+    s->slots = g_new0(ReadCacheSlot, s->nb_slots);
+    s->blocks = g_hash_table_new(g_int64_hash, g_int64_equal);
+    QTAILQ_INIT(&s->free_slots);
+    QTAILQ_INIT(&s->lru);
+    for (uint64_t i = 0; i < s->nb_slots; i++) {
+        QTAILQ_INSERT_TAIL(&s->free_slots, &s->slots[i], next);
+    }
+    s->stats.total_blocks = s->nb_slots;
+
+    /* An incoming migration must not use what this host cached before */
+    if (!(flags & BDRV_O_INACTIVE)) {
+        ret = read_cache_load(bs, errp);
+        if (ret < 0) {
+            g_hash_table_destroy(s->blocks);
+            g_free(s->slots);
+            qemu_mutex_destroy(&s->lock);
+            return ret;
+        }
+    }
+
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+        (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+
+    return 0;
+}
+
+static void read_cache_close(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+
+    GLOBAL_STATE_CODE();
+    GRAPH_RDLOCK_GUARD_MAINLOOP();
+
+    if (!(bs->open_flags & BDRV_O_INACTIVE)) {
+        read_cache_checkpoint(bs);
+    }
+
+    g_hash_table_destroy(s->blocks);
+    g_free(s->slots);
+    qemu_mutex_destroy(&s->lock);
+}
+
+static int GRAPH_RDLOCK read_cache_inactivate(BlockDriverState *bs)
+{
+    return read_cache_checkpoint(bs);
+}
+
+static void GRAPH_RDLOCK
+read_cache_child_perm(BlockDriverState *bs, BdrvChild *c, BdrvChildRole role,
+                      BlockReopenQueue *reopen_queue,
+                      uint64_t perm, uint64_t shared,
+                      uint64_t *nperm, uint64_t *nshared)
+{
+    if (role & BDRV_CHILD_FILTERED) {
+        bdrv_default_perms(bs, c, role, reopen_queue,
+                           perm, shared, nperm, nshared);
+        return;
+    }
+
+    /* Nobody else may touch the cache file */
+    *nperm = BLK_PERM_CONSISTENT_READ;
+    if (!(bs->open_flags & BDRV_O_INACTIVE)) {
+        *nperm |= BLK_PERM_WRITE | BLK_PERM_RESIZE;
+    }
+    *nshared = BLK_PERM_ALL & ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+}
+
+static int64_t coroutine_fn GRAPH_RDLOCK
+read_cache_co_getlength(BlockDriverState *bs)
+{
+    return bdrv_co_getlength(bs->file->bs);
+}
+
+static void coroutine_fn read_cache_fill_entry(void *opaque)
+{
+    ReadCacheFill *fill = opaque;
+    BlockDriverState *bs = fill->bs;
+    BDRVReadCacheState *s = bs->opaque;
+    ReadCacheSlot *slot = fill->slot;
+    int ret;
+
+    bdrv_graph_co_rdlock();
+    qemu_co_rwlock_rdlock(&s->meta_lock);
+    ret = read_cache_mark_dirty(bs);
+    if (ret >= 0) {
+        ret = bdrv_co_pwrite(s->cache_file, read_cache_slot_offset(s, slot),
+                             fill->len, fill->buf, 0);
+    }
+    qemu_co_rwlock_unlock(&s->meta_lock);
+    bdrv_graph_co_rdunlock();
+
+    trace_read_cache_fill(bs, slot->block, ret);
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        s->fills_in_flight--;
+        if (slot->state == READ_CACHE_SLOT_STALE) {
+            read_cache_free_slot(s, slot);
+        } else if (ret < 0) {
+            g_hash_table_remove(s->blocks, &slot->block);
+            read_cache_free_slot(s, slot);
+        } else {
+            slot->state = READ_CACHE_SLOT_VALID;
+            QTAILQ_INSERT_TAIL(&s->lru, slot, next);
+            s->stats.used_blocks++;
+            s->stats.fills++;
+        }
+    }
+
+    qemu_vfree(fill->buf);
+    g_free(fill);
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Start writing a block that was just read from the source to the cache.
+ * @qiov contains the data of the whole block at @qiov_offset. Nothing is
+ * cached if a write happened since the source was read, which was before
+ * write generation @gen ended.
+ */
+static void coroutine_fn GRAPH_RDLOCK
+read_cache_start_fill(BlockDriverState *bs, uint64_t block, int64_t len,
+                      QEMUIOVector *qiov, size_t qiov_offset, uint64_t gen)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    ReadCacheFill *fill;
+    ReadCacheSlot *slot;
+    Coroutine *co;
+    void *buf;
+
+    if (bs->open_flags & BDRV_O_INACTIVE) {
+        return;
+    }
+
+    buf = qemu_try_blockalign(s->cache_file->bs, len);
+    if (!buf) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        if (s->write_gen != gen ||
+            s->fills_in_flight >= READ_CACHE_MAX_FILLS ||
+            g_hash_table_contains(s->blocks, &block)) {
+            slot = NULL;
+        } else {
+            slot = read_cache_alloc_slot(s);
+        }
+        if (slot) {
+            slot->block = block;
+            slot->state = READ_CACHE_SLOT_FILLING;
+            g_hash_table_insert(s->blocks, &slot->block, slot);
+            s->fills_in_flight++;
+        }
+    }
+    if (!slot) {
+        qemu_vfree(buf);
+        return;
+    }
+
+    qemu_iovec_to_buf(qiov, qiov_offset, buf, len);
+
+    fill = g_new(ReadCacheFill, 1);
+    *fill = (ReadCacheFill) {
+        .bs     = bs,
+        .slot   = slot,
+        .buf    = buf,
+        .len    = len,
+    };
+
+    /* Runs once the current request yields or completes */
+    bdrv_inc_in_flight(bs);
+    co = qemu_coroutine_create(read_cache_fill_entry, fill);
+    aio_co_enter(bdrv_get_aio_context(bs), co);
+}
+
+/* Read [start, end) from the source and cache all complete blocks in it */
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_read_miss(BlockDriverState *bs, int64_t start, int64_t end,
+                     QEMUIOVector *qiov, size_t qiov_offset, uint64_t gen)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    uint64_t block;
+    int ret;
+
+    ret = bdrv_co_preadv_part(bs->file, start, end - start, qiov, qiov_offset,
+                              0);
+    if (ret < 0) {
+        return ret;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        s->stats.miss_bytes += end - start;
+    }
+
+    for (block = DIV_ROUND_UP(start, s->block_size);
+         block * s->block_size < end; block++) {
+        int64_t block_start = block * s->block_size;
+        int64_t len = MIN(s->block_size, s->source_size - block_start);
+
+        if (block_start + len > end) {
+            break;
+        }
+        read_cache_start_fill(bs, block, len, qiov,
+                              qiov_offset + (block_start - start), gen);
+    }
+
+    return 0;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                          QEMUIOVector *qiov, size_t qiov_offset,
+                          BdrvRequestFlags flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int64_t end = offset + bytes;
+    int64_t miss_start = -1;
+    int64_t pos, chunk_end;
+    uint64_t gen;
+    int ret;
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        gen = s->write_gen;
+    }
+
+    for (pos = offset; pos < end; pos = chunk_end) {
+        uint64_t block = pos / s->block_size;
+        int64_t block_start = block * s->block_size;
+        ReadCacheSlot *slot;
+
+        chunk_end = MIN(end, block_start + s->block_size);
+
+        slot = read_cache_get_slot(s, block);
+        if (!slot) {
+            if (miss_start < 0) {
+                miss_start = pos;
+            }
+            continue;
+        }
+
+        if (miss_start >= 0) {
+            ret = read_cache_read_miss(bs, miss_start, pos, qiov,
+                                       qiov_offset + (miss_start - offset),
+                                       gen);
+            miss_start = -1;
+            if (ret < 0) {
+                read_cache_put_slot(s, slot, false);
+                return ret;
+            }
+        }
+
+        ret = bdrv_co_preadv_part(s->cache_file,
+                                  read_cache_slot_offset(s, slot) +
+                                  (pos - block_start),
+                                  chunk_end - pos, qiov,
+                                  qiov_offset + (pos - offset), 0);
+        read_cache_put_slot(s, slot, ret < 0);
+        if (ret < 0) {
+            /* Don't fail the guest request for a cache error */
+            ret = read_cache_read_miss(bs, pos, chunk_end, qiov,
+                                       qiov_offset + (pos - offset), gen);
+            if (ret < 0) {
+                return ret;
+            }
+            continue;
+        }
+
+        WITH_QEMU_LOCK_GUARD(&s->lock) {
+            s->stats.hit_bytes += chunk_end - pos;
+        }
+    }
+
+    if (miss_start >= 0) {
+        return read_cache_read_miss(bs, miss_start, end, qiov,
+                                    qiov_offset + (miss_start - offset), gen);
+    }
+    return 0;
+}
+
+/*
+ * Writes drop the affected blocks both before and after they are passed on,
+ * so that neither the cache nor a racing miss can keep the old data.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_write_begin(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    qemu_co_rwlock_rdlock(&s->meta_lock);
+    ret = read_cache_mark_dirty(bs);
+    if (ret >= 0) {
+        read_cache_invalidate(s, offset, bytes);
+    }
+    qemu_co_rwlock_unlock(&s->meta_lock);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                           QEMUIOVector *qiov, size_t qiov_offset,
+                           BdrvRequestFlags flags)
+{
+    int ret = read_cache_write_begin(bs, offset, bytes);
+
+    if (ret < 0) {
+        return ret;
+    }
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+    read_cache_invalidate(bs->opaque, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_pwrite_zeroes(BlockDriverState *bs, int64_t offset,
+                            int64_t bytes, BdrvRequestFlags flags)
+{
+    int ret = read_cache_write_begin(bs, offset, bytes);
+
+    if (ret < 0) {
+        return ret;
+    }
+    ret = bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+    read_cache_invalidate(bs->opaque, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    int ret = read_cache_write_begin(bs, offset, bytes);
+
+    if (ret < 0) {
+        return ret;
+    }
+    ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+    read_cache_invalidate(bs->opaque, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
+                       PreallocMode prealloc, BdrvRequestFlags flags,
+                       Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    /* Drop everything, the cache geometry depends on the source size */
+    ret = read_cache_write_begin(bs, 0, MAX(s->source_size, 1));
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not update cache file");
+        return ret;
+    }
+
+    ret = bdrv_co_truncate(bs->file, offset, exact, prealloc, flags, errp);
+    read_cache_invalidate(s, 0, MAX(s->source_size, 1));
+    if (ret >= 0) {
+        s->source_size = offset;
+    }
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK read_cache_co_flush(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    ret = bdrv_co_flush(bs->file->bs);
+    if (ret < 0) {
+        return ret;
+    }
+
+    qemu_co_rwlock_wrlock(&s->meta_lock);
+    ret = read_cache_checkpoint(bs);
+    qemu_co_rwlock_unlock(&s->meta_lock);
+
+    return ret;
+}
+
+static BlockStatsSpecific *read_cache_get_specific_stats(BlockDriverState *bs)
+{
+    BlockStatsSpecific *stats = g_new(BlockStatsSpecific, 1);
+    BDRVReadCacheState *s = bs->opaque;
+
+    stats->driver = BLOCKDEV_DRIVER_READ_CACHE;
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        stats->u.read_cache = s->stats;
+    }
+
+    return stats;
+}
+
+static BlockDriver bdrv_read_cache = {
+    .format_name                        = "read-cache",
+    .instance_size                      = sizeof(BDRVReadCacheState),
+
+    .bdrv_open                          = read_cache_open,
+    .bdrv_close                         = read_cache_close,
+    .bdrv_inactivate                    = read_cache_inactivate,
+    .bdrv_child_perm                    = read_cache_child_perm,
+
+    .bdrv_co_getlength                  = read_cache_co_getlength,
+
+    .bdrv_co_preadv_part                = read_cache_co_preadv_part,
+    .bdrv_co_pwritev_part               = read_cache_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes              = read_cache_co_pwrite_zeroes,
+    .bdrv_co_pdiscard                   = read_cache_co_pdiscard,
+    .bdrv_co_truncate                   = read_cache_co_truncate,
+    .bdrv_co_flush                      = read_cache_co_flush,
+
+    .bdrv_get_specific_stats            = read_cache_get_specific_stats,
+
+    .is_filter                          = true,
+};
+
+static void bdrv_read_cache_init(void)
+{
+    bdrv_register(&bdrv_read_cache);
+}
+
+block_init(bdrv_read_cache_init);
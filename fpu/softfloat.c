@@ -125,6 +125,12 @@ this code that are retained.
  * detection might get hairy. Two examples: (1) when at least one operand is
  * denormal/inf/NaN; (2) when operands are not guaranteed to lead to a 0 result
  * and the result is < the minimum normal.
+ *
+ * Two exceptions to the above keep guest modes such as ARM's "standard FPSCR"
+ * (flush-to-zero plus default-NaN) on the fast path: a tiny non-zero result
+ * is flushed directly when flush_to_zero is set, since the host result is
+ * then known to be tiny before rounding; and a NaN operand in default-NaN
+ * mode produces the default NaN without unpacking either operand.
  */
 #define GEN_INPUT_FLUSH__NOCHECK(name, soft_t)                          \
     static inline void name(soft_t *a, float_status *s)                 \
@@ -339,6 +345,67 @@ static inline bool f64_is_inf(union_float64 a)
     return float64_is_infinity(a.s);
 }
 
+/*
+ * Flush a tiny, non-zero hardfloat result to zero the way
+ * parts_uncanon_normal would.  Any result below the minimum normal
+ * (exclusive) is tiny before rounding as well, so this is valid for both
+ * tininess detection modes.  Returns false if softfloat must decide.
+ */
+static inline bool f32_flush_tiny(union_float32 *r, float_status *s)
+{
+    if (!s->flush_to_zero || s->rebias_underflow ||
+        !(fabsf(r->h) < FLT_MIN) || float32_is_zero(r->s)) {
+        return false;
+    }
+    r->s = float32_set_sign(float32_zero, float32_is_neg(r->s));
+    float_raise(float_flag_output_denormal, s);
+    return true;
+}
+
+static inline bool f64_flush_tiny(union_float64 *r, float_status *s)
+{
+    if (!s->flush_to_zero || s->rebias_underflow ||
+        !(fabs(r->h) < DBL_MIN) || float64_is_zero(r->s)) {
+        return false;
+    }
+    r->s = float64_set_sign(float64_zero, float64_is_neg(r->s));
+    float_raise(float_flag_output_denormal, s);
+    return true;
+}
+
+/*
+ * In default-NaN mode a 2-input operation with a NaN operand always
+ * returns the default NaN, raising invalid only for signaling inputs
+ * (see parts_pick_nan).  Returns false if neither operand is a NaN.
+ */
+static inline bool f32_dnan2(union_float32 a, union_float32 b,
+                             union_float32 *r, float_status *s)
+{
+    if (!s->default_nan_mode ||
+        !(float32_is_any_nan(a.s) || float32_is_any_nan(b.s))) {
+        return false;
+    }
+    if (float32_is_signaling_nan(a.s, s) || float32_is_signaling_nan(b.s, s)) {
+        float_raise(float_flag_invalid | float_flag_invalid_snan, s);
+    }
+    r->s = float32_default_nan(s);
+    return true;
+}
+
+static inline bool f64_dnan2(union_float64 a, union_float64 b,
+                             union_float64 *r, float_status *s)
+{
+    if (!s->default_nan_mode ||
+        !(float64_is_any_nan(a.s) || float64_is_any_nan(b.s))) {
+        return false;
+    }
+    if (float64_is_signaling_nan(a.s, s) || float64_is_signaling_nan(b.s, s)) {
+        float_raise(float_flag_invalid | float_flag_invalid_snan, s);
+    }
+    r->s = float64_default_nan(s);
+    return true;
+}
+
 static inline float32
 float32_gen2(float32 xa, float32 xb, float_status *s,
              hard_f32_op2_fn hard, soft_f32_op2_fn soft,
@@ -355,6 +422,9 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
 
     float32_input_flush2(&ua.s, &ub.s, s);
     if (unlikely(!pre(ua, ub))) {
+        if (f32_dnan2(ua, ub, &ur, s)) {
+            return ur.s;
+        }
         goto soft;
     }
 
@@ -362,7 +432,9 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
     if (unlikely(f32_is_inf(ur))) {
         float_raise(float_flag_overflow, s);
     } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && post(ua, ub)) {
-        goto soft;
+        if (!f32_flush_tiny(&ur, s)) {
+            goto soft;
+        }
     }
     return ur.s;
 
@@ -386,6 +458,9 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
 
     float64_input_flush2(&ua.s, &ub.s, s);
     if (unlikely(!pre(ua, ub))) {
+        if (f64_dnan2(ua, ub, &ur, s)) {
+            return ur.s;
+        }
         goto soft;
     }
 
@@ -393,7 +468,9 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
     if (unlikely(f64_is_inf(ur))) {
         float_raise(float_flag_overflow, s);
     } else if (unlikely(fabs(ur.h) <= DBL_MIN) && post(ua, ub)) {
-        goto soft;
+        if (!f64_flush_tiny(&ur, s)) {
+            goto soft;
+        }
     }
     return ur.s;
 
@@ -2311,7 +2388,7 @@ float32_muladd(float32 xa, float32 xb, float32 xc, int flags, float_status *s)
 
         if (unlikely(f32_is_inf(ur))) {
             float_raise(float_flag_overflow, s);
-        } else if (unlikely(fabsf(ur.h) <= FLT_MIN)) {
+        } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && !f32_flush_tiny(&ur, s)) {
             ua = ua_orig;
             uc = uc_orig;
             goto soft;
@@ -2382,7 +2459,7 @@ float64_muladd(float64 xa, float64 xb, float64 xc, int flags, float_status *s)
 
         if (unlikely(f64_is_inf(ur))) {
             float_raise(float_flag_overflow, s);
-        } else if (unlikely(fabs(ur.h) <= FLT_MIN)) {
+        } else if (unlikely(fabs(ur.h) <= FLT_MIN) && !f64_flush_tiny(&ur, s)) {
             ua = ua_orig;
             uc = uc_orig;
             goto soft;
@@ -2752,6 +2829,15 @@ float32 float16_to_float32(float16 a, bool ieee, float_status *s)
     const FloatFmt *fmt16 = ieee ? &float16_params : &float16_params_ahp;
     FloatParts64 p;
 
+    if (likely(ieee && float16_is_normal(a))) {
+        /* Widening conversion of a normal is exact: just rebias.  */
+        uint32_t f = float16_val(a);
+        return make_float32(((f & 0x8000) << 16) |
+                            (((f & 0x7fff) + ((127 - 15) << 10)) << 13));
+    } else if (float16_is_zero(a)) {
+        return float32_set_sign(float32_zero, float16_is_neg(a));
+    }
+
     float16a_unpack_canonical(&p, a, s, fmt16);
     parts_float_to_float(&p, s);
     return float32_round_pack_canonical(&p, s);
@@ -2767,11 +2853,53 @@ float64 float16_to_float64(float16 a, bool ieee, float_status *s)
     return float64_round_pack_canonical(&p, s);
 }
 
+/*
+ * Narrow a normal float32 whose result is a normal float16, rounding to
+ * nearest-even with integer arithmetic.  Returns false if the result would
+ * be tiny or overflow, in which case softfloat must handle it.
+ */
+static bool f32_to_f16_fast(float32 a, float16 *r, float_status *s)
+{
+    uint32_t f = float32_val(a);
+    int exp = extract32(f, 23, 8) - 127;
+    uint32_t rem, h;
+
+    if (exp < -14 || exp > 15 ||
+        s->float_rounding_mode != float_round_nearest_even) {
+        return false;
+    }
+
+    h = ((exp + 15) << 10) | extract32(f, 13, 10);
+    rem = extract32(f, 0, 13);
+    if (rem) {
+        /* A carry out of the fraction correctly bumps the exponent.  */
+        if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) {
+            h++;
+        }
+        if (unlikely(h >= 0x7c00)) {
+            return false;
+        }
+        float_raise(float_flag_inexact, s);
+    }
+    *r = make_float16(h | ((f >> 16) & 0x8000));
+    return true;
+}
+
 float16 float32_to_float16(float32 a, bool ieee, float_status *s)
 {
     FloatParts64 p;
     const FloatFmt *fmt;
 
+    if (likely(ieee && float32_is_normal(a))) {
+        float16 r;
+
+        if (f32_to_f16_fast(a, &r, s)) {
+            return r;
+        }
+    } else if (ieee && float32_is_zero(a)) {
+        return float16_set_sign(float16_zero, float32_is_neg(a));
+    }
+
     float32_unpack_canonical(&p, a, s);
     if (ieee) {
         parts_float_to_float(&p, s);
@@ -283,6 +283,22 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-stats",
+        .args_type  = "top:i?,sort:s?",
+        .params     = "[top [executions|translations|invalidations|expansion]]",
+        .help       = "show the hottest translation blocks, up to top "
+                      "entries (default: 10)",
+    },
+#endif
+
+SRST
+  ``info tb-stats`` [*top* [*sort*]]
+    Show execution statistics of the hottest translation blocks, up to
+    *top* entries (default: 10), sorted by *sort* (default: executions).
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
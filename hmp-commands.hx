@@ -652,6 +652,23 @@ SRST
   whether profiling is on or off.
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-stats",
+        .args_type  = "action:s",
+        .params     = "start|stop|reset",
+        .help       = "start, stop or reset collection of translation block "
+                      "statistics",
+    },
+#endif
+
+SRST
+``tb-stats start|stop|reset``
+  Start, stop or reset collection of per translation block execution
+  statistics. Starting or stopping collection flushes the translation
+  cache. Use ``info tb-stats`` to show the collected data.
+ERST
+
     {
         .name       = "system_reset",
         .args_type  = "",
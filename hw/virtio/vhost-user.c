@@ -1935,6 +1935,8 @@ static int vhost_user_postcopy_waker(struct PostCopyFD *pcfd, RAMBlock *rb,
 {
     struct vhost_dev *dev = pcfd->data;
     struct vhost_user *u = dev->opaque;
+    uint64_t end = offset + postcopy_ram_pagesize(rb);
+    bool found = false;
     int i;
 
     trace_vhost_user_postcopy_waker(qemu_ram_get_idstr(rb), offset);
@@ -1942,20 +1944,35 @@ static int vhost_user_postcopy_waker(struct PostCopyFD *pcfd, RAMBlock *rb,
     if (!u) {
         return 0;
     }
-    /* Translate the offset into an address in the clients address space */
+    /*
+     * Translate the placed range into addresses in the clients address
+     * space.  With postcopy-thp it can span several regions.
+     */
     for (i = 0; i < MIN(dev->mem->nregions, u->region_rb_len); i++) {
+        uint64_t region_start = u->region_rb_offset[i];
+        uint64_t region_end = region_start + dev->mem->regions[i].memory_size;
+
         if (u->region_rb[i] == rb &&
-            offset >= u->region_rb_offset[i] &&
-            offset < (u->region_rb_offset[i] +
-                      dev->mem->regions[i].memory_size)) {
-            uint64_t client_addr = (offset - u->region_rb_offset[i]) +
+            offset < region_end && end > region_start) {
+            uint64_t start = MAX(offset, region_start);
+            uint64_t client_addr = (start - region_start) +
                                    u->postcopy_client_bases[i];
+            int ret;
+
             trace_vhost_user_postcopy_waker_found(client_addr);
-            return postcopy_wake_shared(pcfd, client_addr, rb);
+            ret = postcopy_wake_shared(pcfd, client_addr,
+                                       MIN(end, region_end) - start, rb);
+            if (ret) {
+                return ret;
+            }
+            found = true;
         }
     }
 
-    trace_vhost_user_postcopy_waker_nomatch(qemu_ram_get_idstr(rb), offset);
+    if (!found) {
+        trace_vhost_user_postcopy_waker_nomatch(qemu_ram_get_idstr(rb),
+                                                offset);
+    }
     return 0;
 }
 #endif
@@ -214,6 +214,9 @@ struct AioContext {
 #ifdef CONFIG_LINUX_IO_URING
     struct LuringState *linux_io_uring;
 
+    /* State for polled (IORING_SETUP_IOPOLL) io_uring requests */
+    struct LuringState *linux_io_uring_poll;
+
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
     AioHandlerSList submit_list;
@@ -227,6 +230,9 @@ struct AioContext {
     /* Number of AioHandlers without .io_poll() */
     int poll_disable_cnt;
 
+    /* Number of AioHandlers marked with aio_set_fd_busy_poll() */
+    int busy_poll_cnt;
+
     /* Polling mode parameters */
     int64_t poll_ns;        /* current polling time in nanoseconds */
     int64_t poll_max_ns;    /* maximum polling time in nanoseconds */
@@ -484,6 +490,17 @@ void aio_set_fd_handler(AioContext *ctx,
                         IOHandler *io_poll_ready,
                         void *opaque);
 
+/*
+ * Mark the handler of @fd as waiting for events that only polling can
+ * detect, for example completions of an io_uring instance set up with
+ * IORING_SETUP_IOPOLL.  While @busy is true, aio_poll() does not block and
+ * calls the handler's ->io_poll() callback on every iteration.  Do nothing
+ * if @fd has no handler with an ->io_poll() callback.
+ *
+ * Must be called from the AioContext's home thread.
+ */
+void aio_set_fd_busy_poll(AioContext *ctx, int fd, bool busy);
+
 /* Register an event notifier and associated callbacks.  Behaves very similarly
  * to event_notifier_set_handler.  Unlike event_notifier_set_handler, these callbacks
  * will be invoked when using aio_poll().
@@ -530,6 +547,13 @@ struct LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp);
 
 /* Return the LuringState bound to this AioContext */
 struct LuringState *aio_get_linux_io_uring(AioContext *ctx);
+
+/* Setup the polled LuringState bound to this AioContext */
+struct LuringState *aio_setup_linux_io_uring_poll(AioContext *ctx,
+                                                  Error **errp);
+
+/* Return the polled LuringState bound to this AioContext */
+struct LuringState *aio_get_linux_io_uring_poll(AioContext *ctx);
 /**
  * aio_timer_new_with_attrs:
  * @ctx: the aio context
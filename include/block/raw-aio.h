@@ -66,12 +66,27 @@ void laio_attach_aio_context(LinuxAioState *s, AioContext *new_context);
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
 typedef struct LuringState LuringState;
-LuringState *luring_init(Error **errp);
+LuringState *luring_init(bool iopoll, Error **errp);
 void luring_cleanup(LuringState *s);
 
-/* luring_co_submit: submit I/O requests in the thread's current AioContext. */
-int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
-                                  QEMUIOVector *qiov, int type);
+/*
+ * luring_co_submit: submit I/O requests in the thread's current AioContext.
+ * @fixed_fd is the fixed file slot of @fd from luring_register_fd(), or -1.
+ * If @iopoll is true, reads and writes go to the AioContext's IOPOLL ring;
+ * @fd must then be opened with O_DIRECT.
+ */
+int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, int fixed_fd,
+                                  uint64_t offset, QEMUIOVector *qiov,
+                                  int type, bool iopoll);
+
+/*
+ * Memory and files that rings may register with the kernel.  Requests whose
+ * data lies in a registered buffer use READ_FIXED/WRITE_FIXED.
+ */
+void luring_register_buf(void *host, size_t size);
+void luring_unregister_buf(void *host, size_t size);
+int luring_register_fd(int fd);
+void luring_unregister_fd(int index);
 void luring_detach_aio_context(LuringState *s, AioContext *old_context);
 void luring_attach_aio_context(LuringState *s, AioContext *new_context);
 #endif
@@ -265,6 +265,35 @@ static inline uint8_t cpu_physical_memory_range_includes_clean(ram_addr_t start,
     return ret;
 }
 
+/*
+ * Mark the chunks that hold pages [@offset, @offset + @num) of block @idx
+ * of the migration bitmap as written to.  Called after setting the dirty
+ * bits of the pages, within the same RCU critical section.
+ */
+static inline void cpu_physical_memory_set_dirty_chunks(unsigned long idx,
+                                                        unsigned long offset,
+                                                        unsigned long num)
+{
+    unsigned long *summary =
+        qatomic_rcu_read(&ram_list.dirty_chunks)->blocks[idx];
+    unsigned long chunk = offset / DIRTY_MEMORY_CHUNK_SIZE;
+    unsigned long last = (offset + num - 1) / DIRTY_MEMORY_CHUNK_SIZE;
+
+    /*
+     * Order the dirty bits before the summary, the sync clears them in
+     * the opposite order.
+     */
+    smp_mb__after_rmw();
+    for (; chunk <= last; chunk++) {
+        unsigned long *p = summary + BIT_WORD(chunk);
+
+        /* Avoid bouncing the cache line when the chunk is already marked */
+        if (!(qatomic_read(p) & BIT_MASK(chunk))) {
+            qatomic_or(p, BIT_MASK(chunk));
+        }
+    }
+}
+
 static inline void cpu_physical_memory_set_dirty_flag(ram_addr_t addr,
                                                       unsigned client)
 {
@@ -282,6 +311,9 @@ static inline void cpu_physical_memory_set_dirty_flag(ram_addr_t addr,
     blocks = qatomic_rcu_read(&ram_list.dirty_memory[client]);
 
     set_bit_atomic(offset, blocks->blocks[idx]);
+    if (client == DIRTY_MEMORY_MIGRATION) {
+        cpu_physical_memory_set_dirty_chunks(idx, offset, 1);
+    }
 }
 
 static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
@@ -314,6 +346,7 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
             if (likely(mask & (1 << DIRTY_MEMORY_MIGRATION))) {
                 bitmap_set_atomic(blocks[DIRTY_MEMORY_MIGRATION]->blocks[idx],
                                   offset, next - page);
+                cpu_physical_memory_set_dirty_chunks(idx, offset, next - page);
             }
             if (unlikely(mask & (1 << DIRTY_MEMORY_VGA))) {
                 bitmap_set_atomic(blocks[DIRTY_MEMORY_VGA]->blocks[idx],
@@ -386,6 +419,8 @@ uint64_t cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
                         qatomic_or(
                                 &blocks[DIRTY_MEMORY_MIGRATION][idx][offset],
                                 temp);
+                        cpu_physical_memory_set_dirty_chunks(
+                                idx, offset * BITS_PER_LONG, BITS_PER_LONG);
                         if (unlikely(
                             global_dirty_tracking & GLOBAL_DIRTY_DIRTY_RATE)) {
                             total_dirty_pages += nbits;
@@ -479,9 +514,12 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
     if (((word * BITS_PER_LONG) << TARGET_PAGE_BITS) ==
          (start + rb->offset) &&
         !(length & ((BITS_PER_LONG << TARGET_PAGE_BITS) - 1))) {
+        const unsigned long chunk_words =
+            BITS_TO_LONGS(DIRTY_MEMORY_CHUNK_SIZE);
         int k;
         int nr = BITS_TO_LONGS(length >> TARGET_PAGE_BITS);
         unsigned long * const *src;
+        unsigned long * const *chunks;
         unsigned long idx = (word * BITS_PER_LONG) / DIRTY_MEMORY_BLOCK_SIZE;
         unsigned long offset = BIT_WORD((word * BITS_PER_LONG) %
                                         DIRTY_MEMORY_BLOCK_SIZE);
@@ -489,18 +527,42 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
 
         src = qatomic_rcu_read(
                 &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
+        chunks = qatomic_rcu_read(&ram_list.dirty_chunks)->blocks;
 
-        for (k = page; k < page + nr; k++) {
-            if (src[idx][offset]) {
-                unsigned long bits = qatomic_xchg(&src[idx][offset], 0);
-                unsigned long new_dirty;
-                new_dirty = ~dest[k];
-                dest[k] |= bits;
-                new_dirty &= bits;
-                num_dirty += ctpopl(new_dirty);
+        /*
+         * Only visit the chunks that were written to since the last sync.
+         * A chunk that lies entirely in the range has its summary bit
+         * cleared before its words are collected, so a page dirtied
+         * meanwhile marks it again.  The summary of a chunk that is only
+         * partly covered stays set.
+         */
+        for (k = page; k < page + nr; ) {
+            unsigned long chunk = offset / chunk_words;
+            unsigned long *summary = &chunks[idx][BIT_WORD(chunk)];
+            unsigned long n = MIN((chunk + 1) * chunk_words - offset,
+                                  page + nr - k);
+            unsigned long i;
+
+            if (qatomic_read(summary) & BIT_MASK(chunk)) {
+                if (n == chunk_words) {
+                    qatomic_fetch_and(summary, ~BIT_MASK(chunk));
+                }
+                for (i = 0; i < n; i++) {
+                    if (src[idx][offset + i]) {
+                        unsigned long bits =
+                            qatomic_xchg(&src[idx][offset + i], 0);
+                        unsigned long new_dirty;
+                        new_dirty = ~dest[k + i];
+                        dest[k + i] |= bits;
+                        new_dirty &= bits;
+                        num_dirty += ctpopl(new_dirty);
+                    }
+                }
             }
 
-            if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
+            k += n;
+            offset += n;
+            if (offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
                 offset = 0;
                 idx++;
             }
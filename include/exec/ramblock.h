@@ -46,6 +46,15 @@ struct RAMBlock {
     unsigned long *bmap;
     /* bitmap of already received pages in postcopy */
     unsigned long *receivedmap;
+    /*
+     * bitmap of pages present in the migration file, only used by the
+     * source of a mapped-ram migration
+     */
+    unsigned long *file_bmap;
+    /* offset in the migration file of the bitmap above */
+    uint64_t bitmap_offset;
+    /* offset in the migration file of the block's pages */
+    uint64_t pages_offset;
 
     /*
      * bitmap to track already cleared dirty bitmap.  When the bit is
@@ -44,12 +44,26 @@ typedef struct {
     unsigned long *blocks[];
 } DirtyMemoryBlocks;
 
+/*
+ * The DIRTY_MEMORY_MIGRATION bitmap is also summarized one bit per chunk
+ * of DIRTY_MEMORY_CHUNK_SIZE pages, in ram_list.dirty_chunks.  The summary
+ * is split into blocks like the bitmap itself, block i covering the same
+ * pages as dirty_memory[DIRTY_MEMORY_MIGRATION]->blocks[i].  A chunk bit is
+ * set after the dirty bits of its pages, so that syncing the migration
+ * bitmap only needs to look at the chunks that were written to; it may be
+ * set while no page in the chunk is dirty anymore.
+ */
+#define DIRTY_MEMORY_CHUNK_SIZE ((ram_addr_t)4096)
+#define DIRTY_MEMORY_CHUNKS_PER_BLOCK \
+    (DIRTY_MEMORY_BLOCK_SIZE / DIRTY_MEMORY_CHUNK_SIZE)
+
 typedef struct RAMList {
     QemuMutex mutex;
     RAMBlock *mru_block;
     /* RCU-enabled, writes protected by the ramlist lock. */
     QLIST_HEAD(, RAMBlock) blocks;
     DirtyMemoryBlocks *dirty_memory[DIRTY_MEMORY_NUM];
+    DirtyMemoryBlocks *dirty_chunks;
     uint32_t version;
     QLIST_HEAD(, RAMBlockNotifier) ramblock_notifiers;
 } RAMList;
@@ -95,6 +95,35 @@ int qio_channel_socket_connect_sync(QIOChannelSocket *ioc,
                                     SocketAddress *addr,
                                     Error **errp);
 
+/**
+ * qio_channel_socket_enable_zero_copy:
+ * @ioc: the socket channel object
+ *
+ * Enable SO_ZEROCOPY on a connected socket, such as one returned
+ * by qio_channel_socket_accept(), so that it can be written with
+ * QIO_CHANNEL_WRITE_FLAG_ZERO_COPY.
+ *
+ * Returns: true if zero copy writes are supported on @ioc
+ */
+bool qio_channel_socket_enable_zero_copy(QIOChannelSocket *ioc);
+
+/**
+ * qio_channel_socket_reap_zero_copy:
+ * @ioc: the socket channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Consume the zero copy completion notifications that are
+ * already pending on @ioc without blocking. On return,
+ * @ioc->zero_copy_sent counts every zero copy write whose
+ * buffer the kernel no longer references. This is a
+ * non-blocking variant of qio_channel_flush() suitable for
+ * use from coroutines.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int qio_channel_socket_reap_zero_copy(QIOChannelSocket *ioc,
+                                      Error **errp);
+
 /**
  * qio_channel_socket_connect_async:
  * @ioc: the socket channel object
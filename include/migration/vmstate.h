@@ -198,6 +198,20 @@ struct VMStateDescription {
      * a QEMU_VM_SECTION_START section.
      */
     bool early_setup;
+    /*
+     * With the parallel-device-load migration capability, the state of
+     * this VMSD may be loaded on a worker thread, concurrently with other
+     * devices that set this flag.  Only set it if pre_load, post_load and
+     * the field handlers neither take nor need the BQL, and only touch
+     * state owned by the device.
+     *
+     * A parallel load still waits for the earlier sections with a higher
+     * priority, and for the earlier sections whose VMSD name is listed in
+     * the NULL-terminated depends_on array.  Sections that come later in
+     * the stream are never waited for.
+     */
+    bool parallel_load;
+    const char * const *depends_on;
     int version_id;
     int minimum_version_id;
     MigrationPriority priority;
@@ -46,6 +46,9 @@ struct HBitmapIter {
      * the bits (i.e. the subtrees) yet to be processed under that node.
      */
     unsigned long cur[HBITMAP_LEVELS];
+
+    /* Next last-level bit to visit, for compressed bitmaps.  */
+    uint64_t next;
 };
 
 /**
@@ -61,6 +64,35 @@ struct HBitmapIter {
  */
 HBitmap *hbitmap_alloc(uint64_t size, int granularity);
 
+/**
+ * hbitmap_alloc_compressed:
+ * @size: Number of bits in the bitmap.
+ * @granularity: Granularity of the bitmap, as for hbitmap_alloc.
+ *
+ * Allocate a new HBitmap that is stored in compressed form.  It behaves
+ * exactly like one returned by hbitmap_alloc, but uses much less memory if
+ * its bits are mostly clear, or set in large extents; merging and iterating
+ * over such bitmaps is faster too.  Setting and resetting scattered bits
+ * is slower.
+ */
+HBitmap *hbitmap_alloc_compressed(uint64_t size, int granularity);
+
+/**
+ * hbitmap_is_compressed:
+ * @hb: HBitmap to operate on.
+ *
+ * Return whether the HBitmap was allocated with hbitmap_alloc_compressed.
+ */
+bool hbitmap_is_compressed(const HBitmap *hb);
+
+/**
+ * hbitmap_memory_usage:
+ * @hb: HBitmap to operate on.
+ *
+ * Return the number of bytes allocated for the HBitmap.
+ */
+size_t hbitmap_memory_usage(const HBitmap *hb);
+
 /**
  * hbitmap_truncate:
  * @hb: The bitmap to change the size of.
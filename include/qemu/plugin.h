@@ -73,6 +73,7 @@ enum plugin_dyn_cb_type {
 
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
+    PLUGIN_CB_REGULAR_COND,
     PLUGIN_CB_INLINE,
     PLUGIN_N_CB_SUBTYPES,
 };
@@ -93,7 +94,16 @@ struct qemu_plugin_dyn_cb {
         struct {
             enum qemu_plugin_op op;
             uint64_t imm;
+            /* distance between two vCPUs' entries, 0 for a global counter */
+            size_t stride;
         } inline_insn;
+        struct {
+            enum qemu_plugin_cond cond;
+            uint64_t imm;
+            /* vCPU 0's entry and distance to the next vCPU's */
+            void *ptr;
+            size_t stride;
+        } cond;
     };
 };
 
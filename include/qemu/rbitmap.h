@@ -0,0 +1,149 @@
+/*
+ * Compressed Bitmap Data Type
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#ifndef RBITMAP_H
+#define RBITMAP_H
+
+typedef struct RBitmap RBitmap;
+
+/**
+ * rbitmap_new:
+ * @size: Number of bits in the bitmap.
+ *
+ * Allocate a new, empty RBitmap.
+ */
+RBitmap *rbitmap_new(uint64_t size);
+
+/**
+ * rbitmap_free:
+ * @rb: RBitmap to operate on.
+ *
+ * Free an RBitmap and all of its associated memory.
+ */
+void rbitmap_free(RBitmap *rb);
+
+/**
+ * rbitmap_count:
+ * @rb: RBitmap to operate on.
+ *
+ * Return the number of bits set in the RBitmap.
+ */
+uint64_t rbitmap_count(const RBitmap *rb);
+
+/**
+ * rbitmap_memory_usage:
+ * @rb: RBitmap to operate on.
+ *
+ * Return the number of bytes allocated for the RBitmap.
+ */
+size_t rbitmap_memory_usage(const RBitmap *rb);
+
+/**
+ * rbitmap_get:
+ * @rb: RBitmap to operate on.
+ * @bit: Bit to query (0-based).
+ *
+ * Return whether @bit is set.
+ */
+bool rbitmap_get(const RBitmap *rb, uint64_t bit);
+
+/**
+ * rbitmap_set:
+ * @rb: RBitmap to operate on.
+ * @start: First bit to set (0-based).
+ * @count: Number of bits to set.
+ *
+ * Set a consecutive range of bits and return how many of them were clear.
+ */
+uint64_t rbitmap_set(RBitmap *rb, uint64_t start, uint64_t count);
+
+/**
+ * rbitmap_reset:
+ * @rb: RBitmap to operate on.
+ * @start: First bit to reset (0-based).
+ * @count: Number of bits to reset.
+ *
+ * Reset a consecutive range of bits and return how many of them were set.
+ */
+uint64_t rbitmap_reset(RBitmap *rb, uint64_t start, uint64_t count);
+
+/**
+ * rbitmap_reset_all:
+ * @rb: RBitmap to operate on.
+ *
+ * Reset all bits in an RBitmap.
+ */
+void rbitmap_reset_all(RBitmap *rb);
+
+/**
+ * rbitmap_next_set:
+ * @rb: RBitmap to operate on.
+ * @start: First bit to look at.
+ * @end: End of the range to look at (exclusive).
+ *
+ * Return the first set bit in [@start, @end), or -1 if there is none.
+ */
+int64_t rbitmap_next_set(const RBitmap *rb, uint64_t start, uint64_t end);
+
+/**
+ * rbitmap_next_clear:
+ * @rb: RBitmap to operate on.
+ * @start: First bit to look at.
+ * @end: End of the range to look at (exclusive).
+ *
+ * Return the first clear bit in [@start, @end), or -1 if there is none.
+ */
+int64_t rbitmap_next_clear(const RBitmap *rb, uint64_t start, uint64_t end);
+
+/**
+ * rbitmap_or:
+ * @dst: RBitmap to merge into.
+ * @src: RBitmap to merge from.
+ *
+ * Set all bits in @dst that are set in @src.  Both bitmaps must have the
+ * same size.
+ */
+void rbitmap_or(RBitmap *dst, const RBitmap *src);
+
+/**
+ * rbitmap_truncate:
+ * @rb: RBitmap to operate on.
+ * @size: New number of bits.
+ *
+ * Shrink or grow the RBitmap.  Bits beyond @size are dropped when
+ * shrinking; new bits are clear when growing.
+ */
+void rbitmap_truncate(RBitmap *rb, uint64_t size);
+
+/**
+ * rbitmap_get_words:
+ * @rb: RBitmap to operate on.
+ * @first: Index of the first 64-bit word to return.
+ * @nr: Number of words to return.
+ * @words: Buffer for @nr words.
+ *
+ * Store bits 64 * @first to 64 * (@first + @nr) - 1 as a plain bitmap of
+ * 64-bit words in host byte order.  Bits beyond the size of the RBitmap
+ * are returned as clear.
+ */
+void rbitmap_get_words(const RBitmap *rb, uint64_t first, uint64_t nr,
+                       uint64_t *words);
+
+/**
+ * rbitmap_put_words:
+ * @rb: RBitmap to operate on.
+ * @first: Index of the first 64-bit word to store.
+ * @nr: Number of words to store.
+ * @words: Plain bitmap in the format returned by rbitmap_get_words.
+ *
+ * Replace bits 64 * @first to 64 * (@first + @nr) - 1 with @words.  Bits
+ * beyond the size of the RBitmap are ignored.
+ */
+void rbitmap_put_words(RBitmap *rb, uint64_t first, uint64_t nr,
+                       const uint64_t *words);
+
+#endif
@@ -164,20 +164,28 @@ int qio_channel_socket_connect_sync(QIOChannelSocket *ioc,
         return -1;
     }
 
+    qio_channel_socket_enable_zero_copy(ioc);
+
+    qio_channel_set_feature(QIO_CHANNEL(ioc),
+                            QIO_CHANNEL_FEATURE_READ_MSG_PEEK);
+
+    return 0;
+}
+
+
+bool qio_channel_socket_enable_zero_copy(QIOChannelSocket *ioc)
+{
 #ifdef QEMU_MSG_ZEROCOPY
-    int ret, v = 1;
-    ret = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v));
-    if (ret == 0) {
+    int v = 1;
+
+    if (setsockopt(ioc->fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v)) == 0) {
         /* Zero copy available on host */
         qio_channel_set_feature(QIO_CHANNEL(ioc),
                                 QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+        return true;
     }
 #endif
-
-    qio_channel_set_feature(QIO_CHANNEL(ioc),
-                            QIO_CHANNEL_FEATURE_READ_MSG_PEEK);
-
-    return 0;
+    return false;
 }
 
 
@@ -498,6 +506,12 @@ static void qio_channel_socket_copy_fds(struct msghdr *msg,
 }
 
 
+#ifdef QEMU_MSG_ZEROCOPY
+static int qio_channel_socket_reap_errqueue(QIOChannelSocket *sioc,
+                                            bool wait,
+                                            Error **errp);
+#endif
+
 static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
                                         const struct iovec *iov,
                                         size_t niov,
@@ -533,6 +547,17 @@ static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
     ret = recvmsg(sioc->fd, &msg, sflags);
     if (ret < 0) {
         if (errno == EAGAIN) {
+#ifdef QEMU_MSG_ZEROCOPY
+            /*
+             * Pending MSG_ZEROCOPY notifications keep POLLERR asserted,
+             * which would wake up a reader waiting for input over and
+             * over.  Consume them before going back to sleep.
+             */
+            if (sioc->zero_copy_queued != sioc->zero_copy_sent &&
+                qio_channel_socket_reap_errqueue(sioc, false, errp) < 0) {
+                return -1;
+            }
+#endif
             return QIO_CHANNEL_ERR_BLOCK;
         }
         if (errno == EINTR) {
@@ -565,6 +590,7 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
     char control[CMSG_SPACE(sizeof(int) * SOCKET_MAX_FDS)];
     size_t fdsize = sizeof(int) * nfds;
     struct cmsghdr *cmsg;
+    bool zero_copy = false;
     int sflags = 0;
 
     memset(control, 0, CMSG_SPACE(sizeof(int) * SOCKET_MAX_FDS));
@@ -593,6 +619,7 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
     if (flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) {
 #ifdef QEMU_MSG_ZEROCOPY
         sflags = MSG_ZEROCOPY;
+        zero_copy = true;
 #else
         /*
          * We expect QIOChannel class entry point to have
@@ -611,7 +638,19 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
         case EINTR:
             goto retry;
         case ENOBUFS:
-            if (flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) {
+            if (zero_copy &&
+                (flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY_FALLBACK)) {
+                /*
+                 * The process can't lock enough memory for MSG_ZEROCOPY,
+                 * send this buffer the ordinary way instead.  The caller
+                 * may still reuse it right away in that case.
+                 */
+                trace_qio_channel_socket_zero_copy_fallback(sioc);
+                sflags = 0;
+                zero_copy = false;
+                goto retry;
+            }
+            if (zero_copy) {
                 error_setg_errno(errp, errno,
                                  "Process can't lock enough memory for using MSG_ZEROCOPY");
                 return -1;
@@ -624,7 +663,7 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
         return -1;
     }
 
-    if (flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) {
+    if (zero_copy) {
         sioc->zero_copy_queued++;
     }
 
@@ -725,10 +764,19 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
 
 
 #ifdef QEMU_MSG_ZEROCOPY
-static int qio_channel_socket_flush(QIOChannel *ioc,
-                                    Error **errp)
+/*
+ * Collect MSG_ZEROCOPY completion notifications from the socket error
+ * queue. If @wait is true, block until all queued sends have completed,
+ * otherwise only consume the notifications that are already available.
+ *
+ * Returns -1 on error, 1 if every completed send fell back to copying and
+ * 0 otherwise.
+ */
+static int qio_channel_socket_reap_errqueue(QIOChannelSocket *sioc,
+                                            bool wait,
+                                            Error **errp)
 {
-    QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
+    QIOChannel *ioc = QIO_CHANNEL(sioc);
     struct msghdr msg = {};
     struct sock_extended_err *serr;
     struct cmsghdr *cm;
@@ -751,6 +799,9 @@ static int qio_channel_socket_flush(QIOChannel *ioc,
         if (received < 0) {
             switch (errno) {
             case EAGAIN:
+                if (!wait) {
+                    return ret;
+                }
                 /* Nothing on errqueue, wait until something is available */
                 qio_channel_wait(ioc, G_IO_ERR);
                 continue;
@@ -800,6 +851,27 @@ static int qio_channel_socket_flush(QIOChannel *ioc,
     return ret;
 }
 
+static int qio_channel_socket_flush(QIOChannel *ioc,
+                                    Error **errp)
+{
+    return qio_channel_socket_reap_errqueue(QIO_CHANNEL_SOCKET(ioc), true,
+                                            errp);
+}
+
+int qio_channel_socket_reap_zero_copy(QIOChannelSocket *ioc,
+                                      Error **errp)
+{
+    return qio_channel_socket_reap_errqueue(ioc, false, errp) < 0 ? -1 : 0;
+}
+
+#else /* QEMU_MSG_ZEROCOPY */
+
+int qio_channel_socket_reap_zero_copy(QIOChannelSocket *ioc,
+                                      Error **errp)
+{
+    return 0;
+}
+
 #endif /* QEMU_MSG_ZEROCOPY */
 
 static int
@@ -22,6 +22,9 @@
 #include "migration/channel-block.h"
 #include "qapi/error.h"
 #include "block/block.h"
+#include "block/aio.h"
+#include "qemu/coroutine.h"
+#include "qemu/main-loop.h"
 #include "trace.h"
 
 QIOChannelBlock *
@@ -34,6 +37,26 @@ qio_channel_block_new(BlockDriverState *bs)
     bdrv_ref(bs);
     ioc->bs = bs;
 
+    /* The VMState region is addressable, see qio_channel_block_pwritev() */
+    qio_channel_set_feature(QIO_CHANNEL(ioc), QIO_CHANNEL_FEATURE_SEEKABLE);
+
+    return ioc;
+}
+
+
+QIOChannelBlock *
+qio_channel_block_new_iothread(BlockDriverState *bs, Error **errp)
+{
+    QIOChannelBlock *ioc = qio_channel_block_new(bs);
+    g_autofree char *id = g_strdup_printf("%s-%p", TYPE_QIO_CHANNEL_BLOCK,
+                                          ioc);
+
+    ioc->iothread = iothread_create(id, errp);
+    if (!ioc->iothread) {
+        object_unref(OBJECT(ioc));
+        return NULL;
+    }
+
     return ioc;
 }
 
@@ -43,6 +66,7 @@ qio_channel_block_finalize(Object *obj)
 {
     QIOChannelBlock *ioc = QIO_CHANNEL_BLOCK(obj);
 
+    g_clear_pointer(&ioc->iothread, iothread_destroy);
     g_clear_pointer(&ioc->bs, bdrv_unref);
 }
 
@@ -97,6 +121,116 @@ qio_channel_block_writev(QIOChannel *ioc,
 }
 
 
+/*
+ * Positioned I/O may be issued by threads that are neither the main
+ * thread nor running in a coroutine, e.g. the multifd channels during
+ * savevm/loadvm.  Such requests are handed to a coroutine in the
+ * channel's I/O thread, or else in the AioContext of the block device,
+ * and the caller sleeps until they complete.  In the latter case the
+ * thread that holds the AioContext has to keep polling it meanwhile.
+ */
+typedef struct QIOChannelBlockRequest {
+    BlockDriverState *bs;
+    QEMUIOVector *qiov;
+    off_t offset;
+    bool is_write;
+    int ret;
+    QemuSemaphore done;
+} QIOChannelBlockRequest;
+
+
+static void coroutine_fn
+qio_channel_block_request_co(void *opaque)
+{
+    QIOChannelBlockRequest *req = opaque;
+
+    GRAPH_RDLOCK_GUARD();
+
+    if (req->is_write) {
+        req->ret = bdrv_writev_vmstate(req->bs, req->qiov, req->offset);
+    } else {
+        req->ret = bdrv_readv_vmstate(req->bs, req->qiov, req->offset);
+    }
+    qemu_sem_post(&req->done);
+}
+
+
+static int
+qio_channel_block_rw(QIOChannelBlock *bioc,
+                     QEMUIOVector *qiov,
+                     off_t offset,
+                     bool is_write)
+{
+    QIOChannelBlockRequest req = {
+        .bs = bioc->bs,
+        .qiov = qiov,
+        .offset = offset,
+        .is_write = is_write,
+    };
+    AioContext *ctx;
+    Coroutine *co;
+
+    if (qemu_in_coroutine() || qemu_in_main_thread()) {
+        return is_write ? bdrv_writev_vmstate(bioc->bs, qiov, offset) :
+                          bdrv_readv_vmstate(bioc->bs, qiov, offset);
+    }
+
+    qemu_sem_init(&req.done, 0);
+    co = qemu_coroutine_create(qio_channel_block_request_co, &req);
+    ctx = bioc->iothread ? iothread_get_aio_context(bioc->iothread) :
+                           bdrv_get_aio_context(bioc->bs);
+    aio_co_schedule(ctx, co);
+    qemu_sem_wait(&req.done);
+    qemu_sem_destroy(&req.done);
+
+    return req.ret;
+}
+
+
+static ssize_t
+qio_channel_block_preadv(QIOChannel *ioc,
+                         const struct iovec *iov,
+                         size_t niov,
+                         off_t offset,
+                         Error **errp)
+{
+    QIOChannelBlock *bioc = QIO_CHANNEL_BLOCK(ioc);
+    QEMUIOVector qiov;
+    int ret;
+
+    qemu_iovec_init_external(&qiov, (struct iovec *)iov, niov);
+    ret = qio_channel_block_rw(bioc, &qiov, offset, false);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "bdrv_readv_vmstate failed");
+        return -1;
+    }
+
+    return qiov.size;
+}
+
+
+static ssize_t
+qio_channel_block_pwritev(QIOChannel *ioc,
+                          const struct iovec *iov,
+                          size_t niov,
+                          off_t offset,
+                          Error **errp)
+{
+    QIOChannelBlock *bioc = QIO_CHANNEL_BLOCK(ioc);
+    QEMUIOVector qiov;
+    int ret;
+
+    qemu_iovec_init_external(&qiov, (struct iovec *)iov, niov);
+    ret = qio_channel_block_rw(bioc, &qiov, offset, true);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "bdrv_writev_vmstate failed");
+        return -1;
+    }
+
+    return qiov.size;
+}
+
+
 static int
 qio_channel_block_set_blocking(QIOChannel *ioc,
                                bool enabled,
@@ -123,7 +257,7 @@ qio_channel_block_seek(QIOChannel *ioc,
         bioc->offset = offset;
         break;
     case SEEK_CUR:
-        bioc->offset += whence;
+        bioc->offset += offset;
         break;
     case SEEK_END:
         error_setg(errp, "Size of VMstate region is unknown");
@@ -176,6 +310,8 @@ qio_channel_block_class_init(ObjectClass *klass,
 
     ioc_klass->io_writev = qio_channel_block_writev;
     ioc_klass->io_readv = qio_channel_block_readv;
+    ioc_klass->io_pwritev = qio_channel_block_pwritev;
+    ioc_klass->io_preadv = qio_channel_block_preadv;
     ioc_klass->io_set_blocking = qio_channel_block_set_blocking;
     ioc_klass->io_seek = qio_channel_block_seek;
     ioc_klass->io_close = qio_channel_block_close;
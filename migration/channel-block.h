@@ -23,6 +23,7 @@
 
 #include "io/channel.h"
 #include "qom/object.h"
+#include "sysemu/iothread.h"
 
 #define TYPE_QIO_CHANNEL_BLOCK "qio-channel-block"
 OBJECT_DECLARE_SIMPLE_TYPE(QIOChannelBlock, QIO_CHANNEL_BLOCK)
@@ -40,6 +41,7 @@ struct QIOChannelBlock {
     QIOChannel parent;
     BlockDriverState *bs;
     off_t offset;
+    IOThread *iothread;
 };
 
 
@@ -56,4 +58,20 @@ struct QIOChannelBlock {
 QIOChannelBlock *
 qio_channel_block_new(BlockDriverState *bs);
 
+/**
+ * qio_channel_block_new_iothread:
+ * @bs: the block driver state
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Like qio_channel_block_new(), but positioned I/O that
+ * threads outside of the block layer issue on the channel
+ * runs in an I/O thread of its own, instead of the AioContext
+ * of @bs.  Several such channels on the same device can thus
+ * have their I/O processed concurrently.
+ *
+ * Returns: the new channel object, or NULL on error
+ */
+QIOChannelBlock *
+qio_channel_block_new_iothread(BlockDriverState *bs, Error **errp);
+
 #endif /* QIO_CHANNEL_BLOCK_H */
@@ -7,16 +7,26 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "channel.h"
 #include "file.h"
 #include "migration.h"
+#include "options.h"
 #include "io/channel-file.h"
 #include "io/channel-util.h"
 #include "trace.h"
 
 #define OFFSET_OPTION ",offset="
 
+static struct FileOutgoingArgs {
+    char *fname;
+} outgoing_args;
+
+static struct FileIncomingArgs {
+    char *fname;
+} incoming_args;
+
 /* Remove the offset option from @filespec and return it in @offsetp. */
 
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
@@ -36,6 +46,45 @@ int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
     return 0;
 }
 
+/*
+ * Open one more descriptor on the outgoing migration file for a multifd
+ * channel and hand it to @f.  Multifd channels only write guest pages at
+ * fixed offsets, so they can bypass the page cache if requested.
+ */
+void file_send_channel_create(QIOTaskFunc f, void *data)
+{
+    QIOChannelFile *ioc;
+    QIOTask *task;
+    Error *err = NULL;
+    int flags = O_WRONLY;
+
+#ifdef O_DIRECT
+    if (migrate_direct_io()) {
+        flags |= O_DIRECT;
+    }
+#endif
+
+    ioc = qio_channel_file_new_path(outgoing_args.fname, flags, 0, &err);
+    task = qio_task_new(OBJECT(ioc), f, data, NULL);
+    if (!ioc) {
+        qio_task_set_error(task, err);
+    }
+    qio_task_complete(task);
+}
+
+int file_send_channel_destroy(QIOChannel *ioc)
+{
+    object_unref(OBJECT(ioc));
+    return 0;
+}
+
+/* Called once all the multifd channels have been destroyed */
+void file_cleanup_outgoing_migration(void)
+{
+    g_free(outgoing_args.fname);
+    outgoing_args.fname = NULL;
+}
+
 void file_start_outgoing_migration(MigrationState *s,
                                    FileMigrationArgs *file_args, Error **errp)
 {
@@ -56,16 +105,78 @@ void file_start_outgoing_migration(MigrationState *s,
     if (offset && qio_channel_io_seek(ioc, offset, SEEK_SET, errp) < 0) {
         return;
     }
+
+    g_free(outgoing_args.fname);
+    outgoing_args.fname = g_strdup(filename);
+
     qio_channel_set_name(ioc, "migration-file-outgoing");
     migration_channel_connect(s, ioc, NULL, NULL);
 }
 
+/*
+ * With multifd the pages are read back by the multifd threads, each using
+ * its own descriptor on the migration file.  They are created once the
+ * main channel is set up; the last one starts the incoming migration.
+ */
+static void file_create_incoming_channels(const char *filename)
+{
+    int i, flags = O_RDONLY;
+
+#ifdef O_DIRECT
+    if (migrate_direct_io()) {
+        flags |= O_DIRECT;
+    }
+#endif
+
+    for (i = 0; i < migrate_multifd_channels(); i++) {
+        QIOChannelFile *fioc;
+        Error *err = NULL;
+
+        fioc = qio_channel_file_new_path(filename, flags, 0, &err);
+        if (!fioc) {
+            error_report_err(err);
+            return;
+        }
+        qio_channel_set_name(QIO_CHANNEL(fioc), "migration-file-incoming");
+        migration_channel_process_incoming(QIO_CHANNEL(fioc));
+        object_unref(OBJECT(fioc));
+    }
+}
+
+/*
+ * Open a new read-only descriptor on the incoming migration file.  It
+ * stays usable after the migration channels have been closed, e.g. to
+ * load guest pages lazily once the VM is running.
+ */
+QIOChannel *file_open_incoming_channel(Error **errp)
+{
+    QIOChannelFile *fioc;
+
+    if (!incoming_args.fname) {
+        error_setg(errp, "No incoming migration file");
+        return NULL;
+    }
+
+    fioc = qio_channel_file_new_path(incoming_args.fname, O_RDONLY, 0, errp);
+    if (!fioc) {
+        return NULL;
+    }
+    qio_channel_set_name(QIO_CHANNEL(fioc), "migration-file-incoming");
+    return QIO_CHANNEL(fioc);
+}
+
 static gboolean file_accept_incoming_migration(QIOChannel *ioc,
                                                GIOCondition condition,
                                                gpointer opaque)
 {
+    g_autofree char *filename = opaque;
+
     migration_channel_process_incoming(ioc);
     object_unref(OBJECT(ioc));
+
+    if (migrate_multifd()) {
+        file_create_incoming_channels(filename);
+    }
     return G_SOURCE_REMOVE;
 }
 
@@ -87,9 +198,12 @@ void file_start_incoming_migration(FileMigrationArgs *file_args, Error **errp)
     if (offset && qio_channel_io_seek(ioc, offset, SEEK_SET, errp) < 0) {
         return;
     }
+    g_free(incoming_args.fname);
+    incoming_args.fname = g_strdup(filename);
+
     qio_channel_set_name(QIO_CHANNEL(ioc), "migration-file-incoming");
     qio_channel_add_watch_full(ioc, G_IO_IN,
                                file_accept_incoming_migration,
-                               NULL, NULL,
+                               g_strdup(filename), NULL,
                                g_main_context_get_thread_default());
 }
@@ -0,0 +1,639 @@
+/*
+ * Lazy restore of guest RAM from a mapped-ram migration file
+ *
+ * With mapped-ram every guest page has a fixed offset in the migration
+ * file, so the destination doesn't need to read guest RAM before the VM
+ * runs.  Instead, RAM is left empty and registered with userfaultfd: a
+ * fault thread loads each page from the file when it is first touched,
+ * while a prefetch thread walks the rest of RAM in the background.  Once
+ * every page is in place, userfaultfd is unregistered and the file is no
+ * longer needed.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/main-loop.h"
+#include "qemu/memalign.h"
+#include "qemu/rcu.h"
+#include "qemu/rcu_queue.h"
+#include "qemu/stats64.h"
+#include "qemu/thread.h"
+#include "qemu/userfaultfd.h"
+#include "qapi/error.h"
+#include "exec/memory.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "sysemu/runstate.h"
+#include "sysemu/sysemu.h"
+#include "io/channel.h"
+#include "file.h"
+#include "lazy-restore.h"
+#include "migration.h"
+#include "ram.h"
+#include "trace.h"
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+
+/* Size of the reads done by the prefetch thread */
+#define LAZY_RESTORE_PREFETCH_SIZE 0x100000
+
+typedef struct LazyRestoreBlock {
+    struct rcu_head rcu;
+    QTAILQ_ENTRY(LazyRestoreBlock) next;
+    RAMBlock *rb;
+    /* host page size of the block */
+    size_t page_size;
+    /* number of host pages in the block */
+    unsigned long nr_pages;
+    /* target pages that have data in the file, the others are zero */
+    unsigned long *file_bmap;
+    /* host pages that are already in place, set atomically */
+    unsigned long *placed;
+} LazyRestoreBlock;
+
+static struct LazyRestoreState {
+    /* lazy restore has been set up for at least one block */
+    bool active;
+    /* read-only channel on the migration file */
+    QIOChannel *ioc;
+    /* userfaultfd covering all lazily restored blocks */
+    int uffd;
+    /* used to tell the fault thread to quit */
+    int event_fd;
+    bool quit;
+    QemuThread fault_thread;
+    QemuThread prefetch_thread;
+    /* size of the per-thread bounce buffers */
+    size_t buf_size;
+    /* protects updates to @blocks, which the fault thread reads under RCU */
+    QemuMutex lock;
+    QTAILQ_HEAD(, LazyRestoreBlock) blocks;
+    /* incremented whenever a block is removed from @blocks */
+    unsigned blocks_gen;
+    /* block of the last fault and @blocks_gen then, for the fault thread */
+    LazyRestoreBlock *mru_block;
+    unsigned mru_gen;
+    /* bytes of guest RAM covered by @blocks */
+    uint64_t total_bytes;
+    /* bytes of guest RAM already in place */
+    Stat64 placed_bytes;
+    /* number of faults resolved by the fault thread */
+    Stat64 faults;
+    /* set when the VM is resumed, for the prefetch thread to retry */
+    QemuEvent resumed;
+    VMChangeStateEntry *vmstate_change;
+} lazy;
+
+bool lazy_restore_supported(Error **errp)
+{
+    RAMBlock *block;
+    bool ret = false;
+    int uffd;
+
+    if (enable_mlock) {
+        error_setg(errp, "Lazy restore is not compatible with mlock");
+        return false;
+    }
+
+    uffd = uffd_create_fd(0, false);
+    if (uffd < 0) {
+        error_setg(errp, "Lazy restore requires userfaultfd");
+        return false;
+    }
+
+    RCU_READ_LOCK_GUARD();
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        uint64_t ioctls;
+
+        if (uffd_register_memory(uffd, block->host, block->max_length,
+                                 UFFDIO_REGISTER_MODE_MISSING, &ioctls) ||
+            !(ioctls & BIT(_UFFDIO_COPY))) {
+            error_setg(errp, "RAM block %s cannot be restored lazily",
+                       block->idstr);
+            goto out;
+        }
+    }
+    ret = true;
+
+out:
+    uffd_close_fd(uffd);
+    return ret;
+}
+
+static bool lazy_restore_block_contains(LazyRestoreBlock *lb,
+                                        uint64_t address)
+{
+    return address - (uintptr_t)lb->rb->host < lb->rb->used_length;
+}
+
+/*
+ * Called from the fault thread, in RCU critical section.  Faults tend to
+ * hit the same block over and over, so try the last one before walking
+ * the list.  It can only have been freed if @blocks_gen changed since it
+ * was found: blocks are freed a grace period after the increment.
+ */
+static LazyRestoreBlock *lazy_restore_find_block(uint64_t address)
+{
+    unsigned gen = qatomic_read(&lazy.blocks_gen);
+    LazyRestoreBlock *lb = lazy.mru_block;
+
+    if (lb && lazy.mru_gen == gen && lazy_restore_block_contains(lb, address)) {
+        return lb;
+    }
+    QTAILQ_FOREACH_RCU(lb, &lazy.blocks, next) {
+        if (lazy_restore_block_contains(lb, address)) {
+            lazy.mru_block = lb;
+            lazy.mru_gen = gen;
+            return lb;
+        }
+    }
+    return NULL;
+}
+
+static void lazy_restore_free_block(LazyRestoreBlock *lb)
+{
+    g_free(lb->file_bmap);
+    g_free(lb->placed);
+    g_free(lb);
+}
+
+/* Does any target page of host pages [@page, @page + @npages) have data? */
+static bool lazy_restore_has_data(LazyRestoreBlock *lb, unsigned long page,
+                                  unsigned long npages)
+{
+    unsigned long ratio = lb->page_size / qemu_target_page_size();
+    unsigned long start = page * ratio;
+    unsigned long end = (page + npages) * ratio;
+
+    return find_next_bit(lb->file_bmap, end, start) < end;
+}
+
+static int lazy_restore_read(LazyRestoreBlock *lb, unsigned long page,
+                             size_t len, uint8_t *buf, Error **errp)
+{
+    off_t offset = lb->rb->pages_offset + (off_t)page * lb->page_size;
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t ret = qio_channel_pread(lazy.ioc, (char *)buf + done,
+                                        len - done, offset + done, errp);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret == 0) {
+            /* Zero pages at the end of the file need not be allocated */
+            memset(buf + done, 0, len - done);
+            break;
+        }
+        done += ret;
+    }
+    return 0;
+}
+
+static int lazy_restore_uffd_place(void *host, void *from, uint64_t len)
+{
+    int ret;
+
+    if (from) {
+        struct uffdio_copy copy_struct;
+
+        copy_struct.dst = (uint64_t)(uintptr_t)host;
+        copy_struct.src = (uint64_t)(uintptr_t)from;
+        copy_struct.len = len;
+        copy_struct.mode = 0;
+        ret = ioctl(lazy.uffd, UFFDIO_COPY, &copy_struct);
+    } else {
+        struct uffdio_zeropage zero_struct;
+
+        zero_struct.range.start = (uint64_t)(uintptr_t)host;
+        zero_struct.range.len = len;
+        zero_struct.mode = 0;
+        ret = ioctl(lazy.uffd, UFFDIO_ZEROPAGE, &zero_struct);
+    }
+    return ret ? -errno : 0;
+}
+
+static void lazy_restore_mark_placed(LazyRestoreBlock *lb, unsigned long page,
+                                     unsigned long npages)
+{
+    unsigned long i;
+
+    for (i = page; i < page + npages; i++) {
+        unsigned long *p = lb->placed + BIT_WORD(i);
+        unsigned long mask = BIT_MASK(i);
+
+        /* Both threads may race to place a page; account it only once */
+        if (!(qatomic_fetch_or(p, mask) & mask)) {
+            stat64_add(&lazy.placed_bytes, lb->page_size);
+        }
+    }
+}
+
+/*
+ * Place host pages [@page, @page + @npages) of @lb, using @buf as bounce
+ * buffer.  Pages that the other thread placed in the meantime are left
+ * alone.
+ */
+static int lazy_restore_place(LazyRestoreBlock *lb, unsigned long page,
+                              unsigned long npages, uint8_t *buf,
+                              Error **errp)
+{
+    uint8_t *host = lb->rb->host + page * lb->page_size;
+    size_t len = npages * lb->page_size;
+    uint8_t *from = buf;
+    unsigned long i;
+    int ret;
+
+    if (lazy_restore_has_data(lb, page, npages)) {
+        if (lazy_restore_read(lb, page, len, buf, errp)) {
+            return -1;
+        }
+    } else if (qemu_ram_is_uf_zeroable(lb->rb)) {
+        from = NULL;
+    } else {
+        memset(buf, 0, len);
+    }
+
+    ret = lazy_restore_uffd_place(host, from, len);
+    if (ret == -EEXIST && npages > 1) {
+        /* Part of the range is already there, go page by page */
+        for (i = 0; i < npages; i++) {
+            ret = lazy_restore_uffd_place(host + i * lb->page_size,
+                                          from ? from + i * lb->page_size
+                                               : NULL,
+                                          lb->page_size);
+            if (ret && ret != -EEXIST) {
+                break;
+            }
+            lazy_restore_mark_placed(lb, page + i, 1);
+            ret = 0;
+        }
+    } else if (!ret || ret == -EEXIST) {
+        lazy_restore_mark_placed(lb, page, npages);
+        ret = 0;
+    }
+
+    if (ret) {
+        error_setg_errno(errp, -ret, "Failed to place %s offset 0x%" PRIx64,
+                         lb->rb->idstr, (uint64_t)page * lb->page_size);
+    }
+    return ret;
+}
+
+static int lazy_restore_handle_fault(uint64_t address, uint8_t *buf,
+                                     Error **errp)
+{
+    LazyRestoreBlock *lb;
+    ram_addr_t offset;
+
+    RCU_READ_LOCK_GUARD();
+
+    lb = lazy_restore_find_block(address);
+    if (!lb) {
+        error_setg(errp, "Fault outside lazily restored RAM: 0x%" PRIx64,
+                   address);
+        return -1;
+    }
+
+    offset = address - (uintptr_t)lb->rb->host;
+    trace_lazy_restore_fault(lb->rb->idstr, offset);
+    stat64_add(&lazy.faults, 1);
+    return lazy_restore_place(lb, offset / lb->page_size, 1, buf, errp);
+}
+
+/*
+ * Guest RAM could not be loaded: record the error for query-migrate and
+ * stop the VM, as for a disk with werror=stop.  Loading is retried once
+ * the VM is resumed.
+ */
+static void lazy_restore_fail(Error *err)
+{
+    migrate_set_error(migrate_get_current(), err);
+    error_report_err(err);
+    qemu_system_vmstop_request_prepare();
+    qemu_system_vmstop_request(RUN_STATE_IO_ERROR);
+}
+
+static void lazy_restore_vm_state_change(void *opaque, bool running,
+                                         RunState state)
+{
+    if (running) {
+        qemu_event_set(&lazy.resumed);
+    }
+}
+
+static void *lazy_restore_fault_thread(void *opaque)
+{
+    struct pollfd pfd[2] = {
+        { .fd = lazy.uffd, .events = POLLIN },
+        { .fd = lazy.event_fd, .events = POLLIN },
+    };
+    uint8_t *buf = qemu_memalign(qemu_real_host_page_size(),
+                                 qemu_ram_pagesize_largest());
+    struct uffd_msg msg;
+    Error *local_err = NULL;
+    int ret;
+
+    rcu_register_thread();
+
+    while (!qatomic_read(&lazy.quit)) {
+        if (poll(pfd, ARRAY_SIZE(pfd), -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error_setg_errno(&local_err, errno, "Lazy restore poll failed");
+            lazy_restore_fail(local_err);
+            break;
+        }
+        if (!(pfd[0].revents & POLLIN)) {
+            /* Woken up to quit */
+            continue;
+        }
+
+        ret = uffd_read_events(lazy.uffd, &msg, 1);
+        if (ret < 0) {
+            error_setg(&local_err, "Failed to read userfaultfd events");
+            lazy_restore_fail(local_err);
+            break;
+        }
+        if (ret == 0 || msg.event != UFFD_EVENT_PAGEFAULT) {
+            continue;
+        }
+        /*
+         * Keep serving other faults on failure; this one is raised again
+         * when the faulting thread retries after the VM is resumed.
+         */
+        if (lazy_restore_handle_fault(msg.arg.pagefault.address, buf,
+                                      &local_err)) {
+            lazy_restore_fail(local_err);
+            local_err = NULL;
+        }
+    }
+
+    rcu_unregister_thread();
+    qemu_vfree(buf);
+    return NULL;
+}
+
+static void lazy_restore_cleanup(void)
+{
+    LazyRestoreBlock *lb, *tmp;
+    uint64_t one = 1;
+
+    qatomic_set(&lazy.quit, true);
+    if (write(lazy.event_fd, &one, sizeof(one)) != sizeof(one)) {
+        error_report("%s: failed to wake up the fault thread", __func__);
+    }
+    qemu_thread_join(&lazy.fault_thread);
+
+    qemu_mutex_lock_iothread();
+    qemu_del_vm_change_state_handler(lazy.vmstate_change);
+    qemu_mutex_unlock_iothread();
+    lazy.vmstate_change = NULL;
+    qemu_event_destroy(&lazy.resumed);
+
+    /* The fault thread is gone, nothing else looks at the blocks */
+    QTAILQ_FOREACH_SAFE(lb, &lazy.blocks, next, tmp) {
+        QTAILQ_REMOVE(&lazy.blocks, lb, next);
+        uffd_unregister_memory(lazy.uffd, lb->rb->host, lb->rb->used_length);
+        memory_region_unref(lb->rb->mr);
+        lazy_restore_free_block(lb);
+    }
+    qemu_mutex_destroy(&lazy.lock);
+
+    uffd_close_fd(lazy.uffd);
+    close(lazy.event_fd);
+    object_unref(OBJECT(lazy.ioc));
+    lazy.ioc = NULL;
+    ram_block_discard_disable(false);
+
+    trace_lazy_restore_complete(stat64_get(&lazy.faults));
+    qatomic_set(&lazy.active, false);
+}
+
+static int lazy_restore_prefetch_block(LazyRestoreBlock *lb, uint8_t *buf,
+                                       Error **errp)
+{
+    unsigned long chunk = MAX(1, lazy.buf_size / lb->page_size);
+    unsigned long page, end, n;
+    bool data;
+
+    page = find_first_zero_bit(lb->placed, lb->nr_pages);
+    while (page < lb->nr_pages) {
+        end = find_next_bit(lb->placed, lb->nr_pages, page);
+        end = MIN(end, page + chunk);
+
+        /* Split the run so that it is either all data or all zeroes */
+        data = lazy_restore_has_data(lb, page, 1);
+        for (n = 1; page + n < end; n++) {
+            if (lazy_restore_has_data(lb, page + n, 1) != data) {
+                break;
+            }
+        }
+
+        if (lazy_restore_place(lb, page, n, buf, errp)) {
+            return -1;
+        }
+        page = find_next_zero_bit(lb->placed, lb->nr_pages, page + n);
+    }
+    return 0;
+}
+
+static void *lazy_restore_prefetch_thread(void *opaque)
+{
+    uint8_t *buf = qemu_memalign(qemu_real_host_page_size(), lazy.buf_size);
+    Error *local_err = NULL;
+    LazyRestoreBlock *lb;
+
+    rcu_register_thread();
+
+    /*
+     * No more blocks are added or removed once the incoming migration is
+     * complete, so the list can be walked outside RCU critical sections.
+     */
+    QTAILQ_FOREACH(lb, &lazy.blocks, next) {
+        while (lazy_restore_prefetch_block(lb, buf, &local_err)) {
+            /* Stop the VM and try again when it is resumed */
+            qemu_event_reset(&lazy.resumed);
+            lazy_restore_fail(local_err);
+            local_err = NULL;
+            qemu_event_wait(&lazy.resumed);
+        }
+    }
+
+    qemu_vfree(buf);
+    lazy_restore_cleanup();
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static bool lazy_restore_setup(Error **errp)
+{
+    lazy.ioc = file_open_incoming_channel(errp);
+    if (!lazy.ioc) {
+        return false;
+    }
+
+    if (ram_block_discard_disable(true)) {
+        error_setg(errp, "Lazy restore conflicts with RAM discard");
+        goto err_ioc;
+    }
+
+    lazy.uffd = uffd_create_fd(0, true);
+    if (lazy.uffd < 0) {
+        error_setg(errp, "Failed to create userfaultfd");
+        goto err_discard;
+    }
+
+    lazy.event_fd = eventfd(0, EFD_CLOEXEC);
+    if (lazy.event_fd == -1) {
+        error_setg_errno(errp, errno, "Failed to create eventfd");
+        uffd_close_fd(lazy.uffd);
+        goto err_discard;
+    }
+
+    lazy.buf_size = MAX(LAZY_RESTORE_PREFETCH_SIZE,
+                        qemu_ram_pagesize_largest());
+    QTAILQ_INIT(&lazy.blocks);
+    lazy.blocks_gen = 0;
+    lazy.mru_block = NULL;
+    lazy.total_bytes = 0;
+    lazy.quit = false;
+    stat64_init(&lazy.placed_bytes, 0);
+    stat64_init(&lazy.faults, 0);
+    qemu_mutex_init(&lazy.lock);
+
+    /*
+     * Start resolving faults right away, loading device state may
+     * already touch guest RAM.
+     */
+    qemu_thread_create(&lazy.fault_thread, "lazy-restore-fault",
+                       lazy_restore_fault_thread, NULL, QEMU_THREAD_JOINABLE);
+    lazy.active = true;
+    return true;
+
+err_discard:
+    ram_block_discard_disable(false);
+err_ioc:
+    object_unref(OBJECT(lazy.ioc));
+    lazy.ioc = NULL;
+    return false;
+}
+
+bool lazy_restore_add_block(RAMBlock *block, unsigned long *bitmap,
+                            Error **errp)
+{
+    g_autofree unsigned long *file_bmap = bitmap;
+    size_t page_size = qemu_ram_pagesize(block);
+    LazyRestoreBlock *lb;
+    uint64_t ioctls;
+
+    if (!lazy.active && !lazy_restore_setup(errp)) {
+        return false;
+    }
+
+    lb = g_new0(LazyRestoreBlock, 1);
+    lb->rb = block;
+    lb->page_size = page_size;
+    lb->nr_pages = block->used_length / page_size;
+    lb->file_bmap = g_steal_pointer(&file_bmap);
+    lb->placed = bitmap_new(lb->nr_pages);
+
+    /* Make the block visible to the fault thread before registering it */
+    WITH_QEMU_LOCK_GUARD(&lazy.lock) {
+        QTAILQ_INSERT_TAIL_RCU(&lazy.blocks, lb, next);
+    }
+
+    if (uffd_register_memory(lazy.uffd, block->host, block->used_length,
+                             UFFDIO_REGISTER_MODE_MISSING, &ioctls) ||
+        !(ioctls & BIT(_UFFDIO_COPY))) {
+        error_setg(errp, "Failed to register RAM block %s with userfaultfd",
+                   block->idstr);
+        goto err;
+    }
+    if (ioctls & BIT(_UFFDIO_ZEROPAGE)) {
+        qemu_ram_set_uf_zeroable(block);
+    }
+
+    /* Drop anything written at startup, e.g. ROMs; it is in the file */
+    if (ram_discard_range(block->idstr, 0, block->used_length)) {
+        error_setg(errp, "Failed to discard RAM block %s", block->idstr);
+        uffd_unregister_memory(lazy.uffd, block->host, block->used_length);
+        goto err;
+    }
+
+    /* Keep the block alive until every page has been loaded */
+    memory_region_ref(block->mr);
+
+    trace_lazy_restore_add_block(block->idstr, block->used_length,
+                                 block->pages_offset);
+    lazy.total_bytes += block->used_length;
+    return true;
+
+err:
+    /* The fault thread may still be placing a page of the block */
+    WITH_QEMU_LOCK_GUARD(&lazy.lock) {
+        QTAILQ_REMOVE_RCU(&lazy.blocks, lb, next);
+        qatomic_inc(&lazy.blocks_gen);
+    }
+    call_rcu(lb, lazy_restore_free_block, rcu);
+    return false;
+}
+
+void lazy_restore_start_prefetch(void)
+{
+    if (!lazy.active) {
+        return;
+    }
+
+    trace_lazy_restore_start_prefetch(lazy_restore_remaining());
+    qemu_event_init(&lazy.resumed, false);
+    lazy.vmstate_change =
+        qemu_add_vm_change_state_handler(lazy_restore_vm_state_change, NULL);
+    qemu_thread_create(&lazy.prefetch_thread, "lazy-restore-prefetch",
+                       lazy_restore_prefetch_thread, NULL,
+                       QEMU_THREAD_DETACHED);
+}
+
+uint64_t lazy_restore_remaining(void)
+{
+    if (!qatomic_read(&lazy.active)) {
+        return 0;
+    }
+    return lazy.total_bytes - stat64_get(&lazy.placed_bytes);
+}
+
+#else
+/* No target OS support, stubs just fail */
+bool lazy_restore_supported(Error **errp)
+{
+    error_setg(errp, "Lazy restore is only supported on Linux");
+    return false;
+}
+
+bool lazy_restore_add_block(RAMBlock *block, unsigned long *bitmap,
+                            Error **errp)
+{
+    g_free(bitmap);
+    error_setg(errp, "Lazy restore is only supported on Linux");
+    return false;
+}
+
+void lazy_restore_start_prefetch(void)
+{
+}
+
+uint64_t lazy_restore_remaining(void)
+{
+    return 0;
+}
+#endif
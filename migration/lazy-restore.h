@@ -0,0 +1,33 @@
+/*
+ * Lazy restore of guest RAM from a mapped-ram migration file
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_LAZY_RESTORE_H
+#define QEMU_MIGRATION_LAZY_RESTORE_H
+
+#include "exec/cpu-common.h"
+
+/* Return true if the host and the RAM configuration allow lazy restore */
+bool lazy_restore_supported(Error **errp);
+
+/*
+ * Leave the pages of @block in the migration file and load them on first
+ * access instead.  @bitmap has a bit set for each target page that has
+ * data in the file; ownership is transferred to the lazy restore code.
+ */
+bool lazy_restore_add_block(RAMBlock *block, unsigned long *bitmap,
+                            Error **errp);
+
+/*
+ * Called once the incoming migration is complete: start fetching the
+ * pages that haven't been accessed yet in the background.
+ */
+void lazy_restore_start_prefetch(void);
+
+/* Bytes of guest RAM that still have to be loaded from the file */
+uint64_t lazy_restore_remaining(void);
+
+#endif
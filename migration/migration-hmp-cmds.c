@@ -113,6 +113,11 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->ram->normal_bytes >> 10);
         monitor_printf(mon, "dirty sync count: %" PRIu64 "\n",
                        info->ram->dirty_sync_count);
+        monitor_printf(mon, "dirty sync time: %" PRIu64 " us "
+                       "(max %" PRIu64 " us, total %" PRIu64 " us)\n",
+                       info->ram->dirty_sync_time,
+                       info->ram->dirty_sync_time_max,
+                       info->ram->dirty_sync_time_total);
         monitor_printf(mon, "page size: %" PRIu64 " kbytes\n",
                        info->ram->page_size >> 10);
         monitor_printf(mon, "multifd bytes: %" PRIu64 " kbytes\n",
@@ -147,6 +152,40 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         }
     }
 
+    if (info->multifd_channels) {
+        MultiFDChannelStatsList *ch;
+
+        for (ch = info->multifd_channels; ch; ch = ch->next) {
+            monitor_printf(mon, "multifd channel %" PRId64 ": "
+                           "normal %" PRIu64 " pages, "
+                           "zero %" PRIu64 " pages, "
+                           "zero pages/s %" PRIu64 ", "
+                           "%" PRIu64 " kbytes\n",
+                           ch->value->id, ch->value->normal_pages,
+                           ch->value->zero_pages,
+                           ch->value->zero_pages_per_second,
+                           ch->value->bytes >> 10);
+            if (ch->value->compression) {
+                MultiFDAdaptiveStats *comp = ch->value->compression;
+                MultiFDAdaptiveChoiceList *c;
+
+                monitor_printf(mon, "  compression: %s level %" PRId64
+                               ", link %" PRIu64 " kbytes/s\n",
+                               MultiFDCompression_str(comp->method),
+                               comp->level, comp->throughput >> 10);
+                for (c = comp->choices; c; c = c->next) {
+                    monitor_printf(mon, "    %s level %" PRId64 ": "
+                                   "%" PRIu64 " packets, "
+                                   "ratio %" PRIu64 "%%, "
+                                   "cost %" PRIu64 " ns/KiB\n",
+                                   MultiFDCompression_str(c->value->method),
+                                   c->value->level, c->value->packets,
+                                   c->value->ratio, c->value->cost);
+                }
+            }
+        }
+    }
+
     if (info->disk) {
         monitor_printf(mon, "transferred disk: %" PRIu64 " kbytes\n",
                        info->disk->transferred >> 10);
@@ -217,6 +256,18 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         g_free(str);
         visit_free(v);
     }
+    if (info->has_postcopy_faults) {
+        monitor_printf(mon, "postcopy faults: %" PRIu64 "\n",
+                       info->postcopy_faults);
+    }
+    if (info->has_postcopy_prefetch_requests) {
+        monitor_printf(mon, "postcopy prefetch requests: %" PRIu64 "\n",
+                       info->postcopy_prefetch_requests);
+    }
+    if (info->has_lazy_restore_remaining) {
+        monitor_printf(mon, "lazy restore remaining: %" PRIu64 " kbytes\n",
+                       info->lazy_restore_remaining >> 10);
+    }
     if (info->has_socket_address) {
         SocketAddressList *addr;
 
@@ -392,6 +443,17 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %s\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MODE),
             qapi_enum_lookup(&MigMode_lookup, params->mode));
+
+        assert(params->has_zero_page_detection);
+        monitor_printf(mon, "%s: %s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_ZERO_PAGE_DETECTION),
+            qapi_enum_lookup(&ZeroPageDetection_lookup,
+                             params->zero_page_detection));
+
+        assert(params->has_direct_io);
+        monitor_printf(mon, "%s: %s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_DIRECT_IO),
+            params->direct_io ? "on" : "off");
     }
 
     qapi_free_MigrationParameters(params);
@@ -679,6 +741,14 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_mode = true;
         visit_type_MigMode(v, param, &p->mode, &err);
         break;
+    case MIGRATION_PARAMETER_ZERO_PAGE_DETECTION:
+        p->has_zero_page_detection = true;
+        visit_type_ZeroPageDetection(v, param, &p->zero_page_detection, &err);
+        break;
+    case MIGRATION_PARAMETER_DIRECT_IO:
+        p->has_direct_io = true;
+        visit_type_bool(v, param, &p->direct_io, &err);
+        break;
     default:
         assert(0);
     }
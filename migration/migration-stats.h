@@ -55,6 +55,18 @@ typedef struct {
      * copy.
      */
     Stat64 dirty_sync_missed_zero_copy;
+    /*
+     * Time spent in the last dirty bitmap sync, in microseconds.
+     */
+    Stat64 dirty_sync_time;
+    /*
+     * Longest time spent in a dirty bitmap sync, in microseconds.
+     */
+    Stat64 dirty_sync_time_max;
+    /*
+     * Time spent in all dirty bitmap syncs, in microseconds.
+     */
+    Stat64 dirty_sync_time_total;
     /*
      * Number of bytes sent at migration completion stage while the
      * guest is stopped.
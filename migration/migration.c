@@ -27,6 +27,7 @@
 #include "sysemu/cpu-throttle.h"
 #include "rdma.h"
 #include "ram.h"
+#include "lazy-restore.h"
 #include "ram-compress.h"
 #include "migration/global_state.h"
 #include "migration/misc.h"
@@ -60,6 +61,7 @@
 #include "qemu/queue.h"
 #include "multifd.h"
 #include "threadinfo.h"
+#include "samples.h"
 #include "qemu/yank.h"
 #include "sysemu/cpus.h"
 #include "yank_functions.h"
@@ -136,11 +138,18 @@ static bool transport_supports_multi_channels(MigrationAddress *addr)
         return saddr->type == SOCKET_ADDRESS_TYPE_INET ||
                saddr->type == SOCKET_ADDRESS_TYPE_UNIX ||
                saddr->type == SOCKET_ADDRESS_TYPE_VSOCK;
+    } else if (addr->transport == MIGRATION_ADDRESS_TYPE_FILE) {
+        return migrate_mapped_ram();
     }
 
     return false;
 }
 
+static bool transport_supports_seeking(MigrationAddress *addr)
+{
+    return addr->transport == MIGRATION_ADDRESS_TYPE_FILE;
+}
+
 static bool
 migration_channels_and_transport_compatible(MigrationAddress *addr,
                                             Error **errp)
@@ -151,6 +160,11 @@ migration_channels_and_transport_compatible(MigrationAddress *addr,
         return false;
     }
 
+    if (migrate_mapped_ram() && !transport_supports_seeking(addr)) {
+        error_setg(errp, "Migration requires seekable transport (e.g. file)");
+        return false;
+    }
+
     return true;
 }
 
@@ -357,7 +371,7 @@ int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
 {
     uint8_t bufc[12 + 1 + 255]; /* start (8), len (4), rbname up to 256 */
     size_t msglen = 12; /* start + len */
-    size_t len = qemu_ram_pagesize(rb);
+    size_t len = postcopy_ram_pagesize(rb);
     enum mig_rp_message_type msg_type;
     const char *rbname;
     int rbname_len;
@@ -392,7 +406,8 @@ int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
 int migrate_send_rp_req_pages(MigrationIncomingState *mis,
                               RAMBlock *rb, ram_addr_t start, uint64_t haddr)
 {
-    void *aligned = (void *)(uintptr_t)ROUND_DOWN(haddr, qemu_ram_pagesize(rb));
+    /* @start is aligned to postcopy_ram_pagesize() */
+    void *aligned = rb->host + start;
     bool received = false;
 
     WITH_QEMU_LOCK_GUARD(&mis->page_request_mutex) {
@@ -632,6 +647,12 @@ static void process_incoming_migration_bh(void *opaque)
 
     dirty_bitmap_mig_before_vm_start();
 
+    /*
+     * With lazy restore, guest RAM is still being filled in on demand;
+     * fetch the remaining pages in the background from now on.
+     */
+    lazy_restore_start_prefetch();
+
     if (!global_state_received() ||
         global_state_get_runstate() == RUN_STATE_RUNNING) {
         if (autostart) {
@@ -673,6 +694,10 @@ process_incoming_migration_co(void *opaque)
     }
 
     mis->largest_page_size = qemu_ram_pagesize_largest();
+    if (migrate_postcopy_thp()) {
+        mis->largest_page_size = MAX(mis->largest_page_size,
+                                     POSTCOPY_THP_SIZE);
+    }
     postcopy_state_set(POSTCOPY_INCOMING_NONE);
     migrate_set_state(&mis->state, MIGRATION_STATUS_SETUP,
                       MIGRATION_STATUS_ACTIVE);
@@ -1085,6 +1110,11 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         stat64_get(&mig_stats.dirty_sync_count);
     info->ram->dirty_sync_missed_zero_copy =
         stat64_get(&mig_stats.dirty_sync_missed_zero_copy);
+    info->ram->dirty_sync_time = stat64_get(&mig_stats.dirty_sync_time);
+    info->ram->dirty_sync_time_max =
+        stat64_get(&mig_stats.dirty_sync_time_max);
+    info->ram->dirty_sync_time_total =
+        stat64_get(&mig_stats.dirty_sync_time_total);
     info->ram->postcopy_requests =
         stat64_get(&mig_stats.postcopy_requests);
     info->ram->page_size = page_size;
@@ -1116,6 +1146,9 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->ram->remaining = ram_bytes_remaining();
         info->ram->dirty_pages_rate =
            stat64_get(&mig_stats.dirty_pages_rate);
+        if (migrate_multifd()) {
+            info->multifd_channels = multifd_send_stats();
+        }
     }
 
     if (migrate_dirty_limit() && dirtylimit_in_service()) {
@@ -1237,6 +1270,10 @@ static void fill_destination_migration_info(MigrationInfo *info)
     case MIGRATION_STATUS_COMPLETED:
         info->has_status = true;
         fill_destination_postcopy_migration_info(info);
+        if (migrate_lazy_restore()) {
+            info->has_lazy_restore_remaining = true;
+            info->lazy_restore_remaining = lazy_restore_remaining();
+        }
         break;
     }
     info->status = mis->state;
@@ -1612,6 +1649,7 @@ int migrate_init(MigrationState *s, Error **errp)
      */
     memset(&mig_stats, 0, sizeof(mig_stats));
     migration_reset_vfio_bytes_transferred();
+    migration_samples_reset();
 
     return 0;
 }
@@ -2986,6 +3024,13 @@ static void migration_calculate_complete(MigrationState *s)
     if (transfer_time) {
         s->mbps = ((double) bytes * 8.0) / transfer_time / 1000;
     }
+
+    /* Account the end of the migration, including the downtime */
+    if (end_time > s->iteration_start_time) {
+        migration_samples_record(s, end_time,
+                                 bytes - s->iteration_initial_bytes,
+                                 end_time - s->iteration_start_time);
+    }
 }
 
 static void update_iteration_initial_status(MigrationState *s)
@@ -3039,6 +3084,9 @@ static void migration_update_counters(MigrationState *s,
                             s->iteration_initial_pages;
     s->pages_per_second = (double) transferred_pages /
                              (((double) time_spent / 1000.0));
+    if (migrate_multifd()) {
+        multifd_send_update_rates(time_spent);
+    }
 
     /*
      * if we haven't sent anything, we don't want to
@@ -3050,6 +3098,8 @@ static void migration_update_counters(MigrationState *s,
             stat64_get(&mig_stats.dirty_bytes_last_sync) / expected_bw_per_ms;
     }
 
+    migration_samples_record(s, current_time, transferred, time_spent);
+
     migration_rate_reset();
 
     update_iteration_initial_status(s);
@@ -0,0 +1,429 @@
+/*
+ * Multifd adaptive compression
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "qapi/qapi-types-migration.h"
+#include "migration.h"
+#include "trace.h"
+#include "options.h"
+#include "multifd.h"
+
+/*
+ * Every channel chooses, for each packet, between no compression, LZ4
+ * and zstd at a couple of levels.  It keeps running averages of the
+ * compression ratio and of the compression time per byte of every
+ * setting, and of the time it takes to write a byte to the channel, and
+ * picks the setting that it expects to get the packet out fastest:
+ *
+ *     compression time + compressed size * write time per byte
+ *
+ * When the link is fast the channel stops compressing; when it is slow
+ * it compresses harder.  Each setting is tried again once in a while so
+ * that the averages follow the workload.  The packets carry the flag of
+ * the method used, and the receiving side decodes each packet with it.
+ */
+
+/* Weight of the newest sample in the running averages */
+#define ADAPTIVE_WEIGHT 0.125
+/* Every that many packets, one is sent with another setting */
+#define ADAPTIVE_PROBE_INTERVAL 32
+#define ADAPTIVE_MAX_CHOICES 4
+
+typedef struct {
+    MultiFDCompression method;
+    int level;
+    /* number of packets sent with this setting */
+    uint64_t packets;
+    /* compressed size divided by the uncompressed size */
+    double ratio;
+    /* compression time in ns per uncompressed byte */
+    double compress_ns;
+} AdaptiveChoice;
+
+struct adaptive_send_data {
+    /* data of the methods, indexed by MultiFDCompression */
+    void *data[MULTIFD_COMPRESSION__MAX];
+    AdaptiveChoice choices[ADAPTIVE_MAX_CHOICES];
+    int nr_choices;
+    /* choice used for the last packet */
+    int current;
+    /* level that the zstd stream is set to */
+    int zstd_level;
+    /* packets sent, and the choice to probe next */
+    uint64_t packets;
+    int probe;
+    /* time in ns to write a byte to the channel */
+    double write_ns;
+    /* MultiFDSendParams write counters at the previous packet */
+    uint64_t write_bytes;
+    uint64_t write_time_ns;
+};
+
+struct adaptive_recv_data {
+    /* data of the methods, indexed by MultiFDCompression */
+    void *data[MULTIFD_COMPRESSION__MAX];
+};
+
+/* The methods that the adaptive compression chooses from */
+static const MultiFDCompression adaptive_methods[] = {
+    MULTIFD_COMPRESSION_NONE,
+    MULTIFD_COMPRESSION_LZ4,
+#ifdef CONFIG_ZSTD
+    MULTIFD_COMPRESSION_ZSTD,
+#endif
+};
+
+static void adaptive_add_choice(struct adaptive_send_data *a,
+                                MultiFDCompression method, int level)
+{
+    AdaptiveChoice *c = &a->choices[a->nr_choices++];
+
+    assert(a->nr_choices <= ADAPTIVE_MAX_CHOICES);
+    c->method = method;
+    c->level = level;
+}
+
+static double adaptive_average(double avg, double sample, uint64_t samples)
+{
+    if (!samples) {
+        return sample;
+    }
+    return avg + ADAPTIVE_WEIGHT * (sample - avg);
+}
+
+/* Expected time in ns to compress and write one byte of guest memory */
+static double adaptive_cost(struct adaptive_send_data *a, AdaptiveChoice *c)
+{
+    return c->compress_ns + c->ratio * a->write_ns;
+}
+
+static int adaptive_choose(struct adaptive_send_data *a)
+{
+    int best = 0;
+    int i;
+
+    /* Try each setting once first */
+    for (i = 0; i < a->nr_choices; i++) {
+        if (!a->choices[i].packets) {
+            return i;
+        }
+    }
+
+    if (++a->packets % ADAPTIVE_PROBE_INTERVAL == 0) {
+        a->probe = (a->probe + 1) % a->nr_choices;
+        return a->probe;
+    }
+
+    for (i = 1; i < a->nr_choices; i++) {
+        if (adaptive_cost(a, &a->choices[i]) <
+            adaptive_cost(a, &a->choices[best])) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* Account the write of the previous packet to the link throughput */
+static void adaptive_update_write(MultiFDSendParams *p,
+                                  struct adaptive_send_data *a)
+{
+    uint64_t bytes = p->write_bytes - a->write_bytes;
+    uint64_t time_ns = p->write_time_ns - a->write_time_ns;
+
+    if (bytes) {
+        a->write_ns = adaptive_average(a->write_ns, (double)time_ns / bytes,
+                                       a->write_bytes);
+    }
+    a->write_bytes = p->write_bytes;
+    a->write_time_ns = p->write_time_ns;
+}
+
+/**
+ * adaptive_send_setup: setup send side
+ *
+ * Setup all the methods that the channel chooses from.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int adaptive_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct adaptive_send_data *a = g_new0(struct adaptive_send_data, 1);
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(adaptive_methods); i++) {
+        MultiFDCompression method = adaptive_methods[i];
+
+        p->data = NULL;
+        if (multifd_get_ops(method)->send_setup(p, errp)) {
+            while (--i >= 0) {
+                method = adaptive_methods[i];
+                p->data = a->data[method];
+                multifd_get_ops(method)->send_cleanup(p, NULL);
+            }
+            p->data = NULL;
+            g_free(a);
+            return -1;
+        }
+        a->data[method] = p->data;
+    }
+    p->data = a;
+
+    adaptive_add_choice(a, MULTIFD_COMPRESSION_NONE, 0);
+    adaptive_add_choice(a, MULTIFD_COMPRESSION_LZ4, 0);
+#ifdef CONFIG_ZSTD
+    adaptive_add_choice(a, MULTIFD_COMPRESSION_ZSTD, 1);
+    adaptive_add_choice(a, MULTIFD_COMPRESSION_ZSTD, 3);
+#endif
+    a->zstd_level = migrate_multifd_zstd_level();
+    return 0;
+}
+
+/**
+ * adaptive_send_cleanup: cleanup send side
+ *
+ * Cleanup all the methods that the channel chooses from.
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static void adaptive_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct adaptive_send_data *a = p->data;
+    int i;
+
+    if (!a) {
+        return;
+    }
+    for (i = 0; i < ARRAY_SIZE(adaptive_methods); i++) {
+        MultiFDCompression method = adaptive_methods[i];
+
+        p->data = a->data[method];
+        multifd_get_ops(method)->send_cleanup(p, errp);
+    }
+    g_free(a);
+    p->data = NULL;
+}
+
+/**
+ * adaptive_send_prepare: prepare date to be able to send
+ *
+ * Choose the compression setting for the packet and let its method
+ * fill the packet.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int adaptive_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    struct adaptive_send_data *a = p->data;
+    uint64_t size = p->normal_num * p->page_size;
+    MultiFDMethods *ops;
+    AdaptiveChoice *c;
+    int64_t start;
+    int choice;
+    int ret;
+
+    adaptive_update_write(p, a);
+    choice = adaptive_choose(a);
+    c = &a->choices[choice];
+    ops = multifd_get_ops(c->method);
+
+    p->data = a->data[c->method];
+    if (ops->send_set_level && c->level != a->zstd_level) {
+        ret = ops->send_set_level(p, c->level, errp);
+        if (ret) {
+            p->data = a;
+            return ret;
+        }
+        a->zstd_level = c->level;
+    }
+    start = get_clock();
+    ret = ops->send_prepare(p, errp);
+    p->data = a;
+    if (ret) {
+        return ret;
+    }
+
+    c->ratio = adaptive_average(c->ratio, (double)p->next_packet_size / size,
+                                c->packets);
+    c->compress_ns = adaptive_average(c->compress_ns,
+                                      (double)(get_clock() - start) / size,
+                                      c->packets);
+    c->packets++;
+    if (choice != a->current) {
+        trace_multifd_adaptive_choice(p->id,
+                                      MultiFDCompression_str(c->method),
+                                      c->level);
+        a->current = choice;
+    }
+    return 0;
+}
+
+/**
+ * adaptive_send_stats: report the decisions of the channel
+ *
+ * @p: Params for the channel that we are using
+ * @stats: statistics of the channel to fill
+ */
+static void adaptive_send_stats(MultiFDSendParams *p,
+                                MultiFDChannelStats *stats)
+{
+    struct adaptive_send_data *a = p->data;
+    MultiFDAdaptiveStats *info;
+    MultiFDAdaptiveChoiceList **tail;
+    int i;
+
+    if (!a) {
+        return;
+    }
+
+    info = g_new0(MultiFDAdaptiveStats, 1);
+    info->method = a->choices[a->current].method;
+    info->level = a->choices[a->current].level;
+    info->throughput = a->write_ns ? 1e9 / a->write_ns : 0;
+    tail = &info->choices;
+    for (i = 0; i < a->nr_choices; i++) {
+        AdaptiveChoice *c = &a->choices[i];
+        MultiFDAdaptiveChoice *choice = g_new0(MultiFDAdaptiveChoice, 1);
+
+        choice->method = c->method;
+        choice->level = c->level;
+        choice->packets = c->packets;
+        choice->ratio = c->ratio * 100;
+        choice->cost = adaptive_cost(a, c) * KiB;
+        QAPI_LIST_APPEND(tail, choice);
+    }
+    stats->compression = info;
+}
+
+/**
+ * adaptive_recv_setup: setup receive side
+ *
+ * Setup all the methods that the sender may choose from.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int adaptive_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct adaptive_recv_data *a = g_new0(struct adaptive_recv_data, 1);
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(adaptive_methods); i++) {
+        MultiFDCompression method = adaptive_methods[i];
+
+        p->data = NULL;
+        if (multifd_get_ops(method)->recv_setup(p, errp)) {
+            while (--i >= 0) {
+                method = adaptive_methods[i];
+                p->data = a->data[method];
+                multifd_get_ops(method)->recv_cleanup(p);
+            }
+            p->data = NULL;
+            g_free(a);
+            return -1;
+        }
+        a->data[method] = p->data;
+    }
+    p->data = a;
+    return 0;
+}
+
+/**
+ * adaptive_recv_cleanup: cleanup receive side
+ *
+ * Cleanup all the methods that the sender may choose from.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void adaptive_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct adaptive_recv_data *a = p->data;
+    int i;
+
+    if (!a) {
+        return;
+    }
+    for (i = 0; i < ARRAY_SIZE(adaptive_methods); i++) {
+        MultiFDCompression method = adaptive_methods[i];
+
+        p->data = a->data[method];
+        multifd_get_ops(method)->recv_cleanup(p);
+    }
+    g_free(a);
+    p->data = NULL;
+}
+
+/**
+ * adaptive_recv_pages: read the data from the channel into actual pages
+ *
+ * Decode the packet with the method given by its flags.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int adaptive_recv_pages(MultiFDRecvParams *p, Error **errp)
+{
+    struct adaptive_recv_data *a = p->data;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    MultiFDCompression method;
+    int ret;
+
+    switch (flags) {
+    case MULTIFD_FLAG_NOCOMP:
+        method = MULTIFD_COMPRESSION_NONE;
+        break;
+    case MULTIFD_FLAG_LZ4:
+        method = MULTIFD_COMPRESSION_LZ4;
+        break;
+#ifdef CONFIG_ZSTD
+    case MULTIFD_FLAG_ZSTD:
+        method = MULTIFD_COMPRESSION_ZSTD;
+        break;
+#endif
+    default:
+        error_setg(errp, "multifd %u: unsupported compression flags %x",
+                   p->id, flags);
+        return -1;
+    }
+
+    p->data = a->data[method];
+    ret = multifd_get_ops(method)->recv_pages(p, errp);
+    p->data = a;
+    return ret;
+}
+
+static MultiFDMethods multifd_adaptive_ops = {
+    .send_setup = adaptive_send_setup,
+    .send_cleanup = adaptive_send_cleanup,
+    .send_prepare = adaptive_send_prepare,
+    .recv_setup = adaptive_recv_setup,
+    .recv_cleanup = adaptive_recv_cleanup,
+    .recv_pages = adaptive_recv_pages,
+    .send_stats = adaptive_send_stats
+};
+
+static void multifd_adaptive_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_ADAPTIVE, &multifd_adaptive_ops);
+}
+
+migration_init(multifd_adaptive_register);
@@ -0,0 +1,281 @@
+/*
+ * Multifd LZ4 compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <lz4.h>
+#include "qemu/bswap.h"
+#include "qemu/rcu.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "options.h"
+#include "multifd.h"
+
+/*
+ * Each page is compressed on its own, so that LZ4 stays as fast as it
+ * can be.  In the packet, every page is preceded by the big endian
+ * 32 bit size of its compressed data; a page that doesn't compress is
+ * stored as is, with a size equal to the page size.
+ */
+
+struct lz4_data {
+    /* state for LZ4_compress_fast_extState() */
+    void *state;
+    /* compressed buffer */
+    uint8_t *zbuff;
+    /* size of compressed buffer */
+    uint32_t zbuff_len;
+    /* uncompressed buffer of size qemu_target_page_size() */
+    uint8_t *buf;
+};
+
+static uint32_t lz4_zbuff_len(void)
+{
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+
+    return MULTIFD_PACKET_SIZE + page_count * sizeof(uint32_t);
+}
+
+/* Multifd LZ4 compression */
+
+/**
+ * lz4_send_setup: setup send side
+ *
+ * Setup each channel with LZ4 compression.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    z->state = g_try_malloc(LZ4_sizeofState());
+    z->zbuff_len = lz4_zbuff_len();
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    z->buf = g_try_malloc(qemu_target_page_size());
+    if (!z->state || !z->zbuff || !z->buf) {
+        g_free(z->state);
+        g_free(z->zbuff);
+        g_free(z->buf);
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for lz4", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_send_cleanup: cleanup send side
+ *
+ * Return the memory of the channel.
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static void lz4_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->state);
+    z->state = NULL;
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(z->buf);
+    z->buf = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_send_prepare: prepare date to be able to send
+ *
+ * Create a compressed buffer with all the pages that we are going to
+ * send.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+    uint32_t out_size = 0;
+    uint32_t i;
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *out = z->zbuff + out_size + sizeof(uint32_t);
+        int ret;
+
+        if (z->zbuff_len - out_size < sizeof(uint32_t) + p->page_size) {
+            error_setg(errp, "multifd %u: lz4 buffer too small", p->id);
+            return -1;
+        }
+
+        /*
+         * Since the VM might be running, the page may be changing
+         * concurrently with compression; copy it first so that LZ4 sees
+         * consistent data.
+         */
+        memcpy(z->buf, p->pages->block->host + p->normal[i], p->page_size);
+
+        /* Only keep the compressed data if it is smaller than the page */
+        ret = LZ4_compress_fast_extState(z->state, (const char *)z->buf,
+                                         (char *)out, p->page_size,
+                                         p->page_size - 1, 1);
+        if (ret <= 0) {
+            memcpy(out, z->buf, p->page_size);
+            ret = p->page_size;
+        }
+        stl_be_p(z->zbuff + out_size, ret);
+        out_size += sizeof(uint32_t) + ret;
+    }
+    p->iov[p->iovs_num].iov_base = z->zbuff;
+    p->iov[p->iovs_num].iov_len = out_size;
+    p->iovs_num++;
+    p->next_packet_size = out_size;
+    p->flags |= MULTIFD_FLAG_LZ4;
+
+    return 0;
+}
+
+/**
+ * lz4_recv_setup: setup receive side
+ *
+ * Create the compressed buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    z->zbuff_len = lz4_zbuff_len();
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for zbuff", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_recv_cleanup: cleanup receive side
+ *
+ * Return the memory of the channel.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the compressed buffer, and uncompress it into the actual
+ * pages.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_pages(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t in_size = p->next_packet_size;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    struct lz4_data *z = p->data;
+    uint32_t pos = 0;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_LZ4) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_LZ4);
+        return -1;
+    }
+    if (in_size > z->zbuff_len) {
+        error_setg(errp, "multifd %u: packet size received %u is larger "
+                   "than %u", p->id, in_size, z->zbuff_len);
+        return -1;
+    }
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *page = p->host + p->normal[i];
+        uint32_t len;
+
+        if (in_size - pos < sizeof(uint32_t)) {
+            goto truncated;
+        }
+        len = ldl_be_p(z->zbuff + pos);
+        pos += sizeof(uint32_t);
+        if (len > p->page_size || in_size - pos < len) {
+            goto truncated;
+        }
+
+        if (len == p->page_size) {
+            memcpy(page, z->zbuff + pos, len);
+        } else {
+            ret = LZ4_decompress_safe((const char *)z->zbuff + pos,
+                                      (char *)page, len, p->page_size);
+            if (ret != p->page_size) {
+                error_setg(errp, "multifd %u: lz4 decompression returned %d "
+                           "instead of %u", p->id, ret, p->page_size);
+                return -1;
+            }
+        }
+        pos += len;
+    }
+    if (pos != in_size) {
+        goto truncated;
+    }
+    return 0;
+
+truncated:
+    error_setg(errp, "multifd %u: malformed lz4 packet of size %u",
+               p->id, in_size);
+    return -1;
+}
+
+static MultiFDMethods multifd_lz4_ops = {
+    .send_setup = lz4_send_setup,
+    .send_cleanup = lz4_send_cleanup,
+    .send_prepare = lz4_send_prepare,
+    .recv_setup = lz4_recv_setup,
+    .recv_cleanup = lz4_recv_cleanup,
+    .recv_pages = lz4_recv_pages
+};
+
+static void multifd_lz4_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_LZ4, &multifd_lz4_ops);
+}
+
+migration_init(multifd_lz4_register);
@@ -0,0 +1,270 @@
+/*
+ * Multifd XBZRLE implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "ram.h"
+#include "xbzrle.h"
+#include "multifd.h"
+
+/*
+ * The pages are encoded against the XBZRLE cache, which is shared by all
+ * the channels.  In the packet, every page is preceded by the big endian
+ * 32 bit size of its encoded data; a page that misses the cache or that
+ * doesn't encode well is stored as is, with a size equal to the page
+ * size, and a page that didn't change has no data.
+ *
+ * Decoding relies on the destination page holding the data last sent
+ * for it.  Each page is sent at most once per dirty bitmap round and
+ * the channels are synchronized between rounds, so that holds even
+ * though the channels are not ordered with each other.
+ */
+
+struct xbzrle_data {
+    /* encoded buffer */
+    uint8_t *zbuff;
+    /* size of encoded buffer */
+    uint32_t zbuff_len;
+    /* copy of the page being encoded, of size qemu_target_page_size() */
+    uint8_t *buf;
+};
+
+static uint32_t xbzrle_zbuff_len(void)
+{
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+
+    return MULTIFD_PACKET_SIZE + page_count * sizeof(uint32_t);
+}
+
+/* Multifd XBZRLE encoding */
+
+/**
+ * xbzrle_send_setup: setup send side
+ *
+ * Setup each channel with XBZRLE encoding.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z = g_new0(struct xbzrle_data, 1);
+
+    z->zbuff_len = xbzrle_zbuff_len();
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    z->buf = g_try_malloc(qemu_target_page_size());
+    if (!z->zbuff || !z->buf) {
+        g_free(z->zbuff);
+        g_free(z->buf);
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for xbzrle", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * xbzrle_send_cleanup: cleanup send side
+ *
+ * Return the memory of the channel.
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static void xbzrle_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z = p->data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(z->buf);
+    z->buf = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * xbzrle_send_prepare: prepare date to be able to send
+ *
+ * Create a buffer with all the pages that we are going to send,
+ * encoded against the XBZRLE cache.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z = p->data;
+    RAMBlock *block = p->pages->block;
+    XBZRLECacheStats stats = {};
+    uint32_t out_size = 0;
+    uint32_t i;
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *out = z->zbuff + out_size + sizeof(uint32_t);
+        int ret;
+
+        if (z->zbuff_len - out_size < sizeof(uint32_t) + p->page_size) {
+            error_setg(errp, "multifd %u: xbzrle buffer too small", p->id);
+            return -1;
+        }
+
+        /*
+         * The page may be changing while we encode it, and the cache has
+         * to get exactly the data that is sent: work on a copy.
+         */
+        memcpy(z->buf, block->host + p->normal[i], p->page_size);
+
+        /* A page size of encoded data would look like a page sent as is */
+        ret = xbzrle_encode_page(block->offset + p->normal[i], z->buf,
+                                 out, p->page_size - 1, &stats);
+        if (ret < 0) {
+            memcpy(out, z->buf, p->page_size);
+            ret = p->page_size;
+        }
+        stl_be_p(z->zbuff + out_size, ret);
+        out_size += sizeof(uint32_t) + ret;
+    }
+    xbzrle_counters_add(&stats);
+
+    p->iov[p->iovs_num].iov_base = z->zbuff;
+    p->iov[p->iovs_num].iov_len = out_size;
+    p->iovs_num++;
+    p->next_packet_size = out_size;
+    p->flags |= MULTIFD_FLAG_XBZRLE;
+
+    return 0;
+}
+
+/**
+ * xbzrle_recv_setup: setup receive side
+ *
+ * Create the encoded buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *z = g_new0(struct xbzrle_data, 1);
+
+    z->zbuff_len = xbzrle_zbuff_len();
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for zbuff", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * xbzrle_recv_cleanup: cleanup receive side
+ *
+ * Return the memory of the channel.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void xbzrle_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct xbzrle_data *z = p->data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * xbzrle_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the encoded buffer, and apply it to the actual pages.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_recv_pages(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t in_size = p->next_packet_size;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    struct xbzrle_data *z = p->data;
+    uint32_t pos = 0;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_XBZRLE) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_XBZRLE);
+        return -1;
+    }
+    if (in_size > z->zbuff_len) {
+        error_setg(errp, "multifd %u: packet size received %u is larger "
+                   "than %u", p->id, in_size, z->zbuff_len);
+        return -1;
+    }
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *page = p->host + p->normal[i];
+        uint32_t len;
+
+        if (in_size - pos < sizeof(uint32_t)) {
+            goto truncated;
+        }
+        len = ldl_be_p(z->zbuff + pos);
+        pos += sizeof(uint32_t);
+        if (len > p->page_size || in_size - pos < len) {
+            goto truncated;
+        }
+
+        if (len == p->page_size) {
+            memcpy(page, z->zbuff + pos, len);
+        } else if (xbzrle_decode_buffer(z->zbuff + pos, len, page,
+                                        p->page_size) < 0) {
+            error_setg(errp, "multifd %u: failed to decode xbzrle page at "
+                       "offset 0x" RAM_ADDR_FMT, p->id, p->normal[i]);
+            return -1;
+        }
+        pos += len;
+    }
+    if (pos != in_size) {
+        goto truncated;
+    }
+    return 0;
+
+truncated:
+    error_setg(errp, "multifd %u: malformed xbzrle packet of size %u",
+               p->id, in_size);
+    return -1;
+}
+
+MultiFDMethods multifd_xbzrle_ops = {
+    .send_setup = xbzrle_send_setup,
+    .send_cleanup = xbzrle_send_cleanup,
+    .send_prepare = xbzrle_send_prepare,
+    .recv_setup = xbzrle_recv_setup,
+    .recv_cleanup = xbzrle_recv_cleanup,
+    .recv_pages = xbzrle_recv_pages
+};
@@ -33,6 +33,9 @@ struct zstd_data {
     uint8_t *zbuff;
     /* size of compressed buffer */
     uint32_t zbuff_len;
+    /* level of the current frame, and the one to use from the next packet */
+    int level;
+    int next_level;
 };
 
 /* Multifd zstd compression */
@@ -60,7 +63,8 @@ static int zstd_send_setup(MultiFDSendParams *p, Error **errp)
         return -1;
     }
 
-    res = ZSTD_initCStream(z->zcs, migrate_multifd_zstd_level());
+    z->level = z->next_level = migrate_multifd_zstd_level();
+    res = ZSTD_initCStream(z->zcs, z->level);
     if (ZSTD_isError(res)) {
         ZSTD_freeCStream(z->zcs);
         g_free(z);
@@ -100,6 +104,52 @@ static void zstd_send_cleanup(MultiFDSendParams *p, Error **errp)
     p->data = NULL;
 }
 
+/**
+ * zstd_send_end_frame: switch to the next level
+ *
+ * Parameters changed in the middle of a frame only apply from the next
+ * frame on, so close the current one at the start of the packet and set
+ * the new level for the frame that follows.  The decoder goes from one
+ * frame to the next on its own.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int zstd_send_end_frame(MultiFDSendParams *p, Error **errp)
+{
+    struct zstd_data *z = p->data;
+    size_t ret;
+
+    z->in.src = NULL;
+    z->in.size = 0;
+    z->in.pos = 0;
+    do {
+        ret = ZSTD_compressStream2(z->zcs, &z->out, &z->in, ZSTD_e_end);
+    } while (ret > 0 && (z->out.size - z->out.pos > 0));
+    if (ZSTD_isError(ret)) {
+        error_setg(errp, "multifd %u: compressStream error %s",
+                   p->id, ZSTD_getErrorName(ret));
+        return -1;
+    }
+    if (ret > 0) {
+        error_setg(errp, "multifd %u: compressStream buffer too small",
+                   p->id);
+        return -1;
+    }
+
+    ret = ZSTD_CCtx_setParameter(z->zcs, ZSTD_c_compressionLevel,
+                                 z->next_level);
+    if (ZSTD_isError(ret)) {
+        error_setg(errp, "multifd %u: setting level %d failed with error %s",
+                   p->id, z->next_level, ZSTD_getErrorName(ret));
+        return -1;
+    }
+    z->level = z->next_level;
+    return 0;
+}
+
 /**
  * zstd_send_prepare: prepare date to be able to send
  *
@@ -121,6 +171,10 @@ static int zstd_send_prepare(MultiFDSendParams *p, Error **errp)
     z->out.size = z->zbuff_len;
     z->out.pos = 0;
 
+    if (z->next_level != z->level && zstd_send_end_frame(p, errp)) {
+        return -1;
+    }
+
     for (i = 0; i < p->normal_num; i++) {
         ZSTD_EndDirective flush = ZSTD_e_continue;
 
@@ -163,6 +217,26 @@ static int zstd_send_prepare(MultiFDSendParams *p, Error **errp)
     return 0;
 }
 
+/**
+ * zstd_send_set_level: change the compression level
+ *
+ * The new level applies from the next packet on, which starts a new
+ * frame.  That frame doesn't refer back to the data sent before it.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @level: new compression level
+ * @errp: pointer to an error
+ */
+static int zstd_send_set_level(MultiFDSendParams *p, int level, Error **errp)
+{
+    struct zstd_data *z = p->data;
+
+    z->next_level = level;
+    return 0;
+}
+
 /**
  * zstd_recv_setup: setup receive side
  *
@@ -271,15 +345,18 @@ static int zstd_recv_pages(MultiFDRecvParams *p, Error **errp)
          * Welcome to decompressStream semantics
          *
          * We need to loop while:
-         * - return is > 0
+         * - there is no error
          * - there is input available
          * - we haven't put out a full page
+         *
+         * A return of 0 only means that a frame is complete: the sender
+         * starts a new one when it changes the compression level.
          */
         do {
             ret = ZSTD_decompressStream(z->zds, &z->out, &z->in);
-        } while (ret > 0 && (z->in.size - z->in.pos > 0)
-                         && (z->out.pos < p->page_size));
-        if (ret > 0 && (z->out.pos < p->page_size)) {
+        } while (!ZSTD_isError(ret) && (z->in.size - z->in.pos > 0)
+                                    && (z->out.pos < p->page_size));
+        if (!ZSTD_isError(ret) && (z->out.pos < p->page_size)) {
             error_setg(errp, "multifd %u: decompressStream buffer too small",
                        p->id);
             return -1;
@@ -305,7 +382,8 @@ static MultiFDMethods multifd_zstd_ops = {
     .send_prepare = zstd_send_prepare,
     .recv_setup = zstd_recv_setup,
     .recv_cleanup = zstd_recv_cleanup,
-    .recv_pages = zstd_recv_pages
+    .recv_pages = zstd_recv_pages,
+    .send_set_level = zstd_send_set_level
 };
 
 static void multifd_zstd_register(void)
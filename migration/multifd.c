@@ -11,7 +11,9 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/cutils.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
 #include "exec/ramblock.h"
@@ -21,6 +23,7 @@
 #include "migration.h"
 #include "migration-stats.h"
 #include "socket.h"
+#include "file.h"
 #include "tls.h"
 #include "qemu-file.h"
 #include "trace.h"
@@ -29,6 +32,9 @@
 #include "options.h"
 #include "qemu/yank.h"
 #include "io/channel-socket.h"
+#include "migration/channel-block.h"
+#include "block/block.h"
+#include "block/aio-wait.h"
 #include "yank_functions.h"
 
 /* Multiple fd's */
@@ -172,6 +178,13 @@ void multifd_register_ops(int method, MultiFDMethods *ops)
     multifd_ops[method] = ops;
 }
 
+/* Return the methods registered for @method, NULL if it isn't built in */
+MultiFDMethods *multifd_get_ops(int method)
+{
+    assert(0 <= method && method < MULTIFD_COMPRESSION__MAX);
+    return multifd_ops[method];
+}
+
 static int multifd_send_initial_packet(MultiFDSendParams *p, Error **errp)
 {
     MultiFDInit_t msg = {};
@@ -265,6 +278,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->flags = cpu_to_be32(p->flags);
     packet->pages_alloc = cpu_to_be32(p->pages->allocated);
     packet->normal_pages = cpu_to_be32(p->normal_num);
+    packet->zero_pages = cpu_to_be32(p->zero_num);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
 
@@ -278,6 +292,11 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
 
         packet->offset[i] = cpu_to_be64(temp);
     }
+    for (i = 0; i < p->zero_num; i++) {
+        uint64_t temp = p->zero[i];
+
+        packet->offset[p->normal_num + i] = cpu_to_be64(temp);
+    }
 }
 
 static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
@@ -323,10 +342,18 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    p->zero_num = be32_to_cpu(packet->zero_pages);
+    if (p->zero_num > packet->pages_alloc - p->normal_num) {
+        error_setg(errp, "multifd: received packet "
+                   "with %u zero pages and expected maximum zero pages are %u",
+                   p->zero_num, packet->pages_alloc - p->normal_num);
+        return -1;
+    }
+
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
-    if (p->normal_num == 0) {
+    if (p->normal_num == 0 && p->zero_num == 0) {
         return 0;
     }
 
@@ -352,9 +379,61 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         p->normal[i] = offset;
     }
 
+    for (i = 0; i < p->zero_num; i++) {
+        uint64_t offset = be64_to_cpu(packet->offset[p->normal_num + i]);
+
+        if (offset > (p->block->used_length - p->page_size)) {
+            error_setg(errp, "multifd: offset too long %" PRIu64
+                       " (max " RAM_ADDR_FMT ")",
+                       offset, p->block->used_length);
+            return -1;
+        }
+        p->zero[i] = offset;
+    }
+
     return 0;
 }
 
+/*
+ * Set while savevm/loadvm run the channels on the VMState area of this
+ * block device.  Each channel does its I/O in an I/O thread of its own,
+ * but block layer callbacks may still need the device's AioContext, so
+ * the main thread keeps polling it whenever it waits for the channels.
+ */
+static BlockDriverState *multifd_vmstate_bs;
+
+void multifd_set_vmstate_bs(BlockDriverState *bs)
+{
+    multifd_vmstate_bs = bs;
+}
+
+/* Wait for one of the semaphores that the channel threads post */
+static void multifd_wait(QemuSemaphore *sem)
+{
+    if (!multifd_vmstate_bs) {
+        qemu_sem_wait(sem);
+        return;
+    }
+    AIO_WAIT_WHILE(bdrv_get_aio_context(multifd_vmstate_bs),
+                   qemu_sem_timedwait(sem, 0) != 0);
+}
+
+/* Post a semaphore that the main thread may be waiting on */
+static void multifd_post(QemuSemaphore *sem)
+{
+    qemu_sem_post(sem);
+    aio_wait_kick();
+}
+
+/* Wait until a channel thread has exited and can be joined */
+static void multifd_wait_thread_exit(bool *running)
+{
+    if (multifd_vmstate_bs) {
+        AIO_WAIT_WHILE(bdrv_get_aio_context(multifd_vmstate_bs),
+                       qatomic_read(running));
+    }
+}
+
 struct {
     MultiFDSendParams *params;
     /* array of pages to sent */
@@ -402,7 +481,7 @@ static int multifd_send_pages(QEMUFile *f)
         return -1;
     }
 
-    qemu_sem_wait(&multifd_send_state->channels_ready);
+    multifd_wait(&multifd_send_state->channels_ready);
     /*
      * next_channel can remain from a previous migration that was
      * using more channels, so ensure it doesn't overflow if the
@@ -468,6 +547,60 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset)
     return 1;
 }
 
+MultiFDChannelStatsList *multifd_send_stats(void)
+{
+    MultiFDChannelStatsList *list = NULL;
+    MultiFDChannelStatsList **tail = &list;
+    int i;
+
+    if (!multifd_send_state) {
+        return NULL;
+    }
+
+    for (i = 0; i < migrate_multifd_channels(); i++) {
+        MultiFDSendParams *p = &multifd_send_state->params[i];
+        MultiFDChannelStats *stats = g_new0(MultiFDChannelStats, 1);
+
+        stats->id = p->id;
+        WITH_QEMU_LOCK_GUARD(&p->mutex) {
+            stats->normal_pages = p->total_normal_pages;
+            stats->zero_pages = p->total_zero_pages;
+            stats->zero_pages_per_second = p->zero_pages_per_second;
+            stats->bytes = p->total_bytes;
+            if (multifd_send_state->ops->send_stats) {
+                multifd_send_state->ops->send_stats(p, stats);
+            }
+        }
+        QAPI_LIST_APPEND(tail, stats);
+    }
+
+    return list;
+}
+
+/*
+ * Called from the migration thread at the end of each iteration, @time_spent
+ * being the length of the iteration in milliseconds.
+ */
+void multifd_send_update_rates(uint64_t time_spent)
+{
+    int i;
+
+    if (!multifd_send_state || !time_spent) {
+        return;
+    }
+
+    for (i = 0; i < migrate_multifd_channels(); i++) {
+        MultiFDSendParams *p = &multifd_send_state->params[i];
+
+        WITH_QEMU_LOCK_GUARD(&p->mutex) {
+            p->zero_pages_per_second =
+                (p->total_zero_pages - p->iteration_zero_pages) * 1000 /
+                time_spent;
+            p->iteration_zero_pages = p->total_zero_pages;
+        }
+    }
+}
+
 static void multifd_send_terminate_threads(Error *err)
 {
     int i;
@@ -511,6 +644,13 @@ static void multifd_send_terminate_threads(Error *err)
 
 static int multifd_send_channel_destroy(QIOChannel *send)
 {
+    if (multifd_vmstate_bs) {
+        object_unref(OBJECT(send));
+        return 0;
+    }
+    if (migrate_mapped_ram()) {
+        return file_send_channel_destroy(send);
+    }
     return socket_send_channel_destroy(send);
 }
 
@@ -526,6 +666,7 @@ void multifd_save_cleanup(void)
         MultiFDSendParams *p = &multifd_send_state->params[i];
 
         if (p->running) {
+            multifd_wait_thread_exit(&p->running);
             qemu_thread_join(&p->thread);
         }
     }
@@ -552,12 +693,17 @@ void multifd_save_cleanup(void)
         p->iov = NULL;
         g_free(p->normal);
         p->normal = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
         multifd_send_state->ops->send_cleanup(p, &local_err);
         if (local_err) {
             migrate_set_error(migrate_get_current(), local_err);
             error_free(local_err);
         }
     }
+    if (migrate_mapped_ram()) {
+        file_cleanup_outgoing_migration();
+    }
     qemu_sem_destroy(&multifd_send_state->channels_ready);
     g_free(multifd_send_state->params);
     multifd_send_state->params = NULL;
@@ -634,9 +780,9 @@ int multifd_send_sync_main(QEMUFile *f)
     for (i = 0; i < migrate_multifd_channels(); i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
 
-        qemu_sem_wait(&multifd_send_state->channels_ready);
+        multifd_wait(&multifd_send_state->channels_ready);
         trace_multifd_send_sync_main_wait(p->id);
-        qemu_sem_wait(&p->sem_sync);
+        multifd_wait(&p->sem_sync);
 
         if (flush_zero_copy && p->c && (multifd_zero_copy_flush(p->c) < 0)) {
             return -1;
@@ -647,6 +793,83 @@ int multifd_send_sync_main(QEMUFile *f)
     return 0;
 }
 
+/*
+ * Sort the pages of the batch into normal and zero pages.  Zero pages are
+ * only sent as offsets, so that the scan does not have to be done by the
+ * single migration thread.
+ */
+static void multifd_send_zero_page_detect(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = p->pages;
+    bool detect = migrate_zero_page_detection() == ZERO_PAGE_DETECTION_MULTIFD;
+
+    for (int i = 0; i < pages->num; i++) {
+        ram_addr_t offset = pages->offset[i];
+
+        if (detect &&
+            buffer_is_zero(pages->block->host + offset, p->page_size)) {
+            p->zero[p->zero_num] = offset;
+            p->zero_num++;
+            ram_release_page(pages->block->idstr, offset);
+            if (migrate_xbzrle()) {
+                xbzrle_cache_zero_page_multifd(pages->block->offset + offset);
+            }
+        } else {
+            p->normal[p->normal_num] = offset;
+            p->normal_num++;
+        }
+    }
+}
+
+/*
+ * With mapped-ram every page has a fixed place in the migration file, so
+ * there is no packet: the normal pages are written where they belong,
+ * one pwritev per run of contiguous pages, and the file bitmap records
+ * which pages have data.  Zero pages are not written at all.
+ */
+static int multifd_file_write_pages(MultiFDSendParams *p, RAMBlock *block,
+                                    Error **errp)
+{
+    uint32_t start = 0;
+    uint32_t i;
+
+    for (i = 0; i < p->zero_num; i++) {
+        ramblock_set_file_bmap_atomic(block, p->zero[i], false);
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        size_t len;
+        ssize_t ret;
+
+        if (i + 1 < p->normal_num &&
+            p->normal[i] + p->page_size == p->normal[i + 1]) {
+            continue;
+        }
+
+        len = (i - start + 1) * p->page_size;
+        ret = qio_channel_pwritev(p->c, &p->iov[start], i - start + 1,
+                                  block->pages_offset + p->normal[start],
+                                  errp);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret != len) {
+            error_setg(errp, "multifd %u: short write of %zd bytes at "
+                       "offset 0x%" PRIx64 ", expected %zu", p->id, ret,
+                       (uint64_t)(block->pages_offset + p->normal[start]),
+                       len);
+            return -1;
+        }
+        start = i + 1;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        ramblock_set_file_bmap_atomic(block, p->normal[i], true);
+    }
+
+    return 0;
+}
+
 static void *multifd_send_thread(void *opaque)
 {
     MultiFDSendParams *p = opaque;
@@ -654,21 +877,24 @@ static void *multifd_send_thread(void *opaque)
     Error *local_err = NULL;
     int ret = 0;
     bool use_zero_copy_send = migrate_zero_copy_send();
+    bool use_mapped_ram = migrate_mapped_ram();
 
     thread = migration_threads_add(p->name, qemu_get_thread_id());
 
     trace_multifd_send_thread_start(p->id);
     rcu_register_thread();
 
-    if (multifd_send_initial_packet(p, &local_err) < 0) {
-        ret = -1;
-        goto out;
+    if (!use_mapped_ram) {
+        if (multifd_send_initial_packet(p, &local_err) < 0) {
+            ret = -1;
+            goto out;
+        }
+        /* initial packet */
+        p->num_packets = 1;
     }
-    /* initial packet */
-    p->num_packets = 1;
 
     while (true) {
-        qemu_sem_post(&multifd_send_state->channels_ready);
+        multifd_post(&multifd_send_state->channels_ready);
         qemu_sem_wait(&p->sem);
 
         if (qatomic_read(&multifd_send_state->exiting)) {
@@ -678,19 +904,20 @@ static void *multifd_send_thread(void *opaque)
 
         if (p->pending_job) {
             uint64_t packet_num = p->packet_num;
+            RAMBlock *block = p->pages->block;
+            int64_t write_start;
+            uint64_t written;
             uint32_t flags;
             p->normal_num = 0;
+            p->zero_num = 0;
 
-            if (use_zero_copy_send) {
+            if (use_zero_copy_send || use_mapped_ram) {
                 p->iovs_num = 0;
             } else {
                 p->iovs_num = 1;
             }
 
-            for (int i = 0; i < p->pages->num; i++) {
-                p->normal[p->normal_num] = p->pages->offset[i];
-                p->normal_num++;
-            }
+            multifd_send_zero_page_detect(p);
 
             if (p->normal_num) {
                 ret = multifd_send_state->ops->send_prepare(p, &local_err);
@@ -704,41 +931,57 @@ static void *multifd_send_thread(void *opaque)
             p->flags = 0;
             p->num_packets++;
             p->total_normal_pages += p->normal_num;
+            p->total_zero_pages += p->zero_num;
             p->pages->num = 0;
             p->pages->block = NULL;
             qemu_mutex_unlock(&p->mutex);
 
-            trace_multifd_send(p->id, packet_num, p->normal_num, flags,
-                               p->next_packet_size);
+            stat64_add(&mig_stats.normal_pages, p->normal_num);
+            stat64_add(&mig_stats.zero_pages, p->zero_num);
 
-            if (use_zero_copy_send) {
-                /* Send header first, without zerocopy */
-                ret = qio_channel_write_all(p->c, (void *)p->packet,
-                                            p->packet_len, &local_err);
+            trace_multifd_send(p->id, packet_num, p->normal_num, p->zero_num,
+                               flags, p->next_packet_size);
+
+            if (use_mapped_ram) {
+                ret = multifd_file_write_pages(p, block, &local_err);
                 if (ret != 0) {
                     break;
                 }
+                written = p->next_packet_size;
             } else {
-                /* Send header using the same writev call */
-                p->iov[0].iov_len = p->packet_len;
-                p->iov[0].iov_base = p->packet;
-            }
+                if (use_zero_copy_send) {
+                    /* Send header first, without zerocopy */
+                    ret = qio_channel_write_all(p->c, (void *)p->packet,
+                                                p->packet_len, &local_err);
+                    if (ret != 0) {
+                        break;
+                    }
+                } else {
+                    /* Send header using the same writev call */
+                    p->iov[0].iov_len = p->packet_len;
+                    p->iov[0].iov_base = p->packet;
+                }
 
-            ret = qio_channel_writev_full_all(p->c, p->iov, p->iovs_num, NULL,
-                                              0, p->write_flags, &local_err);
-            if (ret != 0) {
-                break;
+                write_start = get_clock();
+                ret = qio_channel_writev_full_all(p->c, p->iov, p->iovs_num,
+                                                  NULL, 0, p->write_flags,
+                                                  &local_err);
+                if (ret != 0) {
+                    break;
+                }
+                p->write_time_ns += get_clock() - write_start;
+                written = p->next_packet_size + p->packet_len;
+                p->write_bytes += written;
             }
-
-            stat64_add(&mig_stats.multifd_bytes,
-                       p->next_packet_size + p->packet_len);
+            stat64_add(&mig_stats.multifd_bytes, written);
             p->next_packet_size = 0;
             qemu_mutex_lock(&p->mutex);
+            p->total_bytes += written;
             p->pending_job--;
             qemu_mutex_unlock(&p->mutex);
 
             if (flags & MULTIFD_FLAG_SYNC) {
-                qemu_sem_post(&p->sem_sync);
+                multifd_post(&p->sem_sync);
             }
         } else {
             qemu_mutex_unlock(&p->mutex);
@@ -751,18 +994,20 @@ out:
         assert(local_err);
         trace_multifd_send_error(p->id);
         multifd_send_terminate_threads(local_err);
-        qemu_sem_post(&p->sem_sync);
-        qemu_sem_post(&multifd_send_state->channels_ready);
+        multifd_post(&p->sem_sync);
+        multifd_post(&multifd_send_state->channels_ready);
         error_free(local_err);
     }
 
     qemu_mutex_lock(&p->mutex);
     p->running = false;
     qemu_mutex_unlock(&p->mutex);
+    aio_wait_kick();
 
     rcu_unregister_thread();
     migration_threads_remove(thread);
-    trace_multifd_send_thread_end(p->id, p->num_packets, p->total_normal_pages);
+    trace_multifd_send_thread_end(p->id, p->num_packets, p->total_normal_pages,
+                                  p->total_zero_pages);
 
     return NULL;
 }
@@ -896,6 +1141,24 @@ static void multifd_new_send_channel_async(QIOTask *task, gpointer opaque)
 
 static void multifd_new_send_channel_create(gpointer opaque)
 {
+    if (multifd_vmstate_bs) {
+        Error *err = NULL;
+        QIOChannelBlock *bioc =
+            qio_channel_block_new_iothread(multifd_vmstate_bs, &err);
+        QIOTask *task = qio_task_new(OBJECT(bioc),
+                                     multifd_new_send_channel_async,
+                                     opaque, NULL);
+
+        if (!bioc) {
+            qio_task_set_error(task, err);
+        }
+        qio_task_complete(task);
+        return;
+    }
+    if (migrate_mapped_ram()) {
+        file_send_channel_create(multifd_new_send_channel_async, opaque);
+        return;
+    }
     socket_send_channel_create(multifd_new_send_channel_async, opaque);
 }
 
@@ -915,7 +1178,11 @@ int multifd_save_setup(Error **errp)
     multifd_send_state->pages = multifd_pages_init(page_count);
     qemu_sem_init(&multifd_send_state->channels_ready, 0);
     qatomic_set(&multifd_send_state->exiting, 0);
-    multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
+    if (migrate_xbzrle()) {
+        multifd_send_state->ops = &multifd_xbzrle_ops;
+    } else {
+        multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
+    }
 
     for (i = 0; i < thread_count; i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
@@ -936,6 +1203,7 @@ int multifd_save_setup(Error **errp)
         /* We need one extra place for the packet header */
         p->iov = g_new0(struct iovec, page_count + 1);
         p->normal = g_new0(ram_addr_t, page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
         p->page_size = qemu_target_page_size();
         p->page_count = page_count;
 
@@ -968,6 +1236,10 @@ struct {
     int count;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
+    /* idle channels, only used with mapped-ram */
+    QemuSemaphore channels_ready;
+    /* next channel to try when queueing a range */
+    int next_channel;
     /* global number of generated multifd packets */
     uint64_t packet_num;
     /* multifd ops */
@@ -995,6 +1267,7 @@ static void multifd_recv_terminate_threads(Error *err)
 
         qemu_mutex_lock(&p->mutex);
         p->quit = true;
+        qemu_sem_post(&p->sem);
         /*
          * We could arrive here for two reasons:
          *  - normal quit, i.e. everything went fine, just finished
@@ -1034,6 +1307,7 @@ void multifd_load_cleanup(void)
             qemu_sem_post(&p->sem_sync);
         }
 
+        multifd_wait_thread_exit(&p->running);
         qemu_thread_join(&p->thread);
     }
     for (i = 0; i < migrate_multifd_channels(); i++) {
@@ -1044,6 +1318,7 @@ void multifd_load_cleanup(void)
         p->c = NULL;
         qemu_mutex_destroy(&p->mutex);
         qemu_sem_destroy(&p->sem_sync);
+        qemu_sem_destroy(&p->sem);
         g_free(p->name);
         p->name = NULL;
         p->packet_len = 0;
@@ -1053,9 +1328,12 @@ void multifd_load_cleanup(void)
         p->iov = NULL;
         g_free(p->normal);
         p->normal = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
         multifd_recv_state->ops->recv_cleanup(p);
     }
     qemu_sem_destroy(&multifd_recv_state->sem_sync);
+    qemu_sem_destroy(&multifd_recv_state->channels_ready);
     g_free(multifd_recv_state->params);
     multifd_recv_state->params = NULL;
     g_free(multifd_recv_state);
@@ -1066,7 +1344,8 @@ void multifd_recv_sync_main(void)
 {
     int i;
 
-    if (!migrate_multifd()) {
+    /* With mapped-ram the channels do not receive any packet to sync on */
+    if (!migrate_multifd() || migrate_mapped_ram()) {
         return;
     }
     for (i = 0; i < migrate_multifd_channels(); i++) {
@@ -1089,6 +1368,104 @@ void multifd_recv_sync_main(void)
     trace_multifd_recv_sync_main(multifd_recv_state->packet_num);
 }
 
+/*
+ * Hand a range of @block, stored at @file_offset in the mapped-ram
+ * migration file, to the next idle multifd channel.
+ *
+ * Returns 0 on success, -1 if the channels have failed.
+ */
+int multifd_recv_queue_range(RAMBlock *block, ram_addr_t offset, size_t size,
+                             off_t file_offset)
+{
+    int n = migrate_multifd_channels();
+    MultiFDRecvParams *p;
+    int i;
+
+    multifd_wait(&multifd_recv_state->channels_ready);
+    for (i = multifd_recv_state->next_channel % n;; i = (i + 1) % n) {
+        p = &multifd_recv_state->params[i];
+
+        qemu_mutex_lock(&p->mutex);
+        if (p->quit) {
+            qemu_mutex_unlock(&p->mutex);
+            return -1;
+        }
+        if (!p->pending_job) {
+            p->pending_job = true;
+            multifd_recv_state->next_channel = (i + 1) % n;
+            break;
+        }
+        qemu_mutex_unlock(&p->mutex);
+    }
+
+    p->range.block = block;
+    p->range.offset = offset;
+    p->range.size = size;
+    p->range.file_offset = file_offset;
+    qemu_mutex_unlock(&p->mutex);
+    qemu_sem_post(&p->sem);
+
+    return 0;
+}
+
+/*
+ * Wait until every range queued with multifd_recv_queue_range() has been
+ * read.  Every channel posts channels_ready once when it becomes idle,
+ * including when it stops because of an error.
+ *
+ * Returns 0 on success, -1 if the channels have failed.
+ */
+int multifd_recv_flush_ranges(void)
+{
+    int n = migrate_multifd_channels();
+    int ret = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        multifd_wait(&multifd_recv_state->channels_ready);
+    }
+    for (i = 0; i < n; i++) {
+        MultiFDRecvParams *p = &multifd_recv_state->params[i];
+
+        WITH_QEMU_LOCK_GUARD(&p->mutex) {
+            if (p->quit) {
+                ret = -1;
+            }
+        }
+        qemu_sem_post(&multifd_recv_state->channels_ready);
+    }
+
+    return ret;
+}
+
+static int multifd_file_recv_range(MultiFDRecvParams *p, Error **errp)
+{
+    MultiFDRecvRange *range = &p->range;
+    ssize_t ret;
+
+    ret = qio_channel_pread(p->c, (char *)range->block->host + range->offset,
+                            range->size, range->file_offset, errp);
+    if (ret < 0) {
+        return -1;
+    }
+    if (ret != range->size) {
+        error_setg(errp, "multifd %u: short read of %zd bytes at offset 0x%"
+                   PRIx64 ", expected %zu", p->id, ret,
+                   (uint64_t)range->file_offset, range->size);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Pages that were never written are already zero and are left alone */
+static void multifd_recv_zero_page_process(MultiFDRecvParams *p)
+{
+    for (int i = 0; i < p->zero_num; i++) {
+        ram_handle_zero(p->host + p->zero[i], p->page_size);
+    }
+}
+
 static void *multifd_recv_thread(void *opaque)
 {
     MultiFDRecvParams *p = opaque;
@@ -1101,6 +1478,37 @@ static void *multifd_recv_thread(void *opaque)
     while (true) {
         uint32_t flags;
 
+        if (migrate_mapped_ram()) {
+            multifd_post(&multifd_recv_state->channels_ready);
+            qemu_sem_wait(&p->sem);
+            if (p->quit) {
+                break;
+            }
+
+            ret = multifd_file_recv_range(p, &local_err);
+
+            qemu_mutex_lock(&p->mutex);
+            trace_multifd_recv_range(p->id, p->range.block->idstr,
+                                     p->range.offset, p->range.size);
+            p->num_packets++;
+            p->total_normal_pages += p->range.size / p->page_size;
+            p->pending_job = false;
+            qemu_mutex_unlock(&p->mutex);
+
+            if (ret != 0) {
+                /*
+                 * Mark the channels as failed before waking up
+                 * multifd_recv_flush_ranges(), so that it sees the error.
+                 */
+                multifd_recv_terminate_threads(local_err);
+                error_free(local_err);
+                local_err = NULL;
+                multifd_post(&multifd_recv_state->channels_ready);
+                break;
+            }
+            continue;
+        }
+
         if (p->quit) {
             break;
         }
@@ -1121,10 +1529,11 @@ static void *multifd_recv_thread(void *opaque)
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
-        trace_multifd_recv(p->id, p->packet_num, p->normal_num, flags,
-                           p->next_packet_size);
+        trace_multifd_recv(p->id, p->packet_num, p->normal_num, p->zero_num,
+                           flags, p->next_packet_size);
         p->num_packets++;
         p->total_normal_pages += p->normal_num;
+        p->total_zero_pages += p->zero_num;
         qemu_mutex_unlock(&p->mutex);
 
         if (p->normal_num) {
@@ -1134,6 +1543,10 @@ static void *multifd_recv_thread(void *opaque)
             }
         }
 
+        if (p->zero_num) {
+            multifd_recv_zero_page_process(p);
+        }
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -1147,9 +1560,11 @@ static void *multifd_recv_thread(void *opaque)
     qemu_mutex_lock(&p->mutex);
     p->running = false;
     qemu_mutex_unlock(&p->mutex);
+    aio_wait_kick();
 
     rcu_unregister_thread();
-    trace_multifd_recv_thread_end(p->id, p->num_packets, p->total_normal_pages);
+    trace_multifd_recv_thread_end(p->id, p->num_packets, p->total_normal_pages,
+                                  p->total_zero_pages);
 
     return NULL;
 }
@@ -1173,14 +1588,21 @@ int multifd_load_setup(Error **errp)
     multifd_recv_state->params = g_new0(MultiFDRecvParams, thread_count);
     qatomic_set(&multifd_recv_state->count, 0);
     qemu_sem_init(&multifd_recv_state->sem_sync, 0);
-    multifd_recv_state->ops = multifd_ops[migrate_multifd_compression()];
+    qemu_sem_init(&multifd_recv_state->channels_ready, 0);
+    if (migrate_xbzrle()) {
+        multifd_recv_state->ops = &multifd_xbzrle_ops;
+    } else {
+        multifd_recv_state->ops = multifd_ops[migrate_multifd_compression()];
+    }
 
     for (i = 0; i < thread_count; i++) {
         MultiFDRecvParams *p = &multifd_recv_state->params[i];
 
         qemu_mutex_init(&p->mutex);
         qemu_sem_init(&p->sem_sync, 0);
+        qemu_sem_init(&p->sem, 0);
         p->quit = false;
+        p->pending_job = false;
         p->id = i;
         p->packet_len = sizeof(MultiFDPacket_t)
                       + sizeof(uint64_t) * page_count;
@@ -1188,6 +1610,7 @@ int multifd_load_setup(Error **errp)
         p->name = g_strdup_printf("multifdrecv_%d", i);
         p->iov = g_new0(struct iovec, page_count);
         p->normal = g_new0(ram_addr_t, page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
         p->page_count = page_count;
         p->page_size = qemu_target_page_size();
     }
@@ -1232,7 +1655,12 @@ void multifd_recv_new_channel(QIOChannel *ioc, Error **errp)
     Error *local_err = NULL;
     int id;
 
-    id = multifd_recv_initial_packet(ioc, &local_err);
+    if (migrate_mapped_ram()) {
+        /* Channels on the migration file carry no handshake */
+        id = qatomic_read(&multifd_recv_state->count);
+    } else {
+        id = multifd_recv_initial_packet(ioc, &local_err);
+    }
     if (id < 0) {
         multifd_recv_terminate_threads(local_err);
         error_propagate_prepend(errp, local_err,
@@ -1254,7 +1682,7 @@ void multifd_recv_new_channel(QIOChannel *ioc, Error **errp)
     p->c = ioc;
     object_ref(OBJECT(ioc));
     /* initial packet */
-    p->num_packets = 1;
+    p->num_packets = migrate_mapped_ram() ? 0 : 1;
 
     p->running = true;
     qemu_thread_create(&p->thread, p->name, multifd_recv_thread, p,
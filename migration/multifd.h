@@ -23,6 +23,12 @@ void multifd_recv_new_channel(QIOChannel *ioc, Error **errp);
 void multifd_recv_sync_main(void);
 int multifd_send_sync_main(QEMUFile *f);
 int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
+int multifd_recv_queue_range(RAMBlock *block, ram_addr_t offset, size_t size,
+                             off_t file_offset);
+int multifd_recv_flush_ranges(void);
+MultiFDChannelStatsList *multifd_send_stats(void);
+void multifd_set_vmstate_bs(BlockDriverState *bs);
+void multifd_send_update_rates(uint64_t time_spent);
 
 /* Multifd Compression flags */
 #define MULTIFD_FLAG_SYNC (1 << 0)
@@ -33,6 +39,8 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
 #define MULTIFD_FLAG_NOCOMP (0 << 1)
 #define MULTIFD_FLAG_ZLIB (1 << 1)
 #define MULTIFD_FLAG_ZSTD (2 << 1)
+#define MULTIFD_FLAG_LZ4 (3 << 1)
+#define MULTIFD_FLAG_XBZRLE (4 << 1)
 
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
@@ -48,8 +56,16 @@ typedef struct {
     /* size of the next packet that contains pages */
     uint32_t next_packet_size;
     uint64_t packet_num;
-    uint64_t unused[4];    /* Reserved for future use */
+    /* zero pages */
+    uint32_t zero_pages;
+    uint32_t unused32[1];    /* Reserved for future use */
+    uint64_t unused64[3];    /* Reserved for future use */
     char ramblock[256];
+    /*
+     * This array contains the pointers to:
+     *  - normal pages (initial normal_pages entries)
+     *  - zero pages (following zero_pages entries)
+     */
     uint64_t offset[];
 } __attribute__((packed)) MultiFDPacket_t;
 
@@ -120,8 +136,6 @@ typedef struct {
     uint32_t next_packet_size;
     /* packets sent through this channel */
     uint64_t num_packets;
-    /* non zero pages sent through this channel */
-    uint64_t total_normal_pages;
     /* buffers to send */
     struct iovec *iov;
     /* number of iovs used */
@@ -130,10 +144,41 @@ typedef struct {
     ram_addr_t *normal;
     /* num of non zero pages */
     uint32_t normal_num;
+    /* Pages that are zero */
+    ram_addr_t *zero;
+    /* num of zero pages */
+    uint32_t zero_num;
     /* used for compression methods */
     void *data;
+    /* bytes written to the channel and time spent writing them */
+    uint64_t write_bytes;
+    uint64_t write_time_ns;
+
+    /* statistics, protected by the mutex */
+
+    /* non zero pages sent through this channel */
+    uint64_t total_normal_pages;
+    /* zero pages sent through this channel */
+    uint64_t total_zero_pages;
+    /* total_zero_pages at the start of the current iteration */
+    uint64_t iteration_zero_pages;
+    /* zero pages found per second in the last iteration */
+    uint64_t zero_pages_per_second;
+    /* bytes written to this channel */
+    uint64_t total_bytes;
 }  MultiFDSendParams;
 
+/* A range of a RAMBlock that is read back from a mapped-ram file */
+typedef struct {
+    RAMBlock *block;
+    /* offset of the range inside the ramblock */
+    ram_addr_t offset;
+    /* length of the range */
+    size_t size;
+    /* where the range is stored in the migration file */
+    off_t file_offset;
+} MultiFDRecvRange;
+
 typedef struct {
     /* Fields are only written at creating/deletion time */
     /* No lock required for them, they are read only */
@@ -155,6 +200,8 @@ typedef struct {
 
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
+    /* sem where to wait for more work, only used with mapped-ram */
+    QemuSemaphore sem;
 
     /* this mutex protects the following parameters */
     QemuMutex mutex;
@@ -166,6 +213,10 @@ typedef struct {
     uint32_t flags;
     /* global number of generated multifd packets */
     uint64_t packet_num;
+    /* thread has a range to read, only used with mapped-ram */
+    bool pending_job;
+    /* the range to read */
+    MultiFDRecvRange range;
 
     /* thread local variables. No locking required */
 
@@ -181,12 +232,18 @@ typedef struct {
     uint8_t *host;
     /* non zero pages recv through this channel */
     uint64_t total_normal_pages;
+    /* zero pages recv through this channel */
+    uint64_t total_zero_pages;
     /* buffers to recv */
     struct iovec *iov;
     /* Pages that are not zero */
     ram_addr_t *normal;
     /* num of non zero pages */
     uint32_t normal_num;
+    /* Pages that are zero */
+    ram_addr_t *zero;
+    /* num of zero pages */
+    uint32_t zero_num;
     /* used for de-compression methods */
     void *data;
 } MultiFDRecvParams;
@@ -204,9 +261,17 @@ typedef struct {
     void (*recv_cleanup)(MultiFDRecvParams *p);
     /* Read all pages */
     int (*recv_pages)(MultiFDRecvParams *p, Error **errp);
+    /* Change the compression level of the sending side, optional */
+    int (*send_set_level)(MultiFDSendParams *p, int level, Error **errp);
+    /* Fill method specific statistics, optional, called with p->mutex */
+    void (*send_stats)(MultiFDSendParams *p, MultiFDChannelStats *stats);
 } MultiFDMethods;
 
 void multifd_register_ops(int method, MultiFDMethods *ops);
+MultiFDMethods *multifd_get_ops(int method);
+
+/* Used instead of the compression methods when xbzrle is enabled */
+extern MultiFDMethods multifd_xbzrle_ops;
 
 #endif
 
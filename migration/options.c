@@ -25,6 +25,7 @@
 #include "migration/misc.h"
 #include "migration.h"
 #include "migration-stats.h"
+#include "lazy-restore.h"
 #include "qemu-file.h"
 #include "ram.h"
 #include "options.h"
@@ -64,6 +65,7 @@
 #define DEFAULT_MIGRATE_MULTIFD_ZLIB_LEVEL 1
 /* 0: means nocompress, 1: best speed, ... 20: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL 1
+#define DEFAULT_MIGRATE_ZERO_PAGE_DETECTION ZERO_PAGE_DETECTION_LEGACY
 
 /* Background transfer rate for postcopy, 0 means unlimited, note
  * that page requests can still exceed this limit.
@@ -179,6 +181,11 @@ Property migration_properties[] = {
     DEFINE_PROP_MIG_MODE("mode", MigrationState,
                       parameters.mode,
                       MIG_MODE_NORMAL),
+    DEFINE_PROP_ZERO_PAGE_DETECTION("zero-page-detection", MigrationState,
+                       parameters.zero_page_detection,
+                       DEFAULT_MIGRATE_ZERO_PAGE_DETECTION),
+    DEFINE_PROP_BOOL("direct-io", MigrationState,
+                     parameters.direct_io, false),
 
     /* Migration capabilities */
     DEFINE_PROP_MIG_CAP("x-xbzrle", MIGRATION_CAPABILITY_XBZRLE),
@@ -204,6 +211,13 @@ Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-switchover-ack",
                         MIGRATION_CAPABILITY_SWITCHOVER_ACK),
     DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
+    DEFINE_PROP_MIG_CAP("mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("lazy-restore", MIGRATION_CAPABILITY_LAZY_RESTORE),
+    DEFINE_PROP_MIG_CAP("parallel-device-load",
+                        MIGRATION_CAPABILITY_PARALLEL_DEVICE_LOAD),
+    DEFINE_PROP_MIG_CAP("postcopy-thp", MIGRATION_CAPABILITY_POSTCOPY_THP),
+    DEFINE_PROP_MIG_CAP("postcopy-prefetch",
+                        MIGRATION_CAPABILITY_POSTCOPY_PREFETCH),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -277,6 +291,20 @@ bool migrate_late_block_activate(void)
     return s->capabilities[MIGRATION_CAPABILITY_LATE_BLOCK_ACTIVATE];
 }
 
+bool migrate_lazy_restore(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_LAZY_RESTORE];
+}
+
+bool migrate_mapped_ram(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
+}
+
 bool migrate_multifd(void)
 {
     MigrationState *s = migrate_get_current();
@@ -284,6 +312,13 @@ bool migrate_multifd(void)
     return s->capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+bool migrate_parallel_device_load(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_PARALLEL_DEVICE_LOAD];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s = migrate_get_current();
@@ -305,6 +340,13 @@ bool migrate_postcopy_preempt(void)
     return s->capabilities[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT];
 }
 
+bool migrate_postcopy_prefetch(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_POSTCOPY_PREFETCH];
+}
+
 bool migrate_postcopy_ram(void)
 {
     MigrationState *s = migrate_get_current();
@@ -312,6 +354,13 @@ bool migrate_postcopy_ram(void)
     return s->capabilities[MIGRATION_CAPABILITY_POSTCOPY_RAM];
 }
 
+bool migrate_postcopy_thp(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_POSTCOPY_THP];
+}
+
 bool migrate_rdma_pin_all(void)
 {
     MigrationState *s = migrate_get_current();
@@ -599,6 +648,25 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_POSTCOPY_THP]) {
+        if (!new_caps[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+            error_setg(errp, "Postcopy THP requires postcopy-ram");
+            return false;
+        }
+
+        if (migrate_incoming_started()) {
+            error_setg(errp,
+                       "Postcopy THP must be set before incoming starts");
+            return false;
+        }
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_POSTCOPY_PREFETCH] &&
+        !new_caps[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+        error_setg(errp, "Postcopy prefetch requires postcopy-ram");
+        return false;
+    }
+
     if (new_caps[MIGRATION_CAPABILITY_MULTIFD]) {
         if (new_caps[MIGRATION_CAPABILITY_COMPRESS]) {
             error_setg(errp, "Multifd is not compatible with compress");
@@ -610,6 +678,41 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        if (new_caps[MIGRATION_CAPABILITY_XBZRLE] ||
+            new_caps[MIGRATION_CAPABILITY_COMPRESS] ||
+            new_caps[MIGRATION_CAPABILITY_POSTCOPY_RAM] ||
+            new_caps[MIGRATION_CAPABILITY_ZERO_COPY_SEND] ||
+            new_caps[MIGRATION_CAPABILITY_X_COLO] ||
+            new_caps[MIGRATION_CAPABILITY_BLOCK]) {
+            error_setg(errp, "Mapped-ram migration is incompatible with "
+                       "xbzrle, compress, postcopy-ram, zero-copy-send, "
+                       "x-colo and block");
+            return false;
+        }
+        if (new_caps[MIGRATION_CAPABILITY_MULTIFD] &&
+            migrate_multifd_compression()) {
+            error_setg(errp, "Mapped-ram only available for non-compressed "
+                       "multifd migration");
+            return false;
+        }
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_LAZY_RESTORE]) {
+        if (!new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+            error_setg(errp, "Lazy restore requires mapped-ram");
+            return false;
+        }
+        if (migrate_incoming_started()) {
+            error_setg(errp,
+                       "Lazy restore must be set before incoming starts");
+            return false;
+        }
+        if (!lazy_restore_supported(errp)) {
+            return false;
+        }
+    }
+
     if (new_caps[MIGRATION_CAPABILITY_SWITCHOVER_ACK]) {
         if (!new_caps[MIGRATION_CAPABILITY_RETURN_PATH]) {
             error_setg(errp, "Capability 'switchover-ack' requires capability "
@@ -631,11 +734,12 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
-    if (new_caps[MIGRATION_CAPABILITY_MULTIFD]) {
-        if (new_caps[MIGRATION_CAPABILITY_XBZRLE]) {
-            error_setg(errp, "Multifd is not compatible with xbzrle");
-            return false;
-        }
+    if (new_caps[MIGRATION_CAPABILITY_MULTIFD] &&
+        new_caps[MIGRATION_CAPABILITY_XBZRLE] &&
+        migrate_multifd_compression()) {
+        error_setg(errp, "Xbzrle only available for non-compressed "
+                   "multifd migration");
+        return false;
     }
 
     if (new_caps[MIGRATION_CAPABILITY_COMPRESS]) {
@@ -795,6 +899,13 @@ int migrate_decompress_threads(void)
     return s->parameters.decompress_threads;
 }
 
+bool migrate_direct_io(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.direct_io;
+}
+
 uint64_t migrate_downtime_limit(void)
 {
     MigrationState *s = migrate_get_current();
@@ -901,6 +1012,13 @@ uint64_t migrate_xbzrle_cache_size(void)
     return s->parameters.xbzrle_cache_size;
 }
 
+ZeroPageDetection migrate_zero_page_detection(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.zero_page_detection;
+}
+
 /* parameter setters */
 
 void migrate_set_block_incremental(bool value)
@@ -1011,6 +1129,10 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->vcpu_dirty_limit = s->parameters.vcpu_dirty_limit;
     params->has_mode = true;
     params->mode = s->parameters.mode;
+    params->has_zero_page_detection = true;
+    params->zero_page_detection = s->parameters.zero_page_detection;
+    params->has_direct_io = true;
+    params->direct_io = s->parameters.direct_io;
 
     return params;
 }
@@ -1047,6 +1169,8 @@ void migrate_params_init(MigrationParameters *params)
     params->has_x_vcpu_dirty_limit_period = true;
     params->has_vcpu_dirty_limit = true;
     params->has_mode = true;
+    params->has_zero_page_detection = true;
+    params->has_direct_io = true;
 }
 
 /*
@@ -1233,6 +1357,27 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (migrate_multifd() && migrate_xbzrle() &&
+        params->has_multifd_compression && params->multifd_compression) {
+        error_setg(errp, "Xbzrle only available for non-compressed "
+                   "multifd migration");
+        return false;
+    }
+
+    if (migrate_mapped_ram() &&
+        params->has_multifd_compression && params->multifd_compression) {
+        error_setg(errp, "Mapped-ram only available for non-compressed "
+                   "multifd migration");
+        return false;
+    }
+
+#ifndef O_DIRECT
+    if (params->has_direct_io && params->direct_io) {
+        error_setg(errp, "No O_DIRECT support on this platform");
+        return false;
+    }
+#endif
+
     return true;
 }
 
@@ -1348,6 +1493,14 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_mode) {
         dest->mode = params->mode;
     }
+
+    if (params->has_zero_page_detection) {
+        dest->zero_page_detection = params->zero_page_detection;
+    }
+
+    if (params->has_direct_io) {
+        dest->direct_io = params->direct_io;
+    }
 }
 
 static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
@@ -1492,6 +1645,14 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_mode) {
         s->parameters.mode = params->mode;
     }
+
+    if (params->has_zero_page_detection) {
+        s->parameters.zero_page_detection = params->zero_page_detection;
+    }
+
+    if (params->has_direct_io) {
+        s->parameters.direct_io = params->direct_io;
+    }
 }
 
 void qmp_migrate_set_parameters(MigrateSetParameters *params, Error **errp)
@@ -17,32 +17,66 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
 #include "qemu/host-utils.h"
+#include "qemu/madvise.h"
+#include "qemu/memalign.h"
+#include "qemu/atomic.h"
+#include "qemu/thread.h"
+#include "qemu/rcu.h"
 #include "page_cache.h"
 #include "trace.h"
 
 /* the page in cache will not be replaced in two cycles */
 #define CACHED_PAGE_LIFETIME 2
 
+/* number of pages that a given address can be cached in */
+#define CACHE_WAYS 8
+
+/* no page is cached in that way */
+#define CACHE_PAGE_INVALID UINTPTR_MAX
+
 typedef struct CacheItem CacheItem;
+typedef struct CacheSet CacheSet;
 
+/*
+ * The page number and the (truncated) generation fit in a host word, so
+ * that they can be accessed atomically on every host.
+ */
 struct CacheItem {
-    uint64_t it_addr;
-    uint64_t it_age;
-    uint8_t *it_data;
+    uintptr_t it_page;
+    uint32_t it_age;
+    /* CLOCK reference bit, set on every hit */
+    bool it_ref;
+};
+
+/*
+ * The items of a set are only modified with the set lock held, but they
+ * are read with atomic accesses so that lookups don't need it.  The
+ * cached data itself is only safe to access with the lock held.
+ */
+struct CacheSet {
+    QemuSpin lock;
+    /* next way considered for replacement */
+    unsigned int hand;
+    CacheItem items[CACHE_WAYS];
 };
 
 struct PageCache {
-    CacheItem *page_cache;
+    struct rcu_head rcu;
+    CacheSet *sets;
+    /* data of all the cached pages, way by way and set by set */
+    uint8_t *arena;
+    size_t arena_size;
     size_t page_size;
+    size_t num_sets;
+    size_t num_ways;
     size_t max_num_items;
-    size_t num_items;
 };
 
 PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
 {
-    int64_t i;
     size_t num_pages = new_size / page_size;
     PageCache *cache;
+    size_t i, j;
 
     if (new_size < page_size) {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "cache size",
@@ -58,30 +92,47 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
     }
 
     /* We prefer not to abort if there is no memory */
-    cache = g_try_malloc(sizeof(*cache));
+    cache = g_try_malloc0(sizeof(*cache));
     if (!cache) {
         error_setg(errp, "Failed to allocate cache");
         return NULL;
     }
     cache->page_size = page_size;
-    cache->num_items = 0;
     cache->max_num_items = num_pages;
+    cache->num_ways = MIN(num_pages, CACHE_WAYS);
+    cache->num_sets = num_pages / cache->num_ways;
 
     trace_migration_pagecache_init(cache->max_num_items);
 
-    /* We prefer not to abort if there is no memory */
-    cache->page_cache = g_try_malloc((cache->max_num_items) *
-                                     sizeof(*cache->page_cache));
-    if (!cache->page_cache) {
+    cache->sets = g_try_new0(CacheSet, cache->num_sets);
+    if (!cache->sets) {
+        error_setg(errp, "Failed to allocate page cache");
+        g_free(cache);
+        return NULL;
+    }
+
+    /*
+     * All the pages live in a single allocation, aligned so that the
+     * host can back it with transparent huge pages: XBZRLE touches the
+     * cache in a random pattern, which is the worst case for the TLB.
+     */
+    cache->arena_size = num_pages * page_size;
+    cache->arena = qemu_try_memalign(QEMU_VMALLOC_ALIGN, cache->arena_size);
+    if (!cache->arena) {
         error_setg(errp, "Failed to allocate page cache");
+        g_free(cache->sets);
         g_free(cache);
         return NULL;
     }
+    qemu_madvise(cache->arena, cache->arena_size, QEMU_MADV_HUGEPAGE);
 
-    for (i = 0; i < cache->max_num_items; i++) {
-        cache->page_cache[i].it_data = NULL;
-        cache->page_cache[i].it_age = 0;
-        cache->page_cache[i].it_addr = -1;
+    for (i = 0; i < cache->num_sets; i++) {
+        CacheSet *set = &cache->sets[i];
+
+        qemu_spin_init(&set->lock);
+        for (j = 0; j < cache->num_ways; j++) {
+            set->items[j].it_page = CACHE_PAGE_INVALID;
+        }
     }
 
     return cache;
@@ -89,87 +140,163 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
 
 void cache_fini(PageCache *cache)
 {
-    int64_t i;
+    size_t i;
 
     g_assert(cache);
-    g_assert(cache->page_cache);
+    g_assert(cache->sets);
 
-    for (i = 0; i < cache->max_num_items; i++) {
-        g_free(cache->page_cache[i].it_data);
+    for (i = 0; i < cache->num_sets; i++) {
+        qemu_spin_destroy(&cache->sets[i].lock);
     }
 
-    g_free(cache->page_cache);
-    cache->page_cache = NULL;
+    qemu_vfree(cache->arena);
+    cache->arena = NULL;
+    g_free(cache->sets);
+    cache->sets = NULL;
     g_free(cache);
 }
 
-static size_t cache_get_cache_pos(const PageCache *cache,
-                                  uint64_t address)
+void cache_fini_rcu(PageCache *cache)
 {
-    g_assert(cache->max_num_items);
-    return (address / cache->page_size) & (cache->max_num_items - 1);
+    call_rcu(cache, cache_fini, rcu);
 }
 
-static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
+static uintptr_t cache_get_page(const PageCache *cache, uint64_t address)
 {
-    size_t pos;
+    return address / cache->page_size;
+}
 
+static CacheSet *cache_get_set(const PageCache *cache, uint64_t address)
+{
     g_assert(cache);
-    g_assert(cache->page_cache);
+    g_assert(cache->sets);
+
+    return &cache->sets[cache_get_page(cache, address) &
+                        (cache->num_sets - 1)];
+}
+
+static uint8_t *cache_get_item_data(const PageCache *cache,
+                                    const CacheSet *set, size_t way)
+{
+    size_t index = (set - cache->sets) * cache->num_ways + way;
+
+    return cache->arena + index * cache->page_size;
+}
 
-    pos = cache_get_cache_pos(cache, addr);
+/* Returns the way of @set that holds @addr, -1 if there is none */
+static int cache_find_way(const PageCache *cache, const CacheSet *set,
+                          uint64_t addr)
+{
+    uintptr_t page = cache_get_page(cache, addr);
+    size_t way;
 
-    return &cache->page_cache[pos];
+    for (way = 0; way < cache->num_ways; way++) {
+        if (qatomic_read(&set->items[way].it_page) == page) {
+            return way;
+        }
+    }
+    return -1;
+}
+
+void cache_lock(PageCache *cache, uint64_t addr)
+{
+    qemu_spin_lock(&cache_get_set(cache, addr)->lock);
+}
+
+void cache_unlock(PageCache *cache, uint64_t addr)
+{
+    qemu_spin_unlock(&cache_get_set(cache, addr)->lock);
 }
 
 uint8_t *get_cached_data(const PageCache *cache, uint64_t addr)
 {
-    return cache_get_by_addr(cache, addr)->it_data;
+    CacheSet *set = cache_get_set(cache, addr);
+    int way = cache_find_way(cache, set, addr);
+
+    return way < 0 ? NULL : cache_get_item_data(cache, set, way);
 }
 
 bool cache_is_cached(const PageCache *cache, uint64_t addr,
                      uint64_t current_age)
 {
-    CacheItem *it;
+    CacheSet *set = cache_get_set(cache, addr);
+    int way = cache_find_way(cache, set, addr);
 
-    it = cache_get_by_addr(cache, addr);
+    if (way < 0) {
+        return false;
+    }
+
+    /* update the it_age when the cache hit */
+    qatomic_set(&set->items[way].it_age, current_age);
+    qatomic_set(&set->items[way].it_ref, true);
+    return true;
+}
 
-    if (it->it_addr == addr) {
-        /* update the it_age when the cache hit */
-        it->it_age = current_age;
-        return true;
+/*
+ * cache_get_victim: pick the way of @set to store a new page in
+ *
+ * Empty ways are used first.  Otherwise this is CLOCK: the hand sweeps
+ * the set, giving referenced pages a second chance, and skips over the
+ * pages that are still fresh.
+ *
+ * Returns the way, or -1 if every page of the set is fresh
+ */
+static int cache_get_victim(const PageCache *cache, CacheSet *set,
+                            uint64_t current_age)
+{
+    size_t way, i;
+
+    for (way = 0; way < cache->num_ways; way++) {
+        if (set->items[way].it_page == CACHE_PAGE_INVALID) {
+            return way;
+        }
     }
-    return false;
+
+    for (i = 0; i < 2 * cache->num_ways; i++) {
+        CacheItem *it;
+
+        way = set->hand;
+        it = &set->items[way];
+        set->hand = (way + 1) % cache->num_ways;
+
+        if (it->it_ref) {
+            qatomic_set(&it->it_ref, false);
+        } else if ((uint32_t)current_age - it->it_age >=
+                   CACHED_PAGE_LIFETIME) {
+            return way;
+        }
+    }
+    return -1;
 }
 
 int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
                  uint64_t current_age)
 {
-
+    CacheSet *set = cache_get_set(cache, addr);
     CacheItem *it;
+    int way;
 
-    /* actual update of entry */
-    it = cache_get_by_addr(cache, addr);
-
-    if (it->it_data && it->it_addr != addr &&
-        it->it_age + CACHED_PAGE_LIFETIME > current_age) {
-        /* the cache page is fresh, don't replace it */
-        return -1;
-    }
-    /* allocate page */
-    if (!it->it_data) {
-        it->it_data = g_try_malloc(cache->page_size);
-        if (!it->it_data) {
-            trace_migration_pagecache_insert();
+    way = cache_find_way(cache, set, addr);
+    if (way < 0) {
+        way = cache_get_victim(cache, set, current_age);
+        if (way < 0) {
+            /* the cache pages are fresh, don't replace them */
             return -1;
         }
-        cache->num_items++;
+    }
+    it = &set->items[way];
+
+    /* Concurrent lookups miss while the data is being replaced */
+    qatomic_set(&it->it_page, CACHE_PAGE_INVALID);
+    if (pdata) {
+        memcpy(cache_get_item_data(cache, set, way), pdata, cache->page_size);
+    } else {
+        memset(cache_get_item_data(cache, set, way), 0, cache->page_size);
     }
 
-    memcpy(it->it_data, pdata, cache->page_size);
-
-    it->it_age = current_age;
-    it->it_addr = addr;
+    qatomic_set(&it->it_age, current_age);
+    qatomic_set(&it->it_ref, true);
+    qatomic_store_release(&it->it_page, cache_get_page(cache, addr));
 
     return 0;
 }
@@ -15,7 +15,14 @@
 #ifndef PAGE_CACHE_H
 #define PAGE_CACHE_H
 
-/* Page cache for storing guest pages */
+/*
+ * Page cache for storing guest pages
+ *
+ * The cache is set associative.  Looking up whether a page is cached
+ * doesn't take any lock, but when the cache is shared between threads
+ * the data of a page may only be read or written, and pages inserted,
+ * with the lock of its set held, see cache_lock().
+ */
 typedef struct PageCache PageCache;
 
 /**
@@ -35,6 +42,29 @@ PageCache *cache_init(uint64_t cache_size, size_t page_size, Error **errp);
  */
 void cache_fini(PageCache *cache);
 
+/**
+ * cache_fini_rcu: free all cache resources once the current RCU read
+ * critical sections are over
+ * @cache pointer to the PageCache struct
+ */
+void cache_fini_rcu(PageCache *cache);
+
+/**
+ * cache_lock: Lock the set of the cache that holds a page
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ */
+void cache_lock(PageCache *cache, uint64_t addr);
+
+/**
+ * cache_unlock: Unlock the set of the cache that holds a page
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ */
+void cache_unlock(PageCache *cache, uint64_t addr);
+
 /**
  * cache_is_cached: Checks to see if the page is cached
  *
@@ -65,7 +95,7 @@ uint8_t *get_cached_data(const PageCache *cache, uint64_t addr);
  *
  * @cache pointer to the PageCache struct
  * @addr: page address
- * @pdata: pointer to the page
+ * @pdata: pointer to the page, NULL for a page full of zeros
  * @current_age: current bitmap generation
  */
 int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
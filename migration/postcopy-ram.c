@@ -39,6 +39,22 @@
 #include "qemu/mmap-alloc.h"
 #include "options.h"
 
+size_t postcopy_ram_pagesize(RAMBlock *rb)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+
+    /*
+     * Blocks whose size isn't a multiple of the unit keep using host
+     * pages, so that the last unit of a block is never partial.
+     */
+    if (migrate_postcopy_thp() && pagesize < POSTCOPY_THP_SIZE &&
+        QEMU_IS_ALIGNED(rb->used_length, POSTCOPY_THP_SIZE)) {
+        return POSTCOPY_THP_SIZE;
+    }
+
+    return pagesize;
+}
+
 /* Arbitrary limit on size of each discard command,
  * keeps them around ~200 bytes
  */
@@ -126,6 +142,10 @@ typedef struct PostcopyBlocktimeContext {
     /* number of vCPU are suspended */
     int smp_cpus_down;
     uint64_t start_time;
+    /* number of faults that blocked a vCPU */
+    uint64_t faults;
+    /* number of pages requested ahead of the faults */
+    uint64_t prefetch_requests;
 
     /*
      * Handler for exit event, necessary for
@@ -197,6 +217,10 @@ void fill_destination_postcopy_migration_info(MigrationInfo *info)
     info->postcopy_blocktime = bc->total_blocktime;
     info->has_postcopy_vcpu_blocktime = true;
     info->postcopy_vcpu_blocktime = get_vcpu_blocktime_list(bc);
+    info->has_postcopy_faults = true;
+    info->postcopy_faults = bc->faults;
+    info->has_postcopy_prefetch_requests = true;
+    info->postcopy_prefetch_requests = bc->prefetch_requests;
 }
 
 static uint32_t get_postcopy_total_blocktime(void)
@@ -745,15 +769,15 @@ static int ram_block_enable_notify(RAMBlock *rb, void *opaque)
 }
 
 int postcopy_wake_shared(struct PostCopyFD *pcfd,
-                         uint64_t client_addr,
+                         uint64_t client_addr, uint64_t len,
                          RAMBlock *rb)
 {
     size_t pagesize = qemu_ram_pagesize(rb);
     struct uffdio_range range;
     int ret;
-    trace_postcopy_wake_shared(client_addr, qemu_ram_get_idstr(rb));
+    trace_postcopy_wake_shared(client_addr, len, qemu_ram_get_idstr(rb));
     range.start = ROUND_DOWN(client_addr, pagesize);
-    range.len = pagesize;
+    range.len = ROUND_UP(client_addr + len, pagesize) - range.start;
     ret = ioctl(pcfd->fd, UFFDIO_WAKE, &range);
     if (ret) {
         error_report("%s: Failed to wake: %zx in %s (%s)",
@@ -766,7 +790,7 @@ int postcopy_wake_shared(struct PostCopyFD *pcfd,
 static int postcopy_request_page(MigrationIncomingState *mis, RAMBlock *rb,
                                  ram_addr_t start, uint64_t haddr)
 {
-    void *aligned = (void *)(uintptr_t)ROUND_DOWN(haddr, qemu_ram_pagesize(rb));
+    void *aligned = rb->host + start;
 
     /*
      * Discarded pages (via RamDiscardManager) are never migrated. On unlikely
@@ -776,7 +800,7 @@ static int postcopy_request_page(MigrationIncomingState *mis, RAMBlock *rb,
      * Checking a single bit is sufficient to handle pagesize > TPS as either
      * all relevant bits are set or not.
      */
-    assert(QEMU_IS_ALIGNED(start, qemu_ram_pagesize(rb)));
+    assert(QEMU_IS_ALIGNED(start, postcopy_ram_pagesize(rb)));
     if (ramblock_page_is_discarded(rb, start)) {
         bool received = ramblock_recv_bitmap_test_byte_offset(rb, start);
 
@@ -794,7 +818,7 @@ static int postcopy_request_page(MigrationIncomingState *mis, RAMBlock *rb,
 int postcopy_request_shared_page(struct PostCopyFD *pcfd, RAMBlock *rb,
                                  uint64_t client_addr, uint64_t rb_offset)
 {
-    uint64_t aligned_rbo = ROUND_DOWN(rb_offset, qemu_ram_pagesize(rb));
+    uint64_t aligned_rbo = ROUND_DOWN(rb_offset, postcopy_ram_pagesize(rb));
     MigrationIncomingState *mis = migration_incoming_get_current();
 
     trace_postcopy_request_shared_page(pcfd->idstr, qemu_ram_get_idstr(rb),
@@ -802,7 +826,8 @@ int postcopy_request_shared_page(struct PostCopyFD *pcfd, RAMBlock *rb,
     if (ramblock_recv_bitmap_test_byte_offset(rb, aligned_rbo)) {
         trace_postcopy_request_shared_page_present(pcfd->idstr,
                                         qemu_ram_get_idstr(rb), rb_offset);
-        return postcopy_wake_shared(pcfd, client_addr, rb);
+        return postcopy_wake_shared(pcfd, client_addr,
+                                    qemu_ram_pagesize(rb), rb);
     }
     postcopy_request_page(mis, rb, aligned_rbo, client_addr);
     return 0;
@@ -872,6 +897,8 @@ static void mark_postcopy_blocktime_begin(uintptr_t addr, uint32_t ptid,
         qatomic_xchg(&dc->vcpu_addr[cpu], 0);
         qatomic_xchg(&dc->page_fault_vcpu_time[cpu], 0);
         qatomic_dec(&dc->smp_cpus_down);
+    } else {
+        dc->faults++;
     }
     trace_mark_postcopy_blocktime_begin(addr, dc, dc->page_fault_vcpu_time[cpu],
                                         cpu, already_received);
@@ -902,9 +929,10 @@ static void mark_postcopy_blocktime_begin(uintptr_t addr, uint32_t ptid,
  *              * - means blocktime per vCPU
  *              x - means overlapped blocktime (total blocktime)
  *
- * @addr: host virtual address
+ * @addr: host virtual address of the placed page
+ * @len: size of the placed page; it may span several faulting addresses
  */
-static void mark_postcopy_blocktime_end(uintptr_t addr)
+static void mark_postcopy_blocktime_end(uintptr_t addr, size_t len)
 {
     MigrationIncomingState *mis = migration_incoming_get_current();
     PostcopyBlocktimeContext *dc = mis->blocktime_ctx;
@@ -925,9 +953,11 @@ static void mark_postcopy_blocktime_end(uintptr_t addr)
      * where key is address value is a list of  */
     for (i = 0; i < smp_cpus; i++) {
         uint32_t vcpu_blocktime = 0;
+        uintptr_t vcpu_addr;
 
         read_vcpu_time = qatomic_fetch_add(&dc->page_fault_vcpu_time[i], 0);
-        if (qatomic_fetch_add(&dc->vcpu_addr[i], 0) != addr ||
+        vcpu_addr = qatomic_fetch_add(&dc->vcpu_addr[i], 0);
+        if (vcpu_addr < addr || vcpu_addr - addr >= len ||
             read_vcpu_time == 0) {
             continue;
         }
@@ -954,6 +984,86 @@ static void mark_postcopy_blocktime_end(uintptr_t addr)
                                       affected_cpu);
 }
 
+/*
+ * With the postcopy-prefetch capability, the fault thread looks for
+ * sequential or strided access patterns in the faults of each vCPU, and
+ * requests the pages that the vCPU is about to fault on.  Strides and
+ * depths are counted in units of postcopy_ram_pagesize().
+ */
+#define POSTCOPY_PREFETCH_MAX_STRIDE 64
+#define POSTCOPY_PREFETCH_MAX_DEPTH  16
+
+typedef struct PostcopyFaultPattern {
+    RAMBlock *rb;
+    /* last page the vCPU faulted on */
+    int64_t last;
+    /* distance between its last two faults */
+    int64_t stride;
+    /* number of consecutive faults that followed @stride */
+    unsigned int hits;
+    /* furthest page requested so far in the direction of @stride */
+    int64_t ahead;
+} PostcopyFaultPattern;
+
+static void postcopy_prefetch(MigrationIncomingState *mis,
+                              PostcopyFaultPattern *pattern,
+                              RAMBlock *rb, ram_addr_t rb_offset)
+{
+    PostcopyBlocktimeContext *dc = mis->blocktime_ctx;
+    size_t pagesize = postcopy_ram_pagesize(rb);
+    int64_t npages = rb->used_length / pagesize;
+    int64_t page = rb_offset / pagesize;
+    unsigned int depth, i;
+
+    if (pattern->rb == rb && page != pattern->last &&
+        page - pattern->last == pattern->stride) {
+        pattern->hits = MIN(pattern->hits + 1, 8);
+    } else {
+        pattern->stride = pattern->rb == rb ? page - pattern->last : 0;
+        pattern->rb = rb;
+        pattern->hits = 0;
+        pattern->ahead = page;
+    }
+    pattern->last = page;
+
+    if (!pattern->hits || pattern->stride > POSTCOPY_PREFETCH_MAX_STRIDE ||
+        pattern->stride < -POSTCOPY_PREFETCH_MAX_STRIDE) {
+        return;
+    }
+
+    /* Look further ahead as long as the pattern holds */
+    depth = MIN(1u << pattern->hits, POSTCOPY_PREFETCH_MAX_DEPTH);
+    for (i = 1; i <= depth; i++) {
+        int64_t target = page + i * pattern->stride;
+        ram_addr_t offset;
+
+        if (target < 0 || target >= npages) {
+            break;
+        }
+        if (pattern->stride > 0 ? target <= pattern->ahead :
+                                  target >= pattern->ahead) {
+            continue;
+        }
+        pattern->ahead = target;
+
+        offset = target * pagesize;
+        if (ramblock_recv_bitmap_test_byte_offset(rb, offset) ||
+            ramblock_page_is_discarded(rb, offset)) {
+            continue;
+        }
+
+        trace_postcopy_prefetch(qemu_ram_get_idstr(rb), offset,
+                                pattern->stride * (int64_t)pagesize);
+        /* A failure shows up on the next fault request */
+        if (migrate_send_rp_message_req_pages(mis, rb, offset)) {
+            break;
+        }
+        if (dc) {
+            dc->prefetch_requests++;
+        }
+    }
+}
+
 static void postcopy_pause_fault_thread(MigrationIncomingState *mis)
 {
     trace_postcopy_pause_fault_thread();
@@ -971,8 +1081,14 @@ static void *postcopy_ram_fault_thread(void *opaque)
     int ret;
     size_t index;
     RAMBlock *rb = NULL;
+    PostcopyFaultPattern *patterns = NULL;
+    unsigned int smp_cpus = MACHINE(qdev_get_machine())->smp.cpus;
 
     trace_postcopy_ram_fault_thread_entry();
+    if (migrate_postcopy_prefetch()) {
+        /* One per vCPU, plus one for faults whose vCPU is unknown */
+        patterns = g_new0(PostcopyFaultPattern, smp_cpus + 1);
+    }
     rcu_register_thread();
     mis->last_rb = NULL; /* last RAMBlock we sent part of */
     qemu_sem_post(&mis->thread_sync_sem);
@@ -1074,7 +1190,7 @@ static void *postcopy_ram_fault_thread(void *opaque)
                 break;
             }
 
-            rb_offset = ROUND_DOWN(rb_offset, qemu_ram_pagesize(rb));
+            rb_offset = ROUND_DOWN(rb_offset, postcopy_ram_pagesize(rb));
             trace_postcopy_ram_fault_thread_request(msg.arg.pagefault.address,
                                                 qemu_ram_get_idstr(rb),
                                                 rb_offset,
@@ -1095,6 +1211,13 @@ retry:
                 postcopy_pause_fault_thread(mis);
                 goto retry;
             }
+
+            if (patterns) {
+                int cpu = get_mem_fault_cpu_index(msg.arg.pagefault.feat.ptid);
+
+                postcopy_prefetch(mis, &patterns[cpu < 0 ? smp_cpus : cpu],
+                                  rb, rb_offset);
+            }
         }
 
         /* Now handle any requests from external processes on shared memory */
@@ -1155,6 +1278,7 @@ retry:
     }
     rcu_unregister_thread();
     trace_postcopy_ram_fault_thread_exit();
+    g_free(patterns);
     g_free(pfd);
     return NULL;
 }
@@ -1317,7 +1441,7 @@ static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
             }
         }
         qemu_mutex_unlock(&mis->page_request_mutex);
-        mark_postcopy_blocktime_end((uintptr_t)host_addr);
+        mark_postcopy_blocktime_end((uintptr_t)host_addr, pagesize);
     }
     return ret;
 }
@@ -1345,7 +1469,7 @@ int postcopy_notify_shared_wake(RAMBlock *rb, uint64_t offset)
 int postcopy_place_page(MigrationIncomingState *mis, void *host, void *from,
                         RAMBlock *rb)
 {
-    size_t pagesize = qemu_ram_pagesize(rb);
+    size_t pagesize = postcopy_ram_pagesize(rb);
 
     /* copy also acks to the kernel waking the stalled thread up
      * TODO: We can inhibit that ack and only do it if it was requested
@@ -1372,7 +1496,7 @@ int postcopy_place_page(MigrationIncomingState *mis, void *host, void *from,
 int postcopy_place_page_zero(MigrationIncomingState *mis, void *host,
                              RAMBlock *rb)
 {
-    size_t pagesize = qemu_ram_pagesize(rb);
+    size_t pagesize = postcopy_ram_pagesize(rb);
     trace_postcopy_place_page_zero(host);
 
     /* Normal RAMBlocks can zero a page using UFFDIO_ZEROPAGE
@@ -1452,7 +1576,7 @@ int postcopy_place_page_zero(MigrationIncomingState *mis, void *host,
 }
 
 int postcopy_wake_shared(struct PostCopyFD *pcfd,
-                         uint64_t client_addr,
+                         uint64_t client_addr, uint64_t len,
                          RAMBlock *rb)
 {
     assert(0);
@@ -13,6 +13,22 @@
 #ifndef QEMU_POSTCOPY_RAM_H
 #define QEMU_POSTCOPY_RAM_H
 
+#include "qemu/units.h"
+
+/*
+ * With the postcopy-thp capability, the pages of RAMBlocks backed by small
+ * pages are sent, requested and placed in units of this size, so that a
+ * fault is resolved for a whole transparent huge page at a time.  Both
+ * sides must agree on it, so it is fixed rather than read from the host.
+ */
+#define POSTCOPY_THP_SIZE (2 * MiB)
+
+/*
+ * Size of the unit in which the pages of @rb are handled during postcopy:
+ * the host page size, or POSTCOPY_THP_SIZE (see above).
+ */
+size_t postcopy_ram_pagesize(RAMBlock *rb);
+
 /* Return true if the host supports everything we need to do postcopy-ram */
 bool postcopy_ram_supported_by_host(MigrationIncomingState *mis,
                                     Error **errp);
@@ -167,19 +183,21 @@ struct PostCopyFD {
 void postcopy_register_shared_ufd(struct PostCopyFD *pcfd);
 void postcopy_unregister_shared_ufd(struct PostCopyFD *pcfd);
 /* Call each of the shared 'waker's registered telling them of
- * availability of a block.
+ * availability of a block: the postcopy_ram_pagesize() bytes of @rb
+ * starting at @offset.
  */
 int postcopy_notify_shared_wake(RAMBlock *rb, uint64_t offset);
-/* postcopy_wake_shared: Notify a client ufd that a page is available
+/* postcopy_wake_shared: Notify a client ufd that a range is available
  *
  * Returns 0 on success
  *
  * @pcfd: Structure with fd, handler and name as above
  * @client_addr: Address in the client program, not QEMU
- * @rb: The RAMBlock the page is in
+ * @len: Length of the range, rounded out to host pages of @rb
+ * @rb: The RAMBlock the range is in
  */
 int postcopy_wake_shared(struct PostCopyFD *pcfd, uint64_t client_addr,
-                         RAMBlock *rb);
+                         uint64_t len, RAMBlock *rb);
 /* Callback from shared fault handlers to ask for a page */
 int postcopy_request_shared_page(struct PostCopyFD *pcfd, RAMBlock *rb,
                                  uint64_t client_addr, uint64_t offset);
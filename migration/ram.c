@@ -41,6 +41,7 @@
 #include "migration/misc.h"
 #include "qemu-file.h"
 #include "postcopy-ram.h"
+#include "lazy-restore.h"
 #include "page_cache.h"
 #include "qemu/error-report.h"
 #include "qapi/error.h"
@@ -94,6 +95,31 @@
 #define RAM_SAVE_FLAG_MULTIFD_FLUSH    0x200
 /* We can't use any flag that is bigger than 0x200 */
 
+/*
+ * mapped-ram migration file layout: the stream carries, after each
+ * RAMBlock's name and length, a MappedRamHeader giving the place of the
+ * block in the file.  There, the bitmap of the pages that have data
+ * (little endian longs) is followed by a region as large as the block,
+ * where each page lives at its offset inside the block.  Pages that are
+ * dirtied again overwrite their previous copy, and pages that are zero or
+ * were never sent leave a hole.
+ */
+#define MAPPED_RAM_HDR_VERSION 1
+/* Alignment of the pages region, large enough for O_DIRECT */
+#define MAPPED_RAM_FILE_OFFSET_ALIGNMENT 0x100000
+/* Size of the reads issued when loading the pages region */
+#define MAPPED_RAM_LOAD_BUF_SIZE 0x100000
+
+typedef struct {
+    uint32_t version;
+    /* target page size, to know how many pages the bitmap covers */
+    uint64_t page_size;
+    /* offset in the migration file of the pages bitmap */
+    uint64_t bitmap_offset;
+    /* offset in the migration file of the pages themselves */
+    uint64_t pages_offset;
+} QEMU_PACKED MappedRamHeader;
+
 XBZRLECacheStats xbzrle_counters;
 
 /* used by the search for pages to send */
@@ -123,11 +149,17 @@ static struct {
     uint8_t *encoded_buf;
     /* buffer for storing page content */
     uint8_t *current_buf;
-    /* Cache for XBZRLE, Protected by lock. */
+    /*
+     * Cache for XBZRLE, Protected by lock.  The multifd send threads
+     * access it within RCU critical sections instead.
+     */
     PageCache *cache;
     QemuMutex lock;
-    /* it will store a page full of zeros */
-    uint8_t *zero_target_page;
+    /*
+     * RAMState.xbzrle_started, for the multifd send threads: they may
+     * still be running when the RAMState is freed.
+     */
+    bool started;
     /* buffer used for XBZRLE decoding */
     uint8_t *decoded_buf;
 } XBZRLE;
@@ -152,7 +184,8 @@ static void XBZRLE_cache_unlock(void)
  * This function is called from migrate_params_apply in main
  * thread, possibly while a migration is in progress.  A running
  * migration may be using the cache and might finish during this call,
- * hence changes to the cache are protected by XBZRLE.lock().
+ * hence changes to the cache are protected by XBZRLE.lock().  The old
+ * cache is freed once the multifd send threads are done with it.
  *
  * Returns 0 for success or -1 for error
  *
@@ -161,7 +194,7 @@ static void XBZRLE_cache_unlock(void)
  */
 int xbzrle_cache_resize(uint64_t new_size, Error **errp)
 {
-    PageCache *new_cache;
+    PageCache *new_cache, *old_cache = NULL;
     int64_t ret = 0;
 
     /* Check for truncation */
@@ -185,11 +218,14 @@ int xbzrle_cache_resize(uint64_t new_size, Error **errp)
             goto out;
         }
 
-        cache_fini(XBZRLE.cache);
-        XBZRLE.cache = new_cache;
+        old_cache = XBZRLE.cache;
+        qatomic_rcu_set(&XBZRLE.cache, new_cache);
     }
 out:
     XBZRLE_cache_unlock();
+    if (old_cache) {
+        cache_fini_rcu(old_cache);
+    }
     return ret;
 }
 
@@ -567,13 +603,18 @@ void mig_throttle_counter_reset(void)
  * by the new data.
  * As a bonus, if the page wasn't in the cache it gets added so that
  * when a small write is made into the 0'd page it gets XBZRLE sent.
+ *
+ * Multifd send threads may be encoding pages of the same set, so take
+ * its lock.
  */
 static void xbzrle_cache_zero_page(ram_addr_t current_addr)
 {
+    cache_lock(XBZRLE.cache, current_addr);
     /* We don't care if this fails to allocate a new cache page
      * as long as it updated an old one */
-    cache_insert(XBZRLE.cache, current_addr, XBZRLE.zero_target_page,
+    cache_insert(XBZRLE.cache, current_addr, NULL,
                  stat64_get(&mig_stats.dirty_sync_count));
+    cache_unlock(XBZRLE.cache, current_addr);
 }
 
 #define ENCODING_FLAG_XBZRLE 0x1
@@ -680,6 +721,107 @@ static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
     return 1;
 }
 
+/**
+ * xbzrle_encode_page: XBZRLE encode a page for a multifd send thread
+ *
+ * Unlike save_xbzrle_page(), this can be called concurrently from
+ * several threads: the cache is only accessed with the lock of the set
+ * holding the page.  Pages that are not cached get inserted, once the
+ * bulk stage is over.
+ *
+ * Returns: > 0 the size of the encoded page
+ *          0 means that page is identical to the one already sent
+ *          -1 means that the page has to be sent as is
+ *
+ * @current_addr: addr of the page
+ * @current_buf: copy of the page contents, that is sent as is on -1
+ * @encoded_buf: buffer of at least @encoded_len bytes
+ * @encoded_len: maximum size of the encoded page
+ * @stats: XBZRLE counters to account the page in
+ */
+int xbzrle_encode_page(ram_addr_t current_addr, uint8_t *current_buf,
+                       uint8_t *encoded_buf, int encoded_len,
+                       XBZRLECacheStats *stats)
+{
+    uint64_t generation = stat64_get(&mig_stats.dirty_sync_count);
+    uint8_t *prev_cached_page;
+    PageCache *cache;
+    int ret;
+
+    RCU_READ_LOCK_GUARD();
+
+    cache = qatomic_rcu_read(&XBZRLE.cache);
+    /* Like ram_save_page(), leave the cache alone during the bulk stage */
+    if (!cache || !qatomic_read(&XBZRLE.started)) {
+        return -1;
+    }
+
+    cache_lock(cache, current_addr);
+    if (!cache_is_cached(cache, current_addr, generation)) {
+        stats->cache_miss++;
+        cache_insert(cache, current_addr, current_buf, generation);
+        cache_unlock(cache, current_addr);
+        return -1;
+    }
+
+    stats->pages++;
+    prev_cached_page = get_cached_data(cache, current_addr);
+    ret = xbzrle_encode_buffer(prev_cached_page, current_buf,
+                               TARGET_PAGE_SIZE, encoded_buf, encoded_len);
+    if (ret != 0) {
+        memcpy(prev_cached_page, current_buf, TARGET_PAGE_SIZE);
+    }
+    cache_unlock(cache, current_addr);
+
+    if (ret == 0) {
+        trace_save_xbzrle_page_skipping();
+    } else if (ret == -1) {
+        trace_save_xbzrle_page_overflow();
+        stats->overflow++;
+        stats->bytes += TARGET_PAGE_SIZE;
+    } else {
+        stats->bytes += ret;
+    }
+    return ret;
+}
+
+/**
+ * xbzrle_cache_zero_page_multifd: update the XBZRLE cache for a page
+ * that a multifd send thread found to be zero
+ *
+ * @current_addr: addr of the page
+ */
+void xbzrle_cache_zero_page_multifd(ram_addr_t current_addr)
+{
+    PageCache *cache;
+
+    RCU_READ_LOCK_GUARD();
+
+    cache = qatomic_rcu_read(&XBZRLE.cache);
+    /* Like save_zero_page(), only once the bulk stage is over */
+    if (cache && qatomic_read(&XBZRLE.started)) {
+        cache_lock(cache, current_addr);
+        cache_insert(cache, current_addr, NULL,
+                     stat64_get(&mig_stats.dirty_sync_count));
+        cache_unlock(cache, current_addr);
+    }
+}
+
+/**
+ * xbzrle_counters_add: account the pages encoded by a multifd send thread
+ *
+ * @stats: counters of the pages encoded since the last call
+ */
+void xbzrle_counters_add(const XBZRLECacheStats *stats)
+{
+    XBZRLE_cache_lock();
+    xbzrle_counters.pages += stats->pages;
+    xbzrle_counters.cache_miss += stats->cache_miss;
+    xbzrle_counters.overflow += stats->overflow;
+    xbzrle_counters.bytes += stats->bytes;
+    XBZRLE_cache_unlock();
+}
+
 /**
  * pss_find_next_dirty: find the next dirty page of current ramblock
  *
@@ -1034,7 +1176,9 @@ static void migration_trigger_throttle(RAMState *rs)
 static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 {
     RAMBlock *block;
+    int64_t start_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     int64_t end_time;
+    uint64_t sync_time;
 
     stat64_add(&mig_stats.dirty_sync_count, 1);
 
@@ -1057,6 +1201,11 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
     memory_global_after_dirty_log_sync();
     trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
 
+    sync_time = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start_us;
+    stat64_set(&mig_stats.dirty_sync_time, sync_time);
+    stat64_max(&mig_stats.dirty_sync_time_max, sync_time);
+    stat64_add(&mig_stats.dirty_sync_time_total, sync_time);
+
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
     /* more than 1 second = 1000 millisecons */
@@ -1123,10 +1272,21 @@ static int save_zero_page(RAMState *rs, PageSearchStatus *pss,
     QEMUFile *file = pss->pss_channel;
     int len = 0;
 
+    if (migrate_zero_page_detection() == ZERO_PAGE_DETECTION_NONE) {
+        return 0;
+    }
+
     if (!buffer_is_zero(p, TARGET_PAGE_SIZE)) {
         return 0;
     }
 
+    if (migrate_mapped_ram()) {
+        /* Zero pages are holes in the file, forget any previous copy */
+        ramblock_set_file_bmap_atomic(pss->block, offset, false);
+        stat64_add(&mig_stats.zero_pages, 1);
+        return 1;
+    }
+
     len += save_page_header(pss, file, pss->block, offset | RAM_SAVE_FLAG_ZERO);
     qemu_put_byte(file, 0);
     len += 1;
@@ -1190,6 +1350,15 @@ static int save_normal_page(PageSearchStatus *pss, RAMBlock *block,
 {
     QEMUFile *file = pss->pss_channel;
 
+    if (migrate_mapped_ram()) {
+        qemu_put_buffer_at(file, buf, TARGET_PAGE_SIZE,
+                           block->pages_offset + offset);
+        ramblock_set_file_bmap_atomic(block, offset, true);
+        ram_transferred_add(TARGET_PAGE_SIZE);
+        stat64_add(&mig_stats.normal_pages, 1);
+        return 1;
+    }
+
     ram_transferred_add(save_page_header(pss, pss->pss_channel, block,
                                          offset | RAM_SAVE_FLAG_PAGE));
     if (async) {
@@ -1256,7 +1425,6 @@ static int ram_save_multifd_page(QEMUFile *file, RAMBlock *block,
     if (multifd_queue_page(file, block, offset) < 0) {
         return -1;
     }
-    stat64_add(&mig_stats.normal_pages, 1);
 
     return 1;
 }
@@ -1361,6 +1529,7 @@ static int find_dirty_block(RAMState *rs, PageSearchStatus *pss)
             /* After the first round, enable XBZRLE. */
             if (migrate_xbzrle()) {
                 rs->xbzrle_started = true;
+                qatomic_set(&XBZRLE.started, true);
             }
         }
         /* Didn't find anything this time, but try again on the new block */
@@ -1944,7 +2113,7 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
      */
     if (postcopy_preempt_active()) {
         ram_addr_t page_start = start >> TARGET_PAGE_BITS;
-        size_t page_size = qemu_ram_pagesize(ramblock);
+        size_t page_size = postcopy_ram_pagesize(ramblock);
         PageSearchStatus *pss = &ram_state->pss[RAM_CHANNEL_POSTCOPY];
         int ret = 0;
 
@@ -2056,10 +2225,6 @@ static int ram_save_target_page_legacy(RAMState *rs, PageSearchStatus *pss)
         return 1;
     }
 
-    if (save_zero_page(rs, pss, offset)) {
-        return 1;
-    }
-
     /*
      * Do not use multifd in postcopy as one whole host page should be
      * placed.  Meanwhile postcopy requires atomic update of pages, so even
@@ -2067,9 +2232,18 @@ static int ram_save_target_page_legacy(RAMState *rs, PageSearchStatus *pss)
      * still see partially copied pages which is data corruption.
      */
     if (migrate_multifd() && !migration_in_postcopy()) {
+        /* The multifd send threads may look for zero pages themselves */
+        if (migrate_zero_page_detection() != ZERO_PAGE_DETECTION_MULTIFD &&
+            save_zero_page(rs, pss, offset)) {
+            return 1;
+        }
         return ram_save_multifd_page(pss->pss_channel, block, offset);
     }
 
+    if (save_zero_page(rs, pss, offset)) {
+        return 1;
+    }
+
     return ram_save_page(rs, pss);
 }
 
@@ -2077,7 +2251,7 @@ static int ram_save_target_page_legacy(RAMState *rs, PageSearchStatus *pss)
 static void pss_host_page_prepare(PageSearchStatus *pss)
 {
     /* How many guest pages are there in one host page? */
-    size_t guest_pfns = qemu_ram_pagesize(pss->block) >> TARGET_PAGE_BITS;
+    size_t guest_pfns = postcopy_ram_pagesize(pss->block) >> TARGET_PAGE_BITS;
 
     pss->host_page_sending = true;
     if (guest_pfns <= 1) {
@@ -2203,7 +2377,7 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss)
     bool page_dirty, preempt_active = postcopy_preempt_active();
     int tmppages, pages = 0;
     size_t pagesize_bits =
-        qemu_ram_pagesize(pss->block) >> TARGET_PAGE_BITS;
+        postcopy_ram_pagesize(pss->block) >> TARGET_PAGE_BITS;
     unsigned long start_page = pss->page;
     int res;
 
@@ -2376,14 +2550,13 @@ static void xbzrle_cleanup(void)
 {
     XBZRLE_cache_lock();
     if (XBZRLE.cache) {
-        cache_fini(XBZRLE.cache);
+        /* The multifd send threads may not have been stopped yet */
+        cache_fini_rcu(XBZRLE.cache);
         g_free(XBZRLE.encoded_buf);
         g_free(XBZRLE.current_buf);
-        g_free(XBZRLE.zero_target_page);
-        XBZRLE.cache = NULL;
+        qatomic_rcu_set(&XBZRLE.cache, NULL);
         XBZRLE.encoded_buf = NULL;
         XBZRLE.current_buf = NULL;
-        XBZRLE.zero_target_page = NULL;
     }
     XBZRLE_cache_unlock();
 }
@@ -2413,6 +2586,8 @@ static void ram_save_cleanup(void *opaque)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
     }
 
     xbzrle_cleanup();
@@ -2434,6 +2609,7 @@ static void ram_state_reset(RAMState *rs)
     rs->last_page = 0;
     rs->last_version = ram_list.version;
     rs->xbzrle_started = false;
+    qatomic_set(&XBZRLE.started, false);
 }
 
 #define MAX_WAIT 50 /* ms, half buffered_file limit */
@@ -2549,11 +2725,12 @@ static void postcopy_chunk_hostpages_pass(MigrationState *ms, RAMBlock *block)
 {
     RAMState *rs = ram_state;
     unsigned long *bitmap = block->bmap;
-    unsigned int host_ratio = block->page_size / TARGET_PAGE_SIZE;
+    size_t pagesize = postcopy_ram_pagesize(block);
+    unsigned int host_ratio = pagesize / TARGET_PAGE_SIZE;
     unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
     unsigned long run_start;
 
-    if (block->page_size == TARGET_PAGE_SIZE) {
+    if (pagesize == TARGET_PAGE_SIZE) {
         /* Easy case - TPS==HPS for a non-huge page RAMBlock */
         return;
     }
@@ -2679,17 +2856,11 @@ static int xbzrle_init(void)
 
     XBZRLE_cache_lock();
 
-    XBZRLE.zero_target_page = g_try_malloc0(TARGET_PAGE_SIZE);
-    if (!XBZRLE.zero_target_page) {
-        error_report("%s: Error allocating zero page", __func__);
-        goto err_out;
-    }
-
     XBZRLE.cache = cache_init(migrate_xbzrle_cache_size(),
                               TARGET_PAGE_SIZE, &local_err);
     if (!XBZRLE.cache) {
         error_report_err(local_err);
-        goto free_zero_page;
+        goto err_out;
     }
 
     XBZRLE.encoded_buf = g_try_malloc0(TARGET_PAGE_SIZE);
@@ -2714,9 +2885,6 @@ free_encoded_buf:
 free_cache:
     cache_fini(XBZRLE.cache);
     XBZRLE.cache = NULL;
-free_zero_page:
-    g_free(XBZRLE.zero_target_page);
-    XBZRLE.zero_target_page = NULL;
 err_out:
     XBZRLE_cache_unlock();
     return -ENOMEM;
@@ -2782,6 +2950,9 @@ static void ram_list_init_bitmaps(void)
             bitmap_set(block->bmap, 0, pages);
             block->clear_bmap_shift = shift;
             block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
+            if (migrate_mapped_ram()) {
+                block->file_bmap = bitmap_new(pages);
+            }
         }
     }
 }
@@ -2924,6 +3095,58 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
  * granularity of these critical sections.
  */
 
+/*
+ * Reserve the place of @block in a mapped-ram migration file and describe
+ * it in the stream.  The stream then continues after the pages region.
+ */
+static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
+{
+    MappedRamHeader header = {};
+    size_t header_size = sizeof(header);
+    long num_pages = block->used_length >> TARGET_PAGE_BITS;
+    size_t bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+
+    block->bitmap_offset = qemu_get_offset(file) + header_size;
+    block->pages_offset = ROUND_UP(block->bitmap_offset + bitmap_size,
+                                   MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+
+    header.version = cpu_to_be32(MAPPED_RAM_HDR_VERSION);
+    header.page_size = cpu_to_be64(TARGET_PAGE_SIZE);
+    header.bitmap_offset = cpu_to_be64(block->bitmap_offset);
+    header.pages_offset = cpu_to_be64(block->pages_offset);
+
+    qemu_put_buffer(file, (uint8_t *)&header, header_size);
+
+    /* prepare offset for next ramblock */
+    qemu_set_offset(file, block->pages_offset + block->used_length, SEEK_SET);
+}
+
+/*
+ * Write the bitmap of the pages that have data in the file to the place
+ * reserved for it by mapped_ram_setup_ramblock().  Must be called once
+ * all pages have been written.
+ */
+static void mapped_ram_save_bitmap(QEMUFile *file, RAMBlock *block)
+{
+    long num_pages = block->used_length >> TARGET_PAGE_BITS;
+    size_t bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+    g_autofree unsigned long *le_bitmap = bitmap_new(num_pages);
+
+    bitmap_to_le(le_bitmap, block->file_bmap, num_pages);
+    qemu_put_buffer_at(file, (uint8_t *)le_bitmap, bitmap_size,
+                       block->bitmap_offset);
+}
+
+void ramblock_set_file_bmap_atomic(RAMBlock *block, ram_addr_t offset,
+                                   bool set)
+{
+    if (set) {
+        set_bit_atomic(offset >> TARGET_PAGE_BITS, block->file_bmap);
+    } else {
+        clear_bit_atomic(offset >> TARGET_PAGE_BITS, block->file_bmap);
+    }
+}
+
 /**
  * ram_save_setup: Setup RAM for migration
  *
@@ -2966,6 +3189,9 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_mapped_ram()) {
+                mapped_ram_setup_ramblock(f, block);
+            }
         }
     }
 
@@ -3188,6 +3414,20 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
         return ret;
     }
 
+    if (migrate_mapped_ram()) {
+        RAMBlock *block;
+
+        WITH_RCU_READ_LOCK_GUARD() {
+            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                mapped_ram_save_bitmap(f, block);
+            }
+        }
+        ret = qemu_file_get_error(f);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
     if (migrate_multifd() && !migrate_multifd_flush_after_each_section()) {
         qemu_put_be64(f, RAM_SAVE_FLAG_MULTIFD_FLUSH);
     }
@@ -3329,18 +3569,23 @@ static inline void *host_from_ram_block_offset(RAMBlock *block,
     return block->host + offset;
 }
 
+/*
+ * The host page here is the unit postcopy places atomically.  It is
+ * aligned within the RAMBlock rather than in the address space: a
+ * POSTCOPY_THP_SIZE unit needs not be aligned in memory, while huge
+ * page backed blocks are aligned to their page size anyway.
+ */
 static void *host_page_from_ram_block_offset(RAMBlock *block,
                                              ram_addr_t offset)
 {
     /* Note: Explicitly no check against offset_in_ramblock(). */
-    return (void *)QEMU_ALIGN_DOWN((uintptr_t)(block->host + offset),
-                                   block->page_size);
+    return block->host + QEMU_ALIGN_DOWN(offset, postcopy_ram_pagesize(block));
 }
 
 static ram_addr_t host_page_offset_from_ram_block_offset(RAMBlock *block,
                                                          ram_addr_t offset)
 {
-    return ((uintptr_t)block->host + offset) & (block->page_size - 1);
+    return offset & (postcopy_ram_pagesize(block) - 1);
 }
 
 void colo_record_bitmap(RAMBlock *block, ram_addr_t *normal, uint32_t pages)
@@ -3566,6 +3811,7 @@ int ram_load_postcopy(QEMUFile *f, int channel)
         void *page_buffer = NULL;
         void *place_source = NULL;
         RAMBlock *block = NULL;
+        size_t pagesize;
         uint8_t ch;
         int len;
 
@@ -3604,7 +3850,8 @@ int ram_load_postcopy(QEMUFile *f, int channel)
                 break;
             }
             tmp_page->target_pages++;
-            matches_target_page_size = block->page_size == TARGET_PAGE_SIZE;
+            pagesize = postcopy_ram_pagesize(block);
+            matches_target_page_size = pagesize == TARGET_PAGE_SIZE;
             /*
              * Postcopy requires that we place whole host pages atomically;
              * these may be huge pages for RAMBlocks that are backed by
@@ -3638,8 +3885,7 @@ int ram_load_postcopy(QEMUFile *f, int channel)
              * If it's the last part of a host page then we place the host
              * page
              */
-            if (tmp_page->target_pages ==
-                (block->page_size / TARGET_PAGE_SIZE)) {
+            if (tmp_page->target_pages == (pagesize / TARGET_PAGE_SIZE)) {
                 place_needed = true;
             }
             place_source = tmp_page->tmp_huge_page;
@@ -3789,6 +4035,163 @@ void colo_flush_ram_cache(void)
     trace_colo_flush_ram_cache_end();
 }
 
+static bool mapped_ram_read_header(QEMUFile *file, MappedRamHeader *header,
+                                   Error **errp)
+{
+    size_t ret, header_size = sizeof(MappedRamHeader);
+
+    ret = qemu_get_buffer(file, (uint8_t *)header, header_size);
+    if (ret != header_size) {
+        error_setg(errp, "Could not read whole mapped-ram migration header "
+                   "(expected %zd, got %zd bytes)", header_size, ret);
+        return false;
+    }
+
+    /* migration stream is big-endian */
+    header->version = be32_to_cpu(header->version);
+
+    if (header->version > MAPPED_RAM_HDR_VERSION) {
+        error_setg(errp, "Migration mapped-ram capability version not "
+                   "supported (expected <= %d, got %d)", MAPPED_RAM_HDR_VERSION,
+                   header->version);
+        return false;
+    }
+
+    header->page_size = be64_to_cpu(header->page_size);
+    header->bitmap_offset = be64_to_cpu(header->bitmap_offset);
+    header->pages_offset = be64_to_cpu(header->pages_offset);
+
+    return true;
+}
+
+/*
+ * Read the pages of @block that have data in the file, either directly or
+ * by handing contiguous ranges to the multifd channels.
+ */
+static bool read_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
+                                     long num_pages, unsigned long *bitmap,
+                                     Error **errp)
+{
+    unsigned long set_bit_idx, clear_bit_idx;
+    ram_addr_t offset;
+    void *host;
+    size_t read, unread, size;
+
+    for (set_bit_idx = find_first_bit(bitmap, num_pages);
+         set_bit_idx < num_pages;
+         set_bit_idx = find_next_bit(bitmap, num_pages, clear_bit_idx + 1)) {
+
+        clear_bit_idx = find_next_zero_bit(bitmap, num_pages, set_bit_idx + 1);
+
+        unread = TARGET_PAGE_SIZE * (clear_bit_idx - set_bit_idx);
+        offset = set_bit_idx << TARGET_PAGE_BITS;
+
+        while (unread > 0) {
+            host = host_from_ram_block_offset(block, offset);
+            if (!host) {
+                error_setg(errp, "page outside of ramblock %s range",
+                           block->idstr);
+                return false;
+            }
+
+            size = MIN(unread, MAPPED_RAM_LOAD_BUF_SIZE);
+
+            if (migrate_multifd()) {
+                if (multifd_recv_queue_range(block, offset, size,
+                                             block->pages_offset + offset)) {
+                    error_setg(errp, "(%s) multifd channels failed",
+                               block->idstr);
+                    return false;
+                }
+                read = size;
+            } else {
+                read = qemu_get_buffer_at(f, host, size,
+                                          block->pages_offset + offset);
+                if (!read) {
+                    qemu_file_get_error_obj(f, errp);
+                    error_prepend(errp, "(%s) failed to read page "
+                                  RAM_ADDR_FMT " from file offset %"
+                                  PRIx64 ": ", block->idstr, offset,
+                                  block->pages_offset + offset);
+                    return false;
+                }
+            }
+            offset += read;
+            unread -= read;
+        }
+    }
+
+    if (migrate_multifd() && multifd_recv_flush_ranges()) {
+        error_setg(errp, "(%s) multifd channels failed", block->idstr);
+        return false;
+    }
+
+    return true;
+}
+
+static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
+                                      ram_addr_t length, Error **errp)
+{
+    g_autofree unsigned long *le_bitmap = NULL;
+    g_autofree unsigned long *bitmap = NULL;
+    MappedRamHeader header;
+    size_t bitmap_size;
+    long num_pages;
+
+    if (!mapped_ram_read_header(f, &header, errp)) {
+        return;
+    }
+
+    if (header.page_size != TARGET_PAGE_SIZE) {
+        error_setg(errp, "ramblock %s was saved with page size %" PRIu64
+                   ", expected %d", block->idstr, header.page_size,
+                   (int)TARGET_PAGE_SIZE);
+        return;
+    }
+
+    block->pages_offset = header.pages_offset;
+
+    /*
+     * Check the alignment of the file region that contains pages.  We
+     * don't enforce MAPPED_RAM_FILE_OFFSET_ALIGNMENT to allow that
+     * value to change in the future.  Do only a sanity check with page
+     * size alignment.
+     */
+    if (!QEMU_IS_ALIGNED(block->pages_offset, TARGET_PAGE_SIZE)) {
+        error_setg(errp,
+                   "Error reading ramblock %s pages, region has bad alignment",
+                   block->idstr);
+        return;
+    }
+
+    num_pages = length / header.page_size;
+    bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+
+    le_bitmap = bitmap_new(num_pages);
+    if (qemu_get_buffer_at(f, (uint8_t *)le_bitmap, bitmap_size,
+                           header.bitmap_offset) != bitmap_size) {
+        error_setg(errp, "Error reading dirty bitmap");
+        return;
+    }
+    bitmap = bitmap_new(num_pages);
+    bitmap_from_le(bitmap, le_bitmap, num_pages);
+
+    /*
+     * Ignored blocks are shared with the destination and have no pages
+     * in the file; they must not be discarded.
+     */
+    if (migrate_lazy_restore() && !migrate_ram_is_ignored(block)) {
+        if (!lazy_restore_add_block(block, g_steal_pointer(&bitmap), errp)) {
+            return;
+        }
+    } else if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
+        return;
+    }
+
+    /* Skip pages array */
+    qemu_set_offset(f, block->pages_offset + length, SEEK_SET);
+}
+
 static int parse_ramblock(QEMUFile *f, RAMBlock *block, ram_addr_t length)
 {
     int ret = 0;
@@ -3832,6 +4235,16 @@ static int parse_ramblock(QEMUFile *f, RAMBlock *block, ram_addr_t length)
             return -EINVAL;
         }
     }
+    if (migrate_mapped_ram()) {
+        Error *local_err = NULL;
+
+        parse_ramblock_mapped_ram(f, block, length, &local_err);
+        if (local_err) {
+            error_report_err(local_err);
+            return -EINVAL;
+        }
+        return 0;
+    }
     ret = rdma_block_notification_handle(f, block->idstr);
     if (ret < 0) {
         qemu_file_set_error(f, ret);
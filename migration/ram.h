@@ -45,6 +45,11 @@ extern XBZRLECacheStats xbzrle_counters;
         if (!qemu_ram_is_migratable(block)) {} else
 
 int xbzrle_cache_resize(uint64_t new_size, Error **errp);
+int xbzrle_encode_page(ram_addr_t current_addr, uint8_t *current_buf,
+                       uint8_t *encoded_buf, int encoded_len,
+                       XBZRLECacheStats *stats);
+void xbzrle_cache_zero_page_multifd(ram_addr_t current_addr);
+void xbzrle_counters_add(const XBZRLECacheStats *stats);
 uint64_t ram_bytes_remaining(void);
 uint64_t ram_bytes_total(void);
 void mig_throttle_counter_reset(void);
@@ -73,6 +78,8 @@ int64_t ramblock_recv_bitmap_send(QEMUFile *file,
                                   const char *block_name);
 bool ram_dirty_bitmap_reload(MigrationState *s, RAMBlock *rb, Error **errp);
 bool ramblock_page_is_discarded(RAMBlock *rb, ram_addr_t start);
+void ramblock_set_file_bmap_atomic(RAMBlock *block, ram_addr_t offset,
+                                  bool set);
 void postcopy_preempt_shutdown_file(MigrationState *s);
 void *postcopy_preempt_thread(void *opaque);
 
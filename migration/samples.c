@@ -0,0 +1,306 @@
+/*
+ * Time series of the progress of outgoing migrations
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "exec/target_page.h"
+#include "qapi/clone-visitor.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-migration.h"
+#include "qapi/qapi-visit-migration.h"
+#include "migration-stats.h"
+#include "multifd.h"
+#include "options.h"
+#include "ram.h"
+#include "samples.h"
+
+#define SAMPLES_BINARY_MAGIC "QEMUMSMP"
+#define SAMPLES_BINARY_VERSION 1
+
+static const char samples_csv_header[] =
+    "time,dirty-sync-count,transferred,throughput,dirty-pages-rate,"
+    "dirty-sync-time,zero-pages,compression-ratio,expected-downtime,"
+    "remaining,channels\n";
+
+static struct {
+    /*
+     * Serializes writes to the stream, so that the file I/O is done
+     * without @lock.  Taken before @lock.
+     */
+    QemuMutex stream_lock;
+    /* protects everything below; the stream is changed with both held */
+    QemuMutex lock;
+    /* ring of the last samples, starting with the oldest at @head */
+    MigrationSample *ring[MIGRATION_SAMPLES_MAX];
+    unsigned int head;
+    unsigned int count;
+    /* counters at the end of the previous iteration */
+    uint64_t zero_pages;
+    uint64_t pages;
+    uint64_t *channel_bytes;
+    /* sample stream, -1 when not streaming */
+    int fd;
+    char *filename;
+    MigrationSampleFormat format;
+} samples = {
+    .fd = -1,
+};
+
+static void __attribute__((constructor)) migration_samples_init(void)
+{
+    qemu_mutex_init(&samples.stream_lock);
+    qemu_mutex_init(&samples.lock);
+}
+
+void migration_samples_reset(void)
+{
+    QEMU_LOCK_GUARD(&samples.lock);
+
+    for (unsigned int i = 0; i < samples.count; i++) {
+        qapi_free_MigrationSample(
+            samples.ring[(samples.head + i) % MIGRATION_SAMPLES_MAX]);
+    }
+    samples.head = 0;
+    samples.count = 0;
+    samples.zero_pages = 0;
+    samples.pages = 0;
+    g_free(samples.channel_bytes);
+    samples.channel_bytes = NULL;
+}
+
+/* Called with samples.stream_lock and samples.lock held */
+static void samples_stream_close(void)
+{
+    if (samples.fd >= 0) {
+        qemu_close(samples.fd);
+    }
+    samples.fd = -1;
+    g_free(samples.filename);
+    samples.filename = NULL;
+}
+
+static void samples_append_le64(GString *buf, uint64_t value)
+{
+    value = cpu_to_le64(value);
+    g_string_append_len(buf, (const char *)&value, sizeof(value));
+}
+
+static void samples_append_le32(GString *buf, uint32_t value)
+{
+    value = cpu_to_le32(value);
+    g_string_append_len(buf, (const char *)&value, sizeof(value));
+}
+
+static void samples_format_csv(GString *buf, const MigrationSample *sample)
+{
+    uint64List *ch;
+
+    g_string_append_printf(buf,
+                           "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+                           ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.3f"
+                           ",%" PRIu64 ",%" PRIu64 ",",
+                           sample->time, sample->dirty_sync_count,
+                           sample->transferred, sample->throughput,
+                           sample->dirty_pages_rate, sample->dirty_sync_time,
+                           sample->zero_pages, sample->compression_ratio,
+                           sample->expected_downtime, sample->remaining);
+    for (ch = sample->channels; ch; ch = ch->next) {
+        g_string_append_printf(buf, "%s%" PRIu64,
+                               ch == sample->channels ? "" : " ", ch->value);
+    }
+    g_string_append_c(buf, '\n');
+}
+
+static void samples_format_binary(GString *buf, const MigrationSample *sample)
+{
+    uint32_t channels = 0;
+    uint64_t ratio;
+    uint64List *ch;
+
+    for (ch = sample->channels; ch; ch = ch->next) {
+        channels++;
+    }
+    memcpy(&ratio, &sample->compression_ratio, sizeof(ratio));
+
+    samples_append_le32(buf, 2 * sizeof(uint32_t) +
+                        (10 + channels) * sizeof(uint64_t));
+    samples_append_le32(buf, channels);
+    samples_append_le64(buf, sample->time);
+    samples_append_le64(buf, sample->dirty_sync_count);
+    samples_append_le64(buf, sample->transferred);
+    samples_append_le64(buf, sample->throughput);
+    samples_append_le64(buf, sample->dirty_pages_rate);
+    samples_append_le64(buf, sample->dirty_sync_time);
+    samples_append_le64(buf, sample->zero_pages);
+    samples_append_le64(buf, sample->expected_downtime);
+    samples_append_le64(buf, sample->remaining);
+    samples_append_le64(buf, ratio);
+    for (ch = sample->channels; ch; ch = ch->next) {
+        samples_append_le64(buf, ch->value);
+    }
+}
+
+/* Called with samples.lock held */
+static GString *samples_stream_format(const MigrationSample *sample,
+                                      MigrationSampleFormat *format)
+{
+    GString *buf = g_string_new(NULL);
+
+    *format = samples.format;
+    if (samples.format == MIGRATION_SAMPLE_FORMAT_BINARY) {
+        samples_format_binary(buf, sample);
+    } else {
+        samples_format_csv(buf, sample);
+    }
+    return buf;
+}
+
+static void samples_stream_write(GString *buf, MigrationSampleFormat format)
+{
+    QEMU_LOCK_GUARD(&samples.stream_lock);
+
+    /* The stream may have been closed or replaced since @buf was made */
+    if (samples.fd < 0 || samples.format != format) {
+        return;
+    }
+
+    if (qemu_write_full(samples.fd, buf->str, buf->len) != buf->len) {
+        /* Losing the stream must not fail the migration */
+        warn_report("migration: stopped writing samples to %s: %s",
+                    samples.filename, strerror(errno));
+        QEMU_LOCK_GUARD(&samples.lock);
+        samples_stream_close();
+    }
+}
+
+void migration_samples_record(MigrationState *s, int64_t current_time,
+                              uint64_t transferred, uint64_t time_spent)
+{
+    MigrationSample *sample = g_new0(MigrationSample, 1);
+    uint64_t zero_pages = stat64_get(&mig_stats.zero_pages);
+    uint64_t pages = ram_get_total_transferred_pages();
+    MultiFDChannelStatsList *channels = NULL;
+    MultiFDChannelStatsList *ch;
+    g_autoptr(GString) buf = NULL;
+    MigrationSampleFormat format = MIGRATION_SAMPLE_FORMAT_CSV;
+
+    if (migrate_multifd()) {
+        channels = multifd_send_stats();
+    }
+
+    sample->time = current_time - s->start_time;
+    sample->dirty_sync_count = stat64_get(&mig_stats.dirty_sync_count);
+    sample->transferred = transferred;
+    sample->throughput = time_spent ? transferred * 1000 / time_spent : 0;
+    sample->dirty_pages_rate = stat64_get(&mig_stats.dirty_pages_rate);
+    sample->dirty_sync_time = stat64_get(&mig_stats.dirty_sync_time);
+    sample->expected_downtime = s->expected_downtime;
+    sample->remaining = ram_bytes_remaining();
+
+    WITH_QEMU_LOCK_GUARD(&samples.lock) {
+        sample->zero_pages = zero_pages - samples.zero_pages;
+        if (transferred) {
+            sample->compression_ratio =
+                (double)(pages - samples.pages - sample->zero_pages) *
+                qemu_target_page_size() / transferred;
+        }
+        samples.zero_pages = zero_pages;
+        samples.pages = pages;
+
+        if (channels) {
+            uint64List **tail = &sample->channels;
+            int i = 0;
+
+            if (!samples.channel_bytes) {
+                samples.channel_bytes = g_new0(uint64_t,
+                                               migrate_multifd_channels());
+            }
+            for (ch = channels; ch; ch = ch->next, i++) {
+                QAPI_LIST_APPEND(tail,
+                                 ch->value->bytes - samples.channel_bytes[i]);
+                samples.channel_bytes[i] = ch->value->bytes;
+            }
+            qapi_free_MultiFDChannelStatsList(channels);
+        }
+
+        if (samples.count == MIGRATION_SAMPLES_MAX) {
+            qapi_free_MigrationSample(samples.ring[samples.head]);
+            samples.ring[samples.head] = sample;
+            samples.head = (samples.head + 1) % MIGRATION_SAMPLES_MAX;
+        } else {
+            samples.ring[(samples.head + samples.count) %
+                         MIGRATION_SAMPLES_MAX] = sample;
+            samples.count++;
+        }
+
+        if (samples.fd >= 0) {
+            buf = samples_stream_format(sample, &format);
+        }
+    }
+
+    if (buf) {
+        samples_stream_write(buf, format);
+    }
+}
+
+MigrationSampleList *qmp_query_migrate_samples(Error **errp)
+{
+    MigrationSampleList *head = NULL;
+    MigrationSampleList **tail = &head;
+
+    QEMU_LOCK_GUARD(&samples.lock);
+    for (unsigned int i = 0; i < samples.count; i++) {
+        MigrationSample *sample =
+            samples.ring[(samples.head + i) % MIGRATION_SAMPLES_MAX];
+
+        QAPI_LIST_APPEND(tail, QAPI_CLONE(MigrationSample, sample));
+    }
+
+    return head;
+}
+
+void qmp_migrate_sample_stream(const char *filename, bool has_format,
+                               MigrationSampleFormat format, Error **errp)
+{
+    g_autoptr(GString) header = g_string_new(NULL);
+    int fd = -1;
+
+    if (!has_format) {
+        format = MIGRATION_SAMPLE_FORMAT_CSV;
+    }
+
+    if (filename) {
+        fd = qemu_create(filename, O_WRONLY | O_TRUNC, 0644, errp);
+        if (fd < 0) {
+            return;
+        }
+
+        if (format == MIGRATION_SAMPLE_FORMAT_BINARY) {
+            g_string_append(header, SAMPLES_BINARY_MAGIC);
+            samples_append_le32(header, SAMPLES_BINARY_VERSION);
+        } else {
+            g_string_append(header, samples_csv_header);
+        }
+        if (qemu_write_full(fd, header->str, header->len) != header->len) {
+            error_setg_errno(errp, errno, "Failed to write to '%s'",
+                             filename);
+            qemu_close(fd);
+            return;
+        }
+    }
+
+    QEMU_LOCK_GUARD(&samples.stream_lock);
+    QEMU_LOCK_GUARD(&samples.lock);
+    samples_stream_close();
+    if (filename) {
+        samples.fd = fd;
+        samples.filename = g_strdup(filename);
+        samples.format = format;
+    }
+}
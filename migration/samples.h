@@ -0,0 +1,37 @@
+/*
+ * Time series of the progress of outgoing migrations
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_SAMPLES_H
+#define QEMU_MIGRATION_SAMPLES_H
+
+#include "migration.h"
+
+/* Number of samples kept for query-migrate-samples */
+#define MIGRATION_SAMPLES_MAX 3000
+
+/**
+ * migration_samples_reset: forget the samples of the previous migration
+ */
+void migration_samples_reset(void);
+
+/**
+ * migration_samples_record: record the progress over the last iteration
+ *
+ * Called from the migration thread at the end of each iteration, and
+ * once more when the migration completes.  The sample is kept for
+ * query-migrate-samples, and written to the sample stream if there is
+ * one.
+ *
+ * @s: current migration state
+ * @current_time: end of the iteration, in milliseconds of realtime clock
+ * @transferred: bytes sent during the iteration
+ * @time_spent: length of the iteration in milliseconds
+ */
+void migration_samples_record(MigrationState *s, int64_t current_time,
+                              uint64_t transferred, uint64_t time_spent);
+
+#endif
@@ -38,6 +38,7 @@
 #include "migration/global_state.h"
 #include "migration/channel-block.h"
 #include "ram.h"
+#include "multifd.h"
 #include "qemu-file.h"
 #include "savevm.h"
 #include "postcopy-ram.h"
@@ -95,6 +96,8 @@ enum qemu_vm_cmd {
 };
 
 #define MAX_VM_CMD_PACKAGED_SIZE UINT32_MAX
+/* Largest device state sent in a QEMU_VM_SECTION_FULL_SIZED section */
+#define MAX_VM_SECTION_SIZED_SIZE (1ul << 28)
 static struct mig_cmd_args {
     ssize_t     len; /* -1 = variable */
     const char *name;
@@ -217,6 +220,10 @@ typedef struct SaveStateEntry {
     void *opaque;
     CompatEntry *compat;
     int is_ram;
+    /* time spent saving the state while the VM was stopped, in us */
+    int64_t save_time_us;
+    /* time spent loading the state while the VM was stopped, in us */
+    int64_t load_time_us;
 } SaveStateEntry;
 
 typedef struct SaveState {
@@ -245,6 +252,7 @@ static bool should_validate_capability(int capability)
     /* Validate only new capabilities to keep compatibility. */
     switch (capability) {
     case MIGRATION_CAPABILITY_X_IGNORE_SHARED:
+    case MIGRATION_CAPABILITY_POSTCOPY_THP:
         return true;
     default:
         return false;
@@ -985,6 +993,7 @@ static void save_section_header(QEMUFile *f, SaveStateEntry *se,
     qemu_put_be32(f, se->section_id);
 
     if (section_type == QEMU_VM_SECTION_FULL ||
+        section_type == QEMU_VM_SECTION_FULL_SIZED ||
         section_type == QEMU_VM_SECTION_START) {
         /* ID string */
         size_t len = strlen(se->idstr);
@@ -1008,7 +1017,58 @@ static void save_section_footer(QEMUFile *f, SaveStateEntry *se)
     }
 }
 
-static int vmstate_save(QEMUFile *f, SaveStateEntry *se, JSONWriter *vmdesc)
+static int vmstate_save_data(QEMUFile *f, SaveStateEntry *se,
+                             JSONWriter *vmdesc, Error **errp)
+{
+    trace_vmstate_save(se->idstr, se->vmsd ? se->vmsd->name : "(old)");
+    if (!se->vmsd) {
+        vmstate_save_old_style(f, se, vmdesc);
+        return 0;
+    }
+    return vmstate_save_state_with_err(f, se->vmsd, se->opaque, vmdesc, errp);
+}
+
+/*
+ * Save the state of @se into a buffer, then write it to @f preceded by
+ * its size, so that the destination can read the whole section without
+ * parsing it and load it on another thread.
+ */
+static int vmstate_save_sized(QEMUFile *f, SaveStateEntry *se,
+                              JSONWriter *vmdesc, Error **errp)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *fb;
+    int ret;
+
+    bioc = qio_channel_buffer_new(4096);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "migration-section-buffer");
+    fb = qemu_file_new_output(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    ret = vmstate_save_data(fb, se, vmdesc, errp);
+    if (!ret) {
+        qemu_fflush(fb);
+        ret = qemu_file_get_error(fb);
+        if (ret) {
+            error_setg_errno(errp, -ret, "Failed to buffer state of '%s'",
+                             se->idstr);
+        }
+    }
+    if (!ret && bioc->usage > MAX_VM_SECTION_SIZED_SIZE) {
+        error_setg(errp, "State of '%s' is too large: %zu bytes",
+                   se->idstr, bioc->usage);
+        ret = -EFBIG;
+    }
+    if (!ret) {
+        qemu_put_be32(f, bioc->usage);
+        qemu_put_buffer(f, bioc->data, bioc->usage);
+    }
+    qemu_fclose(fb);
+    return ret;
+}
+
+static int vmstate_save(QEMUFile *f, SaveStateEntry *se, JSONWriter *vmdesc,
+                        bool sized)
 {
     int ret;
     Error *local_err = NULL;
@@ -1023,23 +1083,23 @@ static int vmstate_save(QEMUFile *f, SaveStateEntry *se, JSONWriter *vmdesc)
     }
 
     trace_savevm_section_start(se->idstr, se->section_id);
-    save_section_header(f, se, QEMU_VM_SECTION_FULL);
+    save_section_header(f, se, sized ? QEMU_VM_SECTION_FULL_SIZED :
+                                       QEMU_VM_SECTION_FULL);
     if (vmdesc) {
         json_writer_start_object(vmdesc, NULL);
         json_writer_str(vmdesc, "name", se->idstr);
         json_writer_int64(vmdesc, "instance_id", se->instance_id);
     }
 
-    trace_vmstate_save(se->idstr, se->vmsd ? se->vmsd->name : "(old)");
-    if (!se->vmsd) {
-        vmstate_save_old_style(f, se, vmdesc);
+    if (sized) {
+        ret = vmstate_save_sized(f, se, vmdesc, &local_err);
     } else {
-        ret = vmstate_save_state_with_err(f, se->vmsd, se->opaque, vmdesc, &local_err);
-        if (ret) {
-            migrate_set_error(s, local_err);
-            error_report_err(local_err);
-            return ret;
-        }
+        ret = vmstate_save_data(f, se, vmdesc, &local_err);
+    }
+    if (ret) {
+        migrate_set_error(s, local_err);
+        error_report_err(local_err);
+        return ret;
     }
 
     trace_savevm_section_end(se->idstr, se->section_id, 0);
@@ -1323,8 +1383,10 @@ void qemu_savevm_state_setup(QEMUFile *f)
 
     trace_savevm_state_setup();
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        se->save_time_us = 0;
+
         if (se->vmsd && se->vmsd->early_setup) {
-            ret = vmstate_save(f, se, ms->vmdesc);
+            ret = vmstate_save(f, se, ms->vmdesc, false);
             if (ret) {
                 qemu_file_set_error(f, ret);
                 break;
@@ -1522,6 +1584,7 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
             return -1;
         }
         end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        se->save_time_us += end_ts_each - start_ts_each;
         trace_vmstate_downtime_save("iterable", se->idstr, se->instance_id,
                                     end_ts_each - start_ts_each);
     }
@@ -1550,13 +1613,14 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
 
         start_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
 
-        ret = vmstate_save(f, se, vmdesc);
+        ret = vmstate_save(f, se, vmdesc, migrate_parallel_device_load());
         if (ret) {
             qemu_file_set_error(f, ret);
             return ret;
         }
 
         end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        se->save_time_us += end_ts_each - start_ts_each;
         trace_vmstate_downtime_save("non-iterable", se->idstr, se->instance_id,
                                     end_ts_each - start_ts_each);
     }
@@ -1698,7 +1762,7 @@ void qemu_savevm_state_cleanup(void)
     }
 }
 
-static int qemu_savevm_state(QEMUFile *f, Error **errp)
+static int qemu_savevm_state(QEMUFile *f, BlockDriverState *bs, Error **errp)
 {
     int ret;
     MigrationState *ms = migrate_get_current();
@@ -1714,12 +1778,30 @@ static int qemu_savevm_state(QEMUFile *f, Error **errp)
         return -EINVAL;
     }
 
+    if (migrate_multifd() && !migrate_mapped_ram()) {
+        error_setg(errp, "Snapshots with multifd require mapped-ram");
+        return -EINVAL;
+    }
+
     ret = migrate_init(ms, errp);
     if (ret) {
         return ret;
     }
     ms->to_dst_file = f;
 
+    /*
+     * The multifd channels write the guest pages straight to their
+     * offsets in the VMState area, alongside the main stream.  Their
+     * block I/O still runs in the AioContext of @bs.
+     */
+    if (migrate_multifd()) {
+        multifd_set_vmstate_bs(bs);
+        ret = multifd_save_setup(errp);
+        if (ret) {
+            goto out;
+        }
+    }
+
     qemu_savevm_state_header(f);
     qemu_savevm_state_setup(f);
 
@@ -1739,6 +1821,10 @@ static int qemu_savevm_state(QEMUFile *f, Error **errp)
         error_setg_errno(errp, -ret, "Error while writing VM state");
     }
 
+out:
+    multifd_save_cleanup();
+    multifd_set_vmstate_bs(NULL);
+
     if (ret != 0) {
         status = MIGRATION_STATUS_FAILED;
     } else {
@@ -1776,7 +1862,7 @@ int qemu_save_device_state(QEMUFile *f)
         if (se->is_ram) {
             continue;
         }
-        ret = vmstate_save(f, se, NULL);
+        ret = vmstate_save(f, se, NULL, false);
         if (ret) {
             return ret;
         }
@@ -2553,13 +2639,13 @@ static bool check_section_footer(QEMUFile *f, SaveStateEntry *se)
     return true;
 }
 
-static int
-qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis,
-                               uint8_t type)
+/*
+ * Read the header of a QEMU_VM_SECTION_START/FULL/FULL_SIZED section and
+ * find the entry it belongs to.
+ */
+static int qemu_loadvm_section_header(QEMUFile *f, SaveStateEntry **sep)
 {
-    bool trace_downtime = (type == QEMU_VM_SECTION_FULL);
     uint32_t instance_id, version_id, section_id;
-    int64_t start_ts, end_ts;
     SaveStateEntry *se;
     char idstr[256];
     int ret;
@@ -2608,6 +2694,24 @@ qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis,
         return -EINVAL;
     }
 
+    *sep = se;
+    return 0;
+}
+
+static int
+qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis,
+                               uint8_t type)
+{
+    bool trace_downtime = (type == QEMU_VM_SECTION_FULL);
+    int64_t start_ts, end_ts;
+    SaveStateEntry *se;
+    int ret;
+
+    ret = qemu_loadvm_section_header(f, &se);
+    if (ret) {
+        return ret;
+    }
+
     if (trace_downtime) {
         start_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     }
@@ -2615,12 +2719,13 @@ qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis,
     ret = vmstate_load(f, se);
     if (ret < 0) {
         error_report("error while loading state for instance 0x%"PRIx32" of"
-                     " device '%s'", instance_id, idstr);
+                     " device '%s'", se->instance_id, se->idstr);
         return ret;
     }
 
     if (trace_downtime) {
         end_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        se->load_time_us += end_ts - start_ts;
         trace_vmstate_downtime_load("non-iterable", se->idstr,
                                     se->instance_id, end_ts - start_ts);
     }
@@ -2675,6 +2780,7 @@ qemu_loadvm_section_part_end(QEMUFile *f, MigrationIncomingState *mis,
 
     if (trace_downtime) {
         end_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        se->load_time_us += end_ts - start_ts;
         trace_vmstate_downtime_load("iterable", se->idstr,
                                     se->instance_id, end_ts - start_ts);
     }
@@ -2686,6 +2792,295 @@ qemu_loadvm_section_part_end(QEMUFile *f, MigrationIncomingState *mis,
     return 0;
 }
 
+/*
+ * With the parallel-device-load capability, QEMU_VM_SECTION_FULL_SIZED
+ * sections of devices that set VMStateDescription.parallel_load are
+ * loaded by a pool of worker threads.  Any other section waits for all
+ * the queued ones to be loaded first, so it still sees the state of the
+ * devices before it in the stream.
+ */
+#define PARALLEL_LOAD_THREADS 4
+
+typedef struct ParallelLoadSection {
+    SaveStateEntry *se;
+    /* Buffer holding the section payload */
+    QEMUFile *f;
+    bool done;
+    QSIMPLEQ_ENTRY(ParallelLoadSection) next;
+} ParallelLoadSection;
+
+typedef struct ParallelLoad {
+    QemuThread threads[PARALLEL_LOAD_THREADS];
+    QemuMutex lock;
+    /* Signalled when a section is queued or loaded, and on quit */
+    QemuCond cond;
+    /* Sections waiting for a worker */
+    QSIMPLEQ_HEAD(, ParallelLoadSection) queue;
+    /* Sections queued since the last barrier, in stream order */
+    GPtrArray *sections;
+    /* Number of sections not loaded yet */
+    unsigned int pending;
+    /* First error returned by a worker */
+    int ret;
+    bool quit;
+} ParallelLoad;
+
+static void parallel_load_section_free(gpointer opaque)
+{
+    ParallelLoadSection *s = opaque;
+
+    qemu_fclose(s->f);
+    g_free(s);
+}
+
+/* Return true if @s must wait for @t, an earlier section, to be loaded */
+static bool parallel_load_depends(ParallelLoadSection *s,
+                                  ParallelLoadSection *t)
+{
+    const char * const *dep;
+
+    if (save_state_priority(t->se) > save_state_priority(s->se)) {
+        return true;
+    }
+    for (dep = s->se->vmsd->depends_on; dep && *dep; dep++) {
+        if (!strcmp(*dep, t->se->vmsd->name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Called with pl->lock held */
+static bool parallel_load_ready(ParallelLoad *pl, ParallelLoadSection *s)
+{
+    guint i;
+
+    for (i = 0; i < pl->sections->len; i++) {
+        ParallelLoadSection *t = g_ptr_array_index(pl->sections, i);
+
+        if (t == s) {
+            break;
+        }
+        if (!t->done && parallel_load_depends(s, t)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *parallel_load_thread(void *opaque)
+{
+    ParallelLoad *pl = opaque;
+    ParallelLoadSection *s;
+    int64_t start_ts, end_ts;
+    int ret;
+
+    rcu_register_thread();
+
+    qemu_mutex_lock(&pl->lock);
+    while (!pl->quit) {
+        s = QSIMPLEQ_FIRST(&pl->queue);
+        if (!s) {
+            qemu_cond_wait(&pl->cond, &pl->lock);
+            continue;
+        }
+        QSIMPLEQ_REMOVE_HEAD(&pl->queue, next);
+
+        /*
+         * Sections are taken in stream order and only wait for earlier
+         * ones, so the oldest section being waited for is always loading.
+         */
+        while (!parallel_load_ready(pl, s)) {
+            qemu_cond_wait(&pl->cond, &pl->lock);
+        }
+        qemu_mutex_unlock(&pl->lock);
+
+        start_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        ret = vmstate_load(s->f, s->se);
+        end_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        s->se->load_time_us += end_ts - start_ts;
+        trace_vmstate_downtime_load("parallel", s->se->idstr,
+                                    s->se->instance_id, end_ts - start_ts);
+        if (ret < 0) {
+            error_report("error while loading state for instance 0x%"PRIx32
+                         " of device '%s'", s->se->instance_id, s->se->idstr);
+        }
+
+        qemu_mutex_lock(&pl->lock);
+        if (ret < 0 && !pl->ret) {
+            pl->ret = ret;
+        }
+        s->done = true;
+        pl->pending--;
+        qemu_cond_broadcast(&pl->cond);
+    }
+    qemu_mutex_unlock(&pl->lock);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static ParallelLoad *parallel_load_get(ParallelLoad **plp)
+{
+    ParallelLoad *pl = *plp;
+    int i;
+
+    if (pl) {
+        return pl;
+    }
+
+    pl = g_new0(ParallelLoad, 1);
+    qemu_mutex_init(&pl->lock);
+    qemu_cond_init(&pl->cond);
+    QSIMPLEQ_INIT(&pl->queue);
+    pl->sections = g_ptr_array_new_with_free_func(parallel_load_section_free);
+    for (i = 0; i < PARALLEL_LOAD_THREADS; i++) {
+        qemu_thread_create(&pl->threads[i], "mig/dst/devload",
+                           parallel_load_thread, pl, QEMU_THREAD_JOINABLE);
+    }
+
+    *plp = pl;
+    return pl;
+}
+
+static void parallel_load_queue(ParallelLoad *pl, SaveStateEntry *se,
+                                QEMUFile *f)
+{
+    ParallelLoadSection *s = g_new0(ParallelLoadSection, 1);
+
+    s->se = se;
+    s->f = f;
+
+    qemu_mutex_lock(&pl->lock);
+    g_ptr_array_add(pl->sections, s);
+    QSIMPLEQ_INSERT_TAIL(&pl->queue, s, next);
+    pl->pending++;
+    qemu_cond_broadcast(&pl->cond);
+    qemu_mutex_unlock(&pl->lock);
+}
+
+/* Wait until all queued sections are loaded; returns the first error */
+static int parallel_load_drain(ParallelLoad *pl)
+{
+    int ret;
+
+    if (!pl) {
+        return 0;
+    }
+
+    qemu_mutex_lock(&pl->lock);
+    while (pl->pending) {
+        qemu_cond_wait(&pl->cond, &pl->lock);
+    }
+    g_ptr_array_set_size(pl->sections, 0);
+    ret = pl->ret;
+    pl->ret = 0;
+    qemu_mutex_unlock(&pl->lock);
+
+    return ret;
+}
+
+static int parallel_load_finish(ParallelLoad *pl)
+{
+    int ret;
+    int i;
+
+    if (!pl) {
+        return 0;
+    }
+
+    ret = parallel_load_drain(pl);
+
+    qemu_mutex_lock(&pl->lock);
+    pl->quit = true;
+    qemu_cond_broadcast(&pl->cond);
+    qemu_mutex_unlock(&pl->lock);
+
+    for (i = 0; i < PARALLEL_LOAD_THREADS; i++) {
+        qemu_thread_join(&pl->threads[i]);
+    }
+    g_ptr_array_free(pl->sections, true);
+    qemu_cond_destroy(&pl->cond);
+    qemu_mutex_destroy(&pl->lock);
+    g_free(pl);
+
+    return ret;
+}
+
+/*
+ * A QEMU_VM_SECTION_FULL_SIZED section is a QEMU_VM_SECTION_FULL one
+ * whose payload is preceded by its size.  Read it whole, then load it on
+ * a worker thread if the device allows it, or right away otherwise.
+ */
+static int
+qemu_loadvm_section_full_sized(QEMUFile *f, MigrationIncomingState *mis,
+                               ParallelLoad **plp)
+{
+    int64_t start_ts, end_ts;
+    QIOChannelBuffer *bioc;
+    SaveStateEntry *se;
+    QEMUFile *fb;
+    size_t length;
+    int ret;
+
+    ret = qemu_loadvm_section_header(f, &se);
+    if (ret) {
+        return ret;
+    }
+
+    length = qemu_get_be32(f);
+    if (length > MAX_VM_SECTION_SIZED_SIZE) {
+        error_report("Unreasonably large state for device '%s': %zu",
+                     se->idstr, length);
+        return -EINVAL;
+    }
+
+    bioc = qio_channel_buffer_new(length);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "migration-section-buffer");
+    if (qemu_get_buffer(f, bioc->data, length) != length) {
+        object_unref(OBJECT(bioc));
+        ret = qemu_file_get_error(f);
+        error_report("Failed to read %zu bytes of state for device '%s'",
+                     length, se->idstr);
+        return ret ? ret : -EIO;
+    }
+    bioc->usage = length;
+    fb = qemu_file_new_input(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    if (!check_section_footer(f, se)) {
+        qemu_fclose(fb);
+        return -EINVAL;
+    }
+
+    if (migrate_parallel_device_load() && se->vmsd &&
+        se->vmsd->parallel_load) {
+        parallel_load_queue(parallel_load_get(plp), se, fb);
+        return 0;
+    }
+
+    ret = parallel_load_drain(*plp);
+    if (ret < 0) {
+        qemu_fclose(fb);
+        return ret;
+    }
+
+    start_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    ret = vmstate_load(fb, se);
+    qemu_fclose(fb);
+    if (ret < 0) {
+        error_report("error while loading state for instance 0x%"PRIx32" of"
+                     " device '%s'", se->instance_id, se->idstr);
+        return ret;
+    }
+    end_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    se->load_time_us += end_ts - start_ts;
+    trace_vmstate_downtime_load("non-iterable", se->idstr,
+                                se->instance_id, end_ts - start_ts);
+
+    return 0;
+}
+
 static int qemu_loadvm_state_header(QEMUFile *f)
 {
     unsigned int v;
@@ -2747,6 +3142,8 @@ static int qemu_loadvm_state_setup(QEMUFile *f)
 
     trace_loadvm_state_setup();
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        se->load_time_us = 0;
+
         if (!se->ops || !se->ops->load_setup) {
             continue;
         }
@@ -2851,6 +3248,7 @@ static bool postcopy_pause_incoming(MigrationIncomingState *mis)
 
 int qemu_loadvm_state_main(QEMUFile *f, MigrationIncomingState *mis)
 {
+    ParallelLoad *pl = NULL;
     uint8_t section_type;
     int ret = 0;
 
@@ -2864,6 +3262,12 @@ retry:
         }
 
         trace_qemu_loadvm_state_section(section_type);
+        if (section_type != QEMU_VM_SECTION_FULL_SIZED) {
+            ret = parallel_load_drain(pl);
+            if (ret < 0) {
+                goto out;
+            }
+        }
         switch (section_type) {
         case QEMU_VM_SECTION_START:
         case QEMU_VM_SECTION_FULL:
@@ -2879,6 +3283,12 @@ retry:
                 goto out;
             }
             break;
+        case QEMU_VM_SECTION_FULL_SIZED:
+            ret = qemu_loadvm_section_full_sized(f, mis, &pl);
+            if (ret < 0) {
+                goto out;
+            }
+            break;
         case QEMU_VM_COMMAND:
             ret = loadvm_process_command(f);
             trace_qemu_loadvm_state_section_command(ret);
@@ -2897,6 +3307,15 @@ retry:
     }
 
 out:
+    if (pl) {
+        int pl_ret = parallel_load_finish(pl);
+
+        pl = NULL;
+        if (ret >= 0 && pl_ret < 0) {
+            ret = pl_ret;
+        }
+    }
+
     if (ret < 0) {
         qemu_file_set_error(f, ret);
 
@@ -3128,8 +3547,10 @@ bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
         error_setg(errp, "Could not open VM state file");
         goto the_end;
     }
-    ret = qemu_savevm_state(f, errp);
-    vm_state_size = qemu_file_transferred(f);
+    ret = qemu_savevm_state(f, bs, errp);
+    /* With mapped-ram, the pages are stored below the end of the stream */
+    vm_state_size = migrate_mapped_ram() ? qemu_get_offset(f) :
+                                           qemu_file_transferred(f);
     ret2 = qemu_fclose(f);
     if (ret < 0) {
         goto the_end;
@@ -3169,6 +3590,29 @@ bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
     return ret == 0;
 }
 
+VMStateTimingList *qmp_query_vmstate_timing(Error **errp)
+{
+    VMStateTimingList *head = NULL;
+    VMStateTimingList **tail = &head;
+    SaveStateEntry *se;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        VMStateTiming *timing;
+
+        if (!se->save_time_us && !se->load_time_us) {
+            continue;
+        }
+        timing = g_new0(VMStateTiming, 1);
+        timing->id = g_strdup(se->idstr);
+        timing->instance_id = se->instance_id;
+        timing->save_time = se->save_time_us;
+        timing->load_time = se->load_time_us;
+        QAPI_LIST_APPEND(tail, timing);
+    }
+
+    return head;
+}
+
 void qmp_xen_save_devices_state(const char *filename, bool has_live, bool live,
                                 Error **errp)
 {
@@ -3251,6 +3695,40 @@ void qmp_xen_load_devices_state(const char *filename, Error **errp)
     migration_incoming_state_destroy();
 }
 
+/*
+ * With multifd, the guest pages are read back from their mapped-ram
+ * offsets in the VMState area by the multifd channels.
+ */
+static bool loadvm_multifd_setup(BlockDriverState *bs, Error **errp)
+{
+    int i;
+
+    if (!migrate_multifd()) {
+        return true;
+    }
+
+    multifd_set_vmstate_bs(bs);
+    if (multifd_load_setup(errp) != 0) {
+        return false;
+    }
+    for (i = 0; i < migrate_multifd_channels(); i++) {
+        QIOChannelBlock *bioc = qio_channel_block_new_iothread(bs, errp);
+        Error *local_err = NULL;
+
+        if (!bioc) {
+            return false;
+        }
+        multifd_recv_new_channel(QIO_CHANNEL(bioc), &local_err);
+        object_unref(OBJECT(bioc));
+        if (local_err) {
+            error_propagate(errp, local_err);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool load_snapshot(const char *name, const char *vmstate,
                    bool has_devices, strList *devices, Error **errp)
 {
@@ -3261,6 +3739,15 @@ bool load_snapshot(const char *name, const char *vmstate,
     AioContext *aio_context;
     MigrationIncomingState *mis = migration_incoming_get_current();
 
+    if (migrate_multifd() && !migrate_mapped_ram()) {
+        error_setg(errp, "Snapshots with multifd require mapped-ram");
+        return false;
+    }
+    if (migrate_lazy_restore()) {
+        error_setg(errp, "Snapshots cannot be restored lazily");
+        return false;
+    }
+
     if (!bdrv_all_can_snapshot(has_devices, devices, errp)) {
         return false;
     }
@@ -3321,8 +3808,15 @@ bool load_snapshot(const char *name, const char *vmstate,
         goto err_drain;
     }
     aio_context_acquire(aio_context);
+    if (!loadvm_multifd_setup(bs_vm_state, errp)) {
+        migration_incoming_state_destroy();
+        multifd_set_vmstate_bs(NULL);
+        aio_context_release(aio_context);
+        goto err_drain;
+    }
     ret = qemu_loadvm_state(f);
     migration_incoming_state_destroy();
+    multifd_set_vmstate_bs(NULL);
     aio_context_release(aio_context);
 
     bdrv_drain_all_end();
@@ -42,6 +42,20 @@
  */
 #define NBD_MAX_BLOCK_STATUS_EXTENTS (1 * MiB / 8)
 
+/*
+ * Read payloads of at least this size are sent with MSG_ZEROCOPY when the
+ * export enables it; for smaller ones the page pinning and completion
+ * notification cost more than the copy they save.
+ */
+#define NBD_ZERO_COPY_MIN_SIZE (64 * KiB)
+
+/*
+ * Upper bound for read buffers that are waiting for their zero copy
+ * completion. Once reached, replies are copied until the kernel catches up,
+ * which also keeps the amount of pinned memory bounded.
+ */
+#define NBD_ZERO_COPY_MAX_PENDING (64 * MiB)
+
 static int system_errno_to_nbd_errno(int err)
 {
     switch (err) {
@@ -99,6 +113,7 @@ struct NBDExport {
     Notifier eject_notifier;
 
     bool allocation_depth;
+    bool zero_copy;
     BdrvDirtyBitmap **export_bitmaps;
     size_t nr_export_bitmaps;
 };
@@ -121,6 +136,17 @@ struct NBDMetaContexts {
                     */
 };
 
+/*
+ * A read buffer that may still be referenced by a MSG_ZEROCOPY send and
+ * can only be freed once sioc->zero_copy_sent reaches @seq.
+ */
+typedef struct NBDZeroCopyBuf {
+    void *data;
+    size_t size;
+    ssize_t seq;
+    QSIMPLEQ_ENTRY(NBDZeroCopyBuf) next;
+} NBDZeroCopyBuf;
+
 struct NBDClient {
     int refcount;
     void (*close_fn)(NBDClient *client, bool negotiated);
@@ -151,6 +177,10 @@ struct NBDClient {
     uint32_t opt; /* Current option being negotiated */
     uint32_t optlen; /* remaining length of data in ioc for the option being
                         negotiated now */
+
+    bool zero_copy; /* Send large read payloads with MSG_ZEROCOPY */
+    QSIMPLEQ_HEAD(, NBDZeroCopyBuf) zero_copy_bufs;
+    size_t zero_copy_pending; /* Total size of zero_copy_bufs */
 };
 
 static void nbd_client_receive_next_request(NBDClient *client);
@@ -1506,6 +1536,78 @@ void nbd_client_get(NBDClient *client)
     client->refcount++;
 }
 
+/*
+ * Free the read buffers whose zero copy sends have completed. Returns
+ * -EIO if the socket reported an error for a zero copy send.
+ */
+static int nbd_zero_copy_reap(NBDClient *client, Error **errp)
+{
+    NBDZeroCopyBuf *buf;
+
+    if (QSIMPLEQ_EMPTY(&client->zero_copy_bufs)) {
+        return 0;
+    }
+
+    if (qio_channel_socket_reap_zero_copy(client->sioc, errp) < 0) {
+        return -EIO;
+    }
+
+    while ((buf = QSIMPLEQ_FIRST(&client->zero_copy_bufs)) &&
+           buf->seq <= client->sioc->zero_copy_sent) {
+        QSIMPLEQ_REMOVE_HEAD(&client->zero_copy_bufs, next);
+        client->zero_copy_pending -= buf->size;
+        qemu_vfree(buf->data);
+        g_free(buf);
+    }
+    return 0;
+}
+
+/*
+ * Take ownership of a read buffer that was just used for the reply, keeping
+ * it alive until the kernel has finished transmitting it. Returns false if
+ * no zero copy send can reference the buffer, in which case the caller
+ * frees it as usual.
+ */
+static bool nbd_zero_copy_defer_free(NBDClient *client, void *data,
+                                     size_t size)
+{
+    QIOChannelSocket *sioc = client->sioc;
+    NBDZeroCopyBuf *buf;
+
+    if (!client->zero_copy || sioc->zero_copy_sent == sioc->zero_copy_queued) {
+        return false;
+    }
+
+    /*
+     * Other requests may have queued sends in the meantime, so the current
+     * counter is an upper bound for the sends that used @data.
+     */
+    buf = g_new(NBDZeroCopyBuf, 1);
+    buf->data = data;
+    buf->size = size;
+    buf->seq = sioc->zero_copy_queued;
+    QSIMPLEQ_INSERT_TAIL(&client->zero_copy_bufs, buf, next);
+    client->zero_copy_pending += size;
+    return true;
+}
+
+/*
+ * Once the connection is gone the content of the buffers does not matter
+ * anymore, and the pages stay pinned by the kernel for as long as it needs
+ * them, so they can be freed right away.
+ */
+static void nbd_zero_copy_free_all(NBDClient *client)
+{
+    NBDZeroCopyBuf *buf;
+
+    while ((buf = QSIMPLEQ_FIRST(&client->zero_copy_bufs))) {
+        QSIMPLEQ_REMOVE_HEAD(&client->zero_copy_bufs, next);
+        qemu_vfree(buf->data);
+        g_free(buf);
+    }
+    client->zero_copy_pending = 0;
+}
+
 void nbd_client_put(NBDClient *client)
 {
     if (--client->refcount == 0) {
@@ -1520,6 +1622,7 @@ void nbd_client_put(NBDClient *client)
             object_unref(OBJECT(client->tlscreds));
         }
         g_free(client->tlsauthz);
+        nbd_zero_copy_free_all(client);
         if (client->exp) {
             QTAILQ_REMOVE(&client->exp->clients, client, next);
             blk_exp_unref(&client->exp->common);
@@ -1814,6 +1917,7 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
     }
 
     exp->allocation_depth = arg->allocation_depth;
+    exp->zero_copy = arg->zero_copy;
 
     /*
      * We need to inhibit request queuing in the block layer to ensure we can
@@ -1914,21 +2018,61 @@ const BlockExportDriver blk_exp_nbd = {
     .request_shutdown   = nbd_export_request_shutdown,
 };
 
-static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
-                                        unsigned niov, Error **errp)
+/*
+ * Send a reply made of @iov. With QIO_CHANNEL_WRITE_FLAG_ZERO_COPY in @flags,
+ * the last element of @iov is sent with MSG_ZEROCOPY after the others, which
+ * are always copied because they live on the caller's stack.
+ */
+static int coroutine_fn nbd_co_send_iov_full(NBDClient *client,
+                                             struct iovec *iov, unsigned niov,
+                                             int flags, Error **errp)
 {
+    unsigned ncopy = flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY ? niov - 1
+                                                              : niov;
     int ret;
 
     g_assert(qemu_in_coroutine());
     qemu_co_mutex_lock(&client->send_lock);
     client->send_coroutine = qemu_coroutine_self();
 
-    ret = qio_channel_writev_all(client->ioc, iov, niov, errp) < 0 ? -EIO : 0;
+    ret = qio_channel_writev_all(client->ioc, iov, ncopy, errp);
+    if (ret == 0 && ncopy < niov) {
+        ret = qio_channel_writev_full_all(client->ioc, &iov[ncopy], 1,
+                                          NULL, 0, flags, errp);
+    }
 
     client->send_coroutine = NULL;
     qemu_co_mutex_unlock(&client->send_lock);
 
-    return ret;
+    return ret < 0 ? -EIO : 0;
+}
+
+static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
+                                        unsigned niov, Error **errp)
+{
+    return nbd_co_send_iov_full(client, iov, niov, 0, errp);
+}
+
+/*
+ * Send a reply whose last element in @iov is read payload. Large payloads
+ * are sent with MSG_ZEROCOPY, or copied if the process can't lock enough
+ * memory for that.
+ */
+static int coroutine_fn nbd_co_send_read_iov(NBDClient *client,
+                                             struct iovec *iov,
+                                             unsigned niov, Error **errp)
+{
+    if (!client->zero_copy ||
+        iov[niov - 1].iov_len < NBD_ZERO_COPY_MIN_SIZE ||
+        client->zero_copy_pending >= NBD_ZERO_COPY_MAX_PENDING) {
+        return nbd_co_send_iov(client, iov, niov, errp);
+    }
+
+    trace_nbd_co_send_zero_copy(iov[niov - 1].iov_base, iov[niov - 1].iov_len);
+    return nbd_co_send_iov_full(client, iov, niov,
+                                QIO_CHANNEL_WRITE_FLAG_ZERO_COPY |
+                                QIO_CHANNEL_WRITE_FLAG_ZERO_COPY_FALLBACK,
+                                errp);
 }
 
 static inline void set_be_simple_reply(NBDSimpleReply *reply, uint64_t error,
@@ -1962,6 +2106,9 @@ static int coroutine_fn nbd_co_send_simple_reply(NBDClient *client,
                                    nbd_err_lookup(nbd_err), len);
     set_be_simple_reply(&reply, nbd_err, request->cookie);
 
+    if (len && request->type == NBD_CMD_READ) {
+        return nbd_co_send_read_iov(client, iov, 2, errp);
+    }
     return nbd_co_send_iov(client, iov, 2, errp);
 }
 
@@ -2043,7 +2190,7 @@ static int coroutine_fn nbd_co_send_chunk_read(NBDClient *client,
                  NBD_REPLY_TYPE_OFFSET_DATA, request);
     stq_be_p(&chunk.offset, offset);
 
-    return nbd_co_send_iov(client, iov, 3, errp);
+    return nbd_co_send_read_iov(client, iov, 3, errp);
 }
 
 static int coroutine_fn nbd_co_send_chunk_error(NBDClient *client,
@@ -3014,6 +3161,14 @@ static coroutine_fn void nbd_trip(void *opaque)
     }
 
     qio_channel_set_cork(client->ioc, false);
+
+    if (request.type == NBD_CMD_READ && req->data &&
+        nbd_zero_copy_defer_free(client, req->data, request.len)) {
+        req->data = NULL;
+    }
+    if (nbd_zero_copy_reap(client, &local_err) < 0) {
+        goto disconnect;
+    }
 done:
     nbd_request_put(req);
     nbd_client_put(client);
@@ -3053,6 +3208,14 @@ static coroutine_fn void nbd_co_client_start(void *opaque)
         return;
     }
 
+    /* TLS needs to transform the data, so it can only be used without */
+    if (client->exp->zero_copy && client->ioc == QIO_CHANNEL(client->sioc)) {
+        client->zero_copy = qio_channel_socket_enable_zero_copy(client->sioc);
+        if (!client->zero_copy) {
+            trace_nbd_zero_copy_unavailable(client->exp->name);
+        }
+    }
+
     nbd_client_receive_next_request(client);
 }
 
@@ -3077,6 +3240,7 @@ void nbd_client_new(QIOChannelSocket *sioc,
     }
     client->tlsauthz = g_strdup(tlsauthz);
     client->sioc = sioc;
+    QSIMPLEQ_INIT(&client->zero_copy_bufs);
     qio_channel_set_delay(QIO_CHANNEL(sioc), false);
     object_ref(OBJECT(client->sioc));
     client->ioc = QIO_CHANNEL(sioc);
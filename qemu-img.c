@@ -205,7 +205,9 @@ void help(void)
            "Parameters to convert subcommand:\n"
            "  '--bitmaps' copies all top-level persistent bitmaps to destination\n"
            "  '-m' specifies how many coroutines work in parallel during the convert\n"
-           "       process (defaults to 8)\n"
+           "       process (defaults to 8); 'auto' adjusts it to the observed\n"
+           "       throughput\n"
+           "  '--output=json' reports progress as one JSON object per line\n"
            "  '-W' allow to write to the target out of order rather than sequential\n"
            "\n"
            "Parameters to snapshot subcommand:\n"
@@ -1671,6 +1673,18 @@ enum ImgConvertBlockStatus {
 #define MAX_COROUTINES 16
 #define CONVERT_THROTTLE_GROUP "img_convert"
 
+/* Upper bound for the memory used by the source extent map (24 MiB) */
+#define CONVERT_MAX_EXTENTS (1024 * 1024)
+
+/* How often the number of coroutines is adjusted with -m auto */
+#define CONVERT_TUNE_INTERVAL_NS (500 * SCALE_MS)
+
+typedef struct ImgConvertExtent {
+    int64_t start;
+    int64_t end;
+    enum ImgConvertBlockStatus status;
+} ImgConvertExtent;
+
 typedef struct ImgConvertState {
     BlockBackend **src;
     int64_t *src_sectors;
@@ -1683,6 +1697,8 @@ typedef struct ImgConvertState {
     int64_t wr_offs;
     enum ImgConvertBlockStatus status;
     int64_t sector_next_status;
+    GArray *extents;
+    bool extents_recording;
     BlockBackend *target;
     bool has_zero_init;
     bool compressed;
@@ -1703,8 +1719,98 @@ typedef struct ImgConvertState {
     int64_t wait_sector_num[MAX_COROUTINES];
     CoMutex lock;
     int ret;
+
+    /* -m auto: only the first active_coroutines coroutines copy data */
+    bool adaptive;
+    int active_coroutines;
+    int tune_step;
+    CoQueue parked;
+    int64_t completed_sectors;
+    int64_t tune_time;
+    int64_t tune_sectors;
+    double tune_rate;
+
+    OutputFormat output_format;
+    int64_t start_time;
+    int64_t progress_time;
 } ImgConvertState;
 
+/*
+ * The extent map is filled while convert_do_copy() sizes the job, so
+ * that the copy itself does not need to query the block status again.
+ * Adjacent extents with the same status are merged.
+ */
+static void convert_extent_record(ImgConvertState *s, int64_t start,
+                                  int64_t end,
+                                  enum ImgConvertBlockStatus status)
+{
+    ImgConvertExtent *last;
+
+    if (!s->extents_recording) {
+        return;
+    }
+
+    if (s->extents->len) {
+        last = &g_array_index(s->extents, ImgConvertExtent,
+                              s->extents->len - 1);
+        if (last->end == start && last->status == status) {
+            last->end = end;
+            return;
+        }
+    }
+
+    if (s->extents->len >= CONVERT_MAX_EXTENTS) {
+        /* Query the block status for the rest of the image while copying */
+        s->extents_recording = false;
+        return;
+    }
+
+    g_array_append_val(s->extents, ((ImgConvertExtent) {
+        .start = start,
+        .end = end,
+        .status = status,
+    }));
+}
+
+/*
+ * Set the status of @sector_num from the extent map.  Returns false if
+ * the map does not cover it, which happens past the end of a map that
+ * hit CONVERT_MAX_EXTENTS.
+ */
+static bool convert_extent_lookup(ImgConvertState *s, int64_t sector_num)
+{
+    guint lo = 0, hi;
+    ImgConvertExtent *e;
+
+    if (s->extents_recording) {
+        return false;
+    }
+
+    /* Find the first extent that ends after @sector_num */
+    hi = s->extents->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+
+        e = &g_array_index(s->extents, ImgConvertExtent, mid);
+        if (e->end > sector_num) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    if (lo == s->extents->len) {
+        return false;
+    }
+
+    e = &g_array_index(s->extents, ImgConvertExtent, lo);
+    if (e->start > sector_num) {
+        return false;
+    }
+    s->status = e->status;
+    s->sector_next_status = e->end;
+    return true;
+}
+
 static void convert_select_part(ImgConvertState *s, int64_t sector_num,
                                 int *src_cur, int64_t *src_cur_offset)
 {
@@ -1739,7 +1845,8 @@ convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
         }
     }
 
-    if (s->sector_next_status <= sector_num) {
+    if (s->sector_next_status <= sector_num &&
+        !convert_extent_lookup(s, sector_num)) {
         uint64_t offset = (sector_num - src_cur_offset) * BDRV_SECTOR_SIZE;
         int64_t count;
         int tail;
@@ -1802,6 +1909,7 @@ convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
         }
 
         s->sector_next_status = sector_num + n;
+        convert_extent_record(s, sector_num, s->sector_next_status, s->status);
     }
 
     n = MIN(n, s->sector_next_status - sector_num);
@@ -1973,6 +2081,65 @@ static int coroutine_fn convert_co_copy_range(ImgConvertState *s, int64_t sector
     return 0;
 }
 
+static void convert_print_progress(ImgConvertState *s, bool done)
+{
+    int64_t now, bytes;
+    double mib_per_sec = 0;
+
+    if (s->output_format == OFORMAT_HUMAN) {
+        qemu_progress_print(100.0 * s->allocated_done /
+                                    s->allocated_sectors, 0);
+        return;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    if (!done && now - s->progress_time < NANOSECONDS_PER_SECOND) {
+        return;
+    }
+    s->progress_time = now;
+
+    bytes = s->completed_sectors * BDRV_SECTOR_SIZE;
+    if (now > s->start_time) {
+        mib_per_sec = (double)bytes / MiB * NANOSECONDS_PER_SECOND /
+                      (now - s->start_time);
+    }
+    printf("{ \"done\": %" PRId64 ", \"total\": %" PRId64
+           ", \"mib-per-sec\": %.2f, \"coroutines\": %d }\n",
+           bytes, s->allocated_sectors * BDRV_SECTOR_SIZE, mib_per_sec,
+           s->active_coroutines);
+    fflush(stdout);
+}
+
+/*
+ * With -m auto, hill-climb the number of active coroutines towards the
+ * highest throughput: keep changing it in the same direction as long as
+ * the throughput improves, and turn around when it stops doing so.
+ */
+static void coroutine_fn convert_tune_coroutines(ImgConvertState *s)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t elapsed = now - s->tune_time;
+    double rate;
+
+    if (elapsed < CONVERT_TUNE_INTERVAL_NS) {
+        return;
+    }
+
+    rate = (double)(s->completed_sectors - s->tune_sectors) / elapsed;
+    if (rate < s->tune_rate * 1.05) {
+        s->tune_step = -s->tune_step;
+    }
+    s->tune_rate = rate;
+    s->tune_time = now;
+    s->tune_sectors = s->completed_sectors;
+
+    s->active_coroutines = MIN(MAX(s->active_coroutines + s->tune_step, 1),
+                               s->num_coroutines);
+    if (s->tune_step > 0) {
+        qemu_co_queue_restart_all(&s->parked);
+    }
+}
+
 static void coroutine_fn convert_co_do_copy(void *opaque)
 {
     ImgConvertState *s = opaque;
@@ -1989,19 +2156,26 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
     assert(index >= 0);
 
     s->running_coroutines++;
-    buf = blk_blockalign(s->target, s->buf_sectors * BDRV_SECTOR_SIZE);
 
     while (1) {
         int n;
         int64_t sector_num;
         enum ImgConvertBlockStatus status;
         bool copy_range;
+        bool allocated;
 
         qemu_co_mutex_lock(&s->lock);
+        while (index >= s->active_coroutines && s->ret == -EINPROGRESS &&
+               s->sector_num < s->total_sectors) {
+            qemu_co_queue_wait(&s->parked, &s->lock);
+        }
         if (s->ret != -EINPROGRESS || s->sector_num >= s->total_sectors) {
             qemu_co_mutex_unlock(&s->lock);
             break;
         }
+        if (!buf) {
+            buf = blk_blockalign(s->target, s->buf_sectors * BDRV_SECTOR_SIZE);
+        }
         WITH_GRAPH_RDLOCK_GUARD() {
             n = convert_iteration_sectors(s, s->sector_num);
         }
@@ -2021,10 +2195,12 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
         s->sector_num += n;
         qemu_co_mutex_unlock(&s->lock);
 
-        if (status == BLK_DATA || (!s->min_sparse && status == BLK_ZERO)) {
+        /* Sectors written to the target, counted in allocated_sectors */
+        allocated = status == BLK_DATA ||
+                    (!s->min_sparse && status == BLK_ZERO);
+        if (allocated) {
             s->allocated_done += n;
-            qemu_progress_print(100.0 * s->allocated_done /
-                                        s->allocated_sectors, 0);
+            convert_print_progress(s, false);
         }
 
 retry:
@@ -2066,9 +2242,15 @@ retry:
                 error_report("error while writing at byte %lld: %s",
                              sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
                 s->ret = ret;
+            } else if (allocated) {
+                s->completed_sectors += n;
             }
         }
 
+        if (s->adaptive) {
+            convert_tune_coroutines(s);
+        }
+
         if (s->wr_in_order) {
             /* reenter the coroutine that might have waited
              * for this write to complete */
@@ -2087,6 +2269,9 @@ retry:
         }
     }
 
+    /* Let parked coroutines notice that there is nothing left to do */
+    qemu_co_queue_restart_all(&s->parked);
+
     qemu_vfree(buf);
     s->co[index] = NULL;
     s->running_coroutines--;
@@ -2119,12 +2304,19 @@ static int convert_do_copy(ImgConvertState *s)
         s->buf_sectors = s->cluster_sectors;
     }
 
+    /*
+     * Map the whole source up front.  The extents are used both to size
+     * the job for progress reporting and to drive the copy.
+     */
+    s->extents = g_array_new(false, false, sizeof(ImgConvertExtent));
+    s->extents_recording = true;
     while (sector_num < s->total_sectors) {
         bdrv_graph_rdlock_main_loop();
         n = convert_iteration_sectors(s, sector_num);
         bdrv_graph_rdunlock_main_loop();
         if (n < 0) {
-            return n;
+            ret = n;
+            goto out;
         }
         if (s->status == BLK_DATA || (!s->min_sparse && s->status == BLK_ZERO))
         {
@@ -2132,12 +2324,20 @@ static int convert_do_copy(ImgConvertState *s)
         }
         sector_num += n;
     }
+    s->extents_recording = false;
 
     /* Do the copy */
     s->sector_next_status = 0;
     s->ret = -EINPROGRESS;
+    s->start_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    s->tune_time = s->start_time;
+    s->tune_step = 1;
+    if (!s->adaptive) {
+        s->active_coroutines = s->num_coroutines;
+    }
 
     qemu_co_mutex_init(&s->lock);
+    qemu_co_queue_init(&s->parked);
     for (i = 0; i < s->num_coroutines; i++) {
         s->co[i] = qemu_coroutine_create(convert_co_do_copy, s);
         s->wait_sector_num[i] = -1;
@@ -2152,11 +2352,19 @@ static int convert_do_copy(ImgConvertState *s)
         /* signal EOF to align */
         ret = blk_pwrite_compressed(s->target, 0, 0, NULL);
         if (ret < 0) {
-            return ret;
+            goto out;
         }
     }
 
-    return s->ret;
+    if (!s->ret && s->output_format == OFORMAT_JSON) {
+        convert_print_progress(s, true);
+    }
+    ret = s->ret;
+
+out:
+    g_array_free(s->extents, true);
+    s->extents = NULL;
+    return ret;
 }
 
 /* Check that bitmaps can be copied, or output an error */
@@ -2204,7 +2412,7 @@ static int convert_copy_bitmaps(BlockDriverState *src, BlockDriverState *dst,
                                    true, bdrv_dirty_bitmap_granularity(bm),
                                    true, true,
                                    true, !bdrv_dirty_bitmap_enabled(bm),
-                                   &err);
+                                   false, false, &err);
         if (err) {
             error_reportf_err(err, "Failed to create bitmap %s: ", name);
             return -1;
@@ -2258,6 +2466,7 @@ static int img_convert(int argc, char **argv)
     bool bitmaps = false;
     bool skip_broken = false;
     int64_t rate_limit = 0;
+    const char *output = NULL;
 
     ImgConvertState s = (ImgConvertState) {
         /* Need at least 4k of zeros for sparse detection */
@@ -2266,6 +2475,7 @@ static int img_convert(int argc, char **argv)
         .buf_sectors        = IO_BUF_SIZE / BDRV_SECTOR_SIZE,
         .wr_in_order        = true,
         .num_coroutines     = 8,
+        .output_format      = OFORMAT_HUMAN,
     };
 
     for(;;) {
@@ -2279,6 +2489,7 @@ static int img_convert(int argc, char **argv)
             {"target-is-zero", no_argument, 0, OPTION_TARGET_IS_ZERO},
             {"bitmaps", no_argument, 0, OPTION_BITMAPS},
             {"skip-broken-bitmaps", no_argument, 0, OPTION_SKIP_BROKEN},
+            {"output", required_argument, 0, OPTION_OUTPUT},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hf:O:B:CcF:o:l:S:pt:T:qnm:WUr:",
@@ -2368,6 +2579,13 @@ static int img_convert(int argc, char **argv)
             skip_create = true;
             break;
         case 'm':
+            if (!strcmp(optarg, "auto")) {
+                s.adaptive = true;
+                s.num_coroutines = MAX_COROUTINES;
+                s.active_coroutines = 8;
+                break;
+            }
+            s.adaptive = false;
             if (qemu_strtol(optarg, NULL, 0, &s.num_coroutines) ||
                 s.num_coroutines < 1 || s.num_coroutines > MAX_COROUTINES) {
                 error_report("Invalid number of coroutines. Allowed number of"
@@ -2413,9 +2631,21 @@ static int img_convert(int argc, char **argv)
         case OPTION_SKIP_BROKEN:
             skip_broken = true;
             break;
+        case OPTION_OUTPUT:
+            output = optarg;
+            break;
         }
     }
 
+    if (output && !strcmp(output, "json")) {
+        s.output_format = OFORMAT_JSON;
+    } else if (output && !strcmp(output, "human")) {
+        s.output_format = OFORMAT_HUMAN;
+    } else if (output) {
+        error_report("--output must be used with human or json as argument.");
+        goto fail_getopt;
+    }
+
     if (!out_fmt && !tgt_image_opts) {
         out_fmt = "raw";
     }
@@ -2483,6 +2713,11 @@ static int img_convert(int argc, char **argv)
     /* Initialize before goto out */
     if (s.quiet) {
         progress = false;
+        s.output_format = OFORMAT_HUMAN;
+    }
+    if (s.output_format == OFORMAT_JSON) {
+        /* Progress is reported as JSON lines by convert_print_progress() */
+        progress = false;
     }
     qemu_progress_init(progress, 1.0);
     qemu_progress_print(0, 100);
@@ -4936,7 +5171,7 @@ static int img_bitmap(int argc, char **argv)
         case BITMAP_ADD:
             qmp_block_dirty_bitmap_add(bs->node_name, bitmap,
                                        !!granularity, granularity, true, true,
-                                       false, false, &err);
+                                       false, false, false, false, &err);
             op = "add";
             break;
         case BITMAP_REMOVE:
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+#
+# Benchmark qcow2 compressed writes with different compression levels,
+# thread counts and dictionaries
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+
+import sys
+import os
+import subprocess
+import time
+import json
+
+import simplebench
+from results_to_text import results_to_text
+
+
+def bench_func(env, case):
+    """Convert the source image into a compressed qcow2 image
+
+    Returns throughput of the source data in MiB/s, with the compression
+    ratio reached as additional information.
+    """
+    fname = f"{case['dir']}/compress-test.qcow2"
+    try:
+        os.remove(fname)
+    except OSError:
+        pass
+
+    create_opts = 'compression_type=zstd'
+    if env['dict']:
+        create_opts += f",compression_dict={env['dict']}"
+
+    src_size = os.path.getsize(case['source'])
+    subprocess.run([env['qemu-img-binary'], 'create', '-f', 'qcow2',
+                    '-o', create_opts, fname, str(src_size)],
+                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+                   check=True)
+
+    target = (f"driver=qcow2,compression-level={env['level']},"
+              f"compression-threads={env['threads']},"
+              f"file.driver=file,file.filename={fname}")
+    args = [env['qemu-img-binary'], 'convert', '-n', '-c', '-W',
+            '-m', str(env['threads']), '-f', 'raw', case['source'],
+            '--target-image-opts', target]
+
+    start = time.time()
+    p = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                       universal_newlines=True)
+    seconds = time.time() - start
+
+    if p.returncode != 0:
+        return {'error': f'qemu-img failed: {p.returncode}: {p.stdout}'}
+
+    dst_size = os.stat(fname).st_blocks * 512
+    return {
+        'seconds': seconds,
+        'iops': src_size / seconds / (1024 * 1024),
+        'ratio': src_size / dst_size,
+    }
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 4:
+        print(f'USAGE: {sys.argv[0]} <qemu-img binary> <zstd dictionary> '
+              'RAW_IMAGE:DIR_PATH ...')
+        print('  The "iops" column shows the source throughput in MiB/s.')
+        exit(1)
+
+    qemu_img = sys.argv[1]
+    dictionary = sys.argv[2]
+
+    envs = []
+    for level in (1, 3, 9, 19):
+        for threads in (1, 4, 16):
+            for d in (None, dictionary):
+                envs.append({
+                    'id': f'level {level}, {threads} threads'
+                          + (', dict' if d else ''),
+                    'qemu-img-binary': qemu_img,
+                    'level': level,
+                    'threads': threads,
+                    'dict': d,
+                })
+
+    cases = []
+    for disk in sys.argv[3:]:
+        source, path = disk.split(':')
+        cases.append({
+            'id': os.path.basename(source),
+            'source': source,
+            'dir': path
+        })
+
+    result = simplebench.bench(bench_func, envs, cases, count=3)
+    print(results_to_text(result))
+    with open('results.json', 'w') as f:
+        json.dump(result, f, indent=4)
@@ -1763,6 +1763,35 @@ void qemu_ram_msync(RAMBlock *block, ram_addr_t start, ram_addr_t length)
 }
 
 /* Called with ram_list.mutex held */
+static void dirty_memory_extend_blocks(DirtyMemoryBlocks **blocks,
+                                       ram_addr_t old_num_blocks,
+                                       ram_addr_t new_num_blocks,
+                                       long block_bits)
+{
+    DirtyMemoryBlocks *old_blocks;
+    DirtyMemoryBlocks *new_blocks;
+    int j;
+
+    old_blocks = qatomic_rcu_read(blocks);
+    new_blocks = g_malloc(sizeof(*new_blocks) +
+                          sizeof(new_blocks->blocks[0]) * new_num_blocks);
+
+    if (old_num_blocks) {
+        memcpy(new_blocks->blocks, old_blocks->blocks,
+               old_num_blocks * sizeof(old_blocks->blocks[0]));
+    }
+
+    for (j = old_num_blocks; j < new_num_blocks; j++) {
+        new_blocks->blocks[j] = bitmap_new(block_bits);
+    }
+
+    qatomic_rcu_set(blocks, new_blocks);
+
+    if (old_blocks) {
+        g_free_rcu(old_blocks, rcu);
+    }
+}
+
 static void dirty_memory_extend(ram_addr_t old_ram_size,
                                 ram_addr_t new_ram_size)
 {
@@ -1777,29 +1806,15 @@ static void dirty_memory_extend(ram_addr_t old_ram_size,
         return;
     }
 
+    /*
+     * The summary is extended first, so that anyone who sees a new block
+     * of the migration bitmap also finds its summary.
+     */
+    dirty_memory_extend_blocks(&ram_list.dirty_chunks, old_num_blocks,
+                               new_num_blocks, DIRTY_MEMORY_CHUNKS_PER_BLOCK);
     for (i = 0; i < DIRTY_MEMORY_NUM; i++) {
-        DirtyMemoryBlocks *old_blocks;
-        DirtyMemoryBlocks *new_blocks;
-        int j;
-
-        old_blocks = qatomic_rcu_read(&ram_list.dirty_memory[i]);
-        new_blocks = g_malloc(sizeof(*new_blocks) +
-                              sizeof(new_blocks->blocks[0]) * new_num_blocks);
-
-        if (old_num_blocks) {
-            memcpy(new_blocks->blocks, old_blocks->blocks,
-                   old_num_blocks * sizeof(old_blocks->blocks[0]));
-        }
-
-        for (j = old_num_blocks; j < new_num_blocks; j++) {
-            new_blocks->blocks[j] = bitmap_new(DIRTY_MEMORY_BLOCK_SIZE);
-        }
-
-        qatomic_rcu_set(&ram_list.dirty_memory[i], new_blocks);
-
-        if (old_blocks) {
-            g_free_rcu(old_blocks, rcu);
-        }
+        dirty_memory_extend_blocks(&ram_list.dirty_memory[i], old_num_blocks,
+                                   new_num_blocks, DIRTY_MEMORY_BLOCK_SIZE);
     }
 }
 
@@ -830,6 +830,12 @@ DO_3SAME_NO_SZ_3(VABD_S, gen_gvec_sabd)
 DO_3SAME_NO_SZ_3(VABA_S, gen_gvec_saba)
 DO_3SAME_NO_SZ_3(VABD_U, gen_gvec_uabd)
 DO_3SAME_NO_SZ_3(VABA_U, gen_gvec_uaba)
+DO_3SAME_NO_SZ_3(VHADD_S, gen_gvec_shadd)
+DO_3SAME_NO_SZ_3(VHADD_U, gen_gvec_uhadd)
+DO_3SAME_NO_SZ_3(VHSUB_S, gen_gvec_shsub)
+DO_3SAME_NO_SZ_3(VHSUB_U, gen_gvec_uhsub)
+DO_3SAME_NO_SZ_3(VRHADD_S, gen_gvec_srhadd)
+DO_3SAME_NO_SZ_3(VRHADD_U, gen_gvec_urhadd)
 
 #define DO_3SAME_CMP(INSN, COND)                                        \
     static void gen_##INSN##_3s(unsigned vece, uint32_t rd_ofs,         \
@@ -988,12 +994,6 @@ DO_3SAME_64_ENV(VQRSHL_U64, gen_helper_neon_qrshl_u64)
         return do_3same(s, a, gen_##INSN##_3s);                         \
     }
 
-DO_3SAME_32(VHADD_S, hadd_s)
-DO_3SAME_32(VHADD_U, hadd_u)
-DO_3SAME_32(VHSUB_S, hsub_s)
-DO_3SAME_32(VHSUB_U, hsub_u)
-DO_3SAME_32(VRHADD_S, rhadd_s)
-DO_3SAME_32(VRHADD_U, rhadd_u)
 DO_3SAME_32(VRSHL_S, rshl_s)
 DO_3SAME_32(VRSHL_U, rshl_u)
 
@@ -1002,105 +1002,36 @@ DO_3SAME_32_ENV(VQSHL_U, qshl_u)
 DO_3SAME_32_ENV(VQRSHL_S, qrshl_s)
 DO_3SAME_32_ENV(VQRSHL_U, qrshl_u)
 
-static bool do_3same_pair(DisasContext *s, arg_3same *a, NeonGenTwoOpFn *fn)
-{
-    /* Operations handled pairwise 32 bits at a time */
-    TCGv_i32 tmp, tmp2, tmp3;
-
-    if (!arm_dc_feature(s, ARM_FEATURE_NEON)) {
-        return false;
-    }
-
-    /* UNDEF accesses to D16-D31 if they don't exist. */
-    if (!dc_isar_feature(aa32_simd_r32, s) &&
-        ((a->vd | a->vn | a->vm) & 0x10)) {
-        return false;
-    }
-
-    if (a->size == 3) {
-        return false;
-    }
-
-    if (!vfp_access_check(s)) {
-        return true;
-    }
-
-    assert(a->q == 0); /* enforced by decode patterns */
-
-    /*
-     * Note that we have to be careful not to clobber the source operands
-     * in the "vm == vd" case by storing the result of the first pass too
-     * early. Since Q is 0 there are always just two passes, so instead
-     * of a complicated loop over each pass we just unroll.
-     */
-    tmp = tcg_temp_new_i32();
-    tmp2 = tcg_temp_new_i32();
-    tmp3 = tcg_temp_new_i32();
-
-    read_neon_element32(tmp, a->vn, 0, MO_32);
-    read_neon_element32(tmp2, a->vn, 1, MO_32);
-    fn(tmp, tmp, tmp2);
-
-    read_neon_element32(tmp3, a->vm, 0, MO_32);
-    read_neon_element32(tmp2, a->vm, 1, MO_32);
-    fn(tmp3, tmp3, tmp2);
-
-    write_neon_element32(tmp, a->vd, 0, MO_32);
-    write_neon_element32(tmp3, a->vd, 1, MO_32);
-
-    return true;
-}
-
-#define DO_3SAME_PAIR(INSN, func)                                       \
+/*
+ * Pairwise ops: the decode patterns only allow Q == 0, and the
+ * out-of-line expansion takes care of Vd overlapping Vm.
+ */
+#define DO_3SAME_PAIR(INSN, FUNC)                                       \
     static bool trans_##INSN##_3s(DisasContext *s, arg_3same *a)        \
     {                                                                   \
-        static NeonGenTwoOpFn * const fns[] = {                         \
-            gen_helper_neon_##func##8,                                  \
-            gen_helper_neon_##func##16,                                 \
-            gen_helper_neon_##func##32,                                 \
-        };                                                              \
-        if (a->size > 2) {                                              \
+        if (a->size == 3) {                                             \
             return false;                                               \
         }                                                               \
-        return do_3same_pair(s, a, fns[a->size]);                       \
+        return do_3same(s, a, FUNC);                                    \
     }
 
-/* 32-bit pairwise ops end up the same as the elementwise versions.  */
-#define gen_helper_neon_pmax_s32  tcg_gen_smax_i32
-#define gen_helper_neon_pmax_u32  tcg_gen_umax_i32
-#define gen_helper_neon_pmin_s32  tcg_gen_smin_i32
-#define gen_helper_neon_pmin_u32  tcg_gen_umin_i32
-#define gen_helper_neon_padd_u32  tcg_gen_add_i32
-
-DO_3SAME_PAIR(VPMAX_S, pmax_s)
-DO_3SAME_PAIR(VPMIN_S, pmin_s)
-DO_3SAME_PAIR(VPMAX_U, pmax_u)
-DO_3SAME_PAIR(VPMIN_U, pmin_u)
-DO_3SAME_PAIR(VPADD, padd_u)
+DO_3SAME_PAIR(VPMAX_S, gen_gvec_smaxp)
+DO_3SAME_PAIR(VPMIN_S, gen_gvec_sminp)
+DO_3SAME_PAIR(VPMAX_U, gen_gvec_umaxp)
+DO_3SAME_PAIR(VPMIN_U, gen_gvec_uminp)
+DO_3SAME_PAIR(VPADD, gen_gvec_addp)
 
 #define DO_3SAME_VQDMULH(INSN, FUNC)                                    \
-    WRAP_ENV_FN(gen_##INSN##_tramp16, gen_helper_neon_##FUNC##_s16);    \
-    WRAP_ENV_FN(gen_##INSN##_tramp32, gen_helper_neon_##FUNC##_s32);    \
-    static void gen_##INSN##_3s(unsigned vece, uint32_t rd_ofs,         \
-                                uint32_t rn_ofs, uint32_t rm_ofs,       \
-                                uint32_t oprsz, uint32_t maxsz)         \
-    {                                                                   \
-        static const GVecGen3 ops[2] = {                                \
-            { .fni4 = gen_##INSN##_tramp16 },                           \
-            { .fni4 = gen_##INSN##_tramp32 },                           \
-        };                                                              \
-        tcg_gen_gvec_3(rd_ofs, rn_ofs, rm_ofs, oprsz, maxsz, &ops[vece - 1]); \
-    }                                                                   \
     static bool trans_##INSN##_3s(DisasContext *s, arg_3same *a)        \
     {                                                                   \
         if (a->size != 1 && a->size != 2) {                             \
             return false;                                               \
         }                                                               \
-        return do_3same(s, a, gen_##INSN##_3s);                         \
+        return do_3same(s, a, FUNC);                                    \
     }
 
-DO_3SAME_VQDMULH(VQDMULH, qdmulh)
-DO_3SAME_VQDMULH(VQRDMULH, qrdmulh)
+DO_3SAME_VQDMULH(VQDMULH, gen_gvec_sqdmulh_qc)
+DO_3SAME_VQDMULH(VQRDMULH, gen_gvec_sqrdmulh_qc)
 
 #define WRAP_FP_GVEC(WRAPNAME, FPST, FUNC)                              \
     static void WRAPNAME(unsigned vece, uint32_t rd_ofs,                \
@@ -1407,76 +1338,30 @@ DO_2SHIFT_ENV(VQSHLU, qshlu_s)
 DO_2SHIFT_ENV(VQSHL_U, qshl_u)
 DO_2SHIFT_ENV(VQSHL_S, qshl_s)
 
-static bool do_2shift_narrow_64(DisasContext *s, arg_2reg_shift *a,
-                                NeonGenTwo64OpFn *shiftfn,
-                                NeonGenNarrowEnvFn *narrowfn)
+static bool do_2shift_narrow(DisasContext *s, int vd, int vm, int shift,
+                             gen_helper_gvec_2_ptr *fn)
 {
-    /* 2-reg-and-shift narrowing-shift operations, size == 3 case */
-    TCGv_i64 constimm, rm1, rm2;
-    TCGv_i32 rd;
+    /*
+     * Narrowing shifts, and the narrowing moves as a shift by 0: the
+     * helper reads all of the Q register input before writing the
+     * D register destination, and saturates into QC.
+     */
+    TCGv_ptr qc;
 
     if (!arm_dc_feature(s, ARM_FEATURE_NEON)) {
         return false;
     }
 
     /* UNDEF accesses to D16-D31 if they don't exist. */
-    if (!dc_isar_feature(aa32_simd_r32, s) &&
-        ((a->vd | a->vm) & 0x10)) {
+    if (!dc_isar_feature(aa32_simd_r32, s) && ((vd | vm) & 0x10)) {
         return false;
     }
 
-    if (a->vm & 1) {
-        return false;
-    }
-
-    if (!vfp_access_check(s)) {
-        return true;
-    }
-
-    /*
-     * This is always a right shift, and the shiftfn is always a
-     * left-shift helper, which thus needs the negated shift count.
-     */
-    constimm = tcg_constant_i64(-a->shift);
-    rm1 = tcg_temp_new_i64();
-    rm2 = tcg_temp_new_i64();
-    rd = tcg_temp_new_i32();
-
-    /* Load both inputs first to avoid potential overwrite if rm == rd */
-    read_neon_element64(rm1, a->vm, 0, MO_64);
-    read_neon_element64(rm2, a->vm, 1, MO_64);
-
-    shiftfn(rm1, rm1, constimm);
-    narrowfn(rd, tcg_env, rm1);
-    write_neon_element32(rd, a->vd, 0, MO_32);
-
-    shiftfn(rm2, rm2, constimm);
-    narrowfn(rd, tcg_env, rm2);
-    write_neon_element32(rd, a->vd, 1, MO_32);
-
-    return true;
-}
-
-static bool do_2shift_narrow_32(DisasContext *s, arg_2reg_shift *a,
-                                NeonGenTwoOpFn *shiftfn,
-                                NeonGenNarrowEnvFn *narrowfn)
-{
-    /* 2-reg-and-shift narrowing-shift operations, size < 3 case */
-    TCGv_i32 constimm, rm1, rm2, rm3, rm4;
-    TCGv_i64 rtmp;
-    uint32_t imm;
-
-    if (!arm_dc_feature(s, ARM_FEATURE_NEON)) {
-        return false;
-    }
-
-    /* UNDEF accesses to D16-D31 if they don't exist. */
-    if (!dc_isar_feature(aa32_simd_r32, s) &&
-        ((a->vd | a->vm) & 0x10)) {
+    if (vm & 1) {
         return false;
     }
 
-    if (a->vm & 1) {
+    if (!fn) {
         return false;
     }
 
@@ -1484,186 +1369,98 @@ static bool do_2shift_narrow_32(DisasContext *s, arg_2reg_shift *a,
         return true;
     }
 
-    /*
-     * This is always a right shift, and the shiftfn is always a
-     * left-shift helper, which thus needs the negated shift count
-     * duplicated into each lane of the immediate value.
-     */
-    if (a->size == 1) {
-        imm = (uint16_t)(-a->shift);
-        imm |= imm << 16;
-    } else {
-        /* size == 2 */
-        imm = -a->shift;
-    }
-    constimm = tcg_constant_i32(imm);
-
-    /* Load all inputs first to avoid potential overwrite */
-    rm1 = tcg_temp_new_i32();
-    rm2 = tcg_temp_new_i32();
-    rm3 = tcg_temp_new_i32();
-    rm4 = tcg_temp_new_i32();
-    read_neon_element32(rm1, a->vm, 0, MO_32);
-    read_neon_element32(rm2, a->vm, 1, MO_32);
-    read_neon_element32(rm3, a->vm, 2, MO_32);
-    read_neon_element32(rm4, a->vm, 3, MO_32);
-    rtmp = tcg_temp_new_i64();
-
-    shiftfn(rm1, rm1, constimm);
-    shiftfn(rm2, rm2, constimm);
-
-    tcg_gen_concat_i32_i64(rtmp, rm1, rm2);
-
-    narrowfn(rm1, tcg_env, rtmp);
-    write_neon_element32(rm1, a->vd, 0, MO_32);
-
-    shiftfn(rm3, rm3, constimm);
-    shiftfn(rm4, rm4, constimm);
-
-    tcg_gen_concat_i32_i64(rtmp, rm3, rm4);
-
-    narrowfn(rm3, tcg_env, rtmp);
-    write_neon_element32(rm3, a->vd, 1, MO_32);
+    qc = tcg_temp_new_ptr();
+    tcg_gen_addi_ptr(qc, tcg_env, offsetof(CPUARMState, vfp.qc));
+    tcg_gen_gvec_2_ptr(neon_full_reg_offset(vd), neon_full_reg_offset(vm),
+                       qc, 8, 8, shift, fn);
     return true;
 }
 
-#define DO_2SN_64(INSN, FUNC, NARROWFUNC)                               \
+#define DO_2SN(INSN, FUNC)                                              \
     static bool trans_##INSN##_2sh(DisasContext *s, arg_2reg_shift *a)  \
     {                                                                   \
-        return do_2shift_narrow_64(s, a, FUNC, NARROWFUNC);             \
-    }
-#define DO_2SN_32(INSN, FUNC, NARROWFUNC)                               \
-    static bool trans_##INSN##_2sh(DisasContext *s, arg_2reg_shift *a)  \
-    {                                                                   \
-        return do_2shift_narrow_32(s, a, FUNC, NARROWFUNC);             \
+        return do_2shift_narrow(s, a->vd, a->vm, a->shift, FUNC);       \
     }
 
-static void gen_neon_narrow_u32(TCGv_i32 dest, TCGv_ptr env, TCGv_i64 src)
-{
-    tcg_gen_extrl_i64_i32(dest, src);
-}
+DO_2SN(VSHRN_64, gen_helper_neon_shrn_d)
+DO_2SN(VSHRN_32, gen_helper_neon_shrn_s)
+DO_2SN(VSHRN_16, gen_helper_neon_shrn_h)
 
-static void gen_neon_narrow_u16(TCGv_i32 dest, TCGv_ptr env, TCGv_i64 src)
-{
-    gen_helper_neon_narrow_u16(dest, src);
-}
+DO_2SN(VRSHRN_64, gen_helper_neon_rshrn_d)
+DO_2SN(VRSHRN_32, gen_helper_neon_rshrn_s)
+DO_2SN(VRSHRN_16, gen_helper_neon_rshrn_h)
 
-static void gen_neon_narrow_u8(TCGv_i32 dest, TCGv_ptr env, TCGv_i64 src)
-{
-    gen_helper_neon_narrow_u8(dest, src);
-}
-
-DO_2SN_64(VSHRN_64, gen_ushl_i64, gen_neon_narrow_u32)
-DO_2SN_32(VSHRN_32, gen_ushl_i32, gen_neon_narrow_u16)
-DO_2SN_32(VSHRN_16, gen_helper_neon_shl_u16, gen_neon_narrow_u8)
-
-DO_2SN_64(VRSHRN_64, gen_helper_neon_rshl_u64, gen_neon_narrow_u32)
-DO_2SN_32(VRSHRN_32, gen_helper_neon_rshl_u32, gen_neon_narrow_u16)
-DO_2SN_32(VRSHRN_16, gen_helper_neon_rshl_u16, gen_neon_narrow_u8)
+DO_2SN(VQSHRUN_64, gen_helper_neon_sqshrun_d)
+DO_2SN(VQSHRUN_32, gen_helper_neon_sqshrun_s)
+DO_2SN(VQSHRUN_16, gen_helper_neon_sqshrun_h)
 
-DO_2SN_64(VQSHRUN_64, gen_sshl_i64, gen_helper_neon_unarrow_sat32)
-DO_2SN_32(VQSHRUN_32, gen_sshl_i32, gen_helper_neon_unarrow_sat16)
-DO_2SN_32(VQSHRUN_16, gen_helper_neon_shl_s16, gen_helper_neon_unarrow_sat8)
+DO_2SN(VQRSHRUN_64, gen_helper_neon_sqrshrun_d)
+DO_2SN(VQRSHRUN_32, gen_helper_neon_sqrshrun_s)
+DO_2SN(VQRSHRUN_16, gen_helper_neon_sqrshrun_h)
+DO_2SN(VQSHRN_S64, gen_helper_neon_sqshrn_d)
+DO_2SN(VQSHRN_S32, gen_helper_neon_sqshrn_s)
+DO_2SN(VQSHRN_S16, gen_helper_neon_sqshrn_h)
 
-DO_2SN_64(VQRSHRUN_64, gen_helper_neon_rshl_s64, gen_helper_neon_unarrow_sat32)
-DO_2SN_32(VQRSHRUN_32, gen_helper_neon_rshl_s32, gen_helper_neon_unarrow_sat16)
-DO_2SN_32(VQRSHRUN_16, gen_helper_neon_rshl_s16, gen_helper_neon_unarrow_sat8)
-DO_2SN_64(VQSHRN_S64, gen_sshl_i64, gen_helper_neon_narrow_sat_s32)
-DO_2SN_32(VQSHRN_S32, gen_sshl_i32, gen_helper_neon_narrow_sat_s16)
-DO_2SN_32(VQSHRN_S16, gen_helper_neon_shl_s16, gen_helper_neon_narrow_sat_s8)
+DO_2SN(VQRSHRN_S64, gen_helper_neon_sqrshrn_d)
+DO_2SN(VQRSHRN_S32, gen_helper_neon_sqrshrn_s)
+DO_2SN(VQRSHRN_S16, gen_helper_neon_sqrshrn_h)
 
-DO_2SN_64(VQRSHRN_S64, gen_helper_neon_rshl_s64, gen_helper_neon_narrow_sat_s32)
-DO_2SN_32(VQRSHRN_S32, gen_helper_neon_rshl_s32, gen_helper_neon_narrow_sat_s16)
-DO_2SN_32(VQRSHRN_S16, gen_helper_neon_rshl_s16, gen_helper_neon_narrow_sat_s8)
+DO_2SN(VQSHRN_U64, gen_helper_neon_uqshrn_d)
+DO_2SN(VQSHRN_U32, gen_helper_neon_uqshrn_s)
+DO_2SN(VQSHRN_U16, gen_helper_neon_uqshrn_h)
 
-DO_2SN_64(VQSHRN_U64, gen_ushl_i64, gen_helper_neon_narrow_sat_u32)
-DO_2SN_32(VQSHRN_U32, gen_ushl_i32, gen_helper_neon_narrow_sat_u16)
-DO_2SN_32(VQSHRN_U16, gen_helper_neon_shl_u16, gen_helper_neon_narrow_sat_u8)
+DO_2SN(VQRSHRN_U64, gen_helper_neon_uqrshrn_d)
+DO_2SN(VQRSHRN_U32, gen_helper_neon_uqrshrn_s)
+DO_2SN(VQRSHRN_U16, gen_helper_neon_uqrshrn_h)
 
-DO_2SN_64(VQRSHRN_U64, gen_helper_neon_rshl_u64, gen_helper_neon_narrow_sat_u32)
-DO_2SN_32(VQRSHRN_U32, gen_helper_neon_rshl_u32, gen_helper_neon_narrow_sat_u16)
-DO_2SN_32(VQRSHRN_U16, gen_helper_neon_rshl_u16, gen_helper_neon_narrow_sat_u8)
-
-static bool do_vshll_2sh(DisasContext *s, arg_2reg_shift *a,
-                         NeonGenWidenFn *widenfn, bool u)
+static bool do_vshll(DisasContext *s, int vd, int vm, int shift,
+                     gen_helper_gvec_2 *fn)
 {
-    TCGv_i64 tmp;
-    TCGv_i32 rm0, rm1;
-    uint64_t widen_mask = 0;
-
+    /* Widening shifts: the helper reads Vm before writing Vd. */
     if (!arm_dc_feature(s, ARM_FEATURE_NEON)) {
         return false;
     }
 
     /* UNDEF accesses to D16-D31 if they don't exist. */
-    if (!dc_isar_feature(aa32_simd_r32, s) &&
-        ((a->vd | a->vm) & 0x10)) {
+    if (!dc_isar_feature(aa32_simd_r32, s) && ((vd | vm) & 0x10)) {
         return false;
     }
 
-    if (a->vd & 1) {
+    if (vd & 1) {
         return false;
     }
 
-    if (!vfp_access_check(s)) {
-        return true;
-    }
-
-    /*
-     * This is a widen-and-shift operation. The shift is always less
-     * than the width of the source type, so after widening the input
-     * vector we can simply shift the whole 64-bit widened register,
-     * and then clear the potential overflow bits resulting from left
-     * bits of the narrow input appearing as right bits of the left
-     * neighbour narrow input. Calculate a mask of bits to clear.
-     */
-    if ((a->shift != 0) && (a->size < 2 || u)) {
-        int esize = 8 << a->size;
-        widen_mask = MAKE_64BIT_MASK(0, esize);
-        widen_mask >>= esize - a->shift;
-        widen_mask = dup_const(a->size + 1, widen_mask);
+    if (!fn) {
+        return false;
     }
 
-    rm0 = tcg_temp_new_i32();
-    rm1 = tcg_temp_new_i32();
-    read_neon_element32(rm0, a->vm, 0, MO_32);
-    read_neon_element32(rm1, a->vm, 1, MO_32);
-    tmp = tcg_temp_new_i64();
-
-    widenfn(tmp, rm0);
-    if (a->shift != 0) {
-        tcg_gen_shli_i64(tmp, tmp, a->shift);
-        tcg_gen_andi_i64(tmp, tmp, ~widen_mask);
+    if (!vfp_access_check(s)) {
+        return true;
     }
-    write_neon_element64(tmp, a->vd, 0, MO_64);
 
-    widenfn(tmp, rm1);
-    if (a->shift != 0) {
-        tcg_gen_shli_i64(tmp, tmp, a->shift);
-        tcg_gen_andi_i64(tmp, tmp, ~widen_mask);
-    }
-    write_neon_element64(tmp, a->vd, 1, MO_64);
+    tcg_gen_gvec_2_ool(neon_full_reg_offset(vd), neon_full_reg_offset(vm),
+                       16, 16, shift, fn);
     return true;
 }
 
 static bool trans_VSHLL_S_2sh(DisasContext *s, arg_2reg_shift *a)
 {
-    static NeonGenWidenFn * const widenfn[] = {
-        gen_helper_neon_widen_s8,
-        gen_helper_neon_widen_s16,
-        tcg_gen_ext_i32_i64,
+    static gen_helper_gvec_2 * const fns[] = {
+        gen_helper_neon_sshll_h,
+        gen_helper_neon_sshll_s,
+        gen_helper_neon_sshll_d,
     };
-    return do_vshll_2sh(s, a, widenfn[a->size], false);
+    return do_vshll(s, a->vd, a->vm, a->shift, fns[a->size]);
 }
 
 static bool trans_VSHLL_U_2sh(DisasContext *s, arg_2reg_shift *a)
 {
-    static NeonGenWidenFn * const widenfn[] = {
-        gen_helper_neon_widen_u8,
-        gen_helper_neon_widen_u16,
-        tcg_gen_extu_i32_i64,
+    static gen_helper_gvec_2 * const fns[] = {
+        gen_helper_neon_ushll_h,
+        gen_helper_neon_ushll_s,
+        gen_helper_neon_ushll_d,
     };
-    return do_vshll_2sh(s, a, widenfn[a->size], true);
+    return do_vshll(s, a->vd, a->vm, a->shift, fns[a->size]);
 }
 
 static bool do_fp_2sh(DisasContext *s, arg_2reg_shift *a,
@@ -2156,87 +1953,68 @@ DO_VMLAL(VMLAL_U,mull_u,add)
 DO_VMLAL(VMLSL_S,mull_s,sub)
 DO_VMLAL(VMLSL_U,mull_u,sub)
 
-static void gen_VQDMULL_16(TCGv_i64 rd, TCGv_i32 rn, TCGv_i32 rm)
-{
-    gen_helper_neon_mull_s16(rd, rn, rm);
-    gen_helper_neon_addl_saturate_s32(rd, tcg_env, rd, rd);
-}
-
-static void gen_VQDMULL_32(TCGv_i64 rd, TCGv_i32 rn, TCGv_i32 rm)
-{
-    gen_mull_s32(rd, rn, rm);
-    gen_helper_neon_addl_saturate_s64(rd, tcg_env, rd, rd);
-}
-
-static bool trans_VQDMULL_3d(DisasContext *s, arg_3diff *a)
+static bool do_long_qc(DisasContext *s, int vd, int vn, int vm,
+                       int size, bool scalar, gen_helper_gvec_3_ptr *fn)
 {
-    static NeonGenTwoOpWidenFn * const opfn[] = {
-        NULL,
-        gen_VQDMULL_16,
-        gen_VQDMULL_32,
-        NULL,
-    };
+    /*
+     * Saturating long operations, 3-regs different lengths or two
+     * registers and a scalar: the helper reads both D register inputs
+     * before writing the Q register destination, and saturates into QC.
+     */
+    int idx = 0;
+    TCGv_ptr qc;
 
-    return do_long_3d(s, a, opfn[a->size], NULL);
-}
+    if (!arm_dc_feature(s, ARM_FEATURE_NEON)) {
+        return false;
+    }
 
-static void gen_VQDMLAL_acc_16(TCGv_i64 rd, TCGv_i64 rn, TCGv_i64 rm)
-{
-    gen_helper_neon_addl_saturate_s32(rd, tcg_env, rn, rm);
-}
+    /* UNDEF accesses to D16-D31 if they don't exist. */
+    if (!dc_isar_feature(aa32_simd_r32, s) && ((vd | vn | vm) & 0x10)) {
+        return false;
+    }
 
-static void gen_VQDMLAL_acc_32(TCGv_i64 rd, TCGv_i64 rn, TCGv_i64 rm)
-{
-    gen_helper_neon_addl_saturate_s64(rd, tcg_env, rn, rm);
-}
+    if (!fn) {
+        /* Bad size (including size == 3, which is a different insn group) */
+        return false;
+    }
 
-static bool trans_VQDMLAL_3d(DisasContext *s, arg_3diff *a)
-{
-    static NeonGenTwoOpWidenFn * const opfn[] = {
-        NULL,
-        gen_VQDMULL_16,
-        gen_VQDMULL_32,
-        NULL,
-    };
-    static NeonGenTwo64OpFn * const accfn[] = {
-        NULL,
-        gen_VQDMLAL_acc_16,
-        gen_VQDMLAL_acc_32,
-        NULL,
-    };
+    if (vd & 1) {
+        return false;
+    }
 
-    return do_long_3d(s, a, opfn[a->size], accfn[a->size]);
-}
+    if (!vfp_access_check(s)) {
+        return true;
+    }
 
-static void gen_VQDMLSL_acc_16(TCGv_i64 rd, TCGv_i64 rn, TCGv_i64 rm)
-{
-    gen_helper_neon_negl_u32(rm, rm);
-    gen_helper_neon_addl_saturate_s32(rd, tcg_env, rn, rm);
-}
+    if (scalar) {
+        /* vm is M:Vm, which encodes both register and index */
+        idx = extract32(vm, size + 2, 2);
+        vm = extract32(vm, 0, size + 2);
+    }
 
-static void gen_VQDMLSL_acc_32(TCGv_i64 rd, TCGv_i64 rn, TCGv_i64 rm)
-{
-    tcg_gen_neg_i64(rm, rm);
-    gen_helper_neon_addl_saturate_s64(rd, tcg_env, rn, rm);
+    qc = tcg_temp_new_ptr();
+    tcg_gen_addi_ptr(qc, tcg_env, offsetof(CPUARMState, vfp.qc));
+    tcg_gen_gvec_3_ptr(neon_full_reg_offset(vd), neon_full_reg_offset(vn),
+                       neon_full_reg_offset(vm), qc, 16, 16, idx, fn);
+    return true;
 }
 
-static bool trans_VQDMLSL_3d(DisasContext *s, arg_3diff *a)
-{
-    static NeonGenTwoOpWidenFn * const opfn[] = {
-        NULL,
-        gen_VQDMULL_16,
-        gen_VQDMULL_32,
-        NULL,
-    };
-    static NeonGenTwo64OpFn * const accfn[] = {
-        NULL,
-        gen_VQDMLSL_acc_16,
-        gen_VQDMLSL_acc_32,
-        NULL,
-    };
+#define DO_LONG_3D_QC(INSN, FUNC)                                       \
+    static bool trans_##INSN##_3d(DisasContext *s, arg_3diff *a)        \
+    {                                                                   \
+        static gen_helper_gvec_3_ptr * const opfn[] = {                 \
+            NULL,                                                       \
+            gen_helper_##FUNC##_h,                                      \
+            gen_helper_##FUNC##_s,                                      \
+            NULL,                                                       \
+        };                                                              \
+        return do_long_qc(s, a->vd, a->vn, a->vm, a->size, false,       \
+                          opfn[a->size]);                               \
+    }
 
-    return do_long_3d(s, a, opfn[a->size], accfn[a->size]);
-}
+DO_LONG_3D_QC(VQDMULL, neon_sqdmull)
+DO_LONG_3D_QC(VQDMLAL, neon_sqdmlal)
+DO_LONG_3D_QC(VQDMLSL, neon_sqdmlsl)
 
 static bool trans_VMULL_P_3d(DisasContext *s, arg_3diff *a)
 {
@@ -2476,61 +2254,31 @@ DO_VMUL_F_2sc(VMUL, gvec_fmul_idx)
 DO_VMUL_F_2sc(VMLA, gvec_fmla_nf_idx)
 DO_VMUL_F_2sc(VMLS, gvec_fmls_nf_idx)
 
-WRAP_ENV_FN(gen_VQDMULH_16, gen_helper_neon_qdmulh_s16)
-WRAP_ENV_FN(gen_VQDMULH_32, gen_helper_neon_qdmulh_s32)
-WRAP_ENV_FN(gen_VQRDMULH_16, gen_helper_neon_qrdmulh_s16)
-WRAP_ENV_FN(gen_VQRDMULH_32, gen_helper_neon_qrdmulh_s32)
-
-static bool trans_VQDMULH_2sc(DisasContext *s, arg_2scalar *a)
-{
-    static NeonGenTwoOpFn * const opfn[] = {
-        NULL,
-        gen_VQDMULH_16,
-        gen_VQDMULH_32,
-        NULL,
-    };
-
-    return do_2scalar(s, a, opfn[a->size], NULL);
-}
-
-static bool trans_VQRDMULH_2sc(DisasContext *s, arg_2scalar *a)
-{
-    static NeonGenTwoOpFn * const opfn[] = {
-        NULL,
-        gen_VQRDMULH_16,
-        gen_VQRDMULH_32,
-        NULL,
-    };
-
-    return do_2scalar(s, a, opfn[a->size], NULL);
-}
-
-static bool do_vqrdmlah_2sc(DisasContext *s, arg_2scalar *a,
-                            NeonGenThreeOpEnvFn *opfn)
+static bool do_2scalar_qc(DisasContext *s, arg_2scalar *a,
+                          gen_helper_gvec_3_ptr *fn)
 {
     /*
-     * VQRDMLAH/VQRDMLSH: this is like do_2scalar, but the opfn
-     * performs a kind of fused op-then-accumulate using a helper
-     * function that takes all of rd, rn and the scalar at once.
+     * Two registers and a scalar, saturating into QC: like
+     * do_2scalar_fp_vec, but the pointer passed is to vfp.qc.
      */
-    TCGv_i32 scalar, rn, rd;
-    int pass;
+    int vec_size = a->q ? 16 : 8;
+    int rd_ofs = neon_full_reg_offset(a->vd);
+    int rn_ofs = neon_full_reg_offset(a->vn);
+    int rm_ofs;
+    int idx;
+    TCGv_ptr qc;
 
     if (!arm_dc_feature(s, ARM_FEATURE_NEON)) {
         return false;
     }
 
-    if (!dc_isar_feature(aa32_rdm, s)) {
-        return false;
-    }
-
     /* UNDEF accesses to D16-D31 if they don't exist. */
     if (!dc_isar_feature(aa32_simd_r32, s) &&
         ((a->vd | a->vn | a->vm) & 0x10)) {
         return false;
     }
 
-    if (!opfn) {
+    if (!fn) {
         /* Bad size (including size == 3, which is a different insn group) */
         return false;
     }
@@ -2543,40 +2291,37 @@ static bool do_vqrdmlah_2sc(DisasContext *s, arg_2scalar *a,
         return true;
     }
 
-    scalar = neon_get_scalar(a->size, a->vm);
-    rn = tcg_temp_new_i32();
-    rd = tcg_temp_new_i32();
+    /* a->vm is M:Vm, which encodes both register and index */
+    idx = extract32(a->vm, a->size + 2, 2);
+    a->vm = extract32(a->vm, 0, a->size + 2);
+    rm_ofs = neon_full_reg_offset(a->vm);
 
-    for (pass = 0; pass < (a->q ? 4 : 2); pass++) {
-        read_neon_element32(rn, a->vn, pass, MO_32);
-        read_neon_element32(rd, a->vd, pass, MO_32);
-        opfn(rd, tcg_env, rn, scalar, rd);
-        write_neon_element32(rd, a->vd, pass, MO_32);
-    }
+    qc = tcg_temp_new_ptr();
+    tcg_gen_addi_ptr(qc, tcg_env, offsetof(CPUARMState, vfp.qc));
+    tcg_gen_gvec_3_ptr(rd_ofs, rn_ofs, rm_ofs, qc,
+                       vec_size, vec_size, idx, fn);
     return true;
 }
 
-static bool trans_VQRDMLAH_2sc(DisasContext *s, arg_2scalar *a)
-{
-    static NeonGenThreeOpEnvFn *opfn[] = {
-        NULL,
-        gen_helper_neon_qrdmlah_s16,
-        gen_helper_neon_qrdmlah_s32,
-        NULL,
-    };
-    return do_vqrdmlah_2sc(s, a, opfn[a->size]);
-}
+#define DO_2SCALAR_QC(INSN, FUNC, FEAT)                                 \
+    static bool trans_##INSN##_2sc(DisasContext *s, arg_2scalar *a)     \
+    {                                                                   \
+        static gen_helper_gvec_3_ptr * const opfn[] = {                 \
+            NULL,                                                       \
+            gen_helper_##FUNC##_h,                                      \
+            gen_helper_##FUNC##_s,                                      \
+            NULL,                                                       \
+        };                                                              \
+        if (!FEAT) {                                                    \
+            return false;                                               \
+        }                                                               \
+        return do_2scalar_qc(s, a, opfn[a->size]);                      \
+    }
 
-static bool trans_VQRDMLSH_2sc(DisasContext *s, arg_2scalar *a)
-{
-    static NeonGenThreeOpEnvFn *opfn[] = {
-        NULL,
-        gen_helper_neon_qrdmlsh_s16,
-        gen_helper_neon_qrdmlsh_s32,
-        NULL,
-    };
-    return do_vqrdmlah_2sc(s, a, opfn[a->size]);
-}
+DO_2SCALAR_QC(VQDMULH, neon_sqdmulh_idx, true)
+DO_2SCALAR_QC(VQRDMULH, neon_sqrdmulh_idx, true)
+DO_2SCALAR_QC(VQRDMLAH, neon_sqrdmlah_idx, dc_isar_feature(aa32_rdm, s))
+DO_2SCALAR_QC(VQRDMLSH, neon_sqrdmlsh_idx, dc_isar_feature(aa32_rdm, s))
 
 static bool do_2scalar_long(DisasContext *s, arg_2scalar *a,
                             NeonGenTwoOpWidenFn *opfn,
@@ -2686,53 +2431,22 @@ DO_VMLAL_2SC(VMLAL_U, mull_u, add)
 DO_VMLAL_2SC(VMLSL_S, mull_s, sub)
 DO_VMLAL_2SC(VMLSL_U, mull_u, sub)
 
-static bool trans_VQDMULL_2sc(DisasContext *s, arg_2scalar *a)
-{
-    static NeonGenTwoOpWidenFn * const opfn[] = {
-        NULL,
-        gen_VQDMULL_16,
-        gen_VQDMULL_32,
-        NULL,
-    };
-
-    return do_2scalar_long(s, a, opfn[a->size], NULL);
-}
-
-static bool trans_VQDMLAL_2sc(DisasContext *s, arg_2scalar *a)
-{
-    static NeonGenTwoOpWidenFn * const opfn[] = {
-        NULL,
-        gen_VQDMULL_16,
-        gen_VQDMULL_32,
-        NULL,
-    };
-    static NeonGenTwo64OpFn * const accfn[] = {
-        NULL,
-        gen_VQDMLAL_acc_16,
-        gen_VQDMLAL_acc_32,
-        NULL,
-    };
-
-    return do_2scalar_long(s, a, opfn[a->size], accfn[a->size]);
-}
-
-static bool trans_VQDMLSL_2sc(DisasContext *s, arg_2scalar *a)
-{
-    static NeonGenTwoOpWidenFn * const opfn[] = {
-        NULL,
-        gen_VQDMULL_16,
-        gen_VQDMULL_32,
-        NULL,
-    };
-    static NeonGenTwo64OpFn * const accfn[] = {
-        NULL,
-        gen_VQDMLSL_acc_16,
-        gen_VQDMLSL_acc_32,
-        NULL,
-    };
+#define DO_LONG_2SC_QC(INSN, FUNC)                                      \
+    static bool trans_##INSN##_2sc(DisasContext *s, arg_2scalar *a)     \
+    {                                                                   \
+        static gen_helper_gvec_3_ptr * const opfn[] = {                 \
+            NULL,                                                       \
+            gen_helper_##FUNC##_idx_h,                                  \
+            gen_helper_##FUNC##_idx_s,                                  \
+            NULL,                                                       \
+        };                                                              \
+        return do_long_qc(s, a->vd, a->vn, a->vm, a->size, true,        \
+                          opfn[a->size]);                               \
+    }
 
-    return do_2scalar_long(s, a, opfn[a->size], accfn[a->size]);
-}
+DO_LONG_2SC_QC(VQDMULL, neon_sqdmull)
+DO_LONG_2SC_QC(VQDMLAL, neon_sqdmlal)
+DO_LONG_2SC_QC(VQDMLSL, neon_sqdmlsl)
 
 static bool trans_VEXT(DisasContext *s, arg_VEXT *a)
 {
@@ -2802,9 +2516,6 @@ static bool trans_VEXT(DisasContext *s, arg_VEXT *a)
 
 static bool trans_VTBL(DisasContext *s, arg_VTBL *a)
 {
-    TCGv_i64 val, def;
-    TCGv_i32 desc;
-
     if (!arm_dc_feature(s, ARM_FEATURE_NEON)) {
         return false;
     }
@@ -2827,18 +2538,10 @@ static bool trans_VTBL(DisasContext *s, arg_VTBL *a)
         return true;
     }
 
-    desc = tcg_constant_i32((a->vn << 2) | a->len);
-    def = tcg_temp_new_i64();
-    if (a->op) {
-        read_neon_element64(def, a->vd, 0, MO_64);
-    } else {
-        tcg_gen_movi_i64(def, 0);
-    }
-    val = tcg_temp_new_i64();
-    read_neon_element64(val, a->vm, 0, MO_64);
-
-    gen_helper_neon_tbl(val, tcg_env, desc, val, def);
-    write_neon_element64(val, a->vd, 0, MO_64);
+    tcg_gen_gvec_2_ptr(neon_full_reg_offset(a->vd),
+                       neon_full_reg_offset(a->vm), tcg_env, 8, 8,
+                       (a->vn << 3) | (a->len << 1) | a->op,
+                       gen_helper_neon_tbl);
     return true;
 }
 
@@ -2920,152 +2623,6 @@ static bool trans_VREV64(DisasContext *s, arg_VREV64 *a)
     return true;
 }
 
-static bool do_2misc_pairwise(DisasContext *s, arg_2misc *a,
-                              NeonGenWidenFn *widenfn,
-                              NeonGenTwo64OpFn *opfn,
-                              NeonGenTwo64OpFn *accfn)
-{
-    /*
-     * Pairwise long operations: widen both halves of the pair,
-     * combine the pairs with the opfn, and then possibly accumulate
-     * into the destination with the accfn.
-     */
-    int pass;
-
-    if (!arm_dc_feature(s, ARM_FEATURE_NEON)) {
-        return false;
-    }
-
-    /* UNDEF accesses to D16-D31 if they don't exist. */
-    if (!dc_isar_feature(aa32_simd_r32, s) &&
-        ((a->vd | a->vm) & 0x10)) {
-        return false;
-    }
-
-    if ((a->vd | a->vm) & a->q) {
-        return false;
-    }
-
-    if (!widenfn) {
-        return false;
-    }
-
-    if (!vfp_access_check(s)) {
-        return true;
-    }
-
-    for (pass = 0; pass < a->q + 1; pass++) {
-        TCGv_i32 tmp;
-        TCGv_i64 rm0_64, rm1_64, rd_64;
-
-        rm0_64 = tcg_temp_new_i64();
-        rm1_64 = tcg_temp_new_i64();
-        rd_64 = tcg_temp_new_i64();
-
-        tmp = tcg_temp_new_i32();
-        read_neon_element32(tmp, a->vm, pass * 2, MO_32);
-        widenfn(rm0_64, tmp);
-        read_neon_element32(tmp, a->vm, pass * 2 + 1, MO_32);
-        widenfn(rm1_64, tmp);
-
-        opfn(rd_64, rm0_64, rm1_64);
-
-        if (accfn) {
-            TCGv_i64 tmp64 = tcg_temp_new_i64();
-            read_neon_element64(tmp64, a->vd, pass, MO_64);
-            accfn(rd_64, tmp64, rd_64);
-        }
-        write_neon_element64(rd_64, a->vd, pass, MO_64);
-    }
-    return true;
-}
-
-static bool trans_VPADDL_S(DisasContext *s, arg_2misc *a)
-{
-    static NeonGenWidenFn * const widenfn[] = {
-        gen_helper_neon_widen_s8,
-        gen_helper_neon_widen_s16,
-        tcg_gen_ext_i32_i64,
-        NULL,
-    };
-    static NeonGenTwo64OpFn * const opfn[] = {
-        gen_helper_neon_paddl_u16,
-        gen_helper_neon_paddl_u32,
-        tcg_gen_add_i64,
-        NULL,
-    };
-
-    return do_2misc_pairwise(s, a, widenfn[a->size], opfn[a->size], NULL);
-}
-
-static bool trans_VPADDL_U(DisasContext *s, arg_2misc *a)
-{
-    static NeonGenWidenFn * const widenfn[] = {
-        gen_helper_neon_widen_u8,
-        gen_helper_neon_widen_u16,
-        tcg_gen_extu_i32_i64,
-        NULL,
-    };
-    static NeonGenTwo64OpFn * const opfn[] = {
-        gen_helper_neon_paddl_u16,
-        gen_helper_neon_paddl_u32,
-        tcg_gen_add_i64,
-        NULL,
-    };
-
-    return do_2misc_pairwise(s, a, widenfn[a->size], opfn[a->size], NULL);
-}
-
-static bool trans_VPADAL_S(DisasContext *s, arg_2misc *a)
-{
-    static NeonGenWidenFn * const widenfn[] = {
-        gen_helper_neon_widen_s8,
-        gen_helper_neon_widen_s16,
-        tcg_gen_ext_i32_i64,
-        NULL,
-    };
-    static NeonGenTwo64OpFn * const opfn[] = {
-        gen_helper_neon_paddl_u16,
-        gen_helper_neon_paddl_u32,
-        tcg_gen_add_i64,
-        NULL,
-    };
-    static NeonGenTwo64OpFn * const accfn[] = {
-        gen_helper_neon_addl_u16,
-        gen_helper_neon_addl_u32,
-        tcg_gen_add_i64,
-        NULL,
-    };
-
-    return do_2misc_pairwise(s, a, widenfn[a->size], opfn[a->size],
-                             accfn[a->size]);
-}
-
-static bool trans_VPADAL_U(DisasContext *s, arg_2misc *a)
-{
-    static NeonGenWidenFn * const widenfn[] = {
-        gen_helper_neon_widen_u8,
-        gen_helper_neon_widen_u16,
-        tcg_gen_extu_i32_i64,
-        NULL,
-    };
-    static NeonGenTwo64OpFn * const opfn[] = {
-        gen_helper_neon_paddl_u16,
-        gen_helper_neon_paddl_u32,
-        tcg_gen_add_i64,
-        NULL,
-    };
-    static NeonGenTwo64OpFn * const accfn[] = {
-        gen_helper_neon_addl_u16,
-        gen_helper_neon_addl_u32,
-        tcg_gen_add_i64,
-        NULL,
-    };
-
-    return do_2misc_pairwise(s, a, widenfn[a->size], opfn[a->size],
-                             accfn[a->size]);
-}
-
 typedef void ZipFn(TCGv_ptr, TCGv_ptr);
 
 static bool do_zip_uzp(DisasContext *s, arg_2misc *a,
@@ -3138,112 +2695,32 @@ static bool trans_VZIP(DisasContext *s, arg_2misc *a)
     return do_zip_uzp(s, a, fn[a->q][a->size]);
 }
 
-static bool do_vmovn(DisasContext *s, arg_2misc *a,
-                     NeonGenNarrowEnvFn *narrowfn)
-{
-    TCGv_i64 rm;
-    TCGv_i32 rd0, rd1;
-
-    if (!arm_dc_feature(s, ARM_FEATURE_NEON)) {
-        return false;
-    }
-
-    /* UNDEF accesses to D16-D31 if they don't exist. */
-    if (!dc_isar_feature(aa32_simd_r32, s) &&
-        ((a->vd | a->vm) & 0x10)) {
-        return false;
-    }
-
-    if (a->vm & 1) {
-        return false;
-    }
-
-    if (!narrowfn) {
-        return false;
-    }
-
-    if (!vfp_access_check(s)) {
-        return true;
-    }
-
-    rm = tcg_temp_new_i64();
-    rd0 = tcg_temp_new_i32();
-    rd1 = tcg_temp_new_i32();
-
-    read_neon_element64(rm, a->vm, 0, MO_64);
-    narrowfn(rd0, tcg_env, rm);
-    read_neon_element64(rm, a->vm, 1, MO_64);
-    narrowfn(rd1, tcg_env, rm);
-    write_neon_element32(rd0, a->vd, 0, MO_32);
-    write_neon_element32(rd1, a->vd, 1, MO_32);
-    return true;
-}
-
-#define DO_VMOVN(INSN, FUNC)                                    \
-    static bool trans_##INSN(DisasContext *s, arg_2misc *a)     \
-    {                                                           \
-        static NeonGenNarrowEnvFn * const narrowfn[] = {        \
-            FUNC##8,                                            \
-            FUNC##16,                                           \
-            FUNC##32,                                           \
-            NULL,                                               \
-        };                                                      \
-        return do_vmovn(s, a, narrowfn[a->size]);               \
+#define DO_VMOVN(INSN, FUNC)                                            \
+    static bool trans_##INSN(DisasContext *s, arg_2misc *a)             \
+    {                                                                   \
+        static gen_helper_gvec_2_ptr * const fns[] = {                  \
+            gen_helper_neon_##FUNC##_h,                                 \
+            gen_helper_neon_##FUNC##_s,                                 \
+            gen_helper_neon_##FUNC##_d,                                 \
+            NULL,                                                       \
+        };                                                              \
+        return do_2shift_narrow(s, a->vd, a->vm, 0, fns[a->size]);      \
     }
 
-DO_VMOVN(VMOVN, gen_neon_narrow_u)
-DO_VMOVN(VQMOVUN, gen_helper_neon_unarrow_sat)
-DO_VMOVN(VQMOVN_S, gen_helper_neon_narrow_sat_s)
-DO_VMOVN(VQMOVN_U, gen_helper_neon_narrow_sat_u)
+DO_VMOVN(VMOVN, shrn)
+DO_VMOVN(VQMOVUN, sqshrun)
+DO_VMOVN(VQMOVN_S, sqshrn)
+DO_VMOVN(VQMOVN_U, uqshrn)
 
 static bool trans_VSHLL(DisasContext *s, arg_2misc *a)
 {
-    TCGv_i32 rm0, rm1;
-    TCGv_i64 rd;
-    static NeonGenWidenFn * const widenfns[] = {
-        gen_helper_neon_widen_u8,
-        gen_helper_neon_widen_u16,
-        tcg_gen_extu_i32_i64,
+    static gen_helper_gvec_2 * const fns[] = {
+        gen_helper_neon_ushll_h,
+        gen_helper_neon_ushll_s,
+        gen_helper_neon_ushll_d,
         NULL,
     };
-    NeonGenWidenFn *widenfn = widenfns[a->size];
-
-    if (!arm_dc_feature(s, ARM_FEATURE_NEON)) {
-        return false;
-    }
-
-    /* UNDEF accesses to D16-D31 if they don't exist. */
-    if (!dc_isar_feature(aa32_simd_r32, s) &&
-        ((a->vd | a->vm) & 0x10)) {
-        return false;
-    }
-
-    if (a->vd & 1) {
-        return false;
-    }
-
-    if (!widenfn) {
-        return false;
-    }
-
-    if (!vfp_access_check(s)) {
-        return true;
-    }
-
-    rd = tcg_temp_new_i64();
-    rm0 = tcg_temp_new_i32();
-    rm1 = tcg_temp_new_i32();
-
-    read_neon_element32(rm0, a->vm, 0, MO_32);
-    read_neon_element32(rm1, a->vm, 1, MO_32);
-
-    widenfn(rd, rm0);
-    tcg_gen_shli_i64(rd, rd, 8 << a->size);
-    write_neon_element64(rd, a->vd, 0, MO_64);
-    widenfn(rd, rm1);
-    tcg_gen_shli_i64(rd, rd, 8 << a->size);
-    write_neon_element64(rd, a->vd, 1, MO_64);
-    return true;
+    return do_vshll(s, a->vd, a->vm, 8 << a->size, fns[a->size]);
 }
 
 static bool trans_VCVT_B16_F32(DisasContext *s, arg_2misc *a)
@@ -3424,6 +2901,10 @@ DO_2MISC_VEC(VCGT0, gen_gvec_cgt0)
 DO_2MISC_VEC(VCLE0, gen_gvec_cle0)
 DO_2MISC_VEC(VCGE0, gen_gvec_cge0)
 DO_2MISC_VEC(VCLT0, gen_gvec_clt0)
+DO_2MISC_VEC(VPADDL_S, gen_gvec_saddlp)
+DO_2MISC_VEC(VPADDL_U, gen_gvec_uaddlp)
+DO_2MISC_VEC(VPADAL_S, gen_gvec_sadalp)
+DO_2MISC_VEC(VPADAL_U, gen_gvec_uadalp)
 
 static bool trans_VMVN(DisasContext *s, arg_2misc *a)
 {
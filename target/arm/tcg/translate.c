@@ -4274,6 +4274,84 @@ void gen_gvec_sqsub_qc(unsigned vece, uint32_t rd_ofs, uint32_t rn_ofs,
                    rn_ofs, rm_ofs, opr_sz, max_sz, &ops[vece]);
 }
 
+/*
+ * The doubled product only overflows for MIN * MIN, so the lanes that
+ * saturate can be found from the inputs without widening.
+ */
+static void gen_sqdmulh_sat(unsigned vece, TCGv_vec sat,
+                            TCGv_vec a, TCGv_vec b)
+{
+    int64_t min_val = MAKE_64BIT_MASK((8 << vece) - 1, 1);
+    TCGv_vec min = tcg_constant_vec_matching(sat, vece, min_val);
+    TCGv_vec x = tcg_temp_new_vec_matching(sat);
+    TCGv_vec y = tcg_temp_new_vec_matching(sat);
+
+    tcg_gen_cmp_vec(TCG_COND_EQ, vece, x, a, min);
+    tcg_gen_cmp_vec(TCG_COND_EQ, vece, y, b, min);
+    tcg_gen_and_vec(vece, x, x, y);
+    tcg_gen_or_vec(vece, sat, sat, x);
+}
+
+static void gen_sqdmulh_vec(unsigned vece, TCGv_vec t, TCGv_vec sat,
+                            TCGv_vec a, TCGv_vec b)
+{
+    gen_sqdmulh_sat(vece, sat, a, b);
+    tcg_gen_sqdmulh_vec(vece, t, a, b);
+}
+
+void gen_gvec_sqdmulh_qc(unsigned vece, uint32_t rd_ofs, uint32_t rn_ofs,
+                         uint32_t rm_ofs, uint32_t opr_sz, uint32_t max_sz)
+{
+    static const TCGOpcode vecop_list[] = {
+        INDEX_op_sqdmulh_vec, INDEX_op_cmp_vec, 0
+    };
+    static const GVecGen4 ops[2] = {
+        { .fniv = gen_sqdmulh_vec,
+          .fno = gen_helper_neon_sqdmulh_h,
+          .write_aofs = true,
+          .opt_opc = vecop_list,
+          .vece = MO_16 },
+        { .fniv = gen_sqdmulh_vec,
+          .fno = gen_helper_neon_sqdmulh_s,
+          .write_aofs = true,
+          .opt_opc = vecop_list,
+          .vece = MO_32 },
+    };
+    tcg_debug_assert(vece >= MO_16 && vece <= MO_32);
+    tcg_gen_gvec_4(rd_ofs, offsetof(CPUARMState, vfp.qc),
+                   rn_ofs, rm_ofs, opr_sz, max_sz, &ops[vece - MO_16]);
+}
+
+static void gen_sqrdmulh_vec(unsigned vece, TCGv_vec t, TCGv_vec sat,
+                             TCGv_vec a, TCGv_vec b)
+{
+    gen_sqdmulh_sat(vece, sat, a, b);
+    tcg_gen_sqrdmulh_vec(vece, t, a, b);
+}
+
+void gen_gvec_sqrdmulh_qc(unsigned vece, uint32_t rd_ofs, uint32_t rn_ofs,
+                          uint32_t rm_ofs, uint32_t opr_sz, uint32_t max_sz)
+{
+    static const TCGOpcode vecop_list[] = {
+        INDEX_op_sqrdmulh_vec, INDEX_op_cmp_vec, 0
+    };
+    static const GVecGen4 ops[2] = {
+        { .fniv = gen_sqrdmulh_vec,
+          .fno = gen_helper_neon_sqrdmulh_h,
+          .write_aofs = true,
+          .opt_opc = vecop_list,
+          .vece = MO_16 },
+        { .fniv = gen_sqrdmulh_vec,
+          .fno = gen_helper_neon_sqrdmulh_s,
+          .write_aofs = true,
+          .opt_opc = vecop_list,
+          .vece = MO_32 },
+    };
+    tcg_debug_assert(vece >= MO_16 && vece <= MO_32);
+    tcg_gen_gvec_4(rd_ofs, offsetof(CPUARMState, vfp.qc),
+                   rn_ofs, rm_ofs, opr_sz, max_sz, &ops[vece - MO_16]);
+}
+
 static void gen_sabd_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
 {
     TCGv_i32 t = tcg_temp_new_i32();
@@ -4500,6 +4578,336 @@ void gen_gvec_uaba(unsigned vece, uint32_t rd_ofs, uint32_t rn_ofs,
     tcg_gen_gvec_3(rd_ofs, rn_ofs, rm_ofs, opr_sz, max_sz, &ops[vece]);
 }
 
+/*
+ * Halving add/sub without widening: compute each operand shifted right
+ * by one, and recover the carry out of bit 0 separately.
+ *   HADD:  (a >> 1) + (b >> 1) + (a & b & 1)
+ *   RHADD: (a >> 1) + (b >> 1) + ((a | b) & 1)
+ *   HSUB:  (a >> 1) - (b >> 1) - (~a & b & 1)
+ * The signed and unsigned forms differ only in the shift.
+ */
+static void gen_shadd_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+    TCGv_i32 u = tcg_temp_new_i32();
+
+    tcg_gen_and_i32(t, a, b);
+    tcg_gen_andi_i32(t, t, 1);
+    tcg_gen_sari_i32(u, a, 1);
+    tcg_gen_sari_i32(d, b, 1);
+    tcg_gen_add_i32(d, d, u);
+    tcg_gen_add_i32(d, d, t);
+}
+
+static void gen_uhadd_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+    TCGv_i32 u = tcg_temp_new_i32();
+
+    tcg_gen_and_i32(t, a, b);
+    tcg_gen_andi_i32(t, t, 1);
+    tcg_gen_shri_i32(u, a, 1);
+    tcg_gen_shri_i32(d, b, 1);
+    tcg_gen_add_i32(d, d, u);
+    tcg_gen_add_i32(d, d, t);
+}
+
+static void gen_srhadd_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+    TCGv_i32 u = tcg_temp_new_i32();
+
+    tcg_gen_or_i32(t, a, b);
+    tcg_gen_andi_i32(t, t, 1);
+    tcg_gen_sari_i32(u, a, 1);
+    tcg_gen_sari_i32(d, b, 1);
+    tcg_gen_add_i32(d, d, u);
+    tcg_gen_add_i32(d, d, t);
+}
+
+static void gen_urhadd_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+    TCGv_i32 u = tcg_temp_new_i32();
+
+    tcg_gen_or_i32(t, a, b);
+    tcg_gen_andi_i32(t, t, 1);
+    tcg_gen_shri_i32(u, a, 1);
+    tcg_gen_shri_i32(d, b, 1);
+    tcg_gen_add_i32(d, d, u);
+    tcg_gen_add_i32(d, d, t);
+}
+
+static void gen_shsub_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+    TCGv_i32 u = tcg_temp_new_i32();
+
+    tcg_gen_andc_i32(t, b, a);
+    tcg_gen_andi_i32(t, t, 1);
+    tcg_gen_sari_i32(u, a, 1);
+    tcg_gen_sari_i32(d, b, 1);
+    tcg_gen_sub_i32(d, u, d);
+    tcg_gen_sub_i32(d, d, t);
+}
+
+static void gen_uhsub_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+    TCGv_i32 u = tcg_temp_new_i32();
+
+    tcg_gen_andc_i32(t, b, a);
+    tcg_gen_andi_i32(t, t, 1);
+    tcg_gen_shri_i32(u, a, 1);
+    tcg_gen_shri_i32(d, b, 1);
+    tcg_gen_sub_i32(d, u, d);
+    tcg_gen_sub_i32(d, d, t);
+}
+
+static void gen_hadd_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b,
+                         bool sign, bool round)
+{
+    TCGv_vec t = tcg_temp_new_vec_matching(d);
+    TCGv_vec u = tcg_temp_new_vec_matching(d);
+
+    if (round) {
+        tcg_gen_or_vec(vece, t, a, b);
+    } else {
+        tcg_gen_and_vec(vece, t, a, b);
+    }
+    tcg_gen_and_vec(vece, t, t, tcg_constant_vec_matching(d, vece, 1));
+    if (sign) {
+        tcg_gen_sari_vec(vece, u, a, 1);
+        tcg_gen_sari_vec(vece, d, b, 1);
+    } else {
+        tcg_gen_shri_vec(vece, u, a, 1);
+        tcg_gen_shri_vec(vece, d, b, 1);
+    }
+    tcg_gen_add_vec(vece, d, d, u);
+    tcg_gen_add_vec(vece, d, d, t);
+}
+
+static void gen_shadd_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b)
+{
+    gen_hadd_vec(vece, d, a, b, true, false);
+}
+
+static void gen_uhadd_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b)
+{
+    gen_hadd_vec(vece, d, a, b, false, false);
+}
+
+static void gen_srhadd_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b)
+{
+    gen_hadd_vec(vece, d, a, b, true, true);
+}
+
+static void gen_urhadd_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b)
+{
+    gen_hadd_vec(vece, d, a, b, false, true);
+}
+
+static void gen_hsub_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b,
+                         bool sign)
+{
+    TCGv_vec t = tcg_temp_new_vec_matching(d);
+    TCGv_vec u = tcg_temp_new_vec_matching(d);
+
+    tcg_gen_andc_vec(vece, t, b, a);
+    tcg_gen_and_vec(vece, t, t, tcg_constant_vec_matching(d, vece, 1));
+    if (sign) {
+        tcg_gen_sari_vec(vece, u, a, 1);
+        tcg_gen_sari_vec(vece, d, b, 1);
+    } else {
+        tcg_gen_shri_vec(vece, u, a, 1);
+        tcg_gen_shri_vec(vece, d, b, 1);
+    }
+    tcg_gen_sub_vec(vece, d, u, d);
+    tcg_gen_sub_vec(vece, d, d, t);
+}
+
+static void gen_shsub_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b)
+{
+    gen_hsub_vec(vece, d, a, b, true);
+}
+
+static void gen_uhsub_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b)
+{
+    gen_hsub_vec(vece, d, a, b, false);
+}
+
+#define GEN_GVEC_HALVING(NAME, ADDSUB, SHIFT)                           \
+void gen_gvec_##NAME(unsigned vece, uint32_t rd_ofs, uint32_t rn_ofs,   \
+                     uint32_t rm_ofs, uint32_t opr_sz, uint32_t max_sz) \
+{                                                                       \
+    static const TCGOpcode vecop_list[] = {                             \
+        SHIFT, ADDSUB, 0                                                \
+    };                                                                  \
+    static const GVecGen3 ops[3] = {                                    \
+        { .fniv = gen_##NAME##_vec,                                     \
+          .fno = gen_helper_gvec_##NAME##_b,                            \
+          .opt_opc = vecop_list,                                        \
+          .vece = MO_8 },                                               \
+        { .fniv = gen_##NAME##_vec,                                     \
+          .fno = gen_helper_gvec_##NAME##_h,                            \
+          .opt_opc = vecop_list,                                        \
+          .vece = MO_16 },                                              \
+        { .fni4 = gen_##NAME##_i32,                                     \
+          .fniv = gen_##NAME##_vec,                                     \
+          .fno = gen_helper_gvec_##NAME##_s,                            \
+          .opt_opc = vecop_list,                                        \
+          .vece = MO_32 },                                              \
+    };                                                                  \
+    tcg_debug_assert(vece <= MO_32);                                    \
+    tcg_gen_gvec_3(rd_ofs, rn_ofs, rm_ofs, opr_sz, max_sz, &ops[vece]); \
+}
+
+GEN_GVEC_HALVING(shadd, INDEX_op_add_vec, INDEX_op_sari_vec)
+GEN_GVEC_HALVING(uhadd, INDEX_op_add_vec, INDEX_op_shri_vec)
+GEN_GVEC_HALVING(srhadd, INDEX_op_add_vec, INDEX_op_sari_vec)
+GEN_GVEC_HALVING(urhadd, INDEX_op_add_vec, INDEX_op_shri_vec)
+GEN_GVEC_HALVING(shsub, INDEX_op_sub_vec, INDEX_op_sari_vec)
+GEN_GVEC_HALVING(uhsub, INDEX_op_sub_vec, INDEX_op_shri_vec)
+
+#undef GEN_GVEC_HALVING
+
+#define GEN_GVEC_PAIR(NAME)                                             \
+void gen_gvec_##NAME(unsigned vece, uint32_t rd_ofs, uint32_t rn_ofs,   \
+                     uint32_t rm_ofs, uint32_t opr_sz, uint32_t max_sz) \
+{                                                                       \
+    static gen_helper_gvec_3 * const fns[3] = {                         \
+        gen_helper_gvec_##NAME##_b,                                     \
+        gen_helper_gvec_##NAME##_h,                                     \
+        gen_helper_gvec_##NAME##_s,                                     \
+    };                                                                  \
+    tcg_debug_assert(vece <= MO_32);                                    \
+    tcg_gen_gvec_3_ool(rd_ofs, rn_ofs, rm_ofs, opr_sz, max_sz, 0,       \
+                       fns[vece]);                                      \
+}
+
+GEN_GVEC_PAIR(addp)
+GEN_GVEC_PAIR(smaxp)
+GEN_GVEC_PAIR(sminp)
+GEN_GVEC_PAIR(umaxp)
+GEN_GVEC_PAIR(uminp)
+
+#undef GEN_GVEC_PAIR
+
+/*
+ * Pairwise add long.  Viewed as vectors of the double-width type, each
+ * result element is the sum of the high and low halves of the input
+ * element, which needs no permutation.  The gen_gvec_* entry points
+ * take the size of the narrow source elements, as for the Neon decode;
+ * the inline expanders below are passed the double-width size.
+ */
+static void gen_saddlp_vec(unsigned vece, TCGv_vec d, TCGv_vec n)
+{
+    int half = 4 << vece;
+    TCGv_vec t = tcg_temp_new_vec_matching(d);
+
+    tcg_gen_shli_vec(vece, t, n, half);
+    tcg_gen_sari_vec(vece, d, n, half);
+    tcg_gen_sari_vec(vece, t, t, half);
+    tcg_gen_add_vec(vece, d, d, t);
+}
+
+static void gen_uaddlp_vec(unsigned vece, TCGv_vec d, TCGv_vec n)
+{
+    int half = 4 << vece;
+    TCGv_vec t = tcg_temp_new_vec_matching(d);
+    TCGv_vec m = tcg_constant_vec_matching(d, vece,
+                                           MAKE_64BIT_MASK(0, half));
+
+    tcg_gen_shri_vec(vece, t, n, half);
+    tcg_gen_and_vec(vece, d, n, m);
+    tcg_gen_add_vec(vece, d, d, t);
+}
+
+static void gen_sadalp_vec(unsigned vece, TCGv_vec d, TCGv_vec n)
+{
+    TCGv_vec t = tcg_temp_new_vec_matching(d);
+
+    gen_saddlp_vec(vece, t, n);
+    tcg_gen_add_vec(vece, d, d, t);
+}
+
+static void gen_uadalp_vec(unsigned vece, TCGv_vec d, TCGv_vec n)
+{
+    TCGv_vec t = tcg_temp_new_vec_matching(d);
+
+    gen_uaddlp_vec(vece, t, n);
+    tcg_gen_add_vec(vece, d, d, t);
+}
+
+static void gen_saddlp_s_i64(TCGv_i64 d, TCGv_i64 n)
+{
+    TCGv_i64 t = tcg_temp_new_i64();
+
+    tcg_gen_ext32s_i64(t, n);
+    tcg_gen_sari_i64(d, n, 32);
+    tcg_gen_add_i64(d, d, t);
+}
+
+static void gen_uaddlp_s_i64(TCGv_i64 d, TCGv_i64 n)
+{
+    TCGv_i64 t = tcg_temp_new_i64();
+
+    tcg_gen_ext32u_i64(t, n);
+    tcg_gen_shri_i64(d, n, 32);
+    tcg_gen_add_i64(d, d, t);
+}
+
+static void gen_sadalp_s_i64(TCGv_i64 d, TCGv_i64 n)
+{
+    TCGv_i64 t = tcg_temp_new_i64();
+
+    gen_saddlp_s_i64(t, n);
+    tcg_gen_add_i64(d, d, t);
+}
+
+static void gen_uadalp_s_i64(TCGv_i64 d, TCGv_i64 n)
+{
+    TCGv_i64 t = tcg_temp_new_i64();
+
+    gen_uaddlp_s_i64(t, n);
+    tcg_gen_add_i64(d, d, t);
+}
+
+#define GEN_GVEC_ADDLP(NAME, SHIFT, ACC)                                \
+void gen_gvec_##NAME(unsigned vece, uint32_t rd_ofs, uint32_t rn_ofs,   \
+                     uint32_t opr_sz, uint32_t max_sz)                  \
+{                                                                       \
+    static const TCGOpcode vecop_list[] = {                             \
+        INDEX_op_shli_vec, SHIFT, INDEX_op_add_vec, 0                   \
+    };                                                                  \
+    static const GVecGen2 ops[3] = {                                    \
+        { .fniv = gen_##NAME##_vec,                                     \
+          .fno = gen_helper_gvec_##NAME##_b,                            \
+          .opt_opc = vecop_list,                                        \
+          .load_dest = ACC,                                             \
+          .vece = MO_16 },                                              \
+        { .fniv = gen_##NAME##_vec,                                     \
+          .fno = gen_helper_gvec_##NAME##_h,                            \
+          .opt_opc = vecop_list,                                        \
+          .load_dest = ACC,                                             \
+          .vece = MO_32 },                                              \
+        { .fni8 = gen_##NAME##_s_i64,                                   \
+          .fniv = gen_##NAME##_vec,                                     \
+          .opt_opc = vecop_list,                                        \
+          .load_dest = ACC,                                             \
+          .vece = MO_64 },                                              \
+    };                                                                  \
+    tcg_debug_assert(vece <= MO_32);                                    \
+    tcg_gen_gvec_2(rd_ofs, rn_ofs, opr_sz, max_sz, &ops[vece]);         \
+}
+
+GEN_GVEC_ADDLP(saddlp, INDEX_op_sari_vec, false)
+GEN_GVEC_ADDLP(uaddlp, INDEX_op_shri_vec, false)
+GEN_GVEC_ADDLP(sadalp, INDEX_op_sari_vec, true)
+GEN_GVEC_ADDLP(uadalp, INDEX_op_shri_vec, true)
+
+#undef GEN_GVEC_ADDLP
+
 static bool aa32_cpreg_encoding_in_impdef_space(uint8_t crn, uint8_t crm)
 {
     static const uint16_t mask[3] = {
@@ -287,8 +287,8 @@ void HELPER(gvec_qrdmlsh_s16)(void *vd, void *vn, void *vm,
     clear_tail(d, opr_sz, simd_maxsz(desc));
 }
 
-void HELPER(neon_sqdmulh_h)(void *vd, void *vn, void *vm,
-                            void *vq, uint32_t desc)
+void HELPER(neon_sqdmulh_h)(void *vd, void *vq, void *vn,
+                            void *vm, uint32_t desc)
 {
     intptr_t i, opr_sz = simd_oprsz(desc);
     int16_t *d = vd, *n = vn, *m = vm;
@@ -299,8 +299,8 @@ void HELPER(neon_sqdmulh_h)(void *vd, void *vn, void *vm,
     clear_tail(d, opr_sz, simd_maxsz(desc));
 }
 
-void HELPER(neon_sqrdmulh_h)(void *vd, void *vn, void *vm,
-                             void *vq, uint32_t desc)
+void HELPER(neon_sqrdmulh_h)(void *vd, void *vq, void *vn,
+                             void *vm, uint32_t desc)
 {
     intptr_t i, opr_sz = simd_oprsz(desc);
     int16_t *d = vd, *n = vn, *m = vm;
@@ -450,8 +450,8 @@ void HELPER(gvec_qrdmlsh_s32)(void *vd, void *vn, void *vm,
     clear_tail(d, opr_sz, simd_maxsz(desc));
 }
 
-void HELPER(neon_sqdmulh_s)(void *vd, void *vn, void *vm,
-                            void *vq, uint32_t desc)
+void HELPER(neon_sqdmulh_s)(void *vd, void *vq, void *vn,
+                            void *vm, uint32_t desc)
 {
     intptr_t i, opr_sz = simd_oprsz(desc);
     int32_t *d = vd, *n = vn, *m = vm;
@@ -462,8 +462,8 @@ void HELPER(neon_sqdmulh_s)(void *vd, void *vn, void *vm,
     clear_tail(d, opr_sz, simd_maxsz(desc));
 }
 
-void HELPER(neon_sqrdmulh_s)(void *vd, void *vn, void *vm,
-                             void *vq, uint32_t desc)
+void HELPER(neon_sqrdmulh_s)(void *vd, void *vq, void *vn,
+                             void *vm, uint32_t desc)
 {
     intptr_t i, opr_sz = simd_oprsz(desc);
     int32_t *d = vd, *n = vn, *m = vm;
@@ -474,6 +474,315 @@ void HELPER(neon_sqrdmulh_s)(void *vd, void *vn, void *vm,
     clear_tail(d, opr_sz, simd_maxsz(desc));
 }
 
+/*
+ * The by-element forms, with the element index in simd_data.  As for
+ * the A32 Neon scalar forms, one element of Vm is used for each 128-bit
+ * segment of Vn, so these also serve 64-bit operations.
+ */
+#define DO_SQRDMLAH_IDX(NAME, TYPE, H, FUNC, ACC, NEG, ROUND)           \
+void HELPER(NAME)(void *vd, void *vn, void *vm, void *vq, uint32_t desc) \
+{                                                                       \
+    intptr_t i, j, opr_sz = simd_oprsz(desc);                           \
+    intptr_t segment = MIN(16, opr_sz) / sizeof(TYPE);                  \
+    intptr_t idx = simd_data(desc);                                     \
+    TYPE *d = vd, *n = vn, *m = vm;                                     \
+                                                                        \
+    for (i = 0; i < opr_sz / sizeof(TYPE); i += segment) {              \
+        TYPE mm = m[H(i + idx)];                                        \
+        for (j = 0; j < segment; j++) {                                 \
+            d[i + j] = FUNC(n[i + j], mm, ACC ? d[i + j] : 0,           \
+                            NEG, ROUND, vq);                            \
+        }                                                               \
+    }                                                                   \
+    clear_tail(d, opr_sz, simd_maxsz(desc));                            \
+}
+
+DO_SQRDMLAH_IDX(neon_sqdmulh_idx_h, int16_t, H2, do_sqrdmlah_h,
+                false, false, false)
+DO_SQRDMLAH_IDX(neon_sqdmulh_idx_s, int32_t, H4, do_sqrdmlah_s,
+                false, false, false)
+DO_SQRDMLAH_IDX(neon_sqrdmulh_idx_h, int16_t, H2, do_sqrdmlah_h,
+                false, false, true)
+DO_SQRDMLAH_IDX(neon_sqrdmulh_idx_s, int32_t, H4, do_sqrdmlah_s,
+                false, false, true)
+DO_SQRDMLAH_IDX(neon_sqrdmlah_idx_h, int16_t, H2, do_sqrdmlah_h,
+                true, false, true)
+DO_SQRDMLAH_IDX(neon_sqrdmlah_idx_s, int32_t, H4, do_sqrdmlah_s,
+                true, false, true)
+DO_SQRDMLAH_IDX(neon_sqrdmlsh_idx_h, int16_t, H2, do_sqrdmlah_h,
+                true, true, true)
+DO_SQRDMLAH_IDX(neon_sqrdmlsh_idx_s, int32_t, H4, do_sqrdmlah_s,
+                true, true, true)
+
+#undef DO_SQRDMLAH_IDX
+
+/*
+ * Signed saturating doubling multiply long, optionally accumulating
+ * into or subtracting from Vd with saturation.  Vd is twice the size
+ * of Vn and Vm, which may overlap it, so the narrow inputs are copied
+ * before anything is written.  The product only saturates for MIN * MIN.
+ */
+static int32_t do_neon_sqdmull_h(int16_t n, int16_t m, uint32_t *sat)
+{
+    int32_t r = (int32_t)n * m;
+
+    if (unlikely(r == 0x40000000)) {
+        *sat = 1;
+        return INT32_MAX;
+    }
+    return r * 2;
+}
+
+static int64_t do_neon_sqdmull_s(int32_t n, int32_t m, uint32_t *sat)
+{
+    int64_t r = (int64_t)n * m;
+
+    if (unlikely(r == INT64_C(0x4000000000000000))) {
+        *sat = 1;
+        return INT64_MAX;
+    }
+    return r * 2;
+}
+
+static int32_t do_neon_sqadd_s(int32_t a, int32_t b, uint32_t *sat)
+{
+    int64_t r = (int64_t)a + b;
+
+    if (r != (int32_t)r) {
+        *sat = 1;
+        return r < 0 ? INT32_MIN : INT32_MAX;
+    }
+    return r;
+}
+
+static int32_t do_neon_sqsub_s(int32_t a, int32_t b, uint32_t *sat)
+{
+    int64_t r = (int64_t)a - b;
+
+    if (r != (int32_t)r) {
+        *sat = 1;
+        return r < 0 ? INT32_MIN : INT32_MAX;
+    }
+    return r;
+}
+
+static int64_t do_neon_sqadd_d(int64_t a, int64_t b, uint32_t *sat)
+{
+    int64_t r;
+
+    if (sadd64_overflow(a, b, &r)) {
+        *sat = 1;
+        return a < 0 ? INT64_MIN : INT64_MAX;
+    }
+    return r;
+}
+
+static int64_t do_neon_sqsub_d(int64_t a, int64_t b, uint32_t *sat)
+{
+    int64_t r;
+
+    if (ssub64_overflow(a, b, &r)) {
+        *sat = 1;
+        return a < 0 ? INT64_MIN : INT64_MAX;
+    }
+    return r;
+}
+
+#define DO_SQDMULL(NAME, TYPEW, TYPEN, HW, HN, MULL, ACC, IDX)          \
+void HELPER(NAME)(void *vd, void *vn, void *vm, void *vq, uint32_t desc) \
+{                                                                       \
+    intptr_t i, opr_sz = simd_oprsz(desc);                              \
+    TYPEN n[16 / sizeof(TYPEW)], m[16 / sizeof(TYPEW)];                 \
+    TYPEW *d = vd;                                                      \
+                                                                        \
+    memcpy(n, vn, opr_sz / 2);                                          \
+    memcpy(m, vm, opr_sz / 2);                                          \
+    for (i = 0; i < opr_sz / sizeof(TYPEW); ++i) {                      \
+        TYPEN mm = IDX ? m[HN(simd_data(desc))] : m[HN(i)];             \
+        TYPEW p = MULL(n[HN(i)], mm, vq);                               \
+        d[HW(i)] = ACC(d[HW(i)], p, vq);                                \
+    }                                                                   \
+    clear_tail(d, opr_sz, simd_maxsz(desc));                            \
+}
+
+#define DO_NOACC(A, P, Q)  (P)
+
+DO_SQDMULL(neon_sqdmull_h, int32_t, int16_t, H4, H2,
+           do_neon_sqdmull_h, DO_NOACC, false)
+DO_SQDMULL(neon_sqdmull_s, int64_t, int32_t, H8, H4,
+           do_neon_sqdmull_s, DO_NOACC, false)
+DO_SQDMULL(neon_sqdmlal_h, int32_t, int16_t, H4, H2,
+           do_neon_sqdmull_h, do_neon_sqadd_s, false)
+DO_SQDMULL(neon_sqdmlal_s, int64_t, int32_t, H8, H4,
+           do_neon_sqdmull_s, do_neon_sqadd_d, false)
+DO_SQDMULL(neon_sqdmlsl_h, int32_t, int16_t, H4, H2,
+           do_neon_sqdmull_h, do_neon_sqsub_s, false)
+DO_SQDMULL(neon_sqdmlsl_s, int64_t, int32_t, H8, H4,
+           do_neon_sqdmull_s, do_neon_sqsub_d, false)
+
+DO_SQDMULL(neon_sqdmull_idx_h, int32_t, int16_t, H4, H2,
+           do_neon_sqdmull_h, DO_NOACC, true)
+DO_SQDMULL(neon_sqdmull_idx_s, int64_t, int32_t, H8, H4,
+           do_neon_sqdmull_s, DO_NOACC, true)
+DO_SQDMULL(neon_sqdmlal_idx_h, int32_t, int16_t, H4, H2,
+           do_neon_sqdmull_h, do_neon_sqadd_s, true)
+DO_SQDMULL(neon_sqdmlal_idx_s, int64_t, int32_t, H8, H4,
+           do_neon_sqdmull_s, do_neon_sqadd_d, true)
+DO_SQDMULL(neon_sqdmlsl_idx_h, int32_t, int16_t, H4, H2,
+           do_neon_sqdmull_h, do_neon_sqsub_s, true)
+DO_SQDMULL(neon_sqdmlsl_idx_s, int64_t, int32_t, H8, H4,
+           do_neon_sqdmull_s, do_neon_sqsub_d, true)
+
+#undef DO_NOACC
+#undef DO_SQDMULL
+
+/*
+ * Neon narrowing shift right by the immediate in simd_data, optionally
+ * rounding and saturating into QC.  Vd is half the size of Vm and may
+ * overlap either half of it, so Vm is copied first.  The suffix is the
+ * size of the wide input elements; a shift of 0 gives VMOVN and VQMOVN.
+ */
+#define DO_SHRN(NAME, TYPEW, TYPEN, HW, HN, ROUND, SAT, MIN, MAX)       \
+void HELPER(NAME)(void *vd, void *vm, void *vq, uint32_t desc)          \
+{                                                                       \
+    intptr_t i, opr_sz = simd_oprsz(desc);                              \
+    int shift = simd_data(desc);                                        \
+    TYPEW m[16 / sizeof(TYPEW)];                                        \
+    TYPEN *d = vd;                                                      \
+                                                                        \
+    memcpy(m, vm, opr_sz * 2);                                          \
+    for (i = 0; i < opr_sz / sizeof(TYPEN); ++i) {                      \
+        TYPEW x = m[HW(i)], r = x >> shift;                             \
+        if (ROUND && shift) {                                           \
+            r += (x >> (shift - 1)) & 1;                                \
+        }                                                               \
+        if (SAT && r != (TYPEN)r) {                                     \
+            r = r > 0 ? MAX : MIN;                                      \
+            *(uint32_t *)vq = 1;                                        \
+        }                                                               \
+        d[HN(i)] = r;                                                   \
+    }                                                                   \
+    clear_tail(d, opr_sz, simd_maxsz(desc));                            \
+}
+
+DO_SHRN(neon_shrn_h, uint16_t, uint8_t, H2, H1, false, false,
+        0, 0)
+DO_SHRN(neon_shrn_s, uint32_t, uint16_t, H4, H2, false, false,
+        0, 0)
+DO_SHRN(neon_shrn_d, uint64_t, uint32_t, H8, H4, false, false,
+        0, 0)
+
+DO_SHRN(neon_rshrn_h, uint16_t, uint8_t, H2, H1, true, false,
+        0, 0)
+DO_SHRN(neon_rshrn_s, uint32_t, uint16_t, H4, H2, true, false,
+        0, 0)
+DO_SHRN(neon_rshrn_d, uint64_t, uint32_t, H8, H4, true, false,
+        0, 0)
+
+DO_SHRN(neon_uqshrn_h, uint16_t, uint8_t, H2, H1, false, true,
+        0, UINT8_MAX)
+DO_SHRN(neon_uqshrn_s, uint32_t, uint16_t, H4, H2, false, true,
+        0, UINT16_MAX)
+DO_SHRN(neon_uqshrn_d, uint64_t, uint32_t, H8, H4, false, true,
+        0, UINT32_MAX)
+
+DO_SHRN(neon_uqrshrn_h, uint16_t, uint8_t, H2, H1, true, true,
+        0, UINT8_MAX)
+DO_SHRN(neon_uqrshrn_s, uint32_t, uint16_t, H4, H2, true, true,
+        0, UINT16_MAX)
+DO_SHRN(neon_uqrshrn_d, uint64_t, uint32_t, H8, H4, true, true,
+        0, UINT32_MAX)
+
+DO_SHRN(neon_sqshrn_h, int16_t, int8_t, H2, H1, false, true,
+        INT8_MIN, INT8_MAX)
+DO_SHRN(neon_sqshrn_s, int32_t, int16_t, H4, H2, false, true,
+        INT16_MIN, INT16_MAX)
+DO_SHRN(neon_sqshrn_d, int64_t, int32_t, H8, H4, false, true,
+        INT32_MIN, INT32_MAX)
+
+DO_SHRN(neon_sqrshrn_h, int16_t, int8_t, H2, H1, true, true,
+        INT8_MIN, INT8_MAX)
+DO_SHRN(neon_sqrshrn_s, int32_t, int16_t, H4, H2, true, true,
+        INT16_MIN, INT16_MAX)
+DO_SHRN(neon_sqrshrn_d, int64_t, int32_t, H8, H4, true, true,
+        INT32_MIN, INT32_MAX)
+
+/* VQSHRUN and VQRSHRUN take signed inputs to unsigned outputs. */
+DO_SHRN(neon_sqshrun_h, int16_t, uint8_t, H2, H1, false, true,
+        0, UINT8_MAX)
+DO_SHRN(neon_sqshrun_s, int32_t, uint16_t, H4, H2, false, true,
+        0, UINT16_MAX)
+DO_SHRN(neon_sqshrun_d, int64_t, uint32_t, H8, H4, false, true,
+        0, UINT32_MAX)
+
+DO_SHRN(neon_sqrshrun_h, int16_t, uint8_t, H2, H1, true, true,
+        0, UINT8_MAX)
+DO_SHRN(neon_sqrshrun_s, int32_t, uint16_t, H4, H2, true, true,
+        0, UINT16_MAX)
+DO_SHRN(neon_sqrshrun_d, int64_t, uint32_t, H8, H4, true, true,
+        0, UINT32_MAX)
+
+#undef DO_SHRN
+
+/*
+ * Neon widening shift left by the immediate in simd_data, which may be
+ * as large as the narrow element size.  Vd is twice the size of Vm and
+ * may overlap it, so Vm is copied first.  The suffix is the size of the
+ * wide output elements.
+ */
+#define DO_SHLL(NAME, TYPEW, TYPEN, HW, HN)                             \
+void HELPER(NAME)(void *vd, void *vm, uint32_t desc)                    \
+{                                                                       \
+    intptr_t i, opr_sz = simd_oprsz(desc);                              \
+    int shift = simd_data(desc);                                        \
+    TYPEN m[16 / sizeof(TYPEW)];                                        \
+    TYPEW *d = vd;                                                      \
+                                                                        \
+    memcpy(m, vm, opr_sz / 2);                                          \
+    for (i = 0; i < opr_sz / sizeof(TYPEW); ++i) {                      \
+        d[HW(i)] = (TYPEW)m[HN(i)] << shift;                            \
+    }                                                                   \
+    clear_tail(d, opr_sz, simd_maxsz(desc));                            \
+}
+
+DO_SHLL(neon_sshll_h, int16_t, int8_t, H2, H1)
+DO_SHLL(neon_sshll_s, int32_t, int16_t, H4, H2)
+DO_SHLL(neon_sshll_d, int64_t, int32_t, H8, H4)
+DO_SHLL(neon_ushll_h, uint16_t, uint8_t, H2, H1)
+DO_SHLL(neon_ushll_s, uint32_t, uint16_t, H4, H2)
+DO_SHLL(neon_ushll_d, uint64_t, uint32_t, H8, H4)
+
+#undef DO_SHLL
+
+/*
+ * Neon VTBL and VTBX, with the first table register, the table length
+ * less one and whether this is VTBX in simd_data.  The table is copied
+ * out of the register file first, so Vd may be any of the inputs.
+ */
+void HELPER(neon_tbl)(void *vd, void *vm, CPUARMState *env, uint32_t desc)
+{
+    uint32_t data = simd_data(desc);
+    bool is_tbx = data & 1;
+    unsigned len = (extract32(data, 1, 2) + 1) * 8;
+    unsigned rn = data >> 3;
+    uint8_t table[32];
+    uint64_t ireg = *(uint64_t *)vm;
+    uint64_t val = is_tbx ? *(uint64_t *)vd : 0;
+    unsigned i, shift;
+
+    for (i = 0; i < len; i++) {
+        table[i] = *aa32_vfp_dreg(env, rn + i / 8) >> ((i % 8) * 8);
+    }
+    for (shift = 0; shift < 64; shift += 8) {
+        unsigned index = (ireg >> shift) & 0xff;
+
+        if (index < len) {
+            val = deposit64(val, shift, 8, table[index]);
+        }
+    }
+    *(uint64_t *)vd = val;
+}
+
 void HELPER(sve2_sqrdmlah_s)(void *vd, void *vn, void *vm,
                              void *va, uint32_t desc)
 {
@@ -2127,6 +2436,144 @@ DO_ABA(gvec_uaba_d, uint64_t)
 
 #undef DO_ABA
 
+/*
+ * Halving add/sub: promote to int32_t (or int64_t for 32-bit elements)
+ * so the intermediate cannot overflow.
+ */
+#define DO_HALVING(NAME, TYPE, WTYPE, OP)                       \
+void HELPER(NAME)(void *vd, void *vn, void *vm, uint32_t desc)  \
+{                                                               \
+    intptr_t i, opr_sz = simd_oprsz(desc);                      \
+    TYPE *d = vd, *n = vn, *m = vm;                             \
+                                                                \
+    for (i = 0; i < opr_sz / sizeof(TYPE); ++i) {               \
+        d[i] = ((WTYPE)n[i] OP (WTYPE)m[i]) >> 1;               \
+    }                                                           \
+    clear_tail(d, opr_sz, simd_maxsz(desc));                    \
+}
+
+DO_HALVING(gvec_shadd_b, int8_t, int32_t, +)
+DO_HALVING(gvec_shadd_h, int16_t, int32_t, +)
+DO_HALVING(gvec_shadd_s, int32_t, int64_t, +)
+
+DO_HALVING(gvec_uhadd_b, uint8_t, int32_t, +)
+DO_HALVING(gvec_uhadd_h, uint16_t, int32_t, +)
+DO_HALVING(gvec_uhadd_s, uint32_t, int64_t, +)
+
+DO_HALVING(gvec_shsub_b, int8_t, int32_t, -)
+DO_HALVING(gvec_shsub_h, int16_t, int32_t, -)
+DO_HALVING(gvec_shsub_s, int32_t, int64_t, -)
+
+DO_HALVING(gvec_uhsub_b, uint8_t, int32_t, -)
+DO_HALVING(gvec_uhsub_h, uint16_t, int32_t, -)
+DO_HALVING(gvec_uhsub_s, uint32_t, int64_t, -)
+
+#undef DO_HALVING
+
+#define DO_RHADD(NAME, TYPE, WTYPE)                             \
+void HELPER(NAME)(void *vd, void *vn, void *vm, uint32_t desc)  \
+{                                                               \
+    intptr_t i, opr_sz = simd_oprsz(desc);                      \
+    TYPE *d = vd, *n = vn, *m = vm;                             \
+                                                                \
+    for (i = 0; i < opr_sz / sizeof(TYPE); ++i) {               \
+        d[i] = ((WTYPE)n[i] + (WTYPE)m[i] + 1) >> 1;            \
+    }                                                           \
+    clear_tail(d, opr_sz, simd_maxsz(desc));                    \
+}
+
+DO_RHADD(gvec_srhadd_b, int8_t, int32_t)
+DO_RHADD(gvec_srhadd_h, int16_t, int32_t)
+DO_RHADD(gvec_srhadd_s, int32_t, int64_t)
+
+DO_RHADD(gvec_urhadd_b, uint8_t, int32_t)
+DO_RHADD(gvec_urhadd_h, uint16_t, int32_t)
+DO_RHADD(gvec_urhadd_s, uint32_t, int64_t)
+
+#undef DO_RHADD
+
+/*
+ * Integer pairwise ops: the low half of the result comes from adjacent
+ * pairs of Vn and the high half from adjacent pairs of Vm.  The Vn
+ * half can be computed in place, but Vm must be saved first when it
+ * overlaps Vd.
+ */
+#define DO_3OP_PAIR(NAME, FUNC, TYPE, H)                        \
+void HELPER(NAME)(void *vd, void *vn, void *vm, uint32_t desc)  \
+{                                                               \
+    ARMVectorReg scratch;                                       \
+    intptr_t i, opr_sz = simd_oprsz(desc);                      \
+    intptr_t half = opr_sz / sizeof(TYPE) / 2;                  \
+    TYPE *d = vd, *n = vn, *m = vm;                             \
+                                                                \
+    if (unlikely(d == m)) {                                     \
+        m = memcpy(&scratch, m, opr_sz);                        \
+    }                                                           \
+    for (i = 0; i < half; ++i) {                                \
+        d[H(i)] = FUNC(n[H(i * 2)], n[H(i * 2 + 1)]);           \
+    }                                                           \
+    for (i = 0; i < half; ++i) {                                \
+        d[H(i + half)] = FUNC(m[H(i * 2)], m[H(i * 2 + 1)]);    \
+    }                                                           \
+    clear_tail(d, opr_sz, simd_maxsz(desc));                    \
+}
+
+#define ADD(A, B) (A + B)
+
+DO_3OP_PAIR(gvec_addp_b, ADD, uint8_t, H1)
+DO_3OP_PAIR(gvec_addp_h, ADD, uint16_t, H2)
+DO_3OP_PAIR(gvec_addp_s, ADD, uint32_t, H4)
+
+DO_3OP_PAIR(gvec_smaxp_b, MAX, int8_t, H1)
+DO_3OP_PAIR(gvec_smaxp_h, MAX, int16_t, H2)
+DO_3OP_PAIR(gvec_smaxp_s, MAX, int32_t, H4)
+
+DO_3OP_PAIR(gvec_sminp_b, MIN, int8_t, H1)
+DO_3OP_PAIR(gvec_sminp_h, MIN, int16_t, H2)
+DO_3OP_PAIR(gvec_sminp_s, MIN, int32_t, H4)
+
+DO_3OP_PAIR(gvec_umaxp_b, MAX, uint8_t, H1)
+DO_3OP_PAIR(gvec_umaxp_h, MAX, uint16_t, H2)
+DO_3OP_PAIR(gvec_umaxp_s, MAX, uint32_t, H4)
+
+DO_3OP_PAIR(gvec_uminp_b, MIN, uint8_t, H1)
+DO_3OP_PAIR(gvec_uminp_h, MIN, uint16_t, H2)
+DO_3OP_PAIR(gvec_uminp_s, MIN, uint32_t, H4)
+
+#undef ADD
+#undef DO_3OP_PAIR
+
+/*
+ * Pairwise add long, optionally accumulating into Vd: each double-width
+ * element of the result is the sum of the two narrow elements it
+ * overlaps, so the operation never crosses an element boundary.
+ */
+#define DO_ADDLP(NAME, TYPEW, TYPEN, HW, HN, ACC)               \
+void HELPER(NAME)(void *vd, void *vn, uint32_t desc)            \
+{                                                               \
+    intptr_t i, opr_sz = simd_oprsz(desc);                      \
+    TYPEW *d = vd;                                              \
+    TYPEN *n = vn;                                              \
+                                                                \
+    for (i = 0; i < opr_sz / sizeof(TYPEW); ++i) {              \
+        TYPEW r = (TYPEW)n[HN(i * 2)] + n[HN(i * 2 + 1)];       \
+        d[HW(i)] = ACC ? d[HW(i)] + r : r;                      \
+    }                                                           \
+    clear_tail(d, opr_sz, simd_maxsz(desc));                    \
+}
+
+DO_ADDLP(gvec_saddlp_b, int16_t, int8_t, H2, H1, false)
+DO_ADDLP(gvec_saddlp_h, int32_t, int16_t, H4, H2, false)
+DO_ADDLP(gvec_uaddlp_b, uint16_t, uint8_t, H2, H1, false)
+DO_ADDLP(gvec_uaddlp_h, uint32_t, uint16_t, H4, H2, false)
+
+DO_ADDLP(gvec_sadalp_b, int16_t, int8_t, H2, H1, true)
+DO_ADDLP(gvec_sadalp_h, int32_t, int16_t, H4, H2, true)
+DO_ADDLP(gvec_uadalp_b, uint16_t, uint8_t, H2, H1, true)
+DO_ADDLP(gvec_uadalp_h, uint32_t, uint16_t, H4, H2, true)
+
+#undef DO_ADDLP
+
 #define DO_NEON_PAIRWISE(NAME, OP)                                      \
     void HELPER(NAME##s)(void *vd, void *vn, void *vm,                  \
                          void *stat, uint32_t oprsz)                    \
@@ -2231,6 +2231,9 @@ bool tcg_op_supported(TCGOpcode op)
     case INDEX_op_sssub_vec:
     case INDEX_op_ussub_vec:
         return have_vec && TCG_TARGET_HAS_sat_vec;
+    case INDEX_op_sqdmulh_vec:
+    case INDEX_op_sqrdmulh_vec:
+        return have_vec && TCG_TARGET_HAS_sqdmulh_vec;
     case INDEX_op_smin_vec:
     case INDEX_op_umin_vec:
     case INDEX_op_smax_vec:
@@ -0,0 +1,139 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Compare dense and compressed HBitmaps as used for dirty bitmaps: memory
+ * footprint, and the time needed to fill, merge and walk them.
+ */
+#include "qemu/osdep.h"
+#include "qemu/hbitmap.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+
+/* 64 KiB dirty bitmap granularity, as used by default for qcow2 */
+#define GRANULARITY 16
+
+enum pattern {
+    PATTERN_SPARSE,
+    PATTERN_EXTENTS,
+    PATTERN_DENSE,
+};
+
+struct workload {
+    const char * const name;
+    enum pattern pattern;
+};
+
+static const struct workload workloads[] = {
+    { .name = "sparse",  .pattern = PATTERN_SPARSE },
+    { .name = "extents", .pattern = PATTERN_EXTENTS },
+    { .name = "dense",   .pattern = PATTERN_DENSE },
+};
+
+struct result {
+    size_t memory;
+    int64_t fill_ns;
+    int64_t merge_ns;
+    int64_t iter_ns;
+};
+
+static HBitmap *bench_alloc(uint64_t size, bool compressed)
+{
+    return compressed ? hbitmap_alloc_compressed(size, GRANULARITY)
+                      : hbitmap_alloc(size, GRANULARITY);
+}
+
+static void bench_fill(HBitmap *hb, uint64_t size, enum pattern pattern,
+                       GRand *rand)
+{
+    uint64_t clusters = size >> GRANULARITY;
+    uint64_t i;
+
+    switch (pattern) {
+    case PATTERN_SPARSE:
+        /* 0.1% of the clusters, written at random */
+        for (i = 0; i < clusters / 1000; i++) {
+            uint64_t c = g_rand_int_range(rand, 0, clusters);
+            hbitmap_set(hb, c << GRANULARITY, 1 << GRANULARITY);
+        }
+        break;
+    case PATTERN_EXTENTS:
+        /* A few hundred sequential writes of up to 256 MiB each */
+        for (i = 0; i < 256; i++) {
+            uint64_t c = g_rand_int_range(rand, 0, clusters);
+            uint64_t n = g_rand_int_range(rand, 1, 4096);
+            n = MIN(n, clusters - c);
+            hbitmap_set(hb, c << GRANULARITY, n << GRANULARITY);
+        }
+        break;
+    case PATTERN_DENSE:
+        /* Roughly half of the clusters, written at random */
+        for (i = 0; i < clusters / 2; i++) {
+            uint64_t c = g_rand_int_range(rand, 0, clusters);
+            hbitmap_set(hb, c << GRANULARITY, 1 << GRANULARITY);
+        }
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static void run_benchmark(enum pattern pattern, bool compressed,
+                          uint64_t size, struct result *res)
+{
+    GRand *rand = g_rand_new_with_seed(42);
+    HBitmap *a = bench_alloc(size, compressed);
+    HBitmap *b = bench_alloc(size, compressed);
+    int64_t start, dirty_start, dirty_count;
+    uint64_t count = 0;
+
+    start = get_clock();
+    bench_fill(a, size, pattern, rand);
+    res->fill_ns = get_clock() - start;
+    bench_fill(b, size, pattern, rand);
+    res->memory = hbitmap_memory_usage(a);
+
+    start = get_clock();
+    hbitmap_merge(a, b, a);
+    res->merge_ns = get_clock() - start;
+
+    start = get_clock();
+    dirty_start = 0;
+    while (hbitmap_next_dirty_area(a, dirty_start, size, INT64_MAX,
+                                   &dirty_start, &dirty_count)) {
+        count += dirty_count;
+        dirty_start += dirty_count;
+    }
+    res->iter_ns = get_clock() - start;
+    g_assert(count == hbitmap_count(a));
+
+    hbitmap_free(a);
+    hbitmap_free(b);
+    g_rand_free(rand);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t sizes[] = { 64 * GiB, 1 * TiB, 4 * TiB };
+    struct result res[2];
+    int i, j;
+
+    printf("# Dirty bitmap with %d KiB granularity; times in ms\n",
+           (int)((1 << GRANULARITY) / KiB));
+    printf("%8s %8s %11s %12s %10s %10s %10s\n",
+           "Disk", "Pattern", "Kind", "Memory (KiB)",
+           "Fill", "Merge", "Iterate");
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        for (j = 0; j < ARRAY_SIZE(workloads); j++) {
+            run_benchmark(workloads[j].pattern, false, sizes[i], &res[0]);
+            run_benchmark(workloads[j].pattern, true, sizes[i], &res[1]);
+            for (int k = 0; k < 2; k++) {
+                printf("%6" PRIu64 "Gi %8s %11s %12zu %10.2f %10.2f %10.2f\n",
+                       sizes[i] / GiB, workloads[j].name,
+                       k ? "compressed" : "dense",
+                       (size_t)(res[k].memory / KiB),
+                       res[k].fill_ns / 1e6, res[k].merge_ns / 1e6,
+                       res[k].iter_ns / 1e6);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Compare the hit rate of the set associative XBZRLE page cache with the
+ * direct mapped cache it replaced, replaying the pages dirtied by a few
+ * typical guest workloads round after round.
+ */
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include "../migration/page_cache.h"
+
+#define CACHE_PAGE_SIZE 4096
+/* 64 MiB, the default xbzrle-cache-size */
+#define CACHE_PAGES 16384
+/* guest RAM the dirty pages are picked from */
+#define RAM_PAGES (64 * CACHE_PAGES)
+#define ROUNDS 16
+/* as in migration/page_cache.c */
+#define CACHED_PAGE_LIFETIME 2
+
+enum pattern {
+    PATTERN_SEQUENTIAL,
+    PATTERN_RANDOM,
+    PATTERN_ALIASED,
+};
+
+struct workload {
+    const char * const name;
+    enum pattern pattern;
+};
+
+static const struct workload workloads[] = {
+    { .name = "sequential", .pattern = PATTERN_SEQUENTIAL },
+    { .name = "random",     .pattern = PATTERN_RANDOM },
+    { .name = "aliased",    .pattern = PATTERN_ALIASED },
+};
+
+/* The working set of the guest, redirtied on every round */
+static uint64_t *bench_working_set(enum pattern pattern, size_t *count)
+{
+    GRand *rand = g_rand_new_with_seed(42);
+    size_t n = CACHE_PAGES * 3 / 4;
+    uint64_t *pages = g_new(uint64_t, n);
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        switch (pattern) {
+        case PATTERN_SEQUENTIAL:
+            /* One large buffer */
+            pages[i] = RAM_PAGES / 2 + i;
+            break;
+        case PATTERN_RANDOM:
+            /* Scattered allocations */
+            pages[i] = g_rand_int_range(rand, 0, RAM_PAGES);
+            break;
+        case PATTERN_ALIASED:
+            /* Eight buffers whose addresses only differ in high bits */
+            pages[i] = (i % 8) * (RAM_PAGES / 8) + i / 8;
+            break;
+        default:
+            g_assert_not_reached();
+        }
+    }
+    g_rand_free(rand);
+    *count = n;
+    return pages;
+}
+
+/* Hit rate of the direct mapped cache that migration used to have */
+static double run_direct_mapped(const uint64_t *pages, size_t n)
+{
+    uint64_t *addr = g_new(uint64_t, CACHE_PAGES);
+    uint64_t *age = g_new0(uint64_t, CACHE_PAGES);
+    uint64_t hits = 0;
+    size_t i, round;
+
+    for (i = 0; i < CACHE_PAGES; i++) {
+        addr[i] = -1;
+    }
+    for (round = 1; round <= ROUNDS; round++) {
+        for (i = 0; i < n; i++) {
+            size_t pos = pages[i] & (CACHE_PAGES - 1);
+
+            if (addr[pos] == pages[i]) {
+                age[pos] = round;
+                hits++;
+            } else if (addr[pos] == -1 ||
+                       age[pos] + CACHED_PAGE_LIFETIME <= round) {
+                addr[pos] = pages[i];
+                age[pos] = round;
+            }
+        }
+    }
+    g_free(addr);
+    g_free(age);
+    return (double)hits / (n * ROUNDS);
+}
+
+static double run_page_cache(const uint64_t *pages, size_t n,
+                             int64_t *access_ns)
+{
+    PageCache *cache = cache_init((uint64_t)CACHE_PAGES * CACHE_PAGE_SIZE,
+                                  CACHE_PAGE_SIZE, &error_abort);
+    uint8_t *page = g_malloc0(CACHE_PAGE_SIZE);
+    uint64_t hits = 0;
+    size_t i, round;
+    int64_t start;
+
+    start = get_clock();
+    for (round = 1; round <= ROUNDS; round++) {
+        for (i = 0; i < n; i++) {
+            uint64_t addr = pages[i] * CACHE_PAGE_SIZE;
+
+            cache_lock(cache, addr);
+            if (cache_is_cached(cache, addr, round)) {
+                memcpy(get_cached_data(cache, addr), page, CACHE_PAGE_SIZE);
+                hits++;
+            } else {
+                cache_insert(cache, addr, page, round);
+            }
+            cache_unlock(cache, addr);
+        }
+    }
+    *access_ns = (get_clock() - start) / (n * ROUNDS);
+
+    cache_fini(cache);
+    g_free(page);
+    return (double)hits / (n * ROUNDS);
+}
+
+int main(int argc, char *argv[])
+{
+    int i;
+
+    printf("# %d MiB cache, %d rounds redirtying 3/4 of its size\n",
+           (int)((uint64_t)CACHE_PAGES * CACHE_PAGE_SIZE / MiB), ROUNDS);
+    printf("%10s %14s %16s %12s\n",
+           "Pattern", "Direct (hit%)", "Set-assoc (hit%)", "ns/access");
+    for (i = 0; i < ARRAY_SIZE(workloads); i++) {
+        uint64_t *pages;
+        int64_t access_ns;
+        double direct, assoc;
+        size_t n;
+
+        pages = bench_working_set(workloads[i].pattern, &n);
+        direct = run_direct_mapped(pages, n);
+        assoc = run_page_cache(pages, n, &access_ns);
+        printf("%10s %14.1f %16.1f %12" PRId64 "\n", workloads[i].name,
+               direct * 100, assoc * 100, access_ns);
+        g_free(pages);
+    }
+    return 0;
+}
@@ -15,6 +15,7 @@
 #include <fenv.h>
 #include "qemu/timer.h"
 #include "qemu/int128.h"
+#include "qemu/bitops.h"
 #include "fpu/softfloat.h"
 
 /* amortize the computation of random inputs */
@@ -34,6 +35,7 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_CVT16,
     OP_MAX_NR,
 };
 
@@ -45,6 +47,7 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_CVT16] = "cvt16",
     [OP_MAX_NR] = NULL,
 };
 
@@ -225,6 +228,38 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
     }
 }
 
+/*
+ * Rescale the exponent of the operands so that they are normal in half
+ * precision, which is what the guest's float16 conversions mostly see.
+ */
+static void narrow_to_half_range(union fp *ops, int n_ops, enum precision prec)
+{
+    int i;
+
+    for (i = 0; i < n_ops; i++) {
+        switch (prec) {
+        case PREC_FLOAT32:
+        {
+            uint32_t v = float32_val(ops[i].f32);
+            uint32_t exp = 127 - 14 + extract32(v, 23, 8) % 30;
+
+            ops[i].f32 = make_float32(deposit32(v, 23, 8, exp));
+            break;
+        }
+        case PREC_FLOAT64:
+        {
+            uint64_t v = float64_val(ops[i].f64);
+            uint64_t exp = 1023 - 14 + extract64(v, 52, 11) % 30;
+
+            ops[i].f64 = make_float64(deposit64(v, 52, 11, exp));
+            break;
+        }
+        default:
+            g_assert_not_reached();
+        }
+    }
+}
+
 /*
  * The main benchmark function. Instead of (ab)using macros, we rely
  * on the compiler to unfold this at compile-time.
@@ -312,6 +347,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
             break;
         case PREC_FLOAT32:
             fill_random(ops, n_ops, prec, no_neg);
+            if (op == OP_CVT16) {
+                narrow_to_half_range(ops, n_ops, prec);
+            }
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float32 a = ops[0].f32;
@@ -340,6 +378,11 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_CVT16:
+                    res.f32 = float16_to_float32(float32_to_float16(a, true,
+                                                                    &soft_status),
+                                                 true, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -347,6 +390,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
             break;
         case PREC_FLOAT64:
             fill_random(ops, n_ops, prec, no_neg);
+            if (op == OP_CVT16) {
+                narrow_to_half_range(ops, n_ops, prec);
+            }
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float64 a = ops[0].f64;
@@ -375,6 +421,11 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_CVT16:
+                    res.f64 = float16_to_float64(float64_to_float16(a, true,
+                                                                    &soft_status),
+                                                 true, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -460,6 +511,10 @@ GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
 GEN_BENCH_ALL_TYPES_NO_NEG(sqrt, OP_SQRT, 1)
 #undef GEN_BENCH_ALL_TYPES_NO_NEG
 
+/* There is no portable host half-precision type, so these are soft only */
+GEN_BENCH(bench_cvt16_float32, float32, PREC_FLOAT32, OP_CVT16, 1)
+GEN_BENCH(bench_cvt16_float64, float64, PREC_FLOAT64, OP_CVT16, 1)
+
 #undef GEN_BENCH_NO_NEG
 #undef GEN_BENCH
 
@@ -480,6 +535,10 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    [OP_CVT16] = {
+        [PREC_FLOAT32]   = bench_cvt16_float32,
+        [PREC_FLOAT64]   = bench_cvt16_float64,
+    },
 };
 
 #undef GEN_BENCH_FUNCS
@@ -489,7 +548,11 @@ static void run_bench(void)
     bench_func_t f;
 
     f = bench_funcs[operation][precision];
-    g_assert(f);
+    if (f == NULL) {
+        fprintf(stderr, "fatal: op '%s' not supported with this tester or "
+                "precision\n", op_names[operation]);
+        exit(EXIT_FAILURE);
+    }
     f();
 }
 
@@ -528,6 +591,8 @@ static void usage_complete(int argc, char *argv[])
             "Default: disabled\n");
     fprintf(stderr, " -Z = flush output to zero (soft tester only). "
             "Default: disabled\n");
+    fprintf(stderr, " -N = default NaN mode (soft tester only). "
+            "Default: disabled\n");
 
     g_free(tester_list);
     g_free(op_list);
@@ -615,7 +680,7 @@ static void parse_args(int argc, char *argv[])
     int rounding = ROUND_EVEN;
 
     for (;;) {
-        c = getopt(argc, argv, "d:ho:p:r:t:zZ");
+        c = getopt(argc, argv, "d:ho:p:r:t:zZN");
         if (c < 0) {
             break;
         }
@@ -667,6 +732,9 @@ static void parse_args(int argc, char *argv[])
         case 'Z':
             soft_status.flush_to_zero = 1;
             break;
+        case 'N':
+            soft_status.default_nan_mode = 1;
+            break;
         }
     }
 
@@ -25,6 +25,7 @@
 
 from guestperf.progress import Progress, ProgressStats
 from guestperf.report import Report
+from guestperf.samples import parse_file
 from guestperf.timings import TimingRecord, Timings
 
 sys.path.append(os.path.join(os.path.dirname(__file__),
@@ -220,6 +221,10 @@ def _migrate(self, hardware, scenario, src, dst, connect_uri):
             resp = src.cmd("migrate-set-parameters",
                            vcpu_dirty_limit=scenario._vcpu_dirty_limit)
 
+        samples_file = "/var/tmp/qemu-samples-%d.bin" % os.getpid()
+        resp = src.cmd("migrate-sample-stream",
+                       filename=samples_file, format="binary")
+
         resp = src.cmd("migrate", uri=connect_uri)
 
         post_copy = False
@@ -259,7 +264,12 @@ def _migrate(self, hardware, scenario, src, dst, connect_uri):
                         src_vcpu_time.extend(self._vcpu_timing(src_pid, src_threads))
                         sleep_secs -= 1
 
-                return [progress_history, src_qemu_time, src_vcpu_time]
+                src.cmd("migrate-sample-stream")
+                samples = parse_file(samples_file)
+                os.remove(samples_file)
+
+                return [progress_history, src_qemu_time, src_vcpu_time,
+                        samples]
 
             if self._verbose and (loop % 20) == 0:
                 print("Iter %d: remain %5dMB of %5dMB (total %5dMB @ %5dMb/sec)" % (
@@ -465,6 +475,7 @@ def run(self, hardware, scenario, result_dir=os.getcwd()):
             progress_history = ret[0]
             qemu_timings = ret[1]
             vcpu_timings = ret[2]
+            samples = ret[3]
             if uri[0:5] == "unix:" and os.path.exists(uri[5:]):
                 os.remove(uri[5:])
 
@@ -485,7 +496,8 @@ def run(self, hardware, scenario, result_dir=os.getcwd()):
                           Timings(qemu_timings),
                           Timings(vcpu_timings),
                           self._binary, self._dst_host, self._kernel,
-                          self._initrd, self._transport, self._sleep)
+                          self._initrd, self._transport, self._sleep,
+                          samples)
         except Exception as e:
             if self._debug:
                 print("Failed: %s" % str(e))
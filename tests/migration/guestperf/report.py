@@ -22,6 +22,7 @@
 from guestperf.hardware import Hardware
 from guestperf.scenario import Scenario
 from guestperf.progress import Progress
+from guestperf.samples import Sample
 from guestperf.timings import Timings
 
 class Report(object):
@@ -38,7 +39,8 @@ def __init__(self,
                  kernel,
                  initrd,
                  transport,
-                 sleep):
+                 sleep,
+                 samples):
 
         self._hardware = hardware
         self._scenario = scenario
@@ -52,6 +54,7 @@ def __init__(self,
         self._initrd = initrd
         self._transport = transport
         self._sleep = sleep
+        self._samples = samples
 
     def serialize(self):
         return {
@@ -67,6 +70,7 @@ def serialize(self):
             "initrd": self._initrd,
             "transport": self._transport,
             "sleep": self._sleep,
+            "samples": [sample.serialize() for sample in self._samples],
         }
 
     @classmethod
@@ -83,7 +87,9 @@ def deserialize(cls, data):
             data["kernel"],
             data["initrd"],
             data["transport"],
-            data["sleep"])
+            data["sleep"],
+            [Sample.deserialize(record)
+             for record in data.get("samples", [])])
 
     def to_json(self):
         return json.dumps(self.serialize(), indent=4)
@@ -0,0 +1,148 @@
+#
+# Migration test per-iteration samples
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, see <http://www.gnu.org/licenses/>.
+#
+
+import struct
+
+
+BINARY_MAGIC = b"QEMUMSMP"
+BINARY_VERSION = 1
+
+# Record header: size and number of channels
+BINARY_HEADER = struct.Struct("<II")
+# The fixed size part of a record, see MigrationSampleFormat
+BINARY_FIELDS = struct.Struct("<QQQQQQQQQd")
+
+
+class Sample(object):
+
+    def __init__(self,
+                 time,
+                 dirty_sync_count,
+                 transferred,
+                 throughput,
+                 dirty_pages_rate,
+                 dirty_sync_time,
+                 zero_pages,
+                 compression_ratio,
+                 expected_downtime,
+                 remaining,
+                 channels):
+
+        self._time = time
+        self._dirty_sync_count = dirty_sync_count
+        self._transferred = transferred
+        self._throughput = throughput
+        self._dirty_pages_rate = dirty_pages_rate
+        self._dirty_sync_time = dirty_sync_time
+        self._zero_pages = zero_pages
+        self._compression_ratio = compression_ratio
+        self._expected_downtime = expected_downtime
+        self._remaining = remaining
+        self._channels = channels
+
+    def serialize(self):
+        return {
+            "time": self._time,
+            "dirty_sync_count": self._dirty_sync_count,
+            "transferred": self._transferred,
+            "throughput": self._throughput,
+            "dirty_pages_rate": self._dirty_pages_rate,
+            "dirty_sync_time": self._dirty_sync_time,
+            "zero_pages": self._zero_pages,
+            "compression_ratio": self._compression_ratio,
+            "expected_downtime": self._expected_downtime,
+            "remaining": self._remaining,
+            "channels": self._channels,
+        }
+
+    @classmethod
+    def deserialize(cls, data):
+        return cls(
+            data["time"],
+            data["dirty_sync_count"],
+            data["transferred"],
+            data["throughput"],
+            data["dirty_pages_rate"],
+            data["dirty_sync_time"],
+            data["zero_pages"],
+            data["compression_ratio"],
+            data["expected_downtime"],
+            data["remaining"],
+            data["channels"])
+
+
+def parse_csv(text):
+    lines = text.splitlines()
+    if not lines:
+        return []
+    names = lines[0].split(",")
+
+    samples = []
+    for line in lines[1:]:
+        if line == "":
+            continue
+        data = dict(zip(names, line.split(",")))
+        channels = data.get("channels", "")
+        samples.append(Sample(
+            int(data["time"]),
+            int(data["dirty-sync-count"]),
+            int(data["transferred"]),
+            int(data["throughput"]),
+            int(data["dirty-pages-rate"]),
+            int(data["dirty-sync-time"]),
+            int(data["zero-pages"]),
+            float(data["compression-ratio"]),
+            int(data["expected-downtime"]),
+            int(data["remaining"]),
+            [int(value) for value in channels.split()]))
+    return samples
+
+
+def parse_binary(data):
+    if data[0:len(BINARY_MAGIC)] != BINARY_MAGIC:
+        raise Exception("Not a migration sample stream")
+    offset = len(BINARY_MAGIC)
+    (version,) = struct.unpack_from("<I", data, offset)
+    if version != BINARY_VERSION:
+        raise Exception("Unsupported migration sample stream version %d" %
+                        version)
+    offset += 4
+
+    samples = []
+    # A record may be truncated if QEMU was still writing it
+    while offset + BINARY_HEADER.size <= len(data):
+        size, nchannels = BINARY_HEADER.unpack_from(data, offset)
+        if offset + size > len(data):
+            break
+        fields = BINARY_FIELDS.unpack_from(data, offset + BINARY_HEADER.size)
+        channels = struct.unpack_from(
+            "<%dQ" % nchannels, data,
+            offset + BINARY_HEADER.size + BINARY_FIELDS.size)
+        samples.append(Sample(
+            fields[0], fields[1], fields[2], fields[3], fields[4],
+            fields[5], fields[6], fields[9], fields[7], fields[8],
+            list(channels)))
+        offset += size
+    return samples
+
+
+def parse_file(filename):
+    with open(filename, "rb") as fh:
+        data = fh.read()
+    if data.startswith(BINARY_MAGIC):
+        return parse_binary(data)
+    return parse_csv(data.decode("ascii"))
@@ -0,0 +1,178 @@
+/*
+ * Cross-check per-vCPU inline operations and conditional callbacks
+ * against plain callbacks. Any mismatch aborts.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define COND_PERIOD 100
+
+typedef struct {
+    uint64_t count_tb;
+    uint64_t count_tb_inline;
+    uint64_t count_tb_cond_track;
+    uint64_t count_tb_cond;
+    uint64_t count_insn;
+    uint64_t count_insn_inline;
+    uint64_t insn_store;
+    uint64_t count_insn_cond;
+    uint64_t count_mem;
+    uint64_t count_mem_inline;
+} CPUCount;
+
+static struct qemu_plugin_scoreboard *counts;
+static qemu_plugin_u64 count_tb;
+static qemu_plugin_u64 count_tb_inline;
+static qemu_plugin_u64 count_tb_cond_track;
+static qemu_plugin_u64 count_tb_cond;
+static qemu_plugin_u64 count_insn;
+static qemu_plugin_u64 count_insn_inline;
+static qemu_plugin_u64 insn_store;
+static qemu_plugin_u64 count_insn_cond;
+static qemu_plugin_u64 count_mem;
+static qemu_plugin_u64 count_mem_inline;
+
+static void stats_check(const char *name, qemu_plugin_u64 cb,
+                        qemu_plugin_u64 inl)
+{
+    g_autoptr(GString) out = g_string_new("");
+    uint64_t expected = qemu_plugin_u64_sum(cb);
+    uint64_t got = qemu_plugin_u64_sum(inl);
+
+    g_string_printf(out, "%s: %" PRIu64 " (callback) %" PRIu64 " (inline)\n",
+                    name, expected, got);
+    qemu_plugin_outs(out->str);
+    g_assert(expected == got);
+
+    for (int i = 0; i < qemu_plugin_num_vcpus(); ++i) {
+        g_assert(qemu_plugin_u64_get(cb, i) == qemu_plugin_u64_get(inl, i));
+    }
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *udata)
+{
+    stats_check("tb", count_tb, count_tb_inline);
+    stats_check("insn", count_insn, count_insn_inline);
+    stats_check("insn store+cond", count_insn, count_insn_cond);
+    stats_check("mem", count_mem, count_mem_inline);
+
+    for (int i = 0; i < qemu_plugin_num_vcpus(); ++i) {
+        uint64_t tb = qemu_plugin_u64_get(count_tb, i);
+        uint64_t cond = qemu_plugin_u64_get(count_tb_cond, i);
+        uint64_t track = qemu_plugin_u64_get(count_tb_cond_track, i);
+
+        g_assert(cond * COND_PERIOD + track == tb);
+    }
+
+    qemu_plugin_scoreboard_free(counts);
+}
+
+static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(count_tb, cpu_index, 1);
+}
+
+static void vcpu_tb_cond_exec(unsigned int cpu_index, void *udata)
+{
+    g_assert(qemu_plugin_u64_get(count_tb_cond_track, cpu_index) ==
+             COND_PERIOD);
+    qemu_plugin_u64_set(count_tb_cond_track, cpu_index, 0);
+    qemu_plugin_u64_add(count_tb_cond, cpu_index, 1);
+}
+
+static void vcpu_insn_exec(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(count_insn, cpu_index, 1);
+}
+
+static void vcpu_insn_cond_exec(unsigned int cpu_index, void *udata)
+{
+    uintptr_t stored = qemu_plugin_u64_get(insn_store, cpu_index);
+
+    g_assert(stored == (uintptr_t)udata);
+    qemu_plugin_u64_add(count_insn_cond, cpu_index, 1);
+}
+
+static void vcpu_mem_access(unsigned int cpu_index,
+                            qemu_plugin_meminfo_t info,
+                            uint64_t vaddr, void *udata)
+{
+    qemu_plugin_u64_add(count_mem, cpu_index, 1);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
+                                         QEMU_PLUGIN_CB_NO_REGS, NULL);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, count_tb_inline, 1);
+
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, count_tb_cond_track, 1);
+    qemu_plugin_register_vcpu_tb_exec_cond_cb(
+        tb, vcpu_tb_cond_exec, QEMU_PLUGIN_CB_NO_REGS,
+        QEMU_PLUGIN_COND_EQ, count_tb_cond_track, COND_PERIOD, NULL);
+
+    for (int idx = 0; idx < qemu_plugin_tb_n_insns(tb); ++idx) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, idx);
+        uint64_t vaddr = qemu_plugin_insn_vaddr(insn);
+
+        qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
+                                               QEMU_PLUGIN_CB_NO_REGS, NULL);
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, count_insn_inline, 1);
+
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_STORE_U64, insn_store, vaddr);
+        qemu_plugin_register_vcpu_insn_exec_cond_cb(
+            insn, vcpu_insn_cond_exec, QEMU_PLUGIN_CB_NO_REGS,
+            QEMU_PLUGIN_COND_EQ, insn_store, vaddr, (void *)(uintptr_t)vaddr);
+
+        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
+                                         QEMU_PLUGIN_CB_NO_REGS,
+                                         QEMU_PLUGIN_MEM_RW, NULL);
+        qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+            insn, QEMU_PLUGIN_MEM_RW, QEMU_PLUGIN_INLINE_ADD_U64,
+            count_mem_inline, 1);
+    }
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    counts = qemu_plugin_scoreboard_new(sizeof(CPUCount));
+    count_tb = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_tb);
+    count_tb_inline = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_tb_inline);
+    count_tb_cond_track = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_tb_cond_track);
+    count_tb_cond = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_tb_cond);
+    count_insn = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_insn);
+    count_insn_inline = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_insn_inline);
+    insn_store = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, insn_store);
+    count_insn_cond = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_insn_cond);
+    count_mem = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_mem);
+    count_mem_inline = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_mem_inline);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+
+    return 0;
+}
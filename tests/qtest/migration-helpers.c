@@ -12,6 +12,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/ctype.h"
+#include "qemu/memalign.h"
 #include "qapi/qmp/qjson.h"
 
 #include "migration-helpers.h"
@@ -292,3 +293,43 @@ char *resolve_machine_version(const char *alias, const char *var1,
 
     return find_common_machine_version(machine_name, var1, var2);
 }
+
+#ifdef O_DIRECT
+/*
+ * Probe for O_DIRECT support on the filesystem. Since O_DIRECT restricts
+ * buffer size and alignment, try an actual write.
+ */
+bool probe_o_direct_support(const char *tmpfs)
+{
+    g_autofree char *filename = g_strdup_printf("%s/probe-o-direct", tmpfs);
+    int fd, flags = O_CREAT | O_RDWR | O_TRUNC | O_DIRECT;
+    void *buf;
+    ssize_t ret, len;
+    uint64_t offset;
+
+    fd = open(filename, flags, 0660);
+    if (fd < 0) {
+        unlink(filename);
+        return false;
+    }
+
+    /*
+     * Using 1MB alignment as conservative choice to satisfy any plausible
+     * architecture default page size, and/or filesystem alignment
+     * restrictions.
+     */
+    len = 0x100000;
+    offset = 0x100000;
+
+    buf = qemu_try_memalign(len, len);
+    g_assert(buf);
+    memset(buf, 0, len);
+
+    ret = pwrite(fd, buf, len, offset);
+    unlink(filename);
+    qemu_vfree(buf);
+    close(fd);
+
+    return ret == len;
+}
+#endif
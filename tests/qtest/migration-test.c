@@ -15,10 +15,12 @@
 #include "libqtest.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qdict.h"
+#include "qemu/memfd.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/range.h"
 #include "qemu/sockets.h"
+#include "qemu/units.h"
 #include "chardev/char.h"
 #include "qapi/qapi-visit-sockets.h"
 #include "qapi/qobject-input-visitor.h"
@@ -274,6 +276,7 @@ static void read_blocktime(QTestState *who)
 
     rsp_return = migrate_query_not_failed(who);
     g_assert(qdict_haskey(rsp_return, "postcopy-blocktime"));
+    g_assert(qdict_haskey(rsp_return, "postcopy-faults"));
     qobject_unref(rsp_return);
 }
 
@@ -631,6 +634,8 @@ typedef struct {
      */
     bool hide_stderr;
     bool use_shmem;
+    /* Back guest RAM with a shared memfd, a separate one on each side */
+    bool use_memfd;
     /* only launch the target process */
     bool only_target;
     /* Use dirty ring if true; dirty logging otherwise */
@@ -756,6 +761,11 @@ static int test_migrate_start(QTestState **from, QTestState **to,
         }
     }
 
+    if (args->use_memfd && !qemu_memfd_check(0)) {
+        g_test_skip("memfd is not supported");
+        return -1;
+    }
+
     got_src_stop = false;
     got_dst_resume = false;
     if (strcmp(arch, "i386") == 0 || strcmp(arch, "x86_64") == 0) {
@@ -820,6 +830,10 @@ static int test_migrate_start(QTestState **from, QTestState **to,
             "-object memory-backend-file,id=mem0,size=%s"
             ",mem-path=%s,share=on -numa node,memdev=mem0",
             memory_size, shmem_path);
+    } else if (args->use_memfd) {
+        shmem_opts = g_strdup_printf(
+            "-object memory-backend-memfd,id=mem0,size=%s,share=on "
+            "-machine memory-backend=mem0", memory_size);
     }
 
     if (args->use_dirty_ring) {
@@ -1378,6 +1392,39 @@ static void test_postcopy_compress(void)
     test_postcopy_common(&args);
 }
 
+static void *test_migrate_postcopy_thp_start(QTestState *from,
+                                             QTestState *to)
+{
+    /* Called before migrate_postcopy_prepare() enables postcopy-ram */
+    migrate_set_capability(from, "postcopy-ram", true);
+    migrate_set_capability(to, "postcopy-ram", true);
+
+    migrate_set_capability(from, "postcopy-thp", true);
+    migrate_set_capability(to, "postcopy-thp", true);
+    migrate_set_capability(to, "postcopy-prefetch", true);
+
+    return NULL;
+}
+
+static void test_postcopy_thp(void)
+{
+    MigrateCommon args = {
+        .start_hook = test_migrate_postcopy_thp_start,
+    };
+
+    test_postcopy_common(&args);
+}
+
+static void test_postcopy_thp_shared(void)
+{
+    MigrateCommon args = {
+        .start.use_memfd = true,
+        .start_hook = test_migrate_postcopy_thp_start,
+    };
+
+    test_postcopy_common(&args);
+}
+
 static void test_postcopy_preempt(void)
 {
     MigrateCommon args = {
@@ -2124,6 +2171,279 @@ static void test_precopy_file_offset_bad(void)
     test_file_common(&args, false);
 }
 
+static void *migrate_mapped_ram_start(QTestState *from, QTestState *to)
+{
+    migrate_set_capability(from, "mapped-ram", true);
+    migrate_set_capability(to, "mapped-ram", true);
+
+    return NULL;
+}
+
+static void test_precopy_file_mapped_ram_live(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_mapped_ram_start,
+    };
+
+    test_file_common(&args, false);
+}
+
+static void test_precopy_file_mapped_ram(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_mapped_ram_start,
+    };
+
+    test_file_common(&args, true);
+}
+
+static void *migrate_mapped_ram_lazy_start(QTestState *from, QTestState *to)
+{
+    migrate_mapped_ram_start(from, to);
+
+    migrate_set_capability(to, "lazy-restore", true);
+
+    return NULL;
+}
+
+static void test_precopy_file_mapped_ram_lazy(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_mapped_ram_lazy_start,
+    };
+
+    test_file_common(&args, true);
+}
+
+/* Fill a file with @size_mb MiB, every MiB filled with its index */
+static void mapped_ram_fill_file(const char *path, unsigned size_mb)
+{
+    g_autofree uint8_t *buf = g_malloc(1 * MiB);
+    unsigned mb;
+    int fd;
+
+    fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+    g_assert(fd >= 0);
+    for (mb = 0; mb < size_mb; mb++) {
+        memset(buf, mb % 255 + 1, 1 * MiB);
+        g_assert_cmpint(write(fd, buf, 1 * MiB), ==, 1 * MiB);
+    }
+    close(fd);
+}
+
+/*
+ * Restore a stopped guest whose RAM is all data, and return how long the
+ * destination took to become ready to run, in milliseconds.
+ */
+static int64_t mapped_ram_restore_time(const char *uri, unsigned size_mb,
+                                       bool lazy)
+{
+    QTestState *to;
+    int64_t start, elapsed;
+    unsigned mb;
+
+    to = qtest_initf("-accel tcg -machine q35 -m %uM -incoming defer",
+                     size_mb);
+    migrate_set_capability(to, "mapped-ram", true);
+    migrate_set_capability(to, "lazy-restore", lazy);
+
+    start = g_get_monotonic_time();
+    migrate_incoming_qmp(to, uri, "{}");
+    wait_for_migration_complete(to);
+    elapsed = (g_get_monotonic_time() - start) / 1000;
+
+    /* See mapped_ram_fill_file() */
+    for (mb = 16; mb < size_mb; mb += 64) {
+        g_assert_cmpint(qtest_readb(to, (uint64_t)mb << 20), ==,
+                        mb % 255 + 1);
+    }
+
+    qtest_quit(to);
+    return elapsed;
+}
+
+/*
+ * Report how long restoring a mapped-ram file takes before the guest can
+ * run, with and without lazy-restore, for growing amounts of guest RAM.
+ * Without lazy-restore the time grows with the RAM size; with it, only
+ * the bitmaps and device state are read up front.
+ */
+static void test_precopy_file_mapped_ram_lazy_timing(void)
+{
+    static const unsigned sizes_mb[] = { 256, 1024 };
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    g_autofree char *ram_path = g_strdup_printf("%s/lazy-ram", tmpfs);
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(sizes_mb); i++) {
+        unsigned size_mb = sizes_mb[i];
+        int64_t eager_ms, lazy_ms;
+        QTestState *from;
+
+        mapped_ram_fill_file(ram_path, size_mb);
+
+        /* A private mapping of the file gives a source with no zero pages */
+        from = qtest_initf("-accel tcg -machine q35,memory-backend=mem0 -S "
+                           "-m %uM -object memory-backend-file,id=mem0,"
+                           "size=%uM,mem-path=%s,share=off",
+                           size_mb, size_mb, ram_path);
+        migrate_set_capability(from, "mapped-ram", true);
+        migrate_qmp(from, uri, "{}");
+        wait_for_migration_complete(from);
+        qtest_quit(from);
+        unlink(ram_path);
+
+        eager_ms = mapped_ram_restore_time(uri, size_mb, false);
+        lazy_ms = mapped_ram_restore_time(uri, size_mb, true);
+        g_test_message("%u MiB: ready to run after %" PRId64 " ms, "
+                       "%" PRId64 " ms with lazy-restore",
+                       size_mb, eager_ms, lazy_ms);
+        cleanup(FILE_TEST_FILENAME);
+    }
+}
+
+/*
+ * Report how long savevm keeps a guest whose RAM is all data paused, and
+ * how long loadvm takes, with mapped-ram and a growing number of multifd
+ * channels.  Without multifd the main thread writes all of RAM itself.
+ */
+static void test_savevm_mapped_ram_multifd_timing(void)
+{
+    static const unsigned channels[] = { 0, 1, 2, 4, 8 };
+    const unsigned size_mb = 1024;
+    g_autofree char *ram_path = g_strdup_printf("%s/savevm-ram", tmpfs);
+    g_autofree char *img_path = g_strdup_printf("%s/savevm.qcow2", tmpfs);
+    QTestState *vm;
+    int i;
+
+    if (!mkimg(img_path, "qcow2", 64)) {
+        g_test_skip("qemu-img is not available");
+        return;
+    }
+    mapped_ram_fill_file(ram_path, size_mb);
+
+    vm = qtest_initf("-accel tcg -machine q35,memory-backend=mem0 -S "
+                     "-m %uM -object memory-backend-file,id=mem0,"
+                     "size=%uM,mem-path=%s,share=off "
+                     "-drive if=none,id=d0,file=%s,format=qcow2",
+                     size_mb, size_mb, ram_path, img_path);
+    unlink(ram_path);
+    migrate_set_capability(vm, "mapped-ram", true);
+
+    for (i = 0; i < ARRAY_SIZE(channels); i++) {
+        int64_t start, save_ms, load_ms;
+        char *out;
+
+        migrate_set_capability(vm, "multifd", channels[i] > 0);
+        if (channels[i]) {
+            migrate_set_parameter_int(vm, "multifd-channels", channels[i]);
+        }
+
+        start = g_get_monotonic_time();
+        out = qtest_hmp(vm, "savevm snap0");
+        save_ms = (g_get_monotonic_time() - start) / 1000;
+        g_assert_cmpstr(out, ==, "");
+        g_free(out);
+
+        start = g_get_monotonic_time();
+        out = qtest_hmp(vm, "loadvm snap0");
+        load_ms = (g_get_monotonic_time() - start) / 1000;
+        g_assert_cmpstr(out, ==, "");
+        g_free(out);
+
+        g_free(qtest_hmp(vm, "delvm snap0"));
+        g_test_message("%u MiB, %u multifd channels: savevm %" PRId64
+                       " ms, loadvm %" PRId64 " ms",
+                       size_mb, channels[i], save_ms, load_ms);
+    }
+
+    qtest_quit(vm);
+    unlink(img_path);
+}
+
+static void *migrate_multifd_mapped_ram_start(QTestState *from, QTestState *to)
+{
+    migrate_mapped_ram_start(from, to);
+
+    migrate_set_parameter_int(from, "multifd-channels", 4);
+    migrate_set_parameter_int(to, "multifd-channels", 4);
+
+    migrate_set_capability(from, "multifd", true);
+    migrate_set_capability(to, "multifd", true);
+
+    return NULL;
+}
+
+static void test_multifd_file_mapped_ram_live(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_multifd_mapped_ram_start,
+    };
+
+    test_file_common(&args, false);
+}
+
+static void test_multifd_file_mapped_ram(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_multifd_mapped_ram_start,
+    };
+
+    test_file_common(&args, true);
+}
+
+#ifdef O_DIRECT
+static void *migrate_multifd_mapped_ram_dio_start(QTestState *from,
+                                                  QTestState *to)
+{
+    migrate_multifd_mapped_ram_start(from, to);
+
+    migrate_set_parameter_bool(from, "direct-io", true);
+    migrate_set_parameter_bool(to, "direct-io", true);
+
+    return NULL;
+}
+
+static void test_multifd_file_mapped_ram_dio(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_multifd_mapped_ram_dio_start,
+    };
+
+    if (!probe_o_direct_support(tmpfs)) {
+        g_test_skip("Filesystem does not support O_DIRECT");
+        return;
+    }
+
+    test_file_common(&args, true);
+}
+#endif
+
 static void *test_mode_reboot_start(QTestState *from, QTestState *to)
 {
     migrate_set_parameter_str(from, "mode", "cpr-reboot");
@@ -2185,6 +2505,149 @@ static void test_precopy_tcp_switchover_ack(void)
     test_precopy_common(&args);
 }
 
+static void *test_migrate_parallel_device_load_start(QTestState *from,
+                                                     QTestState *to)
+{
+    migrate_set_capability(from, "parallel-device-load", true);
+    migrate_set_capability(to, "parallel-device-load", true);
+
+    return NULL;
+}
+
+/*
+ * Check that @who reports the time spent on each section, and that some
+ * time was spent saving (or loading) device state.
+ */
+static void check_vmstate_timing(QTestState *who, const char *key)
+{
+    QDict *rsp;
+    QList *list;
+    const QListEntry *entry;
+    uint64_t total = 0;
+
+    rsp = qtest_qmp(who, "{ 'execute': 'query-vmstate-timing' }");
+    list = qdict_get_qlist(rsp, "return");
+    g_assert(list);
+    g_assert(!qlist_empty(list));
+
+    QLIST_FOREACH_ENTRY(list, entry) {
+        QDict *timing = qobject_to(QDict, qlist_entry_obj(entry));
+
+        g_assert(timing);
+        g_assert(qdict_haskey(timing, "id"));
+        g_assert(qdict_haskey(timing, "save-time"));
+        g_assert(qdict_haskey(timing, "load-time"));
+        /* Entries that took no time at all are not reported */
+        g_assert_cmpint(qdict_get_int(timing, "save-time") +
+                        qdict_get_int(timing, "load-time"), >, 0);
+        total += qdict_get_int(timing, key);
+    }
+    g_assert_cmpint(total, >, 0);
+
+    qobject_unref(rsp);
+}
+
+static void test_migrate_parallel_device_load_finish(QTestState *from,
+                                                     QTestState *to,
+                                                     void *opaque)
+{
+    check_vmstate_timing(from, "save-time");
+    check_vmstate_timing(to, "load-time");
+}
+
+static void test_precopy_tcp_parallel_device_load(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "tcp:127.0.0.1:0",
+        .start_hook = test_migrate_parallel_device_load_start,
+        .finish_hook = test_migrate_parallel_device_load_finish,
+    };
+
+    test_precopy_common(&args);
+}
+
+static void *test_migrate_samples_start(QTestState *from, QTestState *to)
+{
+    g_autofree char *path = g_strdup_printf("%s/migsamples", tmpfs);
+
+    qtest_qmp_assert_success(from, "{ 'execute': 'migrate-sample-stream',"
+                             "  'arguments': { 'filename': %s,"
+                             "                 'format': 'csv' } }", path);
+
+    return NULL;
+}
+
+static void test_migrate_samples_finish(QTestState *from, QTestState *to,
+                                        void *opaque)
+{
+    g_autofree char *path = g_strdup_printf("%s/migsamples", tmpfs);
+    g_autofree char *contents = NULL;
+    g_auto(GStrv) lines = NULL;
+    const QListEntry *entry;
+    int64_t last_time = -1;
+    uint64_t transferred = 0;
+    uint64_t total;
+    QDict *rsp;
+    QList *list;
+    int count = 0;
+
+    /* Stop streaming so that the file is complete */
+    qtest_qmp_assert_success(from, "{ 'execute': 'migrate-sample-stream' }");
+
+    rsp = qtest_qmp(from, "{ 'execute': 'query-migrate-samples' }");
+    list = qdict_get_qlist(rsp, "return");
+    g_assert(list);
+
+    QLIST_FOREACH_ENTRY(list, entry) {
+        QDict *sample = qobject_to(QDict, qlist_entry_obj(entry));
+        int64_t time;
+
+        g_assert(sample);
+        g_assert(qdict_haskey(sample, "transferred"));
+        g_assert(qdict_haskey(sample, "compression-ratio"));
+        g_assert(qdict_haskey(sample, "expected-downtime"));
+        time = qdict_get_int(sample, "time");
+        g_assert_cmpint(time, >, last_time);
+        last_time = time;
+        transferred += qdict_get_int(sample, "transferred");
+        count++;
+    }
+    g_assert_cmpint(count, >, 0);
+    qobject_unref(rsp);
+
+    /*
+     * The samples cover the whole migration but its setup, which sends
+     * little more than the list of RAM blocks.
+     */
+    total = read_ram_property_int(from, "transferred");
+    g_assert_cmpint(transferred, <=, total);
+    g_assert_cmpint(transferred, >=, total - total / 10);
+
+    /* A header, then one line per sample */
+    g_assert(g_file_get_contents(path, &contents, NULL, NULL));
+    lines = g_strsplit(contents, "\n", -1);
+    g_assert(g_str_has_prefix(lines[0], "time,"));
+    g_assert_cmpint(g_strv_length(lines), ==, count + 2);
+    g_assert_cmpstr(lines[count + 1], ==, "");
+
+    cleanup("migsamples");
+}
+
+static void test_precopy_unix_samples(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .listen_uri = uri,
+        .connect_uri = uri,
+        .start_hook = test_migrate_samples_start,
+        .finish_hook = test_migrate_samples_finish,
+        /* Run long enough for a few iterations of the migration thread */
+        .live = true,
+    };
+
+    test_precopy_common(&args);
+}
+
 #ifdef CONFIG_GNUTLS
 static void test_precopy_tcp_tls_psk_match(void)
 {
@@ -2529,6 +2992,55 @@ static void test_migrate_auto_converge(void)
     test_migrate_end(from, to, true);
 }
 
+/*
+ * The sync of the migration bitmap skips chunks whose summary bit is
+ * clear.  Dirty memory that the guest never touches, so that nothing
+ * but these writes marks its chunk: the summary bit must be set with the
+ * first write, cleared by the sync that collects it, and set again by a
+ * later write to the same chunk.
+ */
+static void test_precopy_unix_dirty_chunks(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateStart args = {};
+    QTestState *from, *to;
+    /* Past the loop of the guest, both addresses in the same chunk */
+    uint64_t addr_a = end_address + 16 * 1024 * 1024 + 0x100;
+    uint64_t addr_b = addr_a + 64 * 1024;
+
+    if (test_migrate_start(&from, &to, uri, &args)) {
+        return;
+    }
+
+    migrate_ensure_non_converge(from);
+    wait_for_serial("src_serial");
+    migrate_qmp(from, uri, "{}");
+
+    /* Wait until the bulk stage is over */
+    wait_for_migration_pass(from);
+
+    qtest_writeb(from, addr_a, 0x11);
+    wait_for_migration_pass(from);
+    g_assert_false(got_src_stop);
+
+    /* The previous sync collected the chunk, dirty it again */
+    qtest_writeb(from, addr_b, 0x22);
+    qtest_writeb(from, addr_a, 0x33);
+
+    migrate_ensure_converge(from);
+    wait_for_migration_complete(from);
+    if (!got_src_stop) {
+        qtest_qmp_eventwait(from, "STOP");
+    }
+    qtest_qmp_eventwait(to, "RESUME");
+
+    g_assert_cmpint(qtest_readb(to, addr_a), ==, 0x33);
+    g_assert_cmpint(qtest_readb(to, addr_b), ==, 0x22);
+
+    wait_for_serial("dest_serial");
+    test_migrate_end(from, to, true);
+}
+
 static void *
 test_migrate_precopy_tcp_multifd_start_common(QTestState *from,
                                               QTestState *to,
@@ -2556,6 +3068,24 @@ test_migrate_precopy_tcp_multifd_start(QTestState *from,
     return test_migrate_precopy_tcp_multifd_start_common(from, to, "none");
 }
 
+static void *
+test_migrate_precopy_tcp_multifd_zero_page_start(QTestState *from,
+                                                 QTestState *to)
+{
+    test_migrate_precopy_tcp_multifd_start_common(from, to, "none");
+    migrate_set_parameter_str(from, "zero-page-detection", "multifd");
+    return NULL;
+}
+
+static void *
+test_migrate_precopy_tcp_multifd_no_zero_page_start(QTestState *from,
+                                                    QTestState *to)
+{
+    test_migrate_precopy_tcp_multifd_start_common(from, to, "none");
+    migrate_set_parameter_str(from, "zero-page-detection", "none");
+    return NULL;
+}
+
 static void *
 test_migrate_precopy_tcp_multifd_zlib_start(QTestState *from,
                                             QTestState *to)
@@ -2572,6 +3102,31 @@ test_migrate_precopy_tcp_multifd_zstd_start(QTestState *from,
 }
 #endif /* CONFIG_ZSTD */
 
+#ifdef CONFIG_LZ4
+static void *
+test_migrate_precopy_tcp_multifd_lz4_start(QTestState *from,
+                                           QTestState *to)
+{
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "lz4");
+}
+
+static void *
+test_migrate_precopy_tcp_multifd_adaptive_start(QTestState *from,
+                                                QTestState *to)
+{
+    return test_migrate_precopy_tcp_multifd_start_common(from, to,
+                                                         "adaptive");
+}
+#endif /* CONFIG_LZ4 */
+
+static void *
+test_migrate_precopy_tcp_multifd_xbzrle_start(QTestState *from,
+                                              QTestState *to)
+{
+    test_migrate_xbzrle_start(from, to);
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "none");
+}
+
 static void test_multifd_tcp_none(void)
 {
     MigrateCommon args = {
@@ -2587,6 +3142,26 @@ static void test_multifd_tcp_none(void)
     test_precopy_common(&args);
 }
 
+static void test_multifd_tcp_zero_page(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_zero_page_start,
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
+
+static void test_multifd_tcp_no_zero_page(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_no_zero_page_start,
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
+
 static void test_multifd_tcp_zlib(void)
 {
     MigrateCommon args = {
@@ -2607,6 +3182,43 @@ static void test_multifd_tcp_zstd(void)
 }
 #endif
 
+static void test_multifd_tcp_xbzrle(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_xbzrle_start,
+        .iterations = 2,
+        /*
+         * Like without multifd, pages are cached from the 2nd round on
+         * and only hit the cache when they are sent again.
+         */
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
+
+#ifdef CONFIG_LZ4
+static void test_multifd_tcp_lz4(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_lz4_start,
+    };
+    test_precopy_common(&args);
+}
+
+static void test_multifd_tcp_adaptive(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_adaptive_start,
+        /* Let the channels switch methods while the guest runs */
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
+#endif
+
 #ifdef CONFIG_GNUTLS
 static void *
 test_migrate_multifd_tcp_tls_psk_start_match(QTestState *from,
@@ -3342,6 +3954,9 @@ int main(int argc, char **argv)
         qtest_add_func("/migration/postcopy/plain", test_postcopy);
         qtest_add_func("/migration/postcopy/recovery/plain",
                        test_postcopy_recovery);
+        qtest_add_func("/migration/postcopy/thp/plain", test_postcopy_thp);
+        qtest_add_func("/migration/postcopy/thp/shared",
+                       test_postcopy_thp_shared);
         qtest_add_func("/migration/postcopy/preempt/plain", test_postcopy_preempt);
         qtest_add_func("/migration/postcopy/preempt/recovery/plain",
                        test_postcopy_preempt_recovery);
@@ -3366,6 +3981,8 @@ int main(int argc, char **argv)
 #endif
     qtest_add_func("/migration/precopy/unix/plain", test_precopy_unix_plain);
     qtest_add_func("/migration/precopy/unix/xbzrle", test_precopy_unix_xbzrle);
+    qtest_add_func("/migration/precopy/unix/dirty-chunks",
+                   test_precopy_unix_dirty_chunks);
     /*
      * Compression fails from time to time.
      * Put test here but don't enable it until everything is fixed.
@@ -3384,6 +4001,33 @@ int main(int argc, char **argv)
     qtest_add_func("/migration/precopy/file/offset/bad",
                    test_precopy_file_offset_bad);
 
+    qtest_add_func("/migration/precopy/file/mapped-ram",
+                   test_precopy_file_mapped_ram);
+    qtest_add_func("/migration/precopy/file/mapped-ram/live",
+                   test_precopy_file_mapped_ram_live);
+
+    if (has_uffd) {
+        qtest_add_func("/migration/precopy/file/mapped-ram/lazy",
+                       test_precopy_file_mapped_ram_lazy);
+        if (g_test_slow() && g_str_equal(arch, "x86_64")) {
+            qtest_add_func("/migration/precopy/file/mapped-ram/lazy/timing",
+                           test_precopy_file_mapped_ram_lazy_timing);
+        }
+    }
+
+    qtest_add_func("/migration/multifd/file/mapped-ram",
+                   test_multifd_file_mapped_ram);
+    qtest_add_func("/migration/multifd/file/mapped-ram/live",
+                   test_multifd_file_mapped_ram_live);
+#ifdef O_DIRECT
+    qtest_add_func("/migration/multifd/file/mapped-ram/dio",
+                   test_multifd_file_mapped_ram_dio);
+#endif
+    if (g_test_slow() && g_str_equal(arch, "x86_64")) {
+        qtest_add_func("/migration/multifd/savevm/mapped-ram/timing",
+                       test_savevm_mapped_ram_multifd_timing);
+    }
+
     /*
      * Our CI system has problems with shared memory.
      * Don't run this test until we find a workaround.
@@ -3422,6 +4066,10 @@ int main(int argc, char **argv)
 
     qtest_add_func("/migration/precopy/tcp/plain/switchover-ack",
                    test_precopy_tcp_switchover_ack);
+    qtest_add_func("/migration/precopy/tcp/plain/parallel-device-load",
+                   test_precopy_tcp_parallel_device_load);
+    qtest_add_func("/migration/precopy/unix/plain/samples",
+                   test_precopy_unix_samples);
 
 #ifdef CONFIG_GNUTLS
     qtest_add_func("/migration/precopy/tcp/tls/psk/match",
@@ -3468,6 +4116,10 @@ int main(int argc, char **argv)
     }
     qtest_add_func("/migration/multifd/tcp/plain/none",
                    test_multifd_tcp_none);
+    qtest_add_func("/migration/multifd/tcp/plain/zero-page/multifd",
+                   test_multifd_tcp_zero_page);
+    qtest_add_func("/migration/multifd/tcp/plain/zero-page/none",
+                   test_multifd_tcp_no_zero_page);
     /*
      * This test is flaky and sometimes fails in CI and otherwise:
      * don't run unless user opts in via environment variable.
@@ -3481,6 +4133,14 @@ int main(int argc, char **argv)
 #ifdef CONFIG_ZSTD
     qtest_add_func("/migration/multifd/tcp/plain/zstd",
                    test_multifd_tcp_zstd);
+#endif
+    qtest_add_func("/migration/multifd/tcp/plain/xbzrle",
+                   test_multifd_tcp_xbzrle);
+#ifdef CONFIG_LZ4
+    qtest_add_func("/migration/multifd/tcp/plain/lz4",
+                   test_multifd_tcp_lz4);
+    qtest_add_func("/migration/multifd/tcp/plain/adaptive",
+                   test_multifd_tcp_adaptive);
 #endif
 #ifdef CONFIG_GNUTLS
     qtest_add_func("/migration/multifd/tcp/tls/psk/match",
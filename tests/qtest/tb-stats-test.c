@@ -0,0 +1,233 @@
+/*
+ * QTest testcase for the TB statistics commands
+ *
+ * Lets the firmware run with collection started, then checks the counters
+ * of the hottest blocks, that "reset" clears them and that "stop" drops
+ * every entry.  A second case polls a device from the middle of a block
+ * and uses the counters to check that the block is cut at the I/O insn
+ * once, instead of being rewound on every execution.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+
+/* How long to wait for the guest and for deferred work, in 10ms steps */
+#define TB_STATS_RETRIES 1000
+
+static QList *query_tb_stats(QTestState *qts, const char *sort_by)
+{
+    QDict *rsp;
+    QList *ret;
+
+    rsp = qtest_qmp(qts, "{ 'execute': 'x-query-tb-stats',"
+                    "  'arguments': { 'top': 16, 'sort-by': %s } }",
+                    sort_by);
+    g_assert(qdict_haskey(rsp, "return"));
+    ret = qdict_get_qlist(rsp, "return");
+    qobject_ref(ret);
+    qobject_unref(rsp);
+    return ret;
+}
+
+static void tb_stats_action(QTestState *qts, const char *action)
+{
+    qtest_qmp_assert_success(qts, "{ 'execute': 'x-tb-stats',"
+                             "  'arguments': { 'action': %s } }", action);
+}
+
+/* Wait until the top @sort_by entry has a non-zero @key */
+static QList *wait_tb_stats(QTestState *qts, const char *sort_by,
+                            const char *key)
+{
+    for (int i = 0; i < TB_STATS_RETRIES; i++) {
+        QList *list = query_tb_stats(qts, sort_by);
+
+        if (!qlist_empty(list) &&
+            qdict_get_int(qobject_to(QDict, qlist_peek(list)), key)) {
+            return list;
+        }
+        qobject_unref(list);
+        g_usleep(10 * 1000);
+    }
+    g_assert_not_reached();
+}
+
+static void test_tb_stats(void)
+{
+    QTestState *qts = qtest_init("-machine pc -accel tcg");
+    QListEntry *e;
+    QList *list;
+    uint64_t prev;
+
+    /* Nothing is collected until started */
+    list = query_tb_stats(qts, "executions");
+    g_assert(qlist_empty(list));
+    qobject_unref(list);
+
+    tb_stats_action(qts, "start");
+    list = wait_tb_stats(qts, "executions", "executions");
+    prev = UINT64_MAX;
+    QLIST_FOREACH_ENTRY(list, e) {
+        QDict *s = qobject_to(QDict, qlist_entry_obj(e));
+        uint64_t executions = qdict_get_int(s, "executions");
+
+        /* sorted, and every block was translated before it ran */
+        g_assert_cmpuint(executions, <=, prev);
+        prev = executions;
+        g_assert_cmpint(qdict_get_int(s, "translations"), >=, 1);
+        g_assert_cmpint(qdict_get_int(s, "instructions"), >=, 1);
+        g_assert_cmpint(qdict_get_int(s, "guest-size"), >=, 1);
+        g_assert_cmpint(qdict_get_int(s, "host-size"), >=, 1);
+    }
+    qobject_unref(list);
+    list = wait_tb_stats(qts, "translations", "translations");
+    qobject_unref(list);
+
+    /* With the guest paused, nothing can count behind our back */
+    qtest_qmp_assert_success(qts, "{ 'execute': 'stop' }");
+    tb_stats_action(qts, "reset");
+    list = query_tb_stats(qts, "executions");
+    g_assert(!qlist_empty(list));
+    QLIST_FOREACH_ENTRY(list, e) {
+        QDict *s = qobject_to(QDict, qlist_entry_obj(e));
+
+        g_assert_cmpint(qdict_get_int(s, "executions"), ==, 0);
+        g_assert_cmpint(qdict_get_int(s, "translations"), ==, 0);
+        g_assert_cmpint(qdict_get_int(s, "invalidations"), ==, 0);
+    }
+    qobject_unref(list);
+
+    /* Stopping frees the entries once the code cache flush has run */
+    tb_stats_action(qts, "stop");
+    for (int i = 0; ; i++) {
+        g_assert_cmpint(i, <, TB_STATS_RETRIES);
+        list = query_tb_stats(qts, "executions");
+        if (qlist_empty(list)) {
+            break;
+        }
+        qobject_unref(list);
+        g_usleep(10 * 1000);
+    }
+    qobject_unref(list);
+
+    /* and new blocks are no longer counted */
+    qtest_qmp_assert_success(qts, "{ 'execute': 'cont' }");
+    g_usleep(100 * 1000);
+    list = query_tb_stats(qts, "executions");
+    g_assert(qlist_empty(list));
+    qobject_unref(list);
+
+    qtest_quit(qts);
+}
+
+/*
+ * A 64k BIOS that polls VGA memory from the middle of a loop.  It runs
+ * from the reset vector in real mode, 0xffff0000 being the CS base.
+ */
+#define IO_LOOP_PC 0xffff0005
+
+static const uint8_t bios_io_loop[] = {
+    0xb8, 0x00, 0xa0,           /* mov ax, 0xa000 */
+    0x8e, 0xd8,                 /* mov ds, ax */
+    0x41,                       /* loop: inc cx */
+    0xa0, 0x00, 0x00,           /* mov al, [0] */
+    0x42,                       /* inc dx */
+    0xeb, 0xf9,                 /* jmp loop */
+};
+
+static const uint8_t bios_reset_vector[] = {
+    0xe9, 0x0d, 0x00,           /* jmp 0x0000 */
+};
+
+static char *write_io_loop_bios(void)
+{
+    g_autofree uint8_t *rom = g_malloc0(64 * KiB);
+    char *path;
+    int fd;
+
+    memcpy(rom, bios_io_loop, sizeof(bios_io_loop));
+    memcpy(rom + 0xfff0, bios_reset_vector, sizeof(bios_reset_vector));
+
+    fd = g_file_open_tmp("tb-stats-bios-XXXXXX", &path, NULL);
+    g_assert(fd >= 0);
+    g_assert(write(fd, rom, 64 * KiB) == 64 * KiB);
+    close(fd);
+    return path;
+}
+
+static QDict *find_tb_stats(QList *list, uint64_t pc)
+{
+    QListEntry *e;
+
+    QLIST_FOREACH_ENTRY(list, e) {
+        QDict *s = qobject_to(QDict, qlist_entry_obj(e));
+
+        if (qdict_get_int(s, "pc") == pc) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static void test_io_hint(void)
+{
+    g_autofree char *bios = write_io_loop_bios();
+    QTestState *qts;
+    QList *list = NULL;
+    QDict *s = NULL;
+    int64_t executions, translations;
+
+    qts = qtest_initf("-machine pc -vga std -accel tcg -bios %s -S", bios);
+    tb_stats_action(qts, "start");
+    qtest_qmp_assert_success(qts, "{ 'execute': 'cont' }");
+
+    for (int i = 0; i < TB_STATS_RETRIES; i++) {
+        list = query_tb_stats(qts, "executions");
+        s = find_tb_stats(list, IO_LOOP_PC);
+        if (s && qdict_get_int(s, "executions") >= 100000) {
+            break;
+        }
+        qobject_unref(list);
+        list = NULL;
+        g_usleep(10 * 1000);
+    }
+    g_assert(list);
+
+    /*
+     * The first translation ran past the load, which invalidated it; the
+     * second one ends on the load and is the one that keeps running.
+     */
+    executions = qdict_get_int(s, "executions");
+    translations = qdict_get_int(s, "translations");
+    g_assert_cmpint(translations, <=, 2);
+    g_assert_cmpint(qdict_get_int(s, "invalidations"), <=, 1);
+    g_assert_cmpint(qdict_get_int(s, "instructions"), ==, 2);
+    g_test_message("I/O polling block: %" PRId64 " executions, %" PRId64
+                   " translations, so %" PRId64 " cpu_io_recompile() "
+                   "rewinds avoided", executions, translations,
+                   executions - 1);
+    qobject_unref(list);
+
+    qtest_quit(qts);
+    unlink(bios);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (!qtest_has_accel("tcg")) {
+        g_test_skip("TB statistics need TCG");
+        return g_test_run();
+    }
+
+    qtest_add_func("tb-stats/start-reset-stop", test_tb_stats);
+    qtest_add_func("tb-stats/io-hint", test_io_hint);
+
+    return g_test_run();
+}
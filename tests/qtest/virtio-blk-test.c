@@ -20,6 +20,7 @@
 #define TEST_IMAGE_SIZE         (64 * 1024 * 1024)
 #define QVIRTIO_BLK_TIMEOUT_US  (30 * 1000 * 1000)
 #define PCI_SLOT_HP             0x06
+#define MQ_NUM_QUEUES           4
 
 typedef struct QVirtioBlkReq {
     uint32_t type;
@@ -746,6 +747,147 @@ static void test_nonexistent_virtqueue(void *obj, void *data,
     g_free(dev);
 }
 
+/* Queue a one sector read or write on @vq and kick it */
+static uint64_t virtio_blk_rw_submit(QTestState *qts, QGuestAllocator *alloc,
+                                     QVirtioDevice *dev, QVirtQueue *vq,
+                                     uint32_t type, uint64_t sector,
+                                     char *data, uint32_t *free_head)
+{
+    QVirtioBlkReq req = {
+        .type = type,
+        .ioprio = 1,
+        .sector = sector,
+        .data = data,
+    };
+    uint64_t req_addr = virtio_blk_request(alloc, dev, &req, 512);
+
+    *free_head = qvirtqueue_add(qts, vq, req_addr, 16, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 16, 512, type == VIRTIO_BLK_T_IN, true);
+    qvirtqueue_add(qts, vq, req_addr + 528, 1, true, false);
+    qvirtqueue_kick(qts, dev, vq, *free_head);
+
+    return req_addr;
+}
+
+/*
+ * The queues share one interrupt status register without MSI-X, so poll
+ * the used ring instead of waiting for the interrupt.
+ */
+static void virtio_blk_wait_used(QTestState *qts, QVirtQueue *vq,
+                                 uint32_t desc_idx)
+{
+    gint64 start_time = g_get_monotonic_time();
+    uint32_t got_desc_idx;
+
+    for (;;) {
+        qtest_clock_step(qts, 100);
+
+        if (qvirtqueue_get_buf(qts, vq, &got_desc_idx, NULL)) {
+            g_assert_cmpint(got_desc_idx, ==, desc_idx);
+            return;
+        }
+
+        g_assert(g_get_monotonic_time() - start_time <=
+                 QVIRTIO_BLK_TIMEOUT_US);
+    }
+}
+
+/*
+ * Spread the queues of a device over two IOThreads, write a different
+ * pattern through each queue with all requests in flight together, and
+ * read every sector back through a queue that runs in the other IOThread.
+ */
+static void iothread_vq_mapping(void *obj, void *data,
+                                QGuestAllocator *t_alloc)
+{
+    QVirtioPCIDevice *dev1 = obj;
+    QVirtioPCIDevice *pdev;
+    QVirtioDevice *dev;
+    QTestState *qts = dev1->pdev->bus->qts;
+    QVirtQueue *vq[MQ_NUM_QUEUES];
+    uint64_t req_addr[MQ_NUM_QUEUES];
+    uint32_t free_head[MQ_NUM_QUEUES];
+    uint64_t features;
+    char buf[512], expected[512];
+    int i;
+
+    if (dev1->pdev->bus->not_hotpluggable) {
+        g_test_skip("pci bus does not support hotplug");
+        return;
+    }
+
+    /* Queues 0 and 2 run in iothread0, queues 1 and 3 in iothread1 */
+    qtest_qmp_device_add(qts, "virtio-blk-pci", "drv2",
+                         "{'addr': %s, 'drive': 'drive2', 'num-queues': %d, "
+                         " 'iothread-vq-mapping': [{'iothread': 'iothread0'},"
+                         "                         {'iothread': 'iothread1'}]}",
+                         stringify(PCI_SLOT_HP) ".0", MQ_NUM_QUEUES);
+
+    pdev = virtio_pci_new(dev1->pdev->bus, &(QPCIAddress) {
+                              .devfn = QPCI_DEVFN(PCI_SLOT_HP, 0)
+                          });
+    g_assert_nonnull(pdev);
+    dev = &pdev->vdev;
+    g_assert_cmpint(dev->device_type, ==, VIRTIO_ID_BLOCK);
+
+    qvirtio_pci_device_enable(pdev);
+    qvirtio_start_device(dev);
+
+    features = qvirtio_get_features(dev);
+    g_assert(features & (1u << VIRTIO_BLK_F_MQ));
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                            (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                            (1u << VIRTIO_RING_F_EVENT_IDX) |
+                            (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    g_assert_cmpint(qvirtio_config_readw(dev,
+                        offsetof(struct virtio_blk_config, num_queues)),
+                    ==, MQ_NUM_QUEUES);
+
+    for (i = 0; i < MQ_NUM_QUEUES; i++) {
+        vq[i] = qvirtqueue_setup(dev, t_alloc, i);
+    }
+    qvirtio_set_driver_ok(dev);
+
+    for (i = 0; i < MQ_NUM_QUEUES; i++) {
+        memset(buf, 'a' + i, sizeof(buf));
+        req_addr[i] = virtio_blk_rw_submit(qts, t_alloc, dev, vq[i],
+                                           VIRTIO_BLK_T_OUT, i, buf,
+                                           &free_head[i]);
+    }
+    for (i = 0; i < MQ_NUM_QUEUES; i++) {
+        virtio_blk_wait_used(qts, vq[i], free_head[i]);
+        g_assert_cmpint(readb(req_addr[i] + 528), ==, 0);
+        guest_free(t_alloc, req_addr[i]);
+    }
+
+    memset(buf, 0, sizeof(buf));
+    for (i = 0; i < MQ_NUM_QUEUES; i++) {
+        req_addr[i] = virtio_blk_rw_submit(qts, t_alloc, dev,
+                                           vq[(i + 1) % MQ_NUM_QUEUES],
+                                           VIRTIO_BLK_T_IN, i, buf,
+                                           &free_head[i]);
+    }
+    for (i = 0; i < MQ_NUM_QUEUES; i++) {
+        virtio_blk_wait_used(qts, vq[(i + 1) % MQ_NUM_QUEUES], free_head[i]);
+        g_assert_cmpint(readb(req_addr[i] + 528), ==, 0);
+
+        memread(req_addr[i] + 16, buf, sizeof(buf));
+        memset(expected, 'a' + i, sizeof(expected));
+        g_assert_cmpmem(buf, sizeof(buf), expected, sizeof(expected));
+        guest_free(t_alloc, req_addr[i]);
+    }
+
+    for (i = 0; i < MQ_NUM_QUEUES; i++) {
+        qvirtqueue_cleanup(dev->bus, vq[i], t_alloc);
+    }
+    qvirtio_pci_device_disable(pdev);
+    qos_object_destroy((QOSGraphObject *)pdev);
+
+    qpci_unplug_acpi_device_test(qts, "drv2", PCI_SLOT_HP);
+}
+
 static void resize(void *obj, void *data, QGuestAllocator *t_alloc)
 {
     QVirtioBlk *blk_if = obj;
@@ -785,6 +927,20 @@ static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
     return arg;
 }
 
+static void *virtio_blk_test_setup_iothreads(GString *cmd_line, void *arg)
+{
+    char *tmp_path = drive_create();
+
+    g_string_append_printf(cmd_line,
+                           " -object iothread,id=iothread0 "
+                           "-object iothread,id=iothread1 "
+                           "-drive if=none,id=drive2,file=%s,"
+                           "format=raw,auto-read-only=off ",
+                           tmp_path);
+
+    return virtio_blk_test_setup(cmd_line, arg);
+}
+
 static void register_virtio_blk_test(void)
 {
     QOSGraphTestOptions opts = {
@@ -802,6 +958,10 @@ static void register_virtio_blk_test(void)
     qos_add_test("nxvirtq", "virtio-blk-pci",
                       test_nonexistent_virtqueue, &opts);
     qos_add_test("hotplug", "virtio-blk-pci", pci_hotplug, &opts);
+
+    opts.before = virtio_blk_test_setup_iothreads;
+    qos_add_test("iothread-vq-mapping", "virtio-blk-pci", iothread_vq_mapping,
+                 &opts);
 }
 
 libqos_init(register_virtio_blk_test);
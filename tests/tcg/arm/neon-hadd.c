@@ -0,0 +1,153 @@
+/*
+ * Test and time the Neon halving add/subtract instructions
+ *
+ * VHADD, VRHADD and VHSUB are the inner loops of chroma upsampling and
+ * motion compensation in libjpeg-turbo and ffmpeg.  The results of every
+ * element size and signedness are checked against a scalar model, on
+ * random inputs and on all the pairs of edge values; pass an iteration
+ * count to also report throughput.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <arm_neon.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define N 4096
+
+/* 0, 1, max signed, min signed, -2 and -1 of each element size */
+#define NR_EDGES 6
+
+static uint8_t a8[N], b8[N], r8[N];
+static uint16_t a16[N], b16[N], r16[N];
+static uint32_t a32[N], b32[N], r32[N];
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static uint32_t edge(int i, uint32_t mask)
+{
+    const uint32_t edges[NR_EDGES] = {
+        0, 1, mask >> 1, (mask >> 1) + 1, mask - 1, mask
+    };
+
+    return edges[i];
+}
+
+static void init(void)
+{
+    for (int i = 0; i < N; i++) {
+        a8[i] = rnd();
+        b8[i] = rnd();
+        a16[i] = rnd();
+        b16[i] = rnd();
+        a32[i] = rnd() ^ (rnd() << 16);
+        b32[i] = rnd() ^ (rnd() << 16);
+    }
+    for (int i = 0; i < NR_EDGES * NR_EDGES; i++) {
+        a8[i] = edge(i / NR_EDGES, UINT8_MAX);
+        b8[i] = edge(i % NR_EDGES, UINT8_MAX);
+        a16[i] = edge(i / NR_EDGES, UINT16_MAX);
+        b16[i] = edge(i % NR_EDGES, UINT16_MAX);
+        a32[i] = edge(i / NR_EDGES, UINT32_MAX);
+        b32[i] = edge(i % NR_EDGES, UINT32_MAX);
+    }
+}
+
+/*
+ * A vector kernel and its check against @MODEL, computed on 64 bits
+ * from the elements @a and @b.
+ */
+#define HALVING_OP(NAME, ETYPE, LANES, LD, ST, OP, MODEL, A, B, R)      \
+static void NAME(ETYPE *d, const ETYPE *x, const ETYPE *y, int n)       \
+{                                                                       \
+    for (int i = 0; i < n; i += LANES) {                                \
+        ST(d + i, OP(LD(x + i), LD(y + i)));                            \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static int check_##NAME(void)                                           \
+{                                                                       \
+    const ETYPE *x = (const ETYPE *)A, *y = (const ETYPE *)B;           \
+    ETYPE *d = (ETYPE *)R;                                              \
+                                                                        \
+    NAME(d, x, y, N);                                                   \
+    for (int i = 0; i < N; i++) {                                       \
+        int64_t a = x[i], b = y[i];                                     \
+                                                                        \
+        if (d[i] != (ETYPE)(MODEL)) {                                   \
+            fprintf(stderr, #NAME " mismatch at %d: %lld, %lld -> %lld\n", \
+                    i, (long long)a, (long long)b, (long long)d[i]);    \
+            return 1;                                                   \
+        }                                                               \
+    }                                                                   \
+    return 0;                                                           \
+}
+
+#define HALVING_OPS(SFX, ETYPE, LANES, A, B, R)                         \
+    HALVING_OP(do_vhadd_##SFX, ETYPE, LANES, vld1q_##SFX, vst1q_##SFX,  \
+               vhaddq_##SFX, (a + b) >> 1, A, B, R)                     \
+    HALVING_OP(do_vrhadd_##SFX, ETYPE, LANES, vld1q_##SFX, vst1q_##SFX, \
+               vrhaddq_##SFX, (a + b + 1) >> 1, A, B, R)                \
+    HALVING_OP(do_vhsub_##SFX, ETYPE, LANES, vld1q_##SFX, vst1q_##SFX,  \
+               vhsubq_##SFX, (a - b) >> 1, A, B, R)
+
+HALVING_OPS(s8, int8_t, 16, a8, b8, r8)
+HALVING_OPS(u8, uint8_t, 16, a8, b8, r8)
+HALVING_OPS(s16, int16_t, 8, a16, b16, r16)
+HALVING_OPS(u16, uint16_t, 8, a16, b16, r16)
+HALVING_OPS(s32, int32_t, 4, a32, b32, r32)
+HALVING_OPS(u32, uint32_t, 4, a32, b32, r32)
+
+#define HALVING_CHECKS(SFX) \
+    check_do_vhadd_##SFX, check_do_vrhadd_##SFX, check_do_vhsub_##SFX
+
+static int (*const checks[])(void) = {
+    HALVING_CHECKS(s8),
+    HALVING_CHECKS(u8),
+    HALVING_CHECKS(s16),
+    HALVING_CHECKS(u16),
+    HALVING_CHECKS(s32),
+    HALVING_CHECKS(u32),
+};
+
+int main(int argc, char **argv)
+{
+    long iters = argc > 1 ? atol(argv[1]) : 0;
+    struct timespec t0, t1;
+    double secs;
+    int err = 0;
+
+    init();
+    for (int i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        err += checks[i]();
+    }
+    if (err) {
+        return EXIT_FAILURE;
+    }
+    if (iters <= 0) {
+        return EXIT_SUCCESS;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long i = 0; i < iters; i++) {
+        /* libjpeg fancy upsampling, then ffmpeg put_no_rnd_pixels */
+        do_vrhadd_u8(r8, a8, b8, N);
+        do_vhadd_u8(r8, r8, b8, N);
+        do_vhsub_s16((int16_t *)r16, (int16_t *)a16, (int16_t *)r16, N);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("%ld iterations in %.3fs: %.1f MB/s\n", iters, secs,
+           iters * (2.0 * N + 2.0 * N) / secs / 1e6);
+    return EXIT_SUCCESS;
+}
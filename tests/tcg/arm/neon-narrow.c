@@ -0,0 +1,334 @@
+/*
+ * Test and time the Neon narrowing and widening shifts
+ *
+ * VQRSHRUN and VQMOVUN clamp the 16-bit sums of ffmpeg's H.264 qpel and
+ * IDCT-add functions back to pixels, VRSHRN and VQRSHRN descale the
+ * fixed-point sums of libjpeg-turbo's colour conversion, and VSHLL
+ * widens pixels before the arithmetic.  The results and the QC flag of
+ * every form are checked against a scalar model, on random inputs and
+ * on the edge values of each element size; pass an iteration count to
+ * also report throughput.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <arm_neon.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define N 4096
+
+/* 0, 1, max signed, min signed, -2 and -1 of each element size */
+#define NR_EDGES 6
+
+static uint8_t a8[N], r8[N];
+static uint16_t a16[N], r16[N];
+static uint32_t a32[N], r32[N];
+static uint64_t a64[N], r64[N];
+
+/* The saturation the model expects, to compare with QC */
+static int sat;
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static uint64_t edge(int i, uint64_t mask)
+{
+    const uint64_t edges[NR_EDGES] = {
+        0, 1, mask >> 1, (mask >> 1) + 1, mask - 1, mask
+    };
+
+    return edges[i];
+}
+
+static void init(void)
+{
+    for (int i = 0; i < N; i++) {
+        a8[i] = rnd();
+        /* Keep some values near the narrow range, as real sums are. */
+        a16[i] = i & 1 ? rnd() : (int8_t)rnd() * (1 << (rnd() & 3));
+        a32[i] = i & 1 ? rnd() ^ (rnd() << 16)
+                       : (int16_t)rnd() * (1 << (rnd() & 3));
+        a64[i] = i & 1 ? ((uint64_t)rnd() << 40) ^ ((uint64_t)rnd() << 20)
+                       : (uint64_t)(int32_t)(rnd() ^ (rnd() << 16))
+                         << (rnd() & 3);
+    }
+    for (int i = 0; i < NR_EDGES; i++) {
+        a8[i] = edge(i, UINT8_MAX);
+        a16[i] = edge(i, UINT16_MAX);
+        a32[i] = edge(i, UINT32_MAX);
+        a64[i] = edge(i, UINT64_MAX);
+        /* The narrow edges, and one more or less, in the wide inputs */
+        a16[NR_EDGES + i] = (int16_t)(int8_t)edge(i, UINT8_MAX) + 1;
+        a32[NR_EDGES + i] = (int32_t)(int16_t)edge(i, UINT16_MAX) + 1;
+        a64[NR_EDGES + i] = (int64_t)(int32_t)edge(i, UINT32_MAX) + 1;
+        a16[2 * NR_EDGES + i] = edge(i, UINT8_MAX);
+        a32[2 * NR_EDGES + i] = edge(i, UINT16_MAX);
+        a64[2 * NR_EDGES + i] = edge(i, UINT32_MAX);
+    }
+}
+
+static void clear_qc(void)
+{
+    uint32_t fpscr;
+
+    asm volatile("vmrs %0, fpscr" : "=r"(fpscr) : : "memory");
+    fpscr &= ~(1u << 27);
+    asm volatile("vmsr fpscr, %0" : : "r"(fpscr) : "memory");
+}
+
+static int get_qc(void)
+{
+    uint32_t fpscr;
+
+    asm volatile("vmrs %0, fpscr" : "=r"(fpscr) : : "memory");
+    return (fpscr >> 27) & 1;
+}
+
+/* Shift right by @sh, rounding to nearest with ties up if @round */
+static int64_t shr_s(int64_t x, int sh, int round)
+{
+    return (x >> sh) + (round && sh ? (x >> (sh - 1)) & 1 : 0);
+}
+
+static uint64_t shr_u(uint64_t x, int sh, int round)
+{
+    return (x >> sh) + (round && sh ? (x >> (sh - 1)) & 1 : 0);
+}
+
+static int64_t sat_s(int64_t x, int64_t min, int64_t max)
+{
+    if (x < min || x > max) {
+        sat = 1;
+        return x < min ? min : max;
+    }
+    return x;
+}
+
+static uint64_t sat_u(uint64_t x, uint64_t max)
+{
+    if (x > max) {
+        sat = 1;
+        return max;
+    }
+    return x;
+}
+
+/* The moves, with the signature of the shifts by immediate */
+#define vmovn_n_u16(V, SH)      vmovn_u16(V)
+#define vmovn_n_u32(V, SH)      vmovn_u32(V)
+#define vmovn_n_u64(V, SH)      vmovn_u64(V)
+#define vqmovn_n_s16(V, SH)     vqmovn_s16(V)
+#define vqmovn_n_s32(V, SH)     vqmovn_s32(V)
+#define vqmovn_n_s64(V, SH)     vqmovn_s64(V)
+#define vqmovn_n_u16(V, SH)     vqmovn_u16(V)
+#define vqmovn_n_u32(V, SH)     vqmovn_u32(V)
+#define vqmovn_n_u64(V, SH)     vqmovn_u64(V)
+#define vqmovun_n_s16(V, SH)    vqmovun_s16(V)
+#define vqmovun_n_s32(V, SH)    vqmovun_s32(V)
+#define vqmovun_n_s64(V, SH)    vqmovun_s64(V)
+
+/*
+ * Run @OP with immediate @SH over the wide array @X with QC clear, then
+ * compare every element of @R with @MODEL, computed from @a, and QC
+ * with @sat.
+ */
+#define NARROW_OP(NAME, WSFX, NSFX, WTYPE, NTYPE, LANES, OP, SH,         \
+                  MODEL, X, R)                                          \
+static void NAME(NTYPE *d, const WTYPE *x, int n)                       \
+{                                                                       \
+    for (int i = 0; i < n; i += LANES) {                                \
+        vst1_##NSFX(d + i, OP(vld1q_##WSFX(x + i), SH));                \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static int check_##NAME(void)                                           \
+{                                                                       \
+    const WTYPE *x = (const WTYPE *)X;                                  \
+    NTYPE *d = (NTYPE *)R;                                              \
+    int qc;                                                             \
+                                                                        \
+    clear_qc();                                                         \
+    NAME(d, x, N);                                                      \
+    qc = get_qc();                                                      \
+    sat = 0;                                                            \
+    for (int i = 0; i < N; i++) {                                       \
+        WTYPE a = x[i];                                                 \
+        NTYPE want = MODEL;                                             \
+                                                                        \
+        if (d[i] != want) {                                             \
+            fprintf(stderr, #NAME " mismatch at %d: %lld -> %lld, "     \
+                    "want %lld\n", i, (long long)a,                     \
+                    (long long)d[i], (long long)want);                  \
+            return 1;                                                   \
+        }                                                               \
+    }                                                                   \
+    if (qc != sat) {                                                    \
+        fprintf(stderr, #NAME " QC %d, want %d\n", qc, sat);            \
+        return 1;                                                       \
+    }                                                                   \
+    return 0;                                                           \
+}
+
+/*
+ * All the narrowing forms from wide elements of @BITS bits, shifting by
+ * @SH and, to cover the largest immediate, by @BITS / 2.
+ */
+#define NARROW_OPS(S, U, NS, NU, BITS, SH, X, R)                        \
+    NARROW_OP(do_vshrn_##U, U, NU, U##_t, NU##_t, 64 / BITS * 2,        \
+              vshrn_n_##U, SH, shr_u(a, SH, 0), X, R)                   \
+    NARROW_OP(do_vrshrn_##U, U, NU, U##_t, NU##_t, 64 / BITS * 2,       \
+              vrshrn_n_##U, SH, shr_u(a, SH, 1), X, R)                  \
+    NARROW_OP(do_vrshrn_max_##U, U, NU, U##_t, NU##_t, 64 / BITS * 2,   \
+              vrshrn_n_##U, BITS / 2, shr_u(a, BITS / 2, 1), X, R)      \
+    NARROW_OP(do_vqshrn_##S, S, NS, S##_t, NS##_t, 64 / BITS * 2,       \
+              vqshrn_n_##S, SH,                                         \
+              sat_s(shr_s(a, SH, 0), NS##_MIN, NS##_MAX), X, R)         \
+    NARROW_OP(do_vqrshrn_##S, S, NS, S##_t, NS##_t, 64 / BITS * 2,      \
+              vqrshrn_n_##S, SH,                                        \
+              sat_s(shr_s(a, SH, 1), NS##_MIN, NS##_MAX), X, R)         \
+    NARROW_OP(do_vqrshrn_max_##S, S, NS, S##_t, NS##_t, 64 / BITS * 2,  \
+              vqrshrn_n_##S, BITS / 2,                                  \
+              sat_s(shr_s(a, BITS / 2, 1), NS##_MIN, NS##_MAX), X, R)   \
+    NARROW_OP(do_vqshrn_##U, U, NU, U##_t, NU##_t, 64 / BITS * 2,       \
+              vqshrn_n_##U, SH, sat_u(shr_u(a, SH, 0), NU##_MAX), X, R) \
+    NARROW_OP(do_vqrshrn_##U, U, NU, U##_t, NU##_t, 64 / BITS * 2,      \
+              vqrshrn_n_##U, SH, sat_u(shr_u(a, SH, 1), NU##_MAX), X, R) \
+    NARROW_OP(do_vqshrun_##S, S, NU, S##_t, NU##_t, 64 / BITS * 2,      \
+              vqshrun_n_##S, SH,                                        \
+              sat_s(shr_s(a, SH, 0), 0, NU##_MAX), X, R)                \
+    NARROW_OP(do_vqrshrun_##S, S, NU, S##_t, NU##_t, 64 / BITS * 2,     \
+              vqrshrun_n_##S, SH,                                       \
+              sat_s(shr_s(a, SH, 1), 0, NU##_MAX), X, R)                \
+    NARROW_OP(do_vmovn_##U, U, NU, U##_t, NU##_t, 64 / BITS * 2,        \
+              vmovn_n_##U, 0, a, X, R)                                  \
+    NARROW_OP(do_vqmovn_##S, S, NS, S##_t, NS##_t, 64 / BITS * 2,       \
+              vqmovn_n_##S, 0, sat_s(a, NS##_MIN, NS##_MAX), X, R)      \
+    NARROW_OP(do_vqmovn_##U, U, NU, U##_t, NU##_t, 64 / BITS * 2,       \
+              vqmovn_n_##U, 0, sat_u(a, NU##_MAX), X, R)                \
+    NARROW_OP(do_vqmovun_##S, S, NU, S##_t, NU##_t, 64 / BITS * 2,      \
+              vqmovun_n_##S, 0, sat_s(a, 0, NU##_MAX), X, R)
+
+/* Name the types and limits the way the intrinsics name the elements */
+typedef int8_t s8_t;
+typedef int16_t s16_t;
+typedef int32_t s32_t;
+typedef int64_t s64_t;
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef uint64_t u64_t;
+#define s8_MIN  INT8_MIN
+#define s8_MAX  INT8_MAX
+#define s16_MIN INT16_MIN
+#define s16_MAX INT16_MAX
+#define s32_MIN INT32_MIN
+#define s32_MAX INT32_MAX
+#define u8_MAX  UINT8_MAX
+#define u16_MAX UINT16_MAX
+#define u32_MAX UINT32_MAX
+
+NARROW_OPS(s16, u16, s8, u8, 16, 3, a16, r8)
+NARROW_OPS(s32, u32, s16, u16, 32, 5, a32, r16)
+NARROW_OPS(s64, u64, s32, u32, 64, 13, a64, r32)
+
+/* VSHLL by @SH, and by the element size, which is a different encoding */
+#define WIDEN_OP(NAME, NSFX, WSFX, LANES, SH, X, R)                     \
+static void NAME(WSFX##_t *d, const NSFX##_t *x, int n)                 \
+{                                                                       \
+    for (int i = 0; i < n; i += LANES) {                                \
+        vst1q_##WSFX(d + i, vshll_n_##NSFX(vld1_##NSFX(x + i), SH));    \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static int check_##NAME(void)                                           \
+{                                                                       \
+    const NSFX##_t *x = (const NSFX##_t *)X;                            \
+    WSFX##_t *d = (WSFX##_t *)R;                                        \
+                                                                        \
+    NAME(d, x, N);                                                      \
+    for (int i = 0; i < N; i++) {                                       \
+        WSFX##_t want = (uint64_t)(int64_t)x[i] << SH;                  \
+                                                                        \
+        if (d[i] != want) {                                             \
+            fprintf(stderr, #NAME " mismatch at %d: %lld -> %lld, "     \
+                    "want %lld\n", i, (long long)x[i],                  \
+                    (long long)d[i], (long long)want);                  \
+            return 1;                                                   \
+        }                                                               \
+    }                                                                   \
+    return 0;                                                           \
+}
+
+#define WIDEN_OPS(S, U, WS, WU, BITS, SH, X, R)                         \
+    WIDEN_OP(do_vshll_##S, S, WS, 64 / BITS, SH, X, R)                  \
+    WIDEN_OP(do_vshll_##U, U, WU, 64 / BITS, SH, X, R)                  \
+    WIDEN_OP(do_vshll_max_##S, S, WS, 64 / BITS, BITS, X, R)            \
+    WIDEN_OP(do_vshll_max_##U, U, WU, 64 / BITS, BITS, X, R)
+
+WIDEN_OPS(s8, u8, s16, u16, 8, 3, a8, r16)
+WIDEN_OPS(s16, u16, s32, u32, 16, 7, a16, r32)
+WIDEN_OPS(s32, u32, s64, u64, 32, 17, a32, r64)
+
+#define NARROW_CHECKS(S, U)                                             \
+    check_do_vshrn_##U, check_do_vrshrn_##U, check_do_vrshrn_max_##U,   \
+    check_do_vqshrn_##S, check_do_vqrshrn_##S, check_do_vqrshrn_max_##S, \
+    check_do_vqshrn_##U, check_do_vqrshrn_##U,                          \
+    check_do_vqshrun_##S, check_do_vqrshrun_##S,                        \
+    check_do_vmovn_##U, check_do_vqmovn_##S, check_do_vqmovn_##U,       \
+    check_do_vqmovun_##S
+
+#define WIDEN_CHECKS(S, U)                                              \
+    check_do_vshll_##S, check_do_vshll_##U,                             \
+    check_do_vshll_max_##S, check_do_vshll_max_##U
+
+static int (*const checks[])(void) = {
+    NARROW_CHECKS(s16, u16),
+    NARROW_CHECKS(s32, u32),
+    NARROW_CHECKS(s64, u64),
+    WIDEN_CHECKS(s8, u8),
+    WIDEN_CHECKS(s16, u16),
+    WIDEN_CHECKS(s32, u32),
+};
+
+int main(int argc, char **argv)
+{
+    long iters = argc > 1 ? atol(argv[1]) : 0;
+    struct timespec t0, t1;
+    double secs;
+    int err = 0;
+
+    init();
+    for (int i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        err += checks[i]();
+    }
+    if (err) {
+        return EXIT_FAILURE;
+    }
+    if (iters <= 0) {
+        return EXIT_SUCCESS;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long i = 0; i < iters; i++) {
+        /* widen pixels, descale, then clamp back as ffmpeg does */
+        do_vshll_u8((uint16_t *)r16, a8, N);
+        do_vrshrn_u32((uint16_t *)r16, a32, N);
+        do_vqrshrun_s16((uint8_t *)r8, (const int16_t *)a16, N);
+        do_vqmovun_s16((uint8_t *)r8, (const int16_t *)a16, N);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("%ld iterations in %.3fs: %.1f MB/s\n", iters, secs,
+           iters * (N + 4.0 * N + 2.0 * N + 2.0 * N) / secs / 1e6);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+/*
+ * Test and time the Neon integer pairwise instructions
+ *
+ * VPADDL and VPADAL do the 2x2 box filter of libjpeg-turbo's h2v2
+ * downsampling, and VPADD, VPMAX and VPMIN finish the horizontal
+ * reductions of ffmpeg's SAD and pixel-range functions.  The results of
+ * every element size and signedness are checked against a scalar model,
+ * on random inputs and on all the pairs of edge values; pass an
+ * iteration count to also report throughput.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <arm_neon.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define N 4096
+
+/* 0, 1, max signed, min signed, -2 and -1 of each element size */
+#define NR_EDGES 6
+
+static uint8_t a8[N], b8[N], r8[N];
+static uint16_t a16[N], b16[N], r16[N];
+static uint32_t a32[N], b32[N], r32[N];
+static uint64_t b64[N], r64[N];
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static uint32_t edge(int i, uint32_t mask)
+{
+    const uint32_t edges[NR_EDGES] = {
+        0, 1, mask >> 1, (mask >> 1) + 1, mask - 1, mask
+    };
+
+    return edges[i];
+}
+
+static void init(void)
+{
+    for (int i = 0; i < N; i++) {
+        a8[i] = rnd();
+        b8[i] = rnd();
+        a16[i] = rnd();
+        b16[i] = rnd();
+        a32[i] = rnd() ^ (rnd() << 16);
+        b32[i] = rnd() ^ (rnd() << 16);
+        b64[i] = ((uint64_t)rnd() << 40) ^ ((uint64_t)rnd() << 20) ^ rnd();
+    }
+    /* The pairs are adjacent elements of the same input. */
+    for (int i = 0; i < NR_EDGES * NR_EDGES; i++) {
+        a8[2 * i] = edge(i / NR_EDGES, UINT8_MAX);
+        a8[2 * i + 1] = edge(i % NR_EDGES, UINT8_MAX);
+        a16[2 * i] = edge(i / NR_EDGES, UINT16_MAX);
+        a16[2 * i + 1] = edge(i % NR_EDGES, UINT16_MAX);
+        a32[2 * i] = edge(i / NR_EDGES, UINT32_MAX);
+        a32[2 * i + 1] = edge(i % NR_EDGES, UINT32_MAX);
+    }
+    memcpy(b8, a8, 2 * NR_EDGES * NR_EDGES);
+    memcpy(b16, a16, 2 * NR_EDGES * NR_EDGES * 2);
+    memcpy(b32, a32, 2 * NR_EDGES * NR_EDGES * 4);
+}
+
+/*
+ * VPADD, VPMAX and VPMIN on D registers: the low half of each result
+ * comes from pairs of @x and the high half from pairs of @y.  @MODEL
+ * is computed on 64 bits from the pair @a, @b.
+ */
+#define PAIR_OP(NAME, ETYPE, LANES, LD, ST, OP, MODEL, A, B, R)         \
+static void NAME(ETYPE *d, const ETYPE *x, const ETYPE *y, int n)       \
+{                                                                       \
+    for (int i = 0; i < n; i += LANES) {                                \
+        ST(d + i, OP(LD(x + i), LD(y + i)));                            \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static int check_##NAME(void)                                           \
+{                                                                       \
+    const ETYPE *x = (const ETYPE *)A, *y = (const ETYPE *)B;           \
+    ETYPE *d = (ETYPE *)R;                                              \
+                                                                        \
+    NAME(d, x, y, N);                                                   \
+    for (int i = 0; i < N; i++) {                                       \
+        int j = i % LANES, k = i - j + (j % (LANES / 2)) * 2;           \
+        const ETYPE *src = j < LANES / 2 ? x : y;                       \
+        int64_t a = src[k], b = src[k + 1];                             \
+                                                                        \
+        if (d[i] != (ETYPE)(MODEL)) {                                   \
+            fprintf(stderr, #NAME " mismatch at %d: %lld, %lld -> %lld\n", \
+                    i, (long long)a, (long long)b, (long long)d[i]);    \
+            return 1;                                                   \
+        }                                                               \
+    }                                                                   \
+    return 0;                                                           \
+}
+
+#define PAIR_OPS(SFX, ETYPE, LANES, A, B, R)                            \
+    PAIR_OP(do_vpadd_##SFX, ETYPE, LANES, vld1_##SFX, vst1_##SFX,       \
+            vpadd_##SFX, a + b, A, B, R)                                \
+    PAIR_OP(do_vpmax_##SFX, ETYPE, LANES, vld1_##SFX, vst1_##SFX,       \
+            vpmax_##SFX, a > b ? a : b, A, B, R)                        \
+    PAIR_OP(do_vpmin_##SFX, ETYPE, LANES, vld1_##SFX, vst1_##SFX,       \
+            vpmin_##SFX, a < b ? a : b, A, B, R)
+
+PAIR_OPS(s8, int8_t, 8, a8, b8, r8)
+PAIR_OPS(u8, uint8_t, 8, a8, b8, r8)
+PAIR_OPS(s16, int16_t, 4, a16, b16, r16)
+PAIR_OPS(u16, uint16_t, 4, a16, b16, r16)
+PAIR_OPS(s32, int32_t, 2, a32, b32, r32)
+PAIR_OPS(u32, uint32_t, 2, a32, b32, r32)
+
+/*
+ * VPADDL and VPADAL on Q registers: each wide element of the result is
+ * the sum of the two narrow elements of @x it overlaps, plus for VPADAL
+ * the wide element it replaces, which starts out as a copy of @B.
+ */
+#define LONG_OP(NAME, WTYPE, NTYPE, LANES, EXPR, ACC, A, B, R)          \
+static void NAME(WTYPE *d, const NTYPE *x, int n)                       \
+{                                                                       \
+    for (int i = 0; i < n; i += LANES) {                                \
+        EXPR;                                                           \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static int check_##NAME(void)                                           \
+{                                                                       \
+    const NTYPE *x = (const NTYPE *)A;                                  \
+    const WTYPE *acc = (const WTYPE *)B;                                \
+    WTYPE *d = (WTYPE *)R;                                              \
+                                                                        \
+    memcpy(d, acc, N / 2 * sizeof(WTYPE));                              \
+    NAME(d, x, N);                                                      \
+    for (int i = 0; i < N / 2; i++) {                                   \
+        uint64_t want = (uint64_t)(int64_t)x[2 * i] +                   \
+                        (uint64_t)(int64_t)x[2 * i + 1];                \
+                                                                        \
+        if (ACC) {                                                      \
+            want += (uint64_t)(int64_t)acc[i];                          \
+        }                                                               \
+        if (d[i] != (WTYPE)want) {                                      \
+            fprintf(stderr, #NAME " mismatch at %d: %lld, %lld -> %lld\n", \
+                    i, (long long)x[2 * i], (long long)x[2 * i + 1],    \
+                    (long long)d[i]);                                   \
+            return 1;                                                   \
+        }                                                               \
+    }                                                                   \
+    return 0;                                                           \
+}
+
+#define LONG_OPS(SFX, WSFX, WTYPE, NTYPE, LANES, A, B, R)               \
+    LONG_OP(do_vpaddl_##SFX, WTYPE, NTYPE, LANES,                       \
+            vst1q_##WSFX(d + i / 2, vpaddlq_##SFX(vld1q_##SFX(x + i))), \
+            0, A, B, R)                                                 \
+    LONG_OP(do_vpadal_##SFX, WTYPE, NTYPE, LANES,                       \
+            vst1q_##WSFX(d + i / 2,                                     \
+                         vpadalq_##SFX(vld1q_##WSFX(d + i / 2),         \
+                                       vld1q_##SFX(x + i))),            \
+            1, A, B, R)
+
+LONG_OPS(s8, s16, int16_t, int8_t, 16, a8, b16, r16)
+LONG_OPS(u8, u16, uint16_t, uint8_t, 16, a8, b16, r16)
+LONG_OPS(s16, s32, int32_t, int16_t, 8, a16, b32, r32)
+LONG_OPS(u16, u32, uint32_t, uint16_t, 8, a16, b32, r32)
+LONG_OPS(s32, s64, int64_t, int32_t, 4, a32, b64, r64)
+LONG_OPS(u32, u64, uint64_t, uint32_t, 4, a32, b64, r64)
+
+#define PAIR_CHECKS(SFX) \
+    check_do_vpadd_##SFX, check_do_vpmax_##SFX, check_do_vpmin_##SFX
+
+#define LONG_CHECKS(SFX) \
+    check_do_vpaddl_##SFX, check_do_vpadal_##SFX
+
+static int (*const checks[])(void) = {
+    PAIR_CHECKS(s8),
+    PAIR_CHECKS(u8),
+    PAIR_CHECKS(s16),
+    PAIR_CHECKS(u16),
+    PAIR_CHECKS(s32),
+    PAIR_CHECKS(u32),
+    LONG_CHECKS(s8),
+    LONG_CHECKS(u8),
+    LONG_CHECKS(s16),
+    LONG_CHECKS(u16),
+    LONG_CHECKS(s32),
+    LONG_CHECKS(u32),
+};
+
+int main(int argc, char **argv)
+{
+    long iters = argc > 1 ? atol(argv[1]) : 0;
+    struct timespec t0, t1;
+    double secs;
+    int err = 0;
+
+    init();
+    for (int i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        err += checks[i]();
+    }
+    if (err) {
+        return EXIT_FAILURE;
+    }
+    if (iters <= 0) {
+        return EXIT_SUCCESS;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long i = 0; i < iters; i++) {
+        /* libjpeg h2v2 downsampling, then ffmpeg's horizontal reductions */
+        do_vpaddl_u8(r16, a8, N);
+        do_vpadal_u8(r16, b8, N);
+        do_vpmax_u8(r8, a8, b8, N);
+        do_vpadd_u16(r16, r16, a16, N);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("%ld iterations in %.3fs: %.1f MB/s\n", iters, secs,
+           iters * (N + N + 2.0 * N + 4.0 * N) / secs / 1e6);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,309 @@
+/*
+ * Test and time the Neon saturating doubling multiplies
+ *
+ * VQDMULH by lane is the fixed-point multiply of libjpeg-turbo's fast
+ * IDCT, VQRDMULH scales coefficients in ffmpeg's video DSP and
+ * VQDMULL/VQDMLAL/VQDMLSL are the Q15 multiply-accumulates of its
+ * fixed-point audio filters.  The results and the QC flag of every form
+ * are checked against a scalar model, on random inputs and on all the
+ * pairs of edge values; pass an iteration count to also report throughput.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <arm_neon.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define N 4096
+
+/* 0, 1, max, min, -2 and -1 of each element size */
+#define NR_EDGES 6
+
+static int16_t a16[N], b16[N], r16[N];
+static int32_t a32[N], b32[N], r32[N];
+static int64_t b64[N], r64[N];
+
+/* The saturation the model expects, to compare with QC */
+static int sat;
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static int64_t edge(int i, int bits)
+{
+    int64_t max = (int64_t)(UINT64_MAX >> (65 - bits));
+    const int64_t edges[NR_EDGES] = { 0, 1, max, -max - 1, -2, -1 };
+
+    return edges[i];
+}
+
+static void init(void)
+{
+    for (int i = 0; i < N; i++) {
+        a16[i] = rnd();
+        b16[i] = rnd();
+        a32[i] = rnd() ^ (rnd() << 16);
+        b32[i] = rnd() ^ (rnd() << 16);
+        b64[i] = ((uint64_t)rnd() << 40) ^ ((uint64_t)rnd() << 20) ^ rnd();
+    }
+    /* The pairs are the same element of both inputs. */
+    for (int i = 0; i < NR_EDGES * NR_EDGES; i++) {
+        a16[i] = edge(i / NR_EDGES, 16);
+        b16[i] = edge(i % NR_EDGES, 16);
+        a32[i] = edge(i / NR_EDGES, 32);
+        b32[i] = edge(i % NR_EDGES, 32);
+        b32[N - 1 - i] = edge(i % NR_EDGES, 32);
+        b64[N - 1 - i] = edge(i % NR_EDGES, 64);
+    }
+    /* Saturate the by-lane forms too: a block of MIN times a MIN lane. */
+    for (int i = 64; i < 72; i++) {
+        a16[i] = INT16_MIN;
+        a32[i] = INT32_MIN;
+    }
+    b16[65] = INT16_MIN;
+    b16[67] = INT16_MIN;
+    b32[65] = INT32_MIN;
+    b32[69] = INT32_MIN;
+}
+
+static void clear_qc(void)
+{
+    uint32_t fpscr;
+
+    asm volatile("vmrs %0, fpscr" : "=r"(fpscr) : : "memory");
+    fpscr &= ~(1u << 27);
+    asm volatile("vmsr fpscr, %0" : : "r"(fpscr) : "memory");
+}
+
+static int get_qc(void)
+{
+    uint32_t fpscr;
+
+    asm volatile("vmrs %0, fpscr" : "=r"(fpscr) : : "memory");
+    return (fpscr >> 27) & 1;
+}
+
+/* The high half of 2 * a * b, optionally rounded, on @bits elements */
+static int64_t sqdmulh(int64_t a, int64_t b, int bits, int round)
+{
+    int64_t min = -(INT64_C(1) << (bits - 1));
+
+    if (a == min && b == min) {
+        sat = 1;
+        return -min - 1;
+    }
+    return (a * b * 2 + (round ? -min : 0)) >> bits;
+}
+
+/* 2 * a * b, on @bits elements */
+static int64_t sqdmull(int64_t a, int64_t b, int bits)
+{
+    int64_t min = -(INT64_C(1) << (bits - 1));
+
+    if (a == min && b == min) {
+        sat = 1;
+        return bits == 32 ? INT64_MAX : INT32_MAX;
+    }
+    return a * b * 2;
+}
+
+/* a + b, saturated to @bits */
+static int64_t sqadd(int64_t a, int64_t b, int bits)
+{
+    int64_t r;
+
+    if (bits == 64) {
+        if (__builtin_add_overflow(a, b, &r)) {
+            sat = 1;
+            return a < 0 ? INT64_MIN : INT64_MAX;
+        }
+        return r;
+    }
+    r = a + b;
+    if (r != (int32_t)r) {
+        sat = 1;
+        return r < 0 ? INT32_MIN : INT32_MAX;
+    }
+    return r;
+}
+
+static int64_t sqsub(int64_t a, int64_t b, int bits)
+{
+    int64_t r;
+
+    if (bits == 64) {
+        if (__builtin_sub_overflow(a, b, &r)) {
+            sat = 1;
+            return a < 0 ? INT64_MIN : INT64_MAX;
+        }
+        return r;
+    }
+    return sqadd(a, -b, bits);
+}
+
+/*
+ * Run @EXPR over the arrays with QC clear, then compare every element
+ * of @R with @MODEL, computed from @a, @b and @acc, and QC with @sat.
+ * @acc is the initial value of the destination, a copy of @C.
+ */
+#define QC_OP(NAME, DTYPE, STYPE, LANES, EXPR, MODEL, A, B, C, R)       \
+static void NAME(DTYPE *d, const STYPE *x, const STYPE *y, int n)       \
+{                                                                       \
+    for (int i = 0; i < n; i += LANES) {                                \
+        EXPR;                                                           \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static int check_##NAME(void)                                           \
+{                                                                       \
+    const STYPE *x = A, *y = B;                                         \
+    const DTYPE *c = (const DTYPE *)C;                                  \
+    DTYPE *d = R;                                                       \
+    int qc;                                                             \
+                                                                        \
+    memcpy(d, c, N * sizeof(DTYPE));                                    \
+    clear_qc();                                                         \
+    NAME(d, x, y, N);                                                   \
+    qc = get_qc();                                                      \
+    sat = 0;                                                            \
+    for (int i = 0; i < N; i++) {                                       \
+        int64_t a = x[i], acc = c[i];                                   \
+        DTYPE want;                                                     \
+                                                                        \
+        (void)acc;                                                      \
+        want = MODEL;                                                   \
+        if (d[i] != want) {                                             \
+            fprintf(stderr, #NAME " mismatch at %d: %lld -> %lld, "     \
+                    "want %lld\n", i, (long long)a,                     \
+                    (long long)d[i], (long long)want);                  \
+            return 1;                                                   \
+        }                                                               \
+    }                                                                   \
+    if (qc != sat) {                                                    \
+        fprintf(stderr, #NAME " QC %d, want %d\n", qc, sat);            \
+        return 1;                                                       \
+    }                                                                   \
+    return 0;                                                           \
+}
+
+/* The element of @y that lane @L of the D register at @i selects */
+#define LANE(LANES, L) y[i - i % (LANES) + (L)]
+
+#define HIGH_OPS(SFX, TYPE, LANES, BITS, LANE_NR, A, B, R)              \
+    QC_OP(do_vqdmulh_##SFX, TYPE, TYPE, LANES,                          \
+          vst1q_##SFX(d + i, vqdmulhq_##SFX(vld1q_##SFX(x + i),         \
+                                            vld1q_##SFX(y + i))),       \
+          sqdmulh(a, y[i], BITS, 0), A, B, B, R)                        \
+    QC_OP(do_vqrdmulh_##SFX, TYPE, TYPE, LANES,                         \
+          vst1q_##SFX(d + i, vqrdmulhq_##SFX(vld1q_##SFX(x + i),        \
+                                             vld1q_##SFX(y + i))),      \
+          sqdmulh(a, y[i], BITS, 1), A, B, B, R)                        \
+    QC_OP(do_vqdmulh_lane_##SFX, TYPE, TYPE, LANES,                     \
+          vst1q_##SFX(d + i,                                            \
+                      vqdmulhq_lane_##SFX(vld1q_##SFX(x + i),           \
+                                          vld1_##SFX(y + i), LANE_NR)), \
+          sqdmulh(a, LANE(LANES, LANE_NR), BITS, 0), A, B, B, R)               \
+    QC_OP(do_vqrdmulh_lane_##SFX, TYPE, TYPE, LANES,                    \
+          vst1q_##SFX(d + i,                                            \
+                      vqrdmulhq_lane_##SFX(vld1q_##SFX(x + i),          \
+                                           vld1_##SFX(y + i), LANE_NR)), \
+          sqdmulh(a, LANE(LANES, LANE_NR), BITS, 1), A, B, B, R)
+
+HIGH_OPS(s16, int16_t, 8, 16, 1, a16, b16, r16)
+HIGH_OPS(s32, int32_t, 4, 32, 1, a32, b32, r32)
+
+#define LONG_OPS(SFX, WSFX, WTYPE, NTYPE, LANES, BITS, LANE_NR, A, B, C, R) \
+    QC_OP(do_vqdmull_##SFX, WTYPE, NTYPE, LANES,                        \
+          vst1q_##WSFX(d + i, vqdmull_##SFX(vld1_##SFX(x + i),          \
+                                            vld1_##SFX(y + i))),        \
+          sqdmull(a, y[i], BITS), A, B, C, R)                           \
+    QC_OP(do_vqdmlal_##SFX, WTYPE, NTYPE, LANES,                        \
+          vst1q_##WSFX(d + i, vqdmlal_##SFX(vld1q_##WSFX(d + i),        \
+                                            vld1_##SFX(x + i),          \
+                                            vld1_##SFX(y + i))),        \
+          sqadd(acc, sqdmull(a, y[i], BITS), 2 * BITS), A, B, C, R)     \
+    QC_OP(do_vqdmlsl_##SFX, WTYPE, NTYPE, LANES,                        \
+          vst1q_##WSFX(d + i, vqdmlsl_##SFX(vld1q_##WSFX(d + i),        \
+                                            vld1_##SFX(x + i),          \
+                                            vld1_##SFX(y + i))),        \
+          sqsub(acc, sqdmull(a, y[i], BITS), 2 * BITS), A, B, C, R)     \
+    QC_OP(do_vqdmull_lane_##SFX, WTYPE, NTYPE, LANES,                   \
+          vst1q_##WSFX(d + i, vqdmull_lane_##SFX(vld1_##SFX(x + i),     \
+                                                 vld1_##SFX(y + i),     \
+                                                 LANE_NR)),             \
+          sqdmull(a, LANE(LANES, LANE_NR), BITS), A, B, C, R)                  \
+    QC_OP(do_vqdmlal_lane_##SFX, WTYPE, NTYPE, LANES,                   \
+          vst1q_##WSFX(d + i,                                           \
+                       vqdmlal_lane_##SFX(vld1q_##WSFX(d + i),          \
+                                          vld1_##SFX(x + i),            \
+                                          vld1_##SFX(y + i), LANE_NR)), \
+          sqadd(acc, sqdmull(a, LANE(LANES, LANE_NR), BITS), 2 * BITS),        \
+          A, B, C, R)                                                   \
+    QC_OP(do_vqdmlsl_lane_##SFX, WTYPE, NTYPE, LANES,                   \
+          vst1q_##WSFX(d + i,                                           \
+                       vqdmlsl_lane_##SFX(vld1q_##WSFX(d + i),          \
+                                          vld1_##SFX(x + i),            \
+                                          vld1_##SFX(y + i), LANE_NR)), \
+          sqsub(acc, sqdmull(a, LANE(LANES, LANE_NR), BITS), 2 * BITS),        \
+          A, B, C, R)
+
+LONG_OPS(s16, s32, int32_t, int16_t, 4, 16, 3, a16, b16, b32, r32)
+LONG_OPS(s32, s64, int64_t, int32_t, 2, 32, 1, a32, b32, b64, r64)
+
+#define HIGH_CHECKS(SFX)                                                \
+    check_do_vqdmulh_##SFX, check_do_vqrdmulh_##SFX,                    \
+    check_do_vqdmulh_lane_##SFX, check_do_vqrdmulh_lane_##SFX
+
+#define LONG_CHECKS(SFX)                                                \
+    check_do_vqdmull_##SFX, check_do_vqdmlal_##SFX,                     \
+    check_do_vqdmlsl_##SFX, check_do_vqdmull_lane_##SFX,                \
+    check_do_vqdmlal_lane_##SFX, check_do_vqdmlsl_lane_##SFX
+
+static int (*const checks[])(void) = {
+    HIGH_CHECKS(s16),
+    HIGH_CHECKS(s32),
+    LONG_CHECKS(s16),
+    LONG_CHECKS(s32),
+};
+
+int main(int argc, char **argv)
+{
+    long iters = argc > 1 ? atol(argv[1]) : 0;
+    struct timespec t0, t1;
+    double secs;
+    int err = 0;
+
+    init();
+    for (int i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        err += checks[i]();
+    }
+    if (err) {
+        return EXIT_FAILURE;
+    }
+    if (iters <= 0) {
+        return EXIT_SUCCESS;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long i = 0; i < iters; i++) {
+        /* libjpeg fast IDCT, ffmpeg scaling, then a Q15 FIR tap */
+        do_vqdmulh_lane_s16(r16, a16, b16, N);
+        do_vqrdmulh_s16(r16, r16, b16, N);
+        do_vqdmlal_s16(r32, a16, b16, N);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("%ld iterations in %.3fs: %.1f MB/s\n", iters, secs,
+           iters * (3 * 4.0 * N) / secs / 1e6);
+    return EXIT_SUCCESS;
+}
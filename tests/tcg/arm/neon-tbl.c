@@ -0,0 +1,179 @@
+/*
+ * Test and time the Neon table lookups
+ *
+ * VTBL and VTBX do the byte shuffles of libjpeg-turbo's zigzag
+ * reordering and ffmpeg's palette and pixel-format conversions.  Every
+ * table length is checked against a scalar model with in-range and
+ * out-of-range indices, as are the forms whose destination is also the
+ * table or the index register; pass an iteration count to also report
+ * throughput.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <arm_neon.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define N 4096
+
+static uint8_t tab[32], idx[N], def[N], r8[N];
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static void init(void)
+{
+    for (int i = 0; i < sizeof(tab); i++) {
+        tab[i] = rnd();
+    }
+    for (int i = 0; i < N; i++) {
+        /* Mostly in range of the longest table, some far out of it */
+        idx[i] = i & 7 ? rnd() % 40 : rnd();
+        def[i] = rnd();
+    }
+}
+
+/* Look up every byte of @x in the first @LEN * 8 bytes of tab */
+#define TBL_OP(NAME, LEN, TBX, EXPR)                                    \
+static void NAME(uint8_t *d, const uint8_t *x, int n)                   \
+{                                                                       \
+    uint8x8x4_t t;                                                      \
+                                                                        \
+    t.val[0] = vld1_u8(tab);                                            \
+    t.val[1] = vld1_u8(tab + 8);                                        \
+    t.val[2] = vld1_u8(tab + 16);                                       \
+    t.val[3] = vld1_u8(tab + 24);                                       \
+    for (int i = 0; i < n; i += 8) {                                    \
+        EXPR;                                                           \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static int check_##NAME(void)                                           \
+{                                                                       \
+    memcpy(r8, def, N);                                                 \
+    NAME(r8, idx, N);                                                   \
+    for (int i = 0; i < N; i++) {                                       \
+        uint8_t want = idx[i] < LEN * 8 ? tab[idx[i]]                   \
+                                        : TBX ? def[i] : 0;             \
+                                                                        \
+        if (r8[i] != want) {                                            \
+            fprintf(stderr, #NAME " mismatch at %d: %d -> %d, "         \
+                    "want %d\n", i, idx[i], r8[i], want);               \
+            return 1;                                                   \
+        }                                                               \
+    }                                                                   \
+    return 0;                                                           \
+}
+
+TBL_OP(do_vtbl1, 1, 0,
+       vst1_u8(d + i, vtbl1_u8(t.val[0], vld1_u8(x + i))))
+TBL_OP(do_vtbl2, 2, 0,
+       vst1_u8(d + i, vtbl2_u8((uint8x8x2_t){ { t.val[0], t.val[1] } },
+                               vld1_u8(x + i))))
+TBL_OP(do_vtbl3, 3, 0,
+       vst1_u8(d + i,
+               vtbl3_u8((uint8x8x3_t){ { t.val[0], t.val[1], t.val[2] } },
+                        vld1_u8(x + i))))
+TBL_OP(do_vtbl4, 4, 0,
+       vst1_u8(d + i, vtbl4_u8(t, vld1_u8(x + i))))
+TBL_OP(do_vtbx1, 1, 1,
+       vst1_u8(d + i, vtbx1_u8(vld1_u8(d + i), t.val[0], vld1_u8(x + i))))
+TBL_OP(do_vtbx2, 2, 1,
+       vst1_u8(d + i, vtbx2_u8(vld1_u8(d + i),
+                               (uint8x8x2_t){ { t.val[0], t.val[1] } },
+                               vld1_u8(x + i))))
+TBL_OP(do_vtbx3, 3, 1,
+       vst1_u8(d + i,
+               vtbx3_u8(vld1_u8(d + i),
+                        (uint8x8x3_t){ { t.val[0], t.val[1], t.val[2] } },
+                        vld1_u8(x + i))))
+TBL_OP(do_vtbx4, 4, 1,
+       vst1_u8(d + i, vtbx4_u8(vld1_u8(d + i), t, vld1_u8(x + i))))
+
+/*
+ * The destination overlapping the inputs: all of the table and the
+ * index must be read before the result is written.
+ */
+static int check_overlap(void)
+{
+    uint8_t res[3][8];
+
+    for (int i = 0; i < 8; i++) {
+        idx[i] = i & 1 ? 15 - i : 8 + i;
+    }
+    asm volatile("vld1.8 {d0, d1}, [%1]\n\t"
+                 "vld1.8 {d2}, [%2]\n\t"
+                 "vtbl.8 d1, {d0, d1}, d2\n\t"
+                 "vst1.8 {d1}, [%0]"
+                 : : "r"(res[0]), "r"(tab), "r"(idx)
+                 : "d0", "d1", "d2", "memory");
+    asm volatile("vld1.8 {d0, d1}, [%1]\n\t"
+                 "vld1.8 {d2}, [%2]\n\t"
+                 "vtbl.8 d2, {d0, d1}, d2\n\t"
+                 "vst1.8 {d2}, [%0]"
+                 : : "r"(res[1]), "r"(tab), "r"(idx)
+                 : "d0", "d1", "d2", "memory");
+    asm volatile("vld1.8 {d0, d1}, [%1]\n\t"
+                 "vld1.8 {d2}, [%2]\n\t"
+                 "vtbx.8 d0, {d0, d1}, d2\n\t"
+                 "vst1.8 {d0}, [%0]"
+                 : : "r"(res[2]), "r"(tab), "r"(idx)
+                 : "d0", "d1", "d2", "memory");
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 8; i++) {
+            if (res[j][i] != tab[idx[i]]) {
+                fprintf(stderr, "overlap %d mismatch at %d: %d -> %d, "
+                        "want %d\n", j, i, idx[i], res[j][i], tab[idx[i]]);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int (*const checks[])(void) = {
+    check_do_vtbl1, check_do_vtbl2, check_do_vtbl3, check_do_vtbl4,
+    check_do_vtbx1, check_do_vtbx2, check_do_vtbx3, check_do_vtbx4,
+    check_overlap,
+};
+
+int main(int argc, char **argv)
+{
+    long iters = argc > 1 ? atol(argv[1]) : 0;
+    struct timespec t0, t1;
+    double secs;
+    int err = 0;
+
+    init();
+    for (int i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        err += checks[i]();
+    }
+    if (err) {
+        return EXIT_FAILURE;
+    }
+    if (iters <= 0) {
+        return EXIT_SUCCESS;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long i = 0; i < iters; i++) {
+        /* a one-register shuffle, then a 32-byte palette lookup */
+        do_vtbl1(r8, idx, N);
+        do_vtbx4(r8, idx, N);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("%ld iterations in %.3fs: %.1f MB/s\n", iters, secs,
+           iters * 2.0 * N / secs / 1e6);
+    return EXIT_SUCCESS;
+}
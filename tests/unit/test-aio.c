@@ -74,6 +74,12 @@ static void dummy_io_handler_read(EventNotifier *e)
 {
 }
 
+#ifdef CONFIG_POSIX
+static void dummy_io_handler_read_fd(void *opaque)
+{
+}
+#endif
+
 static void bh_delete_cb(void *opaque)
 {
     BHTestData *data = opaque;
@@ -432,6 +438,67 @@ static void test_wait_event_notifier_noflush(void)
     event_notifier_cleanup(&data.e);
 }
 
+#ifdef CONFIG_POSIX
+typedef struct {
+    EventNotifier e;
+    int n;
+} BusyPollTestData;
+
+static bool busy_poll_cb(void *opaque)
+{
+    /* Always has work, although the fd never becomes readable */
+    return true;
+}
+
+static void busy_poll_ready_cb(void *opaque)
+{
+    BusyPollTestData *data = opaque;
+
+    data->n++;
+}
+
+static void set_busy_poll_handler(BusyPollTestData *data)
+{
+    aio_set_fd_handler(ctx, event_notifier_get_fd(&data->e),
+                       dummy_io_handler_read_fd, NULL, busy_poll_cb,
+                       busy_poll_ready_cb, data);
+}
+
+static void test_busy_poll(void)
+{
+    BusyPollTestData data = { .n = 0 };
+    int fd, n;
+
+    event_notifier_init(&data.e, false);
+    fd = event_notifier_get_fd(&data.e);
+    set_busy_poll_handler(&data);
+
+    /* Without busy polling, the handler only runs when the fd is ready */
+    while (aio_poll(ctx, false)) {
+        /* nothing */
+    }
+    g_assert_cmpint(data.n, ==, 0);
+
+    aio_set_fd_busy_poll(ctx, fd, true);
+    g_assert(aio_poll(ctx, false));
+    g_assert_cmpint(data.n, >, 0);
+
+    /* A new handler for the fd keeps being busy polled */
+    set_busy_poll_handler(&data);
+    n = data.n;
+    g_assert(aio_poll(ctx, false));
+    g_assert_cmpint(data.n, >, n);
+
+    aio_set_fd_busy_poll(ctx, fd, false);
+    n = data.n;
+    aio_poll(ctx, false);
+    g_assert_cmpint(data.n, ==, n);
+
+    aio_set_fd_handler(ctx, fd, NULL, NULL, NULL, NULL, NULL);
+    event_notifier_cleanup(&data.e);
+}
+#endif
+
 static void test_timer_schedule(void)
 {
     TimerTestData data = { .n = 0, .ctx = ctx, .ns = SCALE_MS * 750LL,
@@ -912,6 +979,9 @@ int main(int argc, char **argv)
     g_test_add_func("/aio/event/wait/no-flush-cb",  test_wait_event_notifier_noflush);
     g_test_add_func("/aio/event/flush",             test_flush_event_notifier);
     g_test_add_func("/aio/timer/schedule",          test_timer_schedule);
+#ifdef CONFIG_POSIX
+    g_test_add_func("/aio/busy-poll",               test_busy_poll);
+#endif
 
     g_test_add_func("/aio/coroutine/queue-chaining", test_queue_chaining);
     g_test_add_func("/aio/coroutine/worker-thread-co-enter", test_worker_thread_co_enter);
@@ -26,6 +26,7 @@ typedef struct TestHBitmapData {
     size_t         size;
     size_t         old_size;
     int            granularity;
+    bool           compressed;
 } TestHBitmapData;
 
 
@@ -79,7 +80,8 @@ static void hbitmap_test_init(TestHBitmapData *data,
                               uint64_t size, int granularity)
 {
     size_t n;
-    data->hb = hbitmap_alloc(size, granularity);
+    data->hb = data->compressed ? hbitmap_alloc_compressed(size, granularity)
+                                : hbitmap_alloc(size, granularity);
 
     n = DIV_ROUND_UP(size, BITS_PER_LONG);
     if (n == 0) {
@@ -793,11 +795,48 @@ static void test_hbitmap_serialize_zeroes(TestHBitmapData *data,
     }
 }
 
+static void test_hbitmap_merge(TestHBitmapData *data, const void *unused)
+{
+    HBitmap *other;
+
+    hbitmap_test_init(data, L3 * 2, 0);
+    hbitmap_test_set(data, 0, L1 + 1);
+    hbitmap_test_set(data, L3 - L2, L2 * 2);
+
+    /* Merge with a bitmap of the other kind */
+    other = data->compressed ? hbitmap_alloc(L3 * 2, 0)
+                             : hbitmap_alloc_compressed(L3 * 2, 0);
+    hbitmap_set(other, L1, L2);
+    hbitmap_set(other, L3 + 17, 1);
+    hbitmap_set(other, L3 * 2 - L1, L1);
+    bitmap_set(data->bits, L1, L2);
+    bitmap_set(data->bits, L3 + 17, 1);
+    bitmap_set(data->bits, L3 * 2 - L1, L1);
+
+    hbitmap_merge(data->hb, other, data->hb);
+    hbitmap_test_check(data, 0);
+    hbitmap_test_check(data, L3);
+    hbitmap_free(other);
+}
+
+static void hbitmap_test_setup_compressed(TestHBitmapData *data,
+                                          const void *unused)
+{
+    data->compressed = true;
+}
+
+/* Run each test on both dense and compressed HBitmaps */
 static void hbitmap_test_add(const char *testpath,
                                    void (*test_func)(TestHBitmapData *data, const void *user_data))
 {
+    g_autofree char *compressed_path =
+        g_strconcat("/hbitmap-compressed", testpath + strlen("/hbitmap"), NULL);
+
     g_test_add(testpath, TestHBitmapData, NULL, NULL, test_func,
                hbitmap_test_teardown);
+    g_test_add(compressed_path, TestHBitmapData, NULL,
+               hbitmap_test_setup_compressed, test_func,
+               hbitmap_test_teardown);
 }
 
 static void test_hbitmap_iter_and_reset(TestHBitmapData *data,
@@ -1097,6 +1136,8 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/iter/iter_and_reset",
                      test_hbitmap_iter_and_reset);
 
+    hbitmap_test_add("/hbitmap/merge", test_hbitmap_merge);
+
     hbitmap_test_add("/hbitmap/next_zero/next_x_0",
                      test_hbitmap_next_x_0);
     hbitmap_test_add("/hbitmap/next_zero/next_x_4",
@@ -0,0 +1,192 @@
+/*
+ * Multifd zstd compression unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/module.h"
+#include "qapi/error.h"
+#include "qapi/qapi-types-migration.h"
+#include "exec/ramblock.h"
+#include "io/channel-buffer.h"
+#include "../migration/multifd.h"
+
+#define PAGE_SIZE 4096
+#define NR_PAGES (MULTIFD_PACKET_SIZE / PAGE_SIZE)
+
+/* Stubs for what multifd-zstd.c uses from the rest of migration */
+
+static MultiFDMethods *zstd_ops;
+
+int migrate_multifd_zstd_level(void)
+{
+    return 1;
+}
+
+void multifd_register_ops(int method, MultiFDMethods *ops)
+{
+    if (method == MULTIFD_COMPRESSION_ZSTD) {
+        zstd_ops = ops;
+    }
+}
+
+typedef struct {
+    MultiFDSendParams p;
+    MultiFDPages_t pages;
+    RAMBlock block;
+} TestSender;
+
+static uint32_t seed;
+
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+/* Fill @buf with words picked at random from a small vocabulary */
+static void fill_text(uint8_t *buf, size_t len, uint32_t s)
+{
+    static char words[1024][12];
+    size_t pos = 0;
+    int i, j;
+
+    seed = 1;
+    for (i = 0; i < ARRAY_SIZE(words); i++) {
+        int n = 3 + rnd() % 8;
+
+        for (j = 0; j < n; j++) {
+            words[i][j] = 'a' + rnd() % 26;
+        }
+        words[i][n] = '\0';
+    }
+
+    seed = s;
+    while (pos < len) {
+        const char *w = words[rnd() % ARRAY_SIZE(words)];
+        size_t n = MIN(strlen(w), len - pos);
+
+        memcpy(buf + pos, w, n);
+        pos += n;
+        if (pos < len) {
+            buf[pos++] = ' ';
+        }
+    }
+}
+
+static void sender_init(TestSender *s, uint8_t *host)
+{
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    s->block.host = host;
+    s->pages.block = &s->block;
+    s->p.pages = &s->pages;
+    s->p.page_size = PAGE_SIZE;
+    s->p.normal = g_new(ram_addr_t, NR_PAGES);
+    for (i = 0; i < NR_PAGES; i++) {
+        s->p.normal[i] = i * PAGE_SIZE;
+    }
+    s->p.normal_num = NR_PAGES;
+    s->p.iov = g_new0(struct iovec, 1);
+    g_assert_cmpint(zstd_ops->send_setup(&s->p, &error_abort), ==, 0);
+}
+
+static void sender_cleanup(TestSender *s)
+{
+    zstd_ops->send_cleanup(&s->p, &error_abort);
+    g_free(s->p.normal);
+    g_free(s->p.iov);
+}
+
+/* Compress @data, returns the packet in p->iov[0] */
+static uint32_t send_packet(TestSender *s, uint8_t *data)
+{
+    s->block.host = data;
+    s->p.iovs_num = 0;
+    s->p.flags = 0;
+    g_assert_cmpint(zstd_ops->send_prepare(&s->p, &error_abort), ==, 0);
+    g_assert_cmpint(s->p.iovs_num, ==, 1);
+    g_assert_cmpint(s->p.flags, ==, MULTIFD_FLAG_ZSTD);
+    return s->p.next_packet_size;
+}
+
+/* Decompress the packet that @s just prepared and compare it to @data */
+static void recv_packet(MultiFDRecvParams *r, QIOChannelBuffer *bioc,
+                        TestSender *s, const uint8_t *data)
+{
+    size_t start = bioc->offset;
+
+    qio_channel_write_all(QIO_CHANNEL(bioc), s->p.iov[0].iov_base,
+                          s->p.iov[0].iov_len, &error_abort);
+    bioc->offset = start;
+
+    memset(r->host, 0, MULTIFD_PACKET_SIZE);
+    r->next_packet_size = s->p.next_packet_size;
+    r->flags = s->p.flags;
+    g_assert_cmpint(zstd_ops->recv_pages(r, &error_abort), ==, 0);
+    g_assert(memcmp(r->host, data, MULTIFD_PACKET_SIZE) == 0);
+}
+
+static void test_set_level(void)
+{
+    g_autofree uint8_t *warmup = g_malloc(MULTIFD_PACKET_SIZE);
+    g_autofree uint8_t *data = g_malloc(MULTIFD_PACKET_SIZE);
+    g_autofree uint8_t *host = g_malloc(MULTIFD_PACKET_SIZE);
+    QIOChannelBuffer *bioc = qio_channel_buffer_new(MULTIFD_PACKET_SIZE);
+    MultiFDRecvParams r = {
+        .page_size = PAGE_SIZE,
+        .c = QIO_CHANNEL(bioc),
+        .host = host,
+        .normal_num = NR_PAGES,
+    };
+    TestSender fixed, changed;
+    uint32_t fixed_size, changed_size;
+    int i;
+
+    fill_text(warmup, MULTIFD_PACKET_SIZE, 2);
+    fill_text(data, MULTIFD_PACKET_SIZE, 3);
+    sender_init(&fixed, warmup);
+    sender_init(&changed, warmup);
+    r.normal = fixed.p.normal;
+    g_assert_cmpint(zstd_ops->recv_setup(&r, &error_abort), ==, 0);
+
+    /* Both streams are in the middle of a frame after the first packet */
+    g_assert_cmpint(send_packet(&fixed, warmup), ==,
+                    send_packet(&changed, warmup));
+    recv_packet(&r, bioc, &changed, warmup);
+
+    /* A higher level must take effect with the very next packet */
+    g_assert_cmpint(zstd_ops->send_set_level(&changed.p, 19, &error_abort),
+                    ==, 0);
+    fixed_size = send_packet(&fixed, data);
+    changed_size = send_packet(&changed, data);
+    g_assert_cmpint(changed_size, <, fixed_size);
+    recv_packet(&r, bioc, &changed, data);
+
+    /* Back to the initial level, the decoder follows across frames */
+    g_assert_cmpint(zstd_ops->send_set_level(&changed.p, 1, &error_abort),
+                    ==, 0);
+    for (i = 0; i < 2; i++) {
+        send_packet(&changed, i ? data : warmup);
+        recv_packet(&r, bioc, &changed, i ? data : warmup);
+    }
+
+    zstd_ops->recv_cleanup(&r);
+    sender_cleanup(&fixed);
+    sender_cleanup(&changed);
+    object_unref(OBJECT(bioc));
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    module_call_init(MODULE_INIT_QOM);
+    module_call_init(MODULE_INIT_MIGRATION);
+    g_assert(zstd_ops);
+
+    g_test_add_func("/multifd/zstd/set-level", test_set_level);
+    return g_test_run();
+}
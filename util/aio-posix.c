@@ -97,6 +97,21 @@ static bool aio_remove_fd_handler(AioContext *ctx, AioHandler *node)
     return true;
 }
 
+/*
+ * The fd of a busy polled handler never becomes ready, so the handler would
+ * not be added back to the polling list if it was removed for being idle or
+ * replaced by a new one.
+ */
+static void aio_add_busy_poll_handler(AioContext *ctx, AioHandler *node)
+{
+    if (!QLIST_IS_INSERTED(node, node_poll)) {
+        if (ctx->poll_started && node->io_poll_begin) {
+            node->io_poll_begin(node->opaque);
+        }
+        QLIST_INSERT_HEAD(&ctx->poll_aio_handlers, node, node_poll);
+    }
+}
+
 void aio_set_fd_handler(AioContext *ctx,
                         int fd,
                         IOHandler *io_read,
@@ -125,6 +140,9 @@ void aio_set_fd_handler(AioContext *ctx,
             qemu_lockcnt_unlock(&ctx->list_lock);
             return;
         }
+        if (node->busy_poll) {
+            ctx->busy_poll_cnt--;
+        }
         /* Clean events in order to unregister fd from the ctx epoll. */
         node->pfd.events = 0;
 
@@ -144,6 +162,14 @@ void aio_set_fd_handler(AioContext *ctx,
         new_node->io_poll_ready = io_poll_ready;
         new_node->opaque = opaque;
 
+        if (node && node->busy_poll) {
+            if (io_poll) {
+                new_node->busy_poll = true;
+            } else {
+                ctx->busy_poll_cnt--;
+            }
+        }
+
         if (is_new) {
             new_node->pfd.fd = fd;
         } else {
@@ -155,6 +181,9 @@ void aio_set_fd_handler(AioContext *ctx,
         new_node->pfd.events |= (io_write ? G_IO_OUT | G_IO_ERR : 0);
 
         QLIST_INSERT_HEAD_RCU(&ctx->aio_handlers, new_node, node);
+        if (new_node->busy_poll) {
+            aio_add_busy_poll_handler(ctx, new_node);
+        }
     }
 
     /* No need to order poll_disable_cnt writes against other updates;
@@ -178,6 +207,22 @@ void aio_set_fd_handler(AioContext *ctx,
     }
 }
 
+void aio_set_fd_busy_poll(AioContext *ctx, int fd, bool busy)
+{
+    AioHandler *node = find_aio_handler(ctx, fd);
+
+    if (!node || !node->io_poll || node->busy_poll == busy) {
+        return;
+    }
+
+    trace_poll_busy(ctx, node, fd, busy);
+    node->busy_poll = busy;
+    ctx->busy_poll_cnt += busy ? 1 : -1;
+    if (busy) {
+        aio_add_busy_poll_handler(ctx, node);
+    }
+}
+
 static void aio_set_fd_poll(AioContext *ctx, int fd,
                             IOHandler *io_poll_begin,
                             IOHandler *io_poll_end)
@@ -263,7 +308,8 @@ bool aio_prepare(AioContext *ctx)
     poll_set_started(ctx, &ready_list, false);
     /* TODO what to do with this list? */
 
-    return false;
+    /* Busy polled handlers are checked in aio_dispatch(), do not block */
+    return ctx->busy_poll_cnt > 0;
 }
 
 bool aio_pending(AioContext *ctx)
@@ -293,7 +339,7 @@ bool aio_pending(AioContext *ctx)
     }
     qemu_lockcnt_dec(&ctx->list_lock);
 
-    return result;
+    return result || ctx->busy_poll_cnt > 0;
 }
 
 static void aio_free_deleted_handlers(AioContext *ctx)
@@ -417,10 +463,33 @@ static bool aio_dispatch_handlers(AioContext *ctx)
     return progress;
 }
 
+static bool run_busy_poll_handlers(AioContext *ctx,
+                                   AioHandlerList *ready_list)
+{
+    bool progress = false;
+    AioHandler *node;
+    AioHandler *tmp;
+
+    QLIST_FOREACH_SAFE(node, &ctx->poll_aio_handlers, node_poll, tmp) {
+        if (node->busy_poll && node->io_poll(node->opaque)) {
+            aio_add_poll_ready_handler(ready_list, node);
+            progress = true;
+        }
+    }
+
+    return progress;
+}
+
 void aio_dispatch(AioContext *ctx)
 {
+    AioHandlerList ready_list = QLIST_HEAD_INITIALIZER(ready_list);
+
     qemu_lockcnt_inc(&ctx->list_lock);
     aio_bh_poll(ctx);
+    if (ctx->busy_poll_cnt) {
+        run_busy_poll_handlers(ctx, &ready_list);
+        aio_dispatch_ready_handlers(ctx, &ready_list);
+    }
     aio_dispatch_handlers(ctx);
     aio_free_deleted_handlers(ctx);
     qemu_lockcnt_dec(&ctx->list_lock);
@@ -483,6 +552,9 @@ static bool remove_idle_poll_handlers(AioContext *ctx,
     }
 
     QLIST_FOREACH_SAFE(node, &ctx->poll_aio_handlers, node_poll, tmp) {
+        if (node->busy_poll) {
+            continue;
+        }
         if (node->poll_idle_timeout == 0LL) {
             node->poll_idle_timeout = now + POLL_IDLE_INTERVAL_NS;
         } else if (now >= node->poll_idle_timeout) {
@@ -629,6 +701,17 @@ bool aio_poll(AioContext *ctx, bool blocking)
     progress = try_poll_mode(ctx, &ready_list, &timeout);
     assert(!(timeout && progress));
 
+    /*
+     * Busy polled handlers are waiting for events that will not wake up the
+     * fd monitor, so poll them at least once and never block.
+     */
+    if (ctx->busy_poll_cnt) {
+        if (!progress) {
+            progress = run_busy_poll_handlers(ctx, &ready_list);
+        }
+        timeout = 0;
+    }
+
     /*
      * aio_notify can avoid the expensive event_notifier_set if
      * everything (file descriptors, bottom halves, timers) will
@@ -668,6 +751,9 @@ bool aio_poll(AioContext *ctx, bool blocking)
         }
 
         ctx->fdmon_ops->wait(ctx, &ready_list, timeout);
+    } else if (ctx->busy_poll_cnt && !progress) {
+        /* Handlers that are not being polled are only seen by the fd monitor */
+        ctx->fdmon_ops->wait(ctx, &ready_list, 0);
     }
 
     if (use_notify_me) {
@@ -38,6 +38,7 @@ struct AioHandler {
 #endif
     int64_t poll_idle_timeout; /* when to stop userspace polling */
     bool poll_ready; /* has polling detected an event? */
+    bool busy_poll; /* see aio_set_fd_busy_poll() */
 };
 
 /* Add a handler to a ready list */
@@ -382,6 +382,11 @@ aio_ctx_finalize(GSource     *source)
         luring_cleanup(ctx->linux_io_uring);
         ctx->linux_io_uring = NULL;
     }
+    if (ctx->linux_io_uring_poll) {
+        luring_detach_aio_context(ctx->linux_io_uring_poll, ctx);
+        luring_cleanup(ctx->linux_io_uring_poll);
+        ctx->linux_io_uring_poll = NULL;
+    }
 #endif
 
     assert(QSLIST_EMPTY(&ctx->scheduled_coroutines));
@@ -466,7 +471,7 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
+    ctx->linux_io_uring = luring_init(false, errp);
     if (!ctx->linux_io_uring) {
         return NULL;
     }
@@ -480,6 +485,27 @@ LuringState *aio_get_linux_io_uring(AioContext *ctx)
     assert(ctx->linux_io_uring);
     return ctx->linux_io_uring;
 }
+
+LuringState *aio_setup_linux_io_uring_poll(AioContext *ctx, Error **errp)
+{
+    if (ctx->linux_io_uring_poll) {
+        return ctx->linux_io_uring_poll;
+    }
+
+    ctx->linux_io_uring_poll = luring_init(true, errp);
+    if (!ctx->linux_io_uring_poll) {
+        return NULL;
+    }
+
+    luring_attach_aio_context(ctx->linux_io_uring_poll, ctx);
+    return ctx->linux_io_uring_poll;
+}
+
+LuringState *aio_get_linux_io_uring_poll(AioContext *ctx)
+{
+    assert(ctx->linux_io_uring_poll);
+    return ctx->linux_io_uring_poll;
+}
 #endif
 
 void aio_notify(AioContext *ctx)
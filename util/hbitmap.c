@@ -12,6 +12,7 @@
 #include "qemu/osdep.h"
 #include "qemu/hbitmap.h"
 #include "qemu/host-utils.h"
+#include "qemu/rbitmap.h"
 #include "trace.h"
 #include "crypto/hash.h"
 
@@ -50,6 +51,11 @@
  * extremely sparse, this is also O(m + m/W + m/W^2 + ...), so the amortized
  * cost of advancing from one bit to the next is usually constant (worst case
  * O(logB n) as in the non-amortized complexity).
+ *
+ * Compressed HBitmaps store the last level in an RBitmap instead, and have
+ * no other levels: the RBitmap skips clean areas on its own.  They need far
+ * less memory for bitmaps that are mostly clean or dirty in large extents,
+ * but setting and resetting scattered bits is slower.
  */
 
 struct HBitmap {
@@ -99,6 +105,9 @@ struct HBitmap {
 
     /* The length of each levels[] array. */
     uint64_t sizes[HBITMAP_LEVELS];
+
+    /* The last level, if the bitmap is compressed.  levels[] is unused. */
+    RBitmap *compressed;
 };
 
 /* Advance hbi to the next nonzero word and return it.  hbi->pos
@@ -148,10 +157,25 @@ static unsigned long hbitmap_iter_skip_words(HBitmapIter *hbi)
 
 int64_t hbitmap_iter_next(HBitmapIter *hbi)
 {
-    unsigned long cur = hbi->cur[HBITMAP_LEVELS - 1] &
-            hbi->hb->levels[HBITMAP_LEVELS - 1][hbi->pos];
+    unsigned long cur;
     int64_t item;
 
+    if (hbi->hb->compressed) {
+        if (hbi->next >= hbi->hb->size) {
+            return -1;
+        }
+        item = rbitmap_next_set(hbi->hb->compressed, hbi->next,
+                                hbi->hb->size);
+        if (item < 0) {
+            hbi->next = hbi->hb->size;
+            return -1;
+        }
+        hbi->next = item + 1;
+        return item << hbi->granularity;
+    }
+
+    cur = hbi->cur[HBITMAP_LEVELS - 1] &
+        hbi->hb->levels[HBITMAP_LEVELS - 1][hbi->pos];
     if (cur == 0) {
         cur = hbitmap_iter_skip_words(hbi);
         if (cur == 0) {
@@ -177,6 +201,11 @@ void hbitmap_iter_init(HBitmapIter *hbi, const HBitmap *hb, uint64_t first)
     hbi->pos = pos >> BITS_PER_LEVEL;
     hbi->granularity = hb->granularity;
 
+    if (hb->compressed) {
+        hbi->next = pos;
+        return;
+    }
+
     for (i = HBITMAP_LEVELS; i-- > 0; ) {
         bit = pos & (BITS_PER_LONG - 1);
         pos >>= BITS_PER_LEVEL;
@@ -217,15 +246,48 @@ int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
     return MAX(start, first_dirty_off);
 }
 
+static int64_t hbitmap_next_zero_compressed(const HBitmap *hb, int64_t start,
+                                             int64_t count)
+{
+    uint64_t end_bit;
+    int64_t res;
+
+    assert(start >= 0 && count >= 0);
+
+    if (start >= hb->orig_size || count == 0) {
+        return -1;
+    }
+
+    end_bit = count > hb->orig_size - start ?
+                hb->size :
+                ((start + count - 1) >> hb->granularity) + 1;
+
+    res = rbitmap_next_clear(hb->compressed, start >> hb->granularity,
+                             end_bit);
+    if (res < 0) {
+        return -1;
+    }
+
+    res = res << hb->granularity;
+    return MAX(res, start);
+}
+
 int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
 {
     size_t pos = (start >> hb->granularity) >> BITS_PER_LEVEL;
-    unsigned long *last_lev = hb->levels[HBITMAP_LEVELS - 1];
-    unsigned long cur = last_lev[pos];
+    unsigned long *last_lev;
+    unsigned long cur;
     unsigned start_bit_offset;
     uint64_t end_bit, sz;
     int64_t res;
 
+    if (hb->compressed) {
+        return hbitmap_next_zero_compressed(hb, start, count);
+    }
+
+    last_lev = hb->levels[HBITMAP_LEVELS - 1];
+    cur = last_lev[pos];
+
     assert(start >= 0 && count >= 0);
 
     if (start >= hb->orig_size || count == 0) {
@@ -479,6 +541,15 @@ void hbitmap_set(HBitmap *hb, uint64_t start, uint64_t count)
     assert(last < hb->size);
     n = last - first + 1;
 
+    if (hb->compressed) {
+        n = rbitmap_set(hb->compressed, first, n);
+        hb->count += n;
+        if (n && hb->meta) {
+            hbitmap_set(hb->meta, start, count);
+        }
+        return;
+    }
+
     hb->count += n - hb_count_between(hb, first, last);
     if (hb_set_between(hb, HBITMAP_LEVELS - 1, first, last) &&
         hb->meta) {
@@ -576,6 +647,16 @@ void hbitmap_reset(HBitmap *hb, uint64_t start, uint64_t count)
     last >>= hb->granularity;
     assert(last < hb->size);
 
+    if (hb->compressed) {
+        uint64_t n = rbitmap_reset(hb->compressed, first, last - first + 1);
+
+        hb->count -= n;
+        if (n && hb->meta) {
+            hbitmap_set(hb->meta, start, count);
+        }
+        return;
+    }
+
     hb->count -= hb_count_between(hb, first, last);
     if (hb_reset_between(hb, HBITMAP_LEVELS - 1, first, last) &&
         hb->meta) {
@@ -587,6 +668,12 @@ void hbitmap_reset_all(HBitmap *hb)
 {
     unsigned int i;
 
+    if (hb->compressed) {
+        rbitmap_reset_all(hb->compressed);
+        hb->count = 0;
+        return;
+    }
+
     /* Same as hbitmap_alloc() except for memset() instead of malloc() */
     for (i = HBITMAP_LEVELS; --i >= 1; ) {
         memset(hb->levels[i], 0, hb->sizes[i] * sizeof(unsigned long));
@@ -621,6 +708,10 @@ bool hbitmap_get(const HBitmap *hb, uint64_t item)
     unsigned long bit = 1UL << (pos & (BITS_PER_LONG - 1));
     assert(pos < hb->size);
 
+    if (hb->compressed) {
+        return rbitmap_get(hb->compressed, pos);
+    }
+
     return (hb->levels[HBITMAP_LEVELS - 1][pos >> BITS_PER_LEVEL] & bit) != 0;
 }
 
@@ -635,10 +726,11 @@ uint64_t hbitmap_serialization_align(const HBitmap *hb)
 
 /* Start should be aligned to serialization granularity, chunk size should be
  * aligned to serialization granularity too, except for last chunk.
+ * Returns the index of the first element in the last level.
  */
-static void serialization_chunk(const HBitmap *hb,
-                                uint64_t start, uint64_t count,
-                                unsigned long **first_el, uint64_t *el_count)
+static uint64_t serialization_chunk(const HBitmap *hb,
+                                    uint64_t start, uint64_t count,
+                                    uint64_t *el_count)
 {
     uint64_t last = start + count - 1;
     uint64_t gran = hbitmap_serialization_align(hb);
@@ -652,34 +744,75 @@ static void serialization_chunk(const HBitmap *hb,
     start = (start >> hb->granularity) >> BITS_PER_LEVEL;
     last = (last >> hb->granularity) >> BITS_PER_LEVEL;
 
-    *first_el = &hb->levels[HBITMAP_LEVELS - 1][start];
     *el_count = last - start + 1;
+    return start;
 }
 
 uint64_t hbitmap_serialization_size(const HBitmap *hb,
                                     uint64_t start, uint64_t count)
 {
     uint64_t el_count;
-    unsigned long *cur;
 
     if (!count) {
         return 0;
     }
-    serialization_chunk(hb, start, count, &cur, &el_count);
+    serialization_chunk(hb, start, count, &el_count);
 
     return el_count * sizeof(unsigned long);
 }
 
+/*
+ * The serialized format is a little-endian bitmap, so it does not depend on
+ * the size of the elements.  Compressed bitmaps use 64-bit words; elements
+ * always start on a 64-bit boundary, but on 32-bit hosts the last chunk may
+ * end in the middle of a word.
+ */
+static void hbitmap_serialize_compressed(const HBitmap *hb, uint8_t *buf,
+                                         uint64_t first, uint64_t el_count)
+{
+    size_t bytes = el_count * sizeof(unsigned long);
+    uint64_t nr = DIV_ROUND_UP(bytes, sizeof(uint64_t));
+    g_autofree uint64_t *words = g_new(uint64_t, nr);
+    uint64_t i;
+
+    rbitmap_get_words(hb->compressed, first * BITS_PER_LONG / 64, nr, words);
+    for (i = 0; i < nr; i++) {
+        cpu_to_le64s(&words[i]);
+    }
+    memcpy(buf, words, bytes);
+}
+
+static void hbitmap_deserialize_compressed(HBitmap *hb, const uint8_t *buf,
+                                           uint64_t first, uint64_t el_count)
+{
+    size_t bytes = el_count * sizeof(unsigned long);
+    uint64_t nr = DIV_ROUND_UP(bytes, sizeof(uint64_t));
+    g_autofree uint64_t *words = g_new0(uint64_t, nr);
+    uint64_t i;
+
+    memcpy(words, buf, bytes);
+    for (i = 0; i < nr; i++) {
+        le64_to_cpus(&words[i]);
+    }
+    rbitmap_put_words(hb->compressed, first * BITS_PER_LONG / 64, nr, words);
+    hb->count = rbitmap_count(hb->compressed);
+}
+
 void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
                             uint64_t start, uint64_t count)
 {
-    uint64_t el_count;
+    uint64_t el_count, first;
     unsigned long *cur, *end;
 
     if (!count) {
         return;
     }
-    serialization_chunk(hb, start, count, &cur, &el_count);
+    first = serialization_chunk(hb, start, count, &el_count);
+    if (hb->compressed) {
+        hbitmap_serialize_compressed(hb, buf, first, el_count);
+        return;
+    }
+    cur = &hb->levels[HBITMAP_LEVELS - 1][first];
     end = cur + el_count;
 
     while (cur != end) {
@@ -696,13 +829,18 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
                               uint64_t start, uint64_t count,
                               bool finish)
 {
-    uint64_t el_count;
+    uint64_t el_count, first;
     unsigned long *cur, *end;
 
     if (!count) {
         return;
     }
-    serialization_chunk(hb, start, count, &cur, &el_count);
+    first = serialization_chunk(hb, start, count, &el_count);
+    if (hb->compressed) {
+        hbitmap_deserialize_compressed(hb, buf, first, el_count);
+        return;
+    }
+    cur = &hb->levels[HBITMAP_LEVELS - 1][first];
     end = cur + el_count;
 
     while (cur != end) {
@@ -722,18 +860,37 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
     }
 }
 
+/* Fill the bits of the last level covered by a serialization chunk */
+static void hbitmap_deserialize_fill_compressed(HBitmap *hb, uint64_t first,
+                                                uint64_t el_count, bool ones)
+{
+    uint64_t start = first * BITS_PER_LONG;
+    uint64_t end = MIN((first + el_count) * BITS_PER_LONG, hb->size);
+
+    if (ones) {
+        rbitmap_set(hb->compressed, start, end - start);
+    } else {
+        rbitmap_reset(hb->compressed, start, end - start);
+    }
+    hb->count = rbitmap_count(hb->compressed);
+}
+
 void hbitmap_deserialize_zeroes(HBitmap *hb, uint64_t start, uint64_t count,
                                 bool finish)
 {
-    uint64_t el_count;
-    unsigned long *first;
+    uint64_t el_count, first;
 
     if (!count) {
         return;
     }
-    serialization_chunk(hb, start, count, &first, &el_count);
+    first = serialization_chunk(hb, start, count, &el_count);
+    if (hb->compressed) {
+        hbitmap_deserialize_fill_compressed(hb, first, el_count, false);
+        return;
+    }
 
-    memset(first, 0, el_count * sizeof(unsigned long));
+    memset(&hb->levels[HBITMAP_LEVELS - 1][first], 0,
+           el_count * sizeof(unsigned long));
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -742,15 +899,19 @@ void hbitmap_deserialize_zeroes(HBitmap *hb, uint64_t start, uint64_t count,
 void hbitmap_deserialize_ones(HBitmap *hb, uint64_t start, uint64_t count,
                               bool finish)
 {
-    uint64_t el_count;
-    unsigned long *first;
+    uint64_t el_count, first;
 
     if (!count) {
         return;
     }
-    serialization_chunk(hb, start, count, &first, &el_count);
+    first = serialization_chunk(hb, start, count, &el_count);
+    if (hb->compressed) {
+        hbitmap_deserialize_fill_compressed(hb, first, el_count, true);
+        return;
+    }
 
-    memset(first, 0xff, el_count * sizeof(unsigned long));
+    memset(&hb->levels[HBITMAP_LEVELS - 1][first], 0xff,
+           el_count * sizeof(unsigned long));
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -761,6 +922,11 @@ void hbitmap_deserialize_finish(HBitmap *bitmap)
     int64_t i, size, prev_size;
     int lev;
 
+    if (bitmap->compressed) {
+        bitmap->count = rbitmap_count(bitmap->compressed);
+        return;
+    }
+
     /* restore levels starting from penultimate to zero level, assuming
      * that the last level is ok */
     size = MAX((bitmap->size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
@@ -785,16 +951,18 @@ void hbitmap_free(HBitmap *hb)
 {
     unsigned i;
     assert(!hb->meta);
+    if (hb->compressed) {
+        rbitmap_free(hb->compressed);
+    }
     for (i = HBITMAP_LEVELS; i-- > 0; ) {
         g_free(hb->levels[i]);
     }
     g_free(hb);
 }
 
-HBitmap *hbitmap_alloc(uint64_t size, int granularity)
+static HBitmap *hbitmap_new(uint64_t size, int granularity)
 {
     HBitmap *hb = g_new0(struct HBitmap, 1);
-    unsigned i;
 
     assert(size <= INT64_MAX);
     hb->orig_size = size;
@@ -805,6 +973,23 @@ HBitmap *hbitmap_alloc(uint64_t size, int granularity)
 
     hb->size = size;
     hb->granularity = granularity;
+    return hb;
+}
+
+HBitmap *hbitmap_alloc_compressed(uint64_t size, int granularity)
+{
+    HBitmap *hb = hbitmap_new(size, granularity);
+
+    hb->compressed = rbitmap_new(hb->size);
+    return hb;
+}
+
+HBitmap *hbitmap_alloc(uint64_t size, int granularity)
+{
+    HBitmap *hb = hbitmap_new(size, granularity);
+    unsigned i;
+
+    size = hb->size;
     for (i = HBITMAP_LEVELS; i-- > 0; ) {
         size = MAX((size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
         hb->sizes[i] = size;
@@ -855,17 +1040,21 @@ void hbitmap_truncate(HBitmap *hb, uint64_t size)
     }
 
     hb->size = size;
-    for (i = HBITMAP_LEVELS; i-- > 0; ) {
-        size = MAX(BITS_TO_LONGS(size), 1);
-        if (hb->sizes[i] == size) {
-            break;
-        }
-        old = hb->sizes[i];
-        hb->sizes[i] = size;
-        hb->levels[i] = g_renew(unsigned long, hb->levels[i], size);
-        if (!shrink) {
-            memset(&hb->levels[i][old], 0x00,
-                   (size - old) * sizeof(*hb->levels[i]));
+    if (hb->compressed) {
+        rbitmap_truncate(hb->compressed, size);
+    } else {
+        for (i = HBITMAP_LEVELS; i-- > 0; ) {
+            size = MAX(BITS_TO_LONGS(size), 1);
+            if (hb->sizes[i] == size) {
+                break;
+            }
+            old = hb->sizes[i];
+            hb->sizes[i] = size;
+            hb->levels[i] = g_renew(unsigned long, hb->levels[i], size);
+            if (!shrink) {
+                memset(&hb->levels[i][old], 0x00,
+                       (size - old) * sizeof(*hb->levels[i]));
+            }
         }
     }
     if (hb->meta) {
@@ -916,7 +1105,25 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
         return;
     }
 
-    if (a->granularity != b->granularity) {
+    if (a->compressed && b->compressed && result->compressed &&
+        a->granularity == b->granularity &&
+        a->granularity == result->granularity) {
+        /* O(number of containers) rather than O(size) */
+        if ((a != result) && (b != result)) {
+            rbitmap_reset_all(result->compressed);
+        }
+        if (a != result) {
+            rbitmap_or(result->compressed, a->compressed);
+        }
+        if (b != result) {
+            rbitmap_or(result->compressed, b->compressed);
+        }
+        result->count = rbitmap_count(result->compressed);
+        return;
+    }
+
+    if (a->granularity != b->granularity ||
+        a->compressed || b->compressed || result->compressed) {
         if ((a != result) && (b != result)) {
             hbitmap_reset_all(result);
         }
@@ -944,12 +1151,56 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
     result->count = hb_count_between(result, 0, result->size - 1);
 }
 
+/* Hash the same data for compressed bitmaps as for their dense equivalent */
+static char *hbitmap_sha256_compressed(const HBitmap *bitmap, Error **errp)
+{
+    uint64_t longs = MAX(BITS_TO_LONGS(bitmap->size), 1);
+    uint64_t nr = DIV_ROUND_UP(longs * BITS_PER_LONG, 64);
+    g_autofree uint64_t *words = g_new(uint64_t, nr);
+    g_autofree unsigned long *data = g_new(unsigned long, longs);
+    char *hash = NULL;
+    uint64_t i;
+
+    rbitmap_get_words(bitmap->compressed, 0, nr, words);
+    for (i = 0; i < longs; i++) {
+        data[i] = words[i * BITS_PER_LONG / 64] >> (i * BITS_PER_LONG % 64);
+    }
+
+    qcrypto_hash_digest(QCRYPTO_HASH_ALG_SHA256, (char *)data,
+                        longs * sizeof(unsigned long), &hash, errp);
+    return hash;
+}
+
 char *hbitmap_sha256(const HBitmap *bitmap, Error **errp)
 {
     size_t size = bitmap->sizes[HBITMAP_LEVELS - 1] * sizeof(unsigned long);
     char *data = (char *)bitmap->levels[HBITMAP_LEVELS - 1];
     char *hash = NULL;
+
+    if (bitmap->compressed) {
+        return hbitmap_sha256_compressed(bitmap, errp);
+    }
+
     qcrypto_hash_digest(QCRYPTO_HASH_ALG_SHA256, data, size, &hash, errp);
 
     return hash;
 }
+
+bool hbitmap_is_compressed(const HBitmap *hb)
+{
+    return hb->compressed != NULL;
+}
+
+size_t hbitmap_memory_usage(const HBitmap *hb)
+{
+    size_t size = sizeof(*hb);
+    unsigned i;
+
+    if (hb->compressed) {
+        return size + rbitmap_memory_usage(hb->compressed);
+    }
+    for (i = 0; i < HBITMAP_LEVELS; i++) {
+        size += hb->sizes[i] * sizeof(unsigned long);
+    }
+    return size;
+}
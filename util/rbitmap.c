@@ -0,0 +1,949 @@
+/*
+ * Compressed Bitmap Data Type
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/rbitmap.h"
+#include "qemu/host-utils.h"
+
+/* RBitmaps are organized like roaring bitmaps: the bit space is split into
+ * chunks of 2^16 bits, and chunks without any set bit are not stored at
+ * all.  The other chunks are kept in a sorted array of containers, each of
+ * which stores its bits in whichever of three representations takes the
+ * least memory:
+ *
+ * - a sorted array of the 16-bit offsets of the set bits, for sparse chunks;
+ * - a sorted list of runs of set bits, for chunks dirtied in large extents;
+ *   a fully set chunk is a single run and takes four bytes;
+ * - a plain 8 KiB bitmap for everything else.
+ *
+ * So a bitmap that is mostly clean, or mostly dirty, takes a small fraction
+ * of the memory of a flat bitmap, and merging or iterating over it works on
+ * whole containers instead of single words.  The price is that updating
+ * scattered bits costs a binary search and, in the array and run
+ * representations, moving memory around.
+ */
+
+#define RB_CHUNK_BITS   16
+#define RB_CHUNK_SIZE   (1U << RB_CHUNK_BITS)
+#define RB_CHUNK_MASK   (RB_CHUNK_SIZE - 1)
+#define RB_CHUNK_WORDS  (RB_CHUNK_SIZE / 64)
+
+/* Beyond these lengths, arrays and run lists are larger than a bitmap */
+#define RB_ARRAY_MAX    (RB_CHUNK_SIZE / 16)
+#define RB_RUNS_MAX     (RB_CHUNK_SIZE / 32)
+
+typedef enum RBType {
+    RB_ARRAY,
+    RB_RUNS,
+    RB_BITMAP,
+} RBType;
+
+/* Runs are never adjacent, they are merged instead */
+typedef struct RBRun {
+    uint16_t start;
+    uint16_t last;
+} RBRun;
+
+typedef struct RBContainer {
+    uint64_t key;       /* Chunk number */
+    uint32_t card;      /* Number of set bits, only zero transiently */
+    uint32_t n;         /* Number of array entries or runs */
+    RBType type;
+    union {
+        uint16_t *array;
+        RBRun *runs;
+        uint64_t *words;
+    };
+} RBContainer;
+
+struct RBitmap {
+    /* Number of bits in the bitmap */
+    uint64_t size;
+
+    /* Number of set bits */
+    uint64_t count;
+
+    /* Containers of the chunks that have set bits, sorted by key */
+    RBContainer *c;
+    size_t nr;
+    size_t alloc;
+};
+
+static void rb_words_set(uint64_t *words, uint64_t start, uint64_t last)
+{
+    uint64_t i = start / 64, j = last / 64;
+    uint64_t first_mask = ~0ULL << (start % 64);
+    uint64_t last_mask = ~0ULL >> (63 - last % 64);
+
+    if (i == j) {
+        words[i] |= first_mask & last_mask;
+        return;
+    }
+    words[i++] |= first_mask;
+    while (i < j) {
+        words[i++] = ~0ULL;
+    }
+    words[j] |= last_mask;
+}
+
+static void rb_words_clear(uint64_t *words, uint64_t start, uint64_t last)
+{
+    uint64_t i = start / 64, j = last / 64;
+    uint64_t first_mask = ~0ULL << (start % 64);
+    uint64_t last_mask = ~0ULL >> (63 - last % 64);
+
+    if (i == j) {
+        words[i] &= ~(first_mask & last_mask);
+        return;
+    }
+    words[i++] &= ~first_mask;
+    while (i < j) {
+        words[i++] = 0;
+    }
+    words[j] &= ~last_mask;
+}
+
+static uint32_t rb_words_count(const uint64_t *words, unsigned start,
+                               unsigned last)
+{
+    unsigned i = start / 64, j = last / 64;
+    uint64_t first_mask = ~0ULL << (start % 64);
+    uint64_t last_mask = ~0ULL >> (63 - last % 64);
+    uint32_t count;
+
+    if (i == j) {
+        return ctpop64(words[i] & first_mask & last_mask);
+    }
+    count = ctpop64(words[i++] & first_mask);
+    while (i < j) {
+        count += ctpop64(words[i++]);
+    }
+    return count + ctpop64(words[j] & last_mask);
+}
+
+/* Find the first bit at or after @pos that is set (or clear, if !@set) */
+static unsigned rb_words_next(const uint64_t *words, unsigned pos, bool set)
+{
+    unsigned i = pos / 64;
+    uint64_t w;
+
+    if (pos >= RB_CHUNK_SIZE) {
+        return RB_CHUNK_SIZE;
+    }
+
+    w = (set ? words[i] : ~words[i]) & (~0ULL << (pos % 64));
+    while (!w) {
+        if (++i == RB_CHUNK_WORDS) {
+            return RB_CHUNK_SIZE;
+        }
+        w = set ? words[i] : ~words[i];
+    }
+    return i * 64 + ctz64(w);
+}
+
+static void rb_container_clear(RBContainer *c)
+{
+    g_free(c->array);
+    c->type = RB_ARRAY;
+    c->array = NULL;
+    c->card = 0;
+    c->n = 0;
+}
+
+static void rb_container_copy(RBContainer *dst, const RBContainer *src)
+{
+    *dst = *src;
+    switch (src->type) {
+    case RB_ARRAY:
+        dst->array = g_memdup2(src->array, src->n * sizeof(uint16_t));
+        break;
+    case RB_RUNS:
+        dst->runs = g_memdup2(src->runs, src->n * sizeof(RBRun));
+        break;
+    case RB_BITMAP:
+        dst->words = g_memdup2(src->words, RB_CHUNK_WORDS * sizeof(uint64_t));
+        break;
+    }
+}
+
+static size_t rb_container_memory_usage(const RBContainer *c)
+{
+    switch (c->type) {
+    case RB_ARRAY:
+        return c->n * sizeof(uint16_t);
+    case RB_RUNS:
+        return c->n * sizeof(RBRun);
+    case RB_BITMAP:
+        return RB_CHUNK_WORDS * sizeof(uint64_t);
+    }
+    g_assert_not_reached();
+}
+
+/* Index of the first array entry that is at least @v */
+static uint32_t rb_array_lower_bound(const RBContainer *c, unsigned v)
+{
+    uint32_t lo = 0, hi = c->n;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (c->array[mid] < v) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Index of the first run that ends at or after @v */
+static uint32_t rb_runs_lower_bound(const RBContainer *c, unsigned v)
+{
+    uint32_t lo = 0, hi = c->n;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (c->runs[mid].last < v) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool rb_container_get(const RBContainer *c, unsigned v)
+{
+    uint32_t i;
+
+    switch (c->type) {
+    case RB_ARRAY:
+        i = rb_array_lower_bound(c, v);
+        return i < c->n && c->array[i] == v;
+    case RB_RUNS:
+        i = rb_runs_lower_bound(c, v);
+        return i < c->n && c->runs[i].start <= v;
+    case RB_BITMAP:
+        return c->words[v / 64] & (1ULL << (v % 64));
+    }
+    g_assert_not_reached();
+}
+
+/*
+ * Find the first offset at or after @v that is set (or clear, if !@set),
+ * or RB_CHUNK_SIZE if there is none.
+ */
+static unsigned rb_container_next(const RBContainer *c, unsigned v, bool set)
+{
+    uint32_t i;
+
+    switch (c->type) {
+    case RB_ARRAY:
+        i = rb_array_lower_bound(c, v);
+        if (set) {
+            return i < c->n ? c->array[i] : RB_CHUNK_SIZE;
+        }
+        while (i < c->n && c->array[i] == v) {
+            i++;
+            v++;
+        }
+        return v;
+    case RB_RUNS:
+        i = rb_runs_lower_bound(c, v);
+        if (i == c->n) {
+            return set ? RB_CHUNK_SIZE : v;
+        }
+        if (set) {
+            return MAX(v, c->runs[i].start);
+        }
+        return c->runs[i].start <= v ? c->runs[i].last + 1 : v;
+    case RB_BITMAP:
+        return rb_words_next(c->words, v, set);
+    }
+    g_assert_not_reached();
+}
+
+/* Number of set bits between @lo and @hi, inclusive */
+static uint32_t rb_container_count(const RBContainer *c, unsigned lo,
+                                   unsigned hi)
+{
+    uint32_t i, count = 0;
+
+    switch (c->type) {
+    case RB_ARRAY:
+        return rb_array_lower_bound(c, hi + 1) - rb_array_lower_bound(c, lo);
+    case RB_RUNS:
+        for (i = rb_runs_lower_bound(c, lo);
+             i < c->n && c->runs[i].start <= hi; i++) {
+            count += MIN(c->runs[i].last, hi) - MAX(c->runs[i].start, lo) + 1;
+        }
+        return count;
+    case RB_BITMAP:
+        return rb_words_count(c->words, lo, hi);
+    }
+    g_assert_not_reached();
+}
+
+static void rb_container_to_words(const RBContainer *c, uint64_t *words)
+{
+    uint32_t i;
+
+    switch (c->type) {
+    case RB_ARRAY:
+        memset(words, 0, RB_CHUNK_WORDS * sizeof(uint64_t));
+        for (i = 0; i < c->n; i++) {
+            words[c->array[i] / 64] |= 1ULL << (c->array[i] % 64);
+        }
+        break;
+    case RB_RUNS:
+        memset(words, 0, RB_CHUNK_WORDS * sizeof(uint64_t));
+        for (i = 0; i < c->n; i++) {
+            rb_words_set(words, c->runs[i].start, c->runs[i].last);
+        }
+        break;
+    case RB_BITMAP:
+        memcpy(words, c->words, RB_CHUNK_WORDS * sizeof(uint64_t));
+        break;
+    }
+}
+
+/*
+ * Replace the contents of @c with @words, a bitmap allocated with g_new(),
+ * using the representation that takes the least memory.  Takes ownership of
+ * @words, which may be @c's own bitmap.
+ */
+static void rb_container_adopt_words(RBContainer *c, uint64_t *words)
+{
+    uint32_t card = 0, nr_runs = 0, i, k;
+    uint64_t carry = 0;
+    unsigned pos;
+
+    for (i = 0; i < RB_CHUNK_WORDS; i++) {
+        uint64_t w = words[i];
+
+        card += ctpop64(w);
+        nr_runs += ctpop64(w & ~((w << 1) | carry));
+        carry = w >> 63;
+    }
+
+    if (c->type != RB_BITMAP || c->words != words) {
+        g_free(c->array);
+    }
+    c->card = card;
+
+    if (!card) {
+        g_free(words);
+        c->type = RB_ARRAY;
+        c->array = NULL;
+        c->n = 0;
+    } else if (nr_runs <= RB_RUNS_MAX &&
+               (card > RB_ARRAY_MAX || nr_runs * 2 <= card)) {
+        RBRun *runs = g_new(RBRun, nr_runs);
+
+        for (k = 0, pos = 0;
+             (pos = rb_words_next(words, pos, true)) < RB_CHUNK_SIZE; k++) {
+            unsigned end = rb_words_next(words, pos, false);
+
+            runs[k] = (RBRun) { .start = pos, .last = end - 1 };
+            pos = end;
+        }
+        assert(k == nr_runs);
+
+        g_free(words);
+        c->type = RB_RUNS;
+        c->runs = runs;
+        c->n = nr_runs;
+    } else if (card <= RB_ARRAY_MAX) {
+        uint16_t *array = g_new(uint16_t, card);
+
+        for (i = 0, k = 0; i < RB_CHUNK_WORDS; i++) {
+            uint64_t w = words[i];
+
+            while (w) {
+                array[k++] = i * 64 + ctz64(w);
+                w &= w - 1;
+            }
+        }
+
+        g_free(words);
+        c->type = RB_ARRAY;
+        c->array = array;
+        c->n = card;
+    } else {
+        c->type = RB_BITMAP;
+        c->words = words;
+        c->n = 0;
+    }
+}
+
+/* Slow path for updates that change the best representation */
+static void rb_container_update_words(RBContainer *c, unsigned lo, unsigned hi,
+                                      bool set)
+{
+    uint64_t *words = g_new(uint64_t, RB_CHUNK_WORDS);
+
+    rb_container_to_words(c, words);
+    if (set) {
+        rb_words_set(words, lo, hi);
+    } else {
+        rb_words_clear(words, lo, hi);
+    }
+    rb_container_adopt_words(c, words);
+}
+
+/* Set bits @lo to @hi, returning the number of bits that were clear */
+static uint32_t rb_container_set(RBContainer *c, unsigned lo, unsigned hi)
+{
+    uint32_t added = hi - lo + 1 - rb_container_count(c, lo, hi);
+    uint32_t i, j, v;
+
+    if (!added) {
+        return 0;
+    }
+
+    if (c->card + added == RB_CHUNK_SIZE || (!c->card && lo < hi)) {
+        g_free(c->array);
+        c->type = RB_RUNS;
+        c->runs = g_new(RBRun, 1);
+        c->runs[0] = c->card ? (RBRun) { .start = 0, .last = RB_CHUNK_MASK }
+                             : (RBRun) { .start = lo, .last = hi };
+        c->n = 1;
+        c->card += added;
+        return added;
+    }
+
+    switch (c->type) {
+    case RB_ARRAY:
+        if (c->card + added > RB_ARRAY_MAX) {
+            break;
+        }
+        i = rb_array_lower_bound(c, lo);
+        j = rb_array_lower_bound(c, hi + 1);
+        c->array = g_renew(uint16_t, c->array, c->card + added);
+        memmove(&c->array[i + hi - lo + 1], &c->array[j],
+                (c->n - j) * sizeof(uint16_t));
+        for (v = lo; v <= hi; v++) {
+            c->array[i + v - lo] = v;
+        }
+        c->card += added;
+        c->n = c->card;
+        return added;
+
+    case RB_RUNS:
+        /* Runs [i, j) overlap with or are adjacent to the new one */
+        i = rb_runs_lower_bound(c, lo ? lo - 1 : 0);
+        for (j = i; j < c->n && c->runs[j].start <= hi + 1; j++) {
+            /* nothing */
+        }
+
+        if (i == j) {
+            /* Switch to an array or bitmap if that is smaller */
+            if (c->n == RB_RUNS_MAX ||
+                (c->card + added <= RB_ARRAY_MAX &&
+                 (c->n + 1) * 2 > c->card + added)) {
+                break;
+            }
+            c->runs = g_renew(RBRun, c->runs, c->n + 1);
+            memmove(&c->runs[i + 1], &c->runs[i],
+                    (c->n - i) * sizeof(RBRun));
+            c->runs[i] = (RBRun) { .start = lo, .last = hi };
+            c->n++;
+        } else {
+            c->runs[i].start = MIN(lo, c->runs[i].start);
+            c->runs[i].last = MAX(hi, c->runs[j - 1].last);
+            memmove(&c->runs[i + 1], &c->runs[j],
+                    (c->n - j) * sizeof(RBRun));
+            c->n -= j - i - 1;
+        }
+        c->card += added;
+        return added;
+
+    case RB_BITMAP:
+        rb_words_set(c->words, lo, hi);
+        c->card += added;
+        return added;
+    }
+
+    rb_container_update_words(c, lo, hi, true);
+    return added;
+}
+
+/*
+ * Reset bits @lo to @hi, returning the number of bits that were set.  If
+ * the container becomes empty, it must be removed by the caller.
+ */
+static uint32_t rb_container_reset(RBContainer *c, unsigned lo, unsigned hi)
+{
+    uint32_t removed = rb_container_count(c, lo, hi);
+    uint32_t i, j, k, keep;
+    RBRun head, tail;
+
+    if (!removed) {
+        return 0;
+    }
+
+    if (removed == c->card) {
+        rb_container_clear(c);
+        return removed;
+    }
+
+    switch (c->type) {
+    case RB_ARRAY:
+        i = rb_array_lower_bound(c, lo);
+        j = rb_array_lower_bound(c, hi + 1);
+        memmove(&c->array[i], &c->array[j], (c->n - j) * sizeof(uint16_t));
+        c->card -= removed;
+        c->n = c->card;
+        return removed;
+
+    case RB_RUNS:
+        /* Runs [i, j) overlap with the range; their ends may survive */
+        i = rb_runs_lower_bound(c, lo);
+        for (j = i; j < c->n && c->runs[j].start <= hi; j++) {
+            /* nothing */
+        }
+        head = c->runs[i];
+        tail = c->runs[j - 1];
+        keep = (head.start < lo) + (tail.last > hi);
+
+        if (keep > j - i) {
+            if (c->n == RB_RUNS_MAX) {
+                break;
+            }
+            c->runs = g_renew(RBRun, c->runs, c->n + 1);
+        }
+        memmove(&c->runs[i + keep], &c->runs[j], (c->n - j) * sizeof(RBRun));
+        k = i;
+        if (head.start < lo) {
+            c->runs[k++] = (RBRun) { .start = head.start, .last = lo - 1 };
+        }
+        if (tail.last > hi) {
+            c->runs[k++] = (RBRun) { .start = hi + 1, .last = tail.last };
+        }
+        c->n = c->n - (j - i) + keep;
+        c->card -= removed;
+        return removed;
+
+    case RB_BITMAP:
+        rb_words_clear(c->words, lo, hi);
+        c->card -= removed;
+        if (c->card <= RB_ARRAY_MAX / 2) {
+            rb_container_adopt_words(c, c->words);
+        }
+        return removed;
+    }
+
+    rb_container_update_words(c, lo, hi, false);
+    return removed;
+}
+
+/* Merge @src into @dst, returning the number of bits that were added */
+static uint32_t rb_container_or(RBContainer *dst, const RBContainer *src)
+{
+    uint32_t old = dst->card, i;
+    uint64_t *words;
+
+    if (dst->card == RB_CHUNK_SIZE) {
+        return 0;
+    }
+
+    if (src->type == RB_RUNS) {
+        for (i = 0; i < src->n; i++) {
+            rb_container_set(dst, src->runs[i].start, src->runs[i].last);
+        }
+        return dst->card - old;
+    }
+
+    if (dst->type == RB_BITMAP) {
+        words = dst->words;
+    } else {
+        words = g_new(uint64_t, RB_CHUNK_WORDS);
+        rb_container_to_words(dst, words);
+    }
+
+    if (src->type == RB_ARRAY) {
+        for (i = 0; i < src->n; i++) {
+            words[src->array[i] / 64] |= 1ULL << (src->array[i] % 64);
+        }
+    } else {
+        for (i = 0; i < RB_CHUNK_WORDS; i++) {
+            words[i] |= src->words[i];
+        }
+    }
+
+    rb_container_adopt_words(dst, words);
+    return dst->card - old;
+}
+
+/* Index of the first container whose key is at least @key */
+static size_t rb_lower_bound(const RBitmap *rb, uint64_t key)
+{
+    size_t lo = 0, hi = rb->nr;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (rb->c[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static const RBContainer *rb_find(const RBitmap *rb, uint64_t key)
+{
+    size_t i = rb_lower_bound(rb, key);
+
+    return i < rb->nr && rb->c[i].key == key ? &rb->c[i] : NULL;
+}
+
+/*
+ * Make sure that there is a container for each chunk from @first to @last,
+ * the first of which is at index @i.  Missing containers are added empty.
+ */
+static void rb_insert_range(RBitmap *rb, size_t i, uint64_t first,
+                            uint64_t last)
+{
+    size_t j = rb_lower_bound(rb, last + 1);
+    size_t nr_keys = last - first + 1;
+    size_t missing = nr_keys - (j - i);
+    size_t src, dst;
+
+    if (!missing) {
+        return;
+    }
+
+    if (rb->nr + missing > rb->alloc) {
+        rb->alloc = MAX(rb->nr + missing, rb->alloc * 2);
+        rb->c = g_renew(RBContainer, rb->c, rb->alloc);
+    }
+
+    /* Move the tail out of the way, then spread the existing containers */
+    memmove(&rb->c[i + nr_keys], &rb->c[j], (rb->nr - j) * sizeof(RBContainer));
+    for (src = j, dst = i + nr_keys; dst-- > i; ) {
+        uint64_t key = first + (dst - i);
+
+        if (src > i && rb->c[src - 1].key == key) {
+            rb->c[dst] = rb->c[--src];
+        } else {
+            rb->c[dst] = (RBContainer) { .key = key, .type = RB_ARRAY };
+        }
+    }
+    rb->nr += missing;
+}
+
+/* Remove the empty containers in [@i, @j) */
+static void rb_remove_empty(RBitmap *rb, size_t i, size_t j)
+{
+    size_t k, n;
+
+    for (k = i, n = i; k < j; k++) {
+        if (rb->c[k].card) {
+            rb->c[n++] = rb->c[k];
+        }
+    }
+    if (n < j) {
+        memmove(&rb->c[n], &rb->c[j], (rb->nr - j) * sizeof(RBContainer));
+        rb->nr -= j - n;
+    }
+}
+
+uint64_t rbitmap_set(RBitmap *rb, uint64_t start, uint64_t count)
+{
+    uint64_t last = start + count - 1;
+    uint64_t first_key = start >> RB_CHUNK_BITS;
+    uint64_t last_key = last >> RB_CHUNK_BITS;
+    uint64_t key, added = 0;
+    size_t i;
+
+    if (!count) {
+        return 0;
+    }
+    assert(last < rb->size);
+
+    i = rb_lower_bound(rb, first_key);
+    rb_insert_range(rb, i, first_key, last_key);
+    for (key = first_key; key <= last_key; key++, i++) {
+        unsigned lo = key == first_key ? start & RB_CHUNK_MASK : 0;
+        unsigned hi = key == last_key ? last & RB_CHUNK_MASK : RB_CHUNK_MASK;
+
+        added += rb_container_set(&rb->c[i], lo, hi);
+    }
+
+    rb->count += added;
+    return added;
+}
+
+uint64_t rbitmap_reset(RBitmap *rb, uint64_t start, uint64_t count)
+{
+    uint64_t last = start + count - 1;
+    uint64_t first_key = start >> RB_CHUNK_BITS;
+    uint64_t last_key = last >> RB_CHUNK_BITS;
+    uint64_t removed = 0;
+    size_t i, j;
+
+    if (!count) {
+        return 0;
+    }
+    assert(last < rb->size);
+
+    i = rb_lower_bound(rb, first_key);
+    for (j = i; j < rb->nr && rb->c[j].key <= last_key; j++) {
+        RBContainer *c = &rb->c[j];
+        unsigned lo = c->key == first_key ? start & RB_CHUNK_MASK : 0;
+        unsigned hi = c->key == last_key ? last & RB_CHUNK_MASK : RB_CHUNK_MASK;
+
+        removed += rb_container_reset(c, lo, hi);
+    }
+    rb_remove_empty(rb, i, j);
+
+    rb->count -= removed;
+    return removed;
+}
+
+void rbitmap_reset_all(RBitmap *rb)
+{
+    size_t i;
+
+    for (i = 0; i < rb->nr; i++) {
+        rb_container_clear(&rb->c[i]);
+    }
+    g_free(rb->c);
+    rb->c = NULL;
+    rb->nr = 0;
+    rb->alloc = 0;
+    rb->count = 0;
+}
+
+bool rbitmap_get(const RBitmap *rb, uint64_t bit)
+{
+    const RBContainer *c = rb_find(rb, bit >> RB_CHUNK_BITS);
+
+    assert(bit < rb->size);
+    return c && rb_container_get(c, bit & RB_CHUNK_MASK);
+}
+
+int64_t rbitmap_next_set(const RBitmap *rb, uint64_t start, uint64_t end)
+{
+    size_t i;
+
+    for (i = rb_lower_bound(rb, start >> RB_CHUNK_BITS); i < rb->nr; i++) {
+        const RBContainer *c = &rb->c[i];
+        uint64_t base = c->key << RB_CHUNK_BITS;
+        unsigned v;
+
+        if (base >= end) {
+            break;
+        }
+
+        v = rb_container_next(c, base < start ? start - base : 0, true);
+        if (v < RB_CHUNK_SIZE) {
+            return base + v < end ? base + v : -1;
+        }
+    }
+    return -1;
+}
+
+int64_t rbitmap_next_clear(const RBitmap *rb, uint64_t start, uint64_t end)
+{
+    size_t i = rb_lower_bound(rb, start >> RB_CHUNK_BITS);
+    uint64_t pos = start;
+
+    while (pos < end) {
+        uint64_t key = pos >> RB_CHUNK_BITS;
+        unsigned v;
+
+        /* Chunks without a container are clear */
+        if (i == rb->nr || rb->c[i].key != key) {
+            return pos;
+        }
+
+        v = rb_container_next(&rb->c[i], pos & RB_CHUNK_MASK, false);
+        if (v < RB_CHUNK_SIZE) {
+            pos = (key << RB_CHUNK_BITS) + v;
+            return pos < end ? pos : -1;
+        }
+        pos = (key + 1) << RB_CHUNK_BITS;
+        i++;
+    }
+    return -1;
+}
+
+void rbitmap_or(RBitmap *dst, const RBitmap *src)
+{
+    size_t alloc = dst->nr + src->nr;
+    size_t i = 0, j = 0, k = 0;
+    RBContainer *c;
+
+    assert(dst->size == src->size);
+    if (dst == src || !src->nr) {
+        return;
+    }
+
+    c = g_new(RBContainer, alloc);
+    while (i < dst->nr || j < src->nr) {
+        if (j == src->nr ||
+            (i < dst->nr && dst->c[i].key < src->c[j].key)) {
+            c[k++] = dst->c[i++];
+        } else if (i == dst->nr || src->c[j].key < dst->c[i].key) {
+            rb_container_copy(&c[k], &src->c[j++]);
+            dst->count += c[k++].card;
+        } else {
+            c[k] = dst->c[i++];
+            dst->count += rb_container_or(&c[k++], &src->c[j++]);
+        }
+    }
+
+    g_free(dst->c);
+    dst->c = c;
+    dst->nr = k;
+    dst->alloc = alloc;
+}
+
+void rbitmap_truncate(RBitmap *rb, uint64_t size)
+{
+    if (size < rb->size) {
+        rbitmap_reset(rb, size, rb->size - size);
+    }
+    rb->size = size;
+}
+
+void rbitmap_get_words(const RBitmap *rb, uint64_t first, uint64_t nr,
+                       uint64_t *words)
+{
+    uint64_t start = first * 64, end = (first + nr) * 64;
+    size_t i;
+
+    memset(words, 0, nr * sizeof(uint64_t));
+
+    for (i = rb_lower_bound(rb, start >> RB_CHUNK_BITS); i < rb->nr; i++) {
+        const RBContainer *c = &rb->c[i];
+        uint64_t base = c->key << RB_CHUNK_BITS;
+        uint32_t k;
+
+        if (base >= end) {
+            break;
+        }
+
+        switch (c->type) {
+        case RB_ARRAY:
+            for (k = 0; k < c->n; k++) {
+                uint64_t bit = base + c->array[k];
+
+                if (bit >= start && bit < end) {
+                    words[(bit - start) / 64] |= 1ULL << (bit % 64);
+                }
+            }
+            break;
+        case RB_RUNS:
+            for (k = 0; k < c->n; k++) {
+                uint64_t s = MAX(base + c->runs[k].start, start);
+                uint64_t l = MIN(base + c->runs[k].last, end - 1);
+
+                if (s <= l) {
+                    rb_words_set(words, s - start, l - start);
+                }
+            }
+            break;
+        case RB_BITMAP:
+            for (k = 0; k < RB_CHUNK_WORDS; k++) {
+                uint64_t w = base / 64 + k;
+
+                if (w >= first && w < first + nr) {
+                    words[w - first] = c->words[k];
+                }
+            }
+            break;
+        }
+    }
+}
+
+void rbitmap_put_words(RBitmap *rb, uint64_t first, uint64_t nr,
+                       const uint64_t *words)
+{
+    uint64_t start = first * 64;
+    uint64_t end = MIN((first + nr) * 64, rb->size);
+    uint64_t key;
+
+    if (start >= end) {
+        return;
+    }
+
+    for (key = start >> RB_CHUNK_BITS; key <= (end - 1) >> RB_CHUNK_BITS;
+         key++) {
+        uint64_t base = key << RB_CHUNK_BITS;
+        uint64_t lo = MAX(base, start);
+        uint64_t hi = MIN(base + RB_CHUNK_SIZE, end);
+        size_t i = rb_lower_bound(rb, key);
+        bool zero = true;
+        uint64_t *chunk;
+        RBContainer *c;
+        uint32_t old;
+        uint64_t b;
+
+        for (b = lo; b < hi && zero; b += 64) {
+            zero = !words[(b - start) / 64];
+        }
+        if (i == rb->nr || rb->c[i].key != key) {
+            if (zero) {
+                continue;
+            }
+            rb_insert_range(rb, i, key, key);
+        }
+
+        c = &rb->c[i];
+        old = c->card;
+        chunk = g_new(uint64_t, RB_CHUNK_WORDS);
+        rb_container_to_words(c, chunk);
+        rb_words_clear(chunk, lo - base, hi - 1 - base);
+        for (b = lo; b < hi; b += 64) {
+            uint64_t w = words[(b - start) / 64];
+
+            if (hi - b < 64) {
+                w &= (1ULL << (hi - b)) - 1;
+            }
+            chunk[(b - base) / 64] |= w;
+        }
+        rb_container_adopt_words(c, chunk);
+
+        rb->count = rb->count - old + c->card;
+        rb_remove_empty(rb, i, i + 1);
+    }
+}
+
+uint64_t rbitmap_count(const RBitmap *rb)
+{
+    return rb->count;
+}
+
+size_t rbitmap_memory_usage(const RBitmap *rb)
+{
+    size_t size = sizeof(*rb) + rb->alloc * sizeof(RBContainer);
+    size_t i;
+
+    for (i = 0; i < rb->nr; i++) {
+        size += rb_container_memory_usage(&rb->c[i]);
+    }
+    return size;
+}
+
+RBitmap *rbitmap_new(uint64_t size)
+{
+    RBitmap *rb = g_new0(RBitmap, 1);
+
+    rb->size = size;
+    return rb;
+}
+
+void rbitmap_free(RBitmap *rb)
+{
+    rbitmap_reset_all(rb);
+    g_free(rb);
+}